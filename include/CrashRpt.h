@@ -499,6 +499,13 @@ crSetCrashCallbackA(
 #define CR_INST_SHOW_ADDITIONAL_INFO_FIELDS	 0x200000 //!< Makes "Your E-mail" and "Describe what you were doing when the problem occurred" fields of Error Report dialog always visible.
 #define CR_INST_ALLOW_ATTACH_MORE_FILES		 0x400000 //!< Adds an ability for user to attach more files to crash report by clicking "Attach More File(s)" item from context menu of Error Report Details dialog.
 #define CR_INST_AUTO_THREAD_HANDLERS         0x800000 //!< If this flag is set, installs exception handlers for newly created threads automatically.
+#define CR_INST_ZIP_COMPRESS_MEDIA          0x1000000 //!< Compress images and video in ZIP archive instead of storing them as is.
+#define CR_INST_ZIP_MINIDUMP_HIGH           0x2000000 //!< Compress minidump files with high compression level instead of fast level.
+#define CR_INST_ZIP_TEXT_FAST               0x4000000 //!< Compress text files (XML, logs) with fast compression level instead of high level.
+#define CR_INST_ZIP_NO_CONTENT_SAMPLING     0x8000000 //!< Choose ZIP compression level by file type only, do not sample file contents.
+#define CR_INST_HTTP_STREAMING_UPLOAD      0x10000000 //!< Upload ZIP archive over HTTP while it is being compressed, without writing it to disk first.
+#define CR_INST_HTTP_RESUMABLE_UPLOAD      0x20000000 //!< Upload ZIP archive over HTTP in chunks, resuming after connection failures.
+#define CR_INST_SUPPRESS_REPEATED_CRASHES  0x40000000 //!< Send a brief report or no report at all for a crash that has recently repeated.
 
 /*! \ingroup CrashRptStructs
 *  \struct CR_INSTALL_INFOW()
@@ -640,6 +647,48 @@ crSetCrashCallbackA(
 *        <td> <b>Available since v.1.4.2</b> Specifying this flag results in automatic installation of all available exception handlers to
 *             all threads that will be created in the future. This flag only works if CrashRpt is compiled as a DLL, it does
 *             not work if you compile CrashRpt as static library.
+*
+*    <tr><td> \ref CR_INST_ZIP_COMPRESS_MEDIA
+*        <td> <b>Available since v.1.5.0</b> By default, files that are already compressed (PNG and JPEG screenshots, OGG video,
+*             archives) are stored in the ZIP archive as is. Specify this flag to compress them with fast compression level.
+*
+*    <tr><td> \ref CR_INST_ZIP_MINIDUMP_HIGH
+*        <td> <b>Available since v.1.5.0</b> By default, minidump files are compressed with fast compression level.
+*             Specify this flag to use high compression level and get a smaller error report at the cost of more CPU time.
+*
+*    <tr><td> \ref CR_INST_ZIP_TEXT_FAST
+*        <td> <b>Available since v.1.5.0</b> By default, text files (XML, logs) are compressed with high compression level.
+*             Specify this flag to use fast compression level for them.
+*
+*    <tr><td> \ref CR_INST_ZIP_NO_CONTENT_SAMPLING
+*        <td> <b>Available since v.1.5.0</b> By default, the beginning of each file is sampled and files that look
+*             incompressible are stored as is. Specify this flag to choose compression level by file type only.
+*
+*    <tr><td> \ref CR_INST_HTTP_STREAMING_UPLOAD
+*        <td> <b>Available since v.1.5.0</b> Specify this flag to upload the ZIP archive over HTTP while it is being
+*             compressed. The archive is sent with chunked transfer encoding and its MD5 hash is sent after the
+*             archive, so the server script must accept chunked requests. The archive is written to disk only if
+*             the upload fails and the report is sent another way. This flag is used only when HTTP has the
+*             highest priority, and it is ignored if \ref CR_INST_STORE_ZIP_ARCHIVES is specified.
+*
+*    <tr><td> \ref CR_INST_HTTP_RESUMABLE_UPLOAD
+*        <td> <b>Available since v.1.5.0</b> Specify this flag to upload the ZIP archive over HTTP in chunks of 1 MB.
+*             If the connection drops, the upload continues from the last chunk the server has received instead of
+*             starting over. The server script must support the resumable upload protocol; see
+*             reporting/scripts/crashrpt_upload_server.py for a reference implementation. This flag disables
+*             \ref CR_INST_HTTP_STREAMING_UPLOAD, because chunks must be read from the archive file again.
+*
+*    <tr><td> \ref CR_INST_SUPPRESS_REPEATED_CRASHES
+*        <td> <b>Available since v.1.5.0</b> Specify this flag to stop writing a minidump for a crash which keeps
+*             repeating on this computer. Before collecting the report, CrashSender.exe calculates the crash
+*             signature from the application version, the exception code, and the modules and offsets of the
+*             faulting address and of the top return addresses on the stack. Signatures are counted in the
+*             ~CrashRpt.ini file in the folder of unsent reports. The first occurrences of a signature produce the
+*             full report; the next ones produce a brief report which contains the crash description XML only;
+*             further ones produce no report, though the application is still restarted if
+*             \ref CR_INST_APP_RESTART is specified. The limits are taken from the [Delivery] section of ~CrashRpt.ini:
+*             FullReportsPerSignature (default is 1), BriefReportsPerSignature (default is 10) and
+*             SignatureWindowDays (default is 7, the period after which a signature is counted anew).
 *   </table>
 *
 *   \b pszPrivacyPolicyURL [in, optional]
@@ -1482,6 +1531,159 @@ crAddRegKeyA(
 #define crAddRegKey crAddRegKeyA
 #endif //UNICODE
 
+/*! \ingroup CrashRptAPI
+*  \brief Records a breadcrumb: a short message telling what the application is doing.
+*
+*  \return This function returns zero if succeeded. Use crGetLastErrorMsg() to retrieve the error message on fail.
+*
+*  \param[in] pszText  Message text, required. Only the first 55 characters are kept.
+*
+*  \remarks
+*
+*  Breadcrumbs show what the application did just before the crash, without the cost of
+*  writing a log file. Recent breadcrumbs are included into the crash description XML file
+*  under \<Breadcrumbs\> tag, ordered by time, each with its thread ID and UTC time.
+*
+*  Each thread keeps its last 64 breadcrumbs in its own ring buffer in the shared memory
+*  read by CrashSender.exe, so recording doesn't take locks, doesn't allocate memory
+*  and doesn't set the last error message on success. It is cheap enough to be called
+*  from frequently executed code. When more than 31 threads record breadcrumbs at once,
+*  the others share a single ring buffer.
+*
+*  When a thread exits, its ring buffer and breadcrumbs are freed for another thread.
+*  This is done on DLL_THREAD_DETACH, so it works with CrashRpt.dll only. With the static
+*  CrashRpt library, ring buffers are not freed, and once 31 threads have recorded
+*  breadcrumbs, the threads coming after them share a single ring buffer.
+*
+*  Breadcrumbs included into an error report are not included into the next one.
+*
+*  This function is available since v.1.5.0.
+*
+*  \code
+*
+*  crAddBreadcrumb(_T("Loading level"));
+*
+*  \endcode
+*
+*  \sa
+*   crAddProperty(), crAddFile2()
+*/
+
+CRASHRPTAPI(int)
+crAddBreadcrumbW(
+                 LPCWSTR pszText
+                 );
+
+/*! \ingroup CrashRptAPI
+*  \copydoc crAddBreadcrumbW()
+*/
+
+CRASHRPTAPI(int)
+crAddBreadcrumbA(
+                 LPCSTR pszText
+                 );
+
+/*! \brief Character set-independent mapping of crAddBreadcrumbW() and crAddBreadcrumbA() functions.
+*  \ingroup CrashRptAPI
+*/
+#ifdef UNICODE
+#define crAddBreadcrumb crAddBreadcrumbW
+#else
+#define crAddBreadcrumb crAddBreadcrumbA
+#endif //UNICODE
+
+/*! \ingroup CrashRptAPI
+*  \brief Creates a ring log that is included into crash report as a file.
+*
+*  \return This function returns zero if succeeded. Use crGetLastErrorMsg() to retrieve the error message on fail.
+*
+*  \param[in] pszDestFile Name of the log file in the error report, required.
+*  \param[in] pszDesc     File description, optional.
+*  \param[in] dwSize      Size of the log in bytes, from 4 KB to 64 MB.
+*
+*  \remarks
+*
+*  The ring log keeps the last \a dwSize bytes written with crWriteRingLog(). It lives in
+*  memory shared with CrashSender.exe, so the application doesn't do any file I/O to write it.
+*  On crash, CrashSender.exe saves the log to the error report before creating the crash
+*  minidump. This is much faster than copying a large log file added with crAddFile2().
+*
+*  The size is rounded up to a power of two. If the log has wrapped around, the saved file
+*  starts from the first complete line.
+*
+*  Only one ring log may be created; it is kept until crUninstall() is called.
+*
+*  This function is available since v.1.5.0.
+*
+*  \sa
+*   crWriteRingLog(), crAddFile2()
+*/
+
+CRASHRPTAPI(int)
+crAddRingLogW(
+              LPCWSTR pszDestFile,
+              LPCWSTR pszDesc,
+              DWORD dwSize
+              );
+
+/*! \ingroup CrashRptAPI
+*  \copydoc crAddRingLogW()
+*/
+
+CRASHRPTAPI(int)
+crAddRingLogA(
+              LPCSTR pszDestFile,
+              LPCSTR pszDesc,
+              DWORD dwSize
+              );
+
+/*! \brief Character set-independent mapping of crAddRingLogW() and crAddRingLogA() functions.
+*  \ingroup CrashRptAPI
+*/
+#ifdef UNICODE
+#define crAddRingLog crAddRingLogW
+#else
+#define crAddRingLog crAddRingLogA
+#endif //UNICODE
+
+/*! \ingroup CrashRptAPI
+*  \brief Appends data to the ring log.
+*
+*  \return This function returns zero if succeeded. Use crGetLastErrorMsg() to retrieve the error message on fail.
+*
+*  \param[in] pData  Data to append.
+*  \param[in] cbData Size of data in bytes.
+*
+*  \remarks
+*
+*  The ring log should be created with crAddRingLog() first. Data are written as is, so
+*  the application decides on the log format; typically these are UTF-8 text lines ending with '\\n'.
+*
+*  This function may be called from several threads at once. It doesn't take locks, doesn't
+*  allocate memory and doesn't set the last error message on success. Data being written
+*  when the crash occurs may be incomplete in the saved log.
+*
+*  This function is available since v.1.5.0.
+*
+*  \code
+*
+*  crAddRingLog(_T("app.log"), _T("Application Log"), 16*1024*1024);
+*
+*  const char szMsg[] = "Level loaded\n";
+*  crWriteRingLog(szMsg, sizeof(szMsg)-1);
+*
+*  \endcode
+*
+*  \sa
+*   crAddRingLog()
+*/
+
+CRASHRPTAPI(int)
+crWriteRingLog(
+               LPCVOID pData,
+               DWORD cbData
+               );
+
 /*! \ingroup CrashRptAPI
 *  \brief Manually generates an error report.
 *
@@ -176,6 +176,7 @@ crpCloseErrorReport(
 #define CRP_TBL_MDMP_MODULES _T("MdmpModules") //!< Table: The list of loaded modules.
 #define CRP_TBL_MDMP_THREADS _T("MdmpThreads") //!< Table: The list of threads.
 #define CRP_TBL_MDMP_LOAD_LOG _T("MdmpLoadLog") //!< Table: Minidump loading log.
+#define CRP_TBL_PROCESSING_STATS _T("ProcessingStats") //!< Table: Time spent in each report processing stage.
 
 /* Meta information */
 
@@ -252,6 +253,11 @@ crpCloseErrorReport(
 // Column IDs of the CRP_MDMP_LOAD_LOG table
 #define CRP_COL_LOAD_LOG_ENTRY _T("LoadLogEntry")   //!< Column: A entry of the minidump loading log.
 
+// Column IDs of the CRP_TBL_PROCESSING_STATS table
+#define CRP_COL_STAGE_NAME       _T("StageName")       //!< Column: Processing stage name.
+#define CRP_COL_STAGE_TIME_USEC  _T("StageTimeUsec")   //!< Column: Total time spent in the stage, in microseconds.
+#define CRP_COL_STAGE_CALL_COUNT _T("StageCallCount")  //!< Column: How many times the stage was entered.
+
 /*! \ingroup CrashRptProbeAPI
 *  \brief Retrieves a string property from crash report.
 *  \return This function returns zero on success, with one exception (see Remarks for more information).
@@ -407,6 +413,64 @@ crpExtractFileA(
 #define crpExtractFile crpExtractFileA
 #endif //UNICODE
 
+/*! \ingroup CrashRptProbeAPI
+*  \brief Extracts all files contained in the opened error report to a directory.
+*  \return This function returns zero if succeeded.
+*
+*  \param[in] hReport Handle to the opened error report.
+*  \param[in] lpszDirectory The directory to extract files to. The directory must exist.
+*  \param[in] bOverwriteExisting Overwrite destination files if they already exist?
+*
+*  \remarks
+*
+*  Use this function to extract every file of the error report (ZIP) file at once. This is
+*  faster than calling crpExtractFile() for each file, because the files are inflated in
+*  parallel on several worker threads, each having its own read handle to the ZIP file.
+*
+*  Each file is saved to \a lpszDirectory under its name in the ZIP archive. Items whose
+*  names contain path components are not extracted and make the function fail.
+*
+*  \a bOverwriteExisting flag defines the behavior when a destination file already exists.
+*  If this parameter is TRUE, the file is overwritten, otherwise the function fails.
+*
+*  If this function fails, use crpGetLastErrorMsg() to retrieve the error message.
+*
+*  \note
+*    The crpExtractAllFilesW() and crpExtractAllFilesA() are wide character and multibyte
+*    character versions of crpExtractAllFiles().
+*
+*  \sa
+*    crpExtractFile()
+*/
+
+CRASHRPTPROBE_API(int)
+crpExtractAllFilesW(
+                CrpHandle hReport,
+                LPCWSTR lpszDirectory,
+                BOOL bOverwriteExisting
+                );
+
+/*! \ingroup CrashRptProbeAPI
+*  \copydoc crpExtractAllFilesW()
+*/
+
+CRASHRPTPROBE_API(int)
+crpExtractAllFilesA(
+                CrpHandle hReport,
+                LPCSTR lpszDirectory,
+                BOOL bOverwriteExisting
+                );
+
+/*! \brief Character set-independent mapping of crpExtractAllFilesW() and crpExtractAllFilesA() functions.
+*  \ingroup CrashRptProbeAPI
+*/
+
+#ifdef UNICODE
+#define crpExtractAllFiles crpExtractAllFilesW
+#else
+#define crpExtractAllFiles crpExtractAllFilesA
+#endif //UNICODE
+
 /*! \ingroup CrashRptProbeAPI
 *  \brief Gets the last CrashRptProbe error message.
 *
@@ -20,17 +20,25 @@ be found in the Authors.txt file in the root of the source tree.
 #include "Utility.h"
 #include "strconv.h"
 
-CCrashDescReader::CCrashDescReader()
+CCrashDescReader::CCrashDescReader(CReportArena* pArena) :
+    m_aFileItems(CArenaStrLess(), CArenaAllocator<std::pair<LPCTSTR const, LPCTSTR> >(pArena)),
+    m_aCustomProps(CArenaStrLess(), CArenaAllocator<std::pair<LPCTSTR const, LPCTSTR> >(pArena))
 {
+    m_pArena = pArena;
     m_bLoaded = false;
+    m_dwGeneratorVersion = 0;
+    m_bOSIs64Bit = FALSE;
     m_dwExceptionType = 0;
     m_dwFPESubcode = 0;
     m_dwExceptionCode = 0;
     m_dwInvParamLine = 0;
-}
 
-CCrashDescReader::~CCrashDescReader()
-{
+    // All string fields are empty until loaded
+    m_sCrashGUID = m_sAppName = m_sAppVersion = m_sImageName = _T("");
+    m_sOperatingSystem = m_sSystemTimeUTC = m_sGeoLocation = _T("");
+    m_sInvParamExpression = m_sInvParamFunction = m_sInvParamFile = _T("");
+    m_sUserEmail = m_sProblemDescription = _T("");
+    m_sMemoryUsageKbytes = m_sGUIResourceCount = m_sOpenHandleCount = _T("");
 }
 
 int CCrashDescReader::Load(CString sFileName)
@@ -91,7 +99,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sCrashGUID = strconv.utf82t(text);
+                m_sCrashGUID = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -104,7 +112,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sAppName = strconv.utf82t(text);
+                m_sAppName = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -117,7 +125,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sAppVersion = strconv.utf82t(text);
+                m_sAppVersion = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -130,7 +138,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sImageName = strconv.utf82t(text);
+                m_sImageName = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -143,7 +151,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sOperatingSystem = strconv.utf82t(text);
+                m_sOperatingSystem = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -156,7 +164,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sGeoLocation = strconv.utf82t(text);
+                m_sGeoLocation = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -183,7 +191,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sSystemTimeUTC = strconv.utf82t(text);
+                m_sSystemTimeUTC = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -209,7 +217,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sUserEmail = strconv.utf82t(text);
+                m_sUserEmail = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -222,7 +230,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sProblemDescription = strconv.utf82t(text);
+                m_sProblemDescription = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -266,7 +274,7 @@ int CCrashDescReader::Load(CString sFileName)
             {
                 const char* text = pTextElem->Value();
                 if(text)
-                    m_sInvParamExpression = strconv.utf82t(text);
+                    m_sInvParamExpression = m_pArena->StrDup(strconv.utf82t(text));
             }
         }
 
@@ -278,7 +286,7 @@ int CCrashDescReader::Load(CString sFileName)
             {
                 const char* text = pTextElem->Value();
                 if(text)
-                    m_sInvParamFunction = strconv.utf82t(text);
+                    m_sInvParamFunction = m_pArena->StrDup(strconv.utf82t(text));
             }
         }
 
@@ -290,7 +298,7 @@ int CCrashDescReader::Load(CString sFileName)
             {
                 const char* text = pTextElem->Value();
                 if(text)
-                    m_sInvParamFile = strconv.utf82t(text);
+                    m_sInvParamFile = m_pArena->StrDup(strconv.utf82t(text));
             }
         }
 
@@ -316,7 +324,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sGUIResourceCount = strconv.utf82t(text);
+                m_sGUIResourceCount = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -329,7 +337,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sOpenHandleCount = strconv.utf82t(text);
+                m_sOpenHandleCount = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -342,7 +350,7 @@ int CCrashDescReader::Load(CString sFileName)
         {
             const char* text = pTextElem->Value();
             if(text)
-                m_sMemoryUsageKbytes = strconv.utf82t(text);
+                m_sMemoryUsageKbytes = m_pArena->StrDup(strconv.utf82t(text));
         }
     }
 
@@ -361,11 +369,8 @@ int CCrashDescReader::Load(CString sFileName)
             const char* szFileName = hFileItem.ToElement()->Attribute("name");
             const char* szFileDescription = hFileItem.ToElement()->Attribute("description");
 
-            CString _sFileName, _sFileDescription;
-            if(szFileName!=NULL)
-                _sFileName = strconv.utf82t(szFileName);
-            if(szFileName!=NULL)
-                _sFileDescription = strconv.utf82t(szFileDescription);
+            LPCTSTR _sFileName = m_pArena->StrDup(szFileName!=NULL ? strconv.utf82t(szFileName) : NULL);
+            LPCTSTR _sFileDescription = m_pArena->StrDup(szFileDescription!=NULL ? strconv.utf82t(szFileDescription) : NULL);
 
             m_aFileItems[_sFileName]=_sFileDescription;
 
@@ -383,11 +388,8 @@ int CCrashDescReader::Load(CString sFileName)
             const char* szName = hProp.ToElement()->Attribute("name");
             const char* szValue = hProp.ToElement()->Attribute("value");
 
-            CString sName, sValue;
-            if(szName!=NULL)
-                sName = strconv.utf82t(szName);
-            if(szValue!=NULL)
-                sValue = strconv.utf82t(szValue);
+            LPCTSTR sName = m_pArena->StrDup(szName!=NULL ? strconv.utf82t(szName) : NULL);
+            LPCTSTR sValue = m_pArena->StrDup(szValue!=NULL ? strconv.utf82t(szValue) : NULL);
 
             m_aCustomProps[sName]=sValue;
 
@@ -423,9 +425,10 @@ int CCrashDescReader::LoadXmlv10(TiXmlHandle hDoc)
         const char* szImageName = hRoot.ToElement()->Attribute("ModuleName");
         if(szImageName!=NULL)
         {
-            m_sImageName = szImageName;
+            strconv_t strconv;
+            m_sImageName = m_pArena->StrDup(strconv.a2t(szImageName));
 
-            m_sAppName = Utility::GetBaseFileName(szImageName);
+            m_sAppName = m_pArena->StrDup(Utility::GetBaseFileName(m_sImageName));
         }
     }
 
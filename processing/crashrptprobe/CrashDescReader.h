@@ -17,13 +17,19 @@ be found in the Authors.txt file in the root of the source tree.
 #include "stdafx.h"
 #include <map>
 #include "tinyxml.h"
+#include "ReportArena.h"
+
+// Map of strings stored in the report arena
+typedef std::map<LPCTSTR, LPCTSTR, CArenaStrLess,
+    CArenaAllocator<std::pair<LPCTSTR const, LPCTSTR> > > CArenaStrMap;
 
 class CCrashDescReader
 {
 public:
 
-    CCrashDescReader();
-    ~CCrashDescReader();
+    // The reader is created inside the report arena (see CReportArena::Construct())
+    // and keeps all loaded strings there. Its destructor is not called.
+    CCrashDescReader(CReportArena* pArena);
 
     int Load(CString sFileName);
 
@@ -31,36 +37,38 @@ public:
 
     DWORD m_dwGeneratorVersion;
 
-    CString m_sCrashGUID;
-    CString m_sAppName;
-    CString m_sAppVersion;
-    CString m_sImageName;
-    CString m_sOperatingSystem;
+    LPCTSTR m_sCrashGUID;
+    LPCTSTR m_sAppName;
+    LPCTSTR m_sAppVersion;
+    LPCTSTR m_sImageName;
+    LPCTSTR m_sOperatingSystem;
     BOOL    m_bOSIs64Bit;
-    CString m_sSystemTimeUTC;
-    CString m_sGeoLocation;
+    LPCTSTR m_sSystemTimeUTC;
+    LPCTSTR m_sGeoLocation;
 
     DWORD m_dwExceptionType;
     DWORD m_dwExceptionCode;
 
     DWORD m_dwFPESubcode;
 
-    CString m_sInvParamExpression;
-    CString m_sInvParamFunction;
-    CString m_sInvParamFile;
+    LPCTSTR m_sInvParamExpression;
+    LPCTSTR m_sInvParamFunction;
+    LPCTSTR m_sInvParamFile;
     DWORD m_dwInvParamLine;
 
-    CString m_sUserEmail;
-    CString m_sProblemDescription;
+    LPCTSTR m_sUserEmail;
+    LPCTSTR m_sProblemDescription;
 
-    CString m_sMemoryUsageKbytes;
-    CString m_sGUIResourceCount;
-    CString m_sOpenHandleCount;
+    LPCTSTR m_sMemoryUsageKbytes;
+    LPCTSTR m_sGUIResourceCount;
+    LPCTSTR m_sOpenHandleCount;
 
-    std::map<CString, CString> m_aFileItems;
-    std::map<CString, CString> m_aCustomProps;
+    CArenaStrMap m_aFileItems;
+    CArenaStrMap m_aCustomProps;
 
 private:
 
+    CReportArena* m_pArena; // Arena where report data is stored.
+
     int LoadXmlv10(TiXmlHandle hDoc);
 };
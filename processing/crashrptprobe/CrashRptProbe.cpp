@@ -19,10 +19,20 @@ be found in the Authors.txt file in the root of the source tree.
 #include <map>
 #include "CrashDescReader.h"
 #include "MinidumpReader.h"
+#include "ReportArena.h"
+#include "ProcessingStats.h"
 #include "md5.h"
 #include "Utility.h"
 #include "strconv.h"
 #include "unzip.h"
+#include "iommap.h"
+
+// ZIP archives not larger than this (in bytes) are read through a memory mapping.
+// Larger ones are read with regular file IO to avoid exhausting address space
+// of 32-bit processes.
+#ifndef CRP_MMAP_ZIP_SIZE_LIMIT
+#define CRP_MMAP_ZIP_SIZE_LIMIT (256*1024*1024)
+#endif
 
 CComAutoCriticalSection g_crp_cs; // Critical section for thread-safe accessing error messages
 std::map<DWORD, CString> g_crp_sErrorMsg; // Last error messages for each calling thread.
@@ -48,27 +58,164 @@ TCHAR* exctypes[13] =
 };
 
 // CrpReportData
-// This structure is used internally for storing report data
+// This structure is used internally for storing report data.
+// The structure itself, the readers and everything they load live in the
+// per-report arena, so closing the report releases them all at once.
 struct CrpReportData
 {
-    CrpReportData()
+    CrpReportData(CReportArena* pArena) :
+        m_ContainedFiles(CArenaAllocator<LPCTSTR>(pArena))
     {
+        m_pArena = pArena;
+        m_lRefCount = 1;
         m_hZip = 0;
         m_pDescReader = NULL;
         m_pDmpReader = NULL;
+        m_sZipFileName = _T("");
+        m_sMiniDumpTempName = _T("");
+        m_sSymSearchPath = _T("");
     }
 
+    CReportArena* m_pArena; // Arena owning all data of this report
+    LONG m_lRefCount;       // The list of opened handles and API calls using the report hold references
     unzFile m_hZip; // Handle to the ZIP archive
+    LPCTSTR m_sZipFileName;          // Path to the ZIP archive
     CCrashDescReader* m_pDescReader; // Pointer to the crash description reader object
     CMiniDumpReader* m_pDmpReader;   // Pointer to the minidump reader object
-    CString m_sMiniDumpTempName;     // The name of the tmp file to store extracted minidump in
-    CString m_sSymSearchPath;        // Symbol files search path
-    std::vector<CString> m_ContainedFiles;
+    LPCTSTR m_sMiniDumpTempName;     // The name of the tmp file to store extracted minidump in
+    LPCTSTR m_sSymSearchPath;        // Symbol files search path
+    std::vector<LPCTSTR, CArenaAllocator<LPCTSTR> > m_ContainedFiles;
+    CProcessingStats m_Stats;        // Time spent in each processing stage
+};
+
+CComAutoCriticalSection g_crp_handles_cs; // Critical section protecting the list of opened handles
+std::map<int, CrpReportData*> g_OpenedHandles; // The list of opened handles
+int g_nLastHandle = 0; // The last handle value given out
+
+// Creates report data object with its own arena.
+CrpReportData* crpCreateReportData()
+{
+    CReportArena* pArena = new CReportArena;
+    CrpReportData* pReportData = pArena->Construct<CrpReportData>();
+    if(pReportData==NULL)
+    {
+        delete pArena;
+        return NULL;
+    }
+
+    pReportData->m_pDescReader = pArena->Construct<CCrashDescReader>();
+    pReportData->m_pDmpReader = pArena->Construct<CMiniDumpReader>();
+    if(pReportData->m_pDescReader==NULL || pReportData->m_pDmpReader==NULL)
+    {
+        delete pArena;
+        return NULL;
+    }
+
+    pReportData->m_pDmpReader->m_pStats = &pReportData->m_Stats;
+
+    return pReportData;
+}
+
+// Releases system resources held by the report and frees its arena.
+void crpFreeReportData(CrpReportData* pReportData)
+{
+    if(pReportData==NULL)
+        return;
+
+    // Unmap the minidump and clean up dbghelp symbol handler
+    if(pReportData->m_pDmpReader!=NULL)
+        pReportData->m_pDmpReader->Close();
+
+    if(pReportData->m_sMiniDumpTempName[0]!=0)
+        Utility::RecycleFile(pReportData->m_sMiniDumpTempName, TRUE);
+
+    if(pReportData->m_hZip!=0)
+        unzClose(pReportData->m_hZip);
+
+    // Free all report data with a single call. Destructors of the objects
+    // stored in the arena are not called - they don't own any memory
+    // outside of the arena.
+    delete pReportData->m_pArena;
+}
+
+// Looks for the report data by handle and adds a reference to it, so that it
+// is not freed by crpCloseErrorReport() called from another thread meanwhile.
+// The reference is released with crpReleaseReportData().
+CrpReportData* crpFindReportData(CrpHandle hReport)
+{
+    CrpReportData* pReportData = NULL;
+    g_crp_handles_cs.Lock();
+    std::map<int, CrpReportData*>::iterator it = g_OpenedHandles.find(hReport);
+    if(it!=g_OpenedHandles.end())
+    {
+        pReportData = it->second;
+        pReportData->m_lRefCount++;
+    }
+    g_crp_handles_cs.Unlock();
+    return pReportData;
+}
+
+// Releases a reference to the report data; frees it when the last one is released.
+void crpReleaseReportData(CrpReportData* pReportData)
+{
+    if(pReportData==NULL)
+        return;
+
+    g_crp_handles_cs.Lock();
+    LONG lRefCount = --pReportData->m_lRefCount;
+    g_crp_handles_cs.Unlock();
+
+    if(lRefCount==0)
+        crpFreeReportData(pReportData);
+}
+
+// Holds a reference to the report data for the duration of an API call.
+class CCrpReportDataRef
+{
+public:
+
+    CCrpReportDataRef(CrpHandle hReport)
+    {
+        m_pReportData = crpFindReportData(hReport);
+    }
+
+    ~CCrpReportDataRef()
+    {
+        crpReleaseReportData(m_pReportData);
+    }
+
+    CrpReportData* Get()
+    {
+        return m_pReportData;
+    }
+
+private:
+
+    CrpReportData* m_pReportData;
 };
 
-// The list of opened handles
-std::map<int, CrpReportData> g_OpenedHandles;
 
+// Opens the ZIP archive for reading. Archives below CRP_MMAP_ZIP_SIZE_LIMIT are mapped
+// to memory, so minizip reads and seeks don't result in file system calls.
+unzFile crpOpenZip(LPCTSTR szFileName)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if(GetFileAttributesEx(szFileName, GetFileExInfoStandard, &fad))
+    {
+        ULONGLONG uSize = ((ULONGLONG)fad.nFileSizeHigh<<32)|fad.nFileSizeLow;
+        if(uSize<=(ULONGLONG)CRP_MMAP_ZIP_SIZE_LIMIT)
+        {
+            zlib_filefunc64_def ff;
+            fill_mmap_filefunc64(&ff);
+            unzFile hZip = unzOpen2_64((const void*)szFileName, &ff);
+            if(hZip!=NULL)
+                return hZip;
+            // Mapping failed, fall back to regular file IO
+        }
+    }
+
+    return unzOpen((const char*)szFileName);
+}
 
 // CalcFileMD5Hash
 // Calculates the MD5 hash for the given file
@@ -76,7 +223,8 @@ int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 {
     crpSetErrorMsg(_T("Unspecified error."));
 
-    BYTE buff[512];
+    const size_t BUFF_SIZE = 64*1024; // Whole MD5 blocks are hashed right from the buffer
+    std::vector<BYTE> buff(BUFF_SIZE);
     MD5 md5;
     MD5_CTX md5_ctx;
     unsigned char md5_hash[16];
@@ -98,10 +246,10 @@ int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 
     while(!feof(f))
     {
-        size_t count = fread(buff, 1, 512, f);
+        size_t count = fread(&buff[0], 1, BUFF_SIZE, f);
         if(count>0)
         {
-            md5.MD5Update(&md5_ctx, buff, (unsigned int)count);
+            md5.MD5Update(&md5_ctx, &buff[0], (unsigned int)count);
         }
     }
 
@@ -120,7 +268,11 @@ int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
     return 0;
 }
 
-int UnzipFile(unzFile hZip, const char* szFileName, const TCHAR* szOutFileName)
+// UnzipFile
+// Extracts a ZIP item to a file. If pBuffer is NULL, a small stack buffer is used;
+// pass a large buffer to inflate and write data in large chunks.
+int UnzipFile(unzFile hZip, const char* szFileName, const TCHAR* szOutFileName,
+              LPBYTE pBuffer=NULL, UINT cbBuffer=0)
 {
     int status = -1;
     int zr=0;
@@ -129,6 +281,12 @@ int UnzipFile(unzFile hZip, const char* szFileName, const TCHAR* szOutFileName)
     BYTE buff[1024];
     int read_len = 0;
 
+    if(pBuffer==NULL || cbBuffer==0)
+    {
+        pBuffer = buff;
+        cbBuffer = sizeof(buff);
+    }
+
     zr = unzLocateFile(hZip, szFileName, 1);
     if(zr!=UNZ_OK)
         return -1;
@@ -146,9 +304,13 @@ int UnzipFile(unzFile hZip, const char* szFileName, const TCHAR* szOutFileName)
     if(f==NULL)
         goto cleanup;
 
+    // Data is written in chunks of the buffer size, so CRT buffering only adds a copy
+    if(cbBuffer>sizeof(buff))
+        setvbuf(f, NULL, _IONBF, 0);
+
     for(;;)
     {
-        read_len = unzReadCurrentFile(hZip, buff, 1024);
+        read_len = unzReadCurrentFile(hZip, pBuffer, cbBuffer);
 
         if(read_len<0)
             goto cleanup;
@@ -156,7 +318,7 @@ int UnzipFile(unzFile hZip, const char* szFileName, const TCHAR* szOutFileName)
         if(read_len==0)
             break;
 
-        size_t written = fwrite(buff, read_len, 1, f);
+        size_t written = fwrite(pBuffer, read_len, 1, f);
         if(written!=1)
             goto cleanup;
     }
@@ -186,7 +348,8 @@ crpOpenErrorReportW(
 
     int status = -1;
     int nNewHandle = 0;
-    CrpReportData report_data;
+    CrpReportData* pReportData = NULL;
+    CReportArena* pArena = NULL;
     int zr = 0;
     int xml_find_res = UNZ_END_OF_LIST_OF_FILE;
     int dmp_find_res = UNZ_END_OF_LIST_OF_FILE;
@@ -200,12 +363,20 @@ crpOpenErrorReportW(
     crpSetErrorMsg(_T("Unspecified error."));
     *pHandle = 0;
 
-    report_data.m_sSymSearchPath = pszSymSearchPath;
-    report_data.m_pDescReader = new CCrashDescReader;
-    report_data.m_pDmpReader = new CMiniDumpReader;
+    // All report data is allocated from the report's own arena
+    pReportData = crpCreateReportData();
+    if(pReportData==NULL)
+    {
+        crpSetErrorMsg(_T("Not enough memory."));
+        goto exit;
+    }
+    pArena = pReportData->m_pArena;
+
+    pReportData->m_sZipFileName = pArena->StrDup(strconv.w2t(pszFileName));
+    pReportData->m_sSymSearchPath = pArena->StrDup(strconv.w2t(pszSymSearchPath));
 
     // Check dbghelp.dll version
-    if(!report_data.m_pDmpReader->CheckDbgHelpApiVersion())
+    if(!pReportData->m_pDmpReader->CheckDbgHelpApiVersion())
     {
         crpSetErrorMsg(_T("Invalid dbghelp.dll version (v6.11 expected)."));
         goto exit; // Invalid hash
@@ -214,7 +385,9 @@ crpOpenErrorReportW(
     // Check ZIP integrity
     if(pszMd5Hash!=NULL)
     {
+        CStageTimer MD5Timer(&pReportData->m_Stats, CRP_STAGE_MD5);
         int result = CalcFileMD5Hash(pszFileName, sCalculatedMD5Hash);
+        MD5Timer.Stop();
         if(result!=0)
             goto exit;
 
@@ -226,31 +399,31 @@ crpOpenErrorReportW(
     }
 
     // Open ZIP archive
-    report_data.m_hZip = unzOpen((const char*)pszFileName);
-    if(report_data.m_hZip==NULL)
+    pReportData->m_hZip = crpOpenZip(pReportData->m_sZipFileName);
+    if(pReportData->m_hZip==NULL)
     {
         crpSetErrorMsg(_T("Error opening ZIP archive."));
         goto exit;
     }
 
     // Look for v1.1 crash description XML
-    xml_find_res = unzLocateFile(report_data.m_hZip, (const char*)"crashrpt.xml", 1);
-    zr = unzGetCurrentFileInfo(report_data.m_hZip, NULL, szXmlFileName, 1024, NULL, 0, NULL, 0);
+    xml_find_res = unzLocateFile(pReportData->m_hZip, (const char*)"crashrpt.xml", 1);
+    zr = unzGetCurrentFileInfo(pReportData->m_hZip, NULL, szXmlFileName, 1024, NULL, 0, NULL, 0);
 
     // Look for v1.1 crash dump
-    dmp_find_res = unzLocateFile(report_data.m_hZip, (const char*)"crashdump.dmp", 1);
-    zr = unzGetCurrentFileInfo(report_data.m_hZip, NULL, szDmpFileName, 1024, NULL, 0, NULL, 0);
+    dmp_find_res = unzLocateFile(pReportData->m_hZip, (const char*)"crashdump.dmp", 1);
+    zr = unzGetCurrentFileInfo(pReportData->m_hZip, NULL, szDmpFileName, 1024, NULL, 0, NULL, 0);
 
     // If xml and dmp still not found, assume it is v1.0
     if(xml_find_res!=UNZ_OK && dmp_find_res!=UNZ_OK)
     {
         // Look for .dmp file
-        zr = unzGoToFirstFile(report_data.m_hZip);
+        zr = unzGoToFirstFile(pReportData->m_hZip);
         if(zr==UNZ_OK)
         {
             for(;;)
             {
-                zr = unzGetCurrentFileInfo(report_data.m_hZip, NULL, szDmpFileName, 1024, NULL, 0, NULL, 0);
+                zr = unzGetCurrentFileInfo(pReportData->m_hZip, NULL, szDmpFileName, 1024, NULL, 0, NULL, 0);
                 if(zr!=UNZ_OK)
                     break;
 
@@ -265,7 +438,7 @@ crpOpenErrorReportW(
                     break;
                 }
 
-                zr=unzGoToNextFile(report_data.m_hZip);
+                zr=unzGoToNextFile(pReportData->m_hZip);
                 if(zr!=UNZ_OK)
                     break;
             }
@@ -273,8 +446,8 @@ crpOpenErrorReportW(
 
         // Assume the name of XML is the same as DMP
         CString sXmlName = Utility::GetBaseFileName(CString(szDmpFileName)) + _T(".xml");
-        zr = unzLocateFile(report_data.m_hZip, strconv.t2a(sXmlName), 1);
-        zr = unzGetCurrentFileInfo(report_data.m_hZip, NULL, szXmlFileName, 1024, NULL, 0, NULL, 0);
+        zr = unzLocateFile(pReportData->m_hZip, strconv.t2a(sXmlName), 1);
+        zr = unzGetCurrentFileInfo(pReportData->m_hZip, NULL, szXmlFileName, 1024, NULL, 0, NULL, 0);
         if(zr==UNZ_OK)
         {
             xml_find_res = UNZ_OK;
@@ -292,7 +465,9 @@ crpOpenErrorReportW(
     if(xml_find_res==UNZ_OK)
     {
         CString sTempFile = Utility::getTempFileName();
-        zr = UnzipFile(report_data.m_hZip, szXmlFileName, sTempFile);
+        CStageTimer UnzipTimer(&pReportData->m_Stats, CRP_STAGE_UNZIP);
+        zr = UnzipFile(pReportData->m_hZip, szXmlFileName, sTempFile);
+        UnzipTimer.Stop();
         if(zr!=0)
         {
             crpSetErrorMsg(_T("Error extracting ZIP item."));
@@ -300,7 +475,9 @@ crpOpenErrorReportW(
             goto exit; // Can't unzip ZIP element
         }
 
-        int result = report_data.m_pDescReader->Load(sTempFile);
+        CStageTimer XmlTimer(&pReportData->m_Stats, CRP_STAGE_XML_PARSE);
+        int result = pReportData->m_pDescReader->Load(sTempFile);
+        XmlTimer.Stop();
         DeleteFile(sTempFile);
         if(result!=0)
         {
@@ -313,7 +490,9 @@ crpOpenErrorReportW(
     if(dmp_find_res==UNZ_OK)
     {
         CString sTempFile = Utility::getTempFileName();
-        zr = UnzipFile(report_data.m_hZip, szDmpFileName, sTempFile);
+        CStageTimer UnzipTimer(&pReportData->m_Stats, CRP_STAGE_UNZIP);
+        zr = UnzipFile(pReportData->m_hZip, szDmpFileName, sTempFile);
+        UnzipTimer.Stop();
         if(zr!=0)
         {
             Utility::RecycleFile(sTempFile, TRUE);
@@ -321,31 +500,30 @@ crpOpenErrorReportW(
             goto exit; // Can't unzip ZIP element
         }
 
-        report_data.m_sMiniDumpTempName = sTempFile;
+        pReportData->m_sMiniDumpTempName = pArena->StrDup(sTempFile);
     }
 
-    if(report_data.m_pDescReader->m_dwGeneratorVersion==1000)
+    if(pReportData->m_pDescReader->m_dwGeneratorVersion==1000)
     {
         // Check if appname is empty (this may be true for v1.0 reports)
-        if(report_data.m_pDescReader->m_sAppName.IsEmpty())
-            report_data.m_pDescReader->m_sAppName = sAppName;
+        if(pReportData->m_pDescReader->m_sAppName[0]==0)
+            pReportData->m_pDescReader->m_sAppName = pArena->StrDup(sAppName);
 
         // Check if app version is empty (this may be true for v1.0 reports)
-        if(report_data.m_pDescReader->m_sAppVersion.IsEmpty() ||
-            report_data.m_pDescReader->m_sImageName.IsEmpty())
+        if(pReportData->m_pDescReader->m_sAppVersion[0]==0 ||
+            pReportData->m_pDescReader->m_sImageName[0]==0)
         {
             // Load minidump right now
-            int nLoad = report_data.m_pDmpReader->Open(report_data.m_sMiniDumpTempName,
-                report_data.m_sSymSearchPath);
+            int nLoad = pReportData->m_pDmpReader->Open(pReportData->m_sMiniDumpTempName,
+                pReportData->m_sSymSearchPath);
             if(nLoad!=0)
             {
                 crpSetErrorMsg(_T("Error opening minidump file."));
-                Utility::RecycleFile(report_data.m_sMiniDumpTempName, TRUE);
                 goto exit;
             }
 
             // Find the candidate for application's executable module
-            CMiniDumpReader* pDmpReader = report_data.m_pDmpReader;
+            CMiniDumpReader* pDmpReader = pReportData->m_pDmpReader;
             int nExeModuleIndx = -1;
             UINT i;
             for(i=0; i<pDmpReader->m_DumpData.m_Modules.size(); i++)
@@ -353,7 +531,7 @@ crpOpenErrorReportW(
                 CString sModuleName = pDmpReader->m_DumpData.m_Modules[i].m_sModuleName;
                 CString sBaseName = Utility::GetBaseFileName(sModuleName);
                 CString sExt = Utility::GetFileExtension(sModuleName);
-                if(sBaseName.CompareNoCase(report_data.m_pDescReader->m_sAppName)==0 &&
+                if(sBaseName.CompareNoCase(pReportData->m_pDescReader->m_sAppName)==0 &&
                     sExt.CompareNoCase(_T("exe"))==0)
                 {
                     nExeModuleIndx = i;
@@ -362,13 +540,13 @@ crpOpenErrorReportW(
             }
             if(nExeModuleIndx>=0)
             {
-                if(report_data.m_pDescReader->m_sImageName.IsEmpty())
+                if(pReportData->m_pDescReader->m_sImageName[0]==0)
                 {
-                    report_data.m_pDescReader->m_sImageName =
+                    pReportData->m_pDescReader->m_sImageName =
                         pDmpReader->m_DumpData.m_Modules[i].m_sImageName;
                 }
 
-                if(report_data.m_pDescReader->m_sAppVersion.IsEmpty())
+                if(pReportData->m_pDescReader->m_sAppVersion[0]==0)
                 {
                     VS_FIXEDFILEINFO* fi = pDmpReader->m_DumpData.m_Modules[i].m_pVersionInfo;
                     if(fi!=NULL)
@@ -378,8 +556,10 @@ crpOpenErrorReportW(
                         WORD dwPatchLevel = (WORD)(fi->dwProductVersionLS>>16);
                         WORD dwVerBuild = (WORD)(fi->dwProductVersionLS&0xFF);
 
-                        report_data.m_pDescReader->m_sAppVersion.Format(_T("%u.%u.%u.%u"),
+                        CString sAppVersion;
+                        sAppVersion.Format(_T("%u.%u.%u.%u"),
                             dwVerMajor, dwVerMinor, dwPatchLevel, dwVerBuild);
+                        pReportData->m_pDescReader->m_sAppVersion = pArena->StrDup(sAppVersion);
                     }
                 }
             }
@@ -387,28 +567,29 @@ crpOpenErrorReportW(
     }
 
     // Enumerate contained files
-    zr = unzGoToFirstFile(report_data.m_hZip);
+    zr = unzGoToFirstFile(pReportData->m_hZip);
     if(zr==UNZ_OK)
     {
         for(;;)
         {
-            zr = unzGetCurrentFileInfo(report_data.m_hZip,
+            zr = unzGetCurrentFileInfo(pReportData->m_hZip,
                 NULL, szFileName, 1024, NULL, 0, NULL, 0);
             if(zr!=UNZ_OK)
                 break;
 
-            CString sFileName = szFileName;
-            report_data.m_ContainedFiles.push_back(sFileName);
+            pReportData->m_ContainedFiles.push_back(pArena->StrDup(strconv.a2t(szFileName)));
 
-            zr=unzGoToNextFile(report_data.m_hZip);
+            zr=unzGoToNextFile(pReportData->m_hZip);
             if(zr!=UNZ_OK)
                 break;
         }
     }
 
     // Add handle to the list of opened handles
-    nNewHandle = (int)g_OpenedHandles.size()+1;
-    g_OpenedHandles[nNewHandle] = report_data;
+    g_crp_handles_cs.Lock();
+    nNewHandle = ++g_nLastHandle;
+    g_OpenedHandles[nNewHandle] = pReportData;
+    g_crp_handles_cs.Unlock();
     *pHandle = nNewHandle;
 
     crpSetErrorMsg(_T("Success."));
@@ -418,12 +599,7 @@ exit:
 
     if(status!=0)
     {
-        delete report_data.m_pDescReader;
-        delete report_data.m_pDmpReader;
-        Utility::RecycleFile(report_data.m_sMiniDumpTempName, TRUE);
-
-        if(report_data.m_hZip!=0)
-            unzClose(report_data.m_hZip);
+        crpFreeReportData(pReportData);
     }
 
 
@@ -453,23 +629,26 @@ crpCloseErrorReport(
 {
     crpSetErrorMsg(_T("Unspecified error."));
 
-    // Look for such handle
-    std::map<int, CrpReportData>::iterator it = g_OpenedHandles.find(handle);
-    if(it==g_OpenedHandles.end())
+    // Look for such handle and remove it from the list of opened handles
+    g_crp_handles_cs.Lock();
+    CrpReportData* pReportData = NULL;
+    std::map<int, CrpReportData*>::iterator it = g_OpenedHandles.find(handle);
+    if(it!=g_OpenedHandles.end())
+    {
+        pReportData = it->second;
+        g_OpenedHandles.erase(it);
+    }
+    g_crp_handles_cs.Unlock();
+
+    if(pReportData==NULL)
     {
         crpSetErrorMsg(_T("Invalid handle specified."));
         return 1;
     }
 
-    delete it->second.m_pDescReader;
-    delete it->second.m_pDmpReader;
-    Utility::RecycleFile(it->second.m_sMiniDumpTempName, TRUE);
-
-    if(it->second.m_hZip)
-        unzClose(it->second.m_hZip);
-
-    // Remove from the list of opened handles
-    g_OpenedHandles.erase(it);
+    // Release the reference held by the list of opened handles. Report data
+    // is freed when calls still using it on other threads return.
+    crpReleaseReportData(pReportData);
 
     // OK.
     crpSetErrorMsg(_T("Success."));
@@ -523,15 +702,16 @@ crpGetPropertyW(
         return -1;
     }
 
-    std::map<int, CrpReportData>::iterator it = g_OpenedHandles.find(hReport);
-    if(it==g_OpenedHandles.end())
+    CCrpReportDataRef ReportRef(hReport);
+    CrpReportData* pReportData = ReportRef.Get();
+    if(pReportData==NULL)
     {
         crpSetErrorMsg(_T("Invalid handle specified."));
         return -1;
     }
 
-    CCrashDescReader* pDescReader = it->second.m_pDescReader;
-    CMiniDumpReader* pDmpReader = it->second.m_pDmpReader;
+    CCrashDescReader* pDescReader = pReportData->m_pDescReader;
+    CMiniDumpReader* pDmpReader = pReportData->m_pDmpReader;
 
     CString sTableId = lpszTableId;
     CString sColumnId = lpszColumnId;
@@ -548,7 +728,7 @@ crpGetPropertyW(
         (pDescReader->m_dwGeneratorVersion==1000 && sTableId.Compare(CRP_TBL_XMLDESC_MISC)==0) )
     {
         // Load the minidump
-        int nOpen = pDmpReader->Open(it->second.m_sMiniDumpTempName, it->second.m_sSymSearchPath);
+        int nOpen = pDmpReader->Open(pReportData->m_sMiniDumpTempName, pReportData->m_sSymSearchPath);
 		if(nOpen!=0)
         {
             crpSetErrorMsg(_T("Could not open minidump file."));
@@ -778,7 +958,7 @@ crpGetPropertyW(
     {
         if(pDescReader->m_dwGeneratorVersion==1000)
         {
-            if(nRowIndex>=(int)it->second.m_ContainedFiles.size())
+            if(nRowIndex>=(int)pReportData->m_ContainedFiles.size())
             {
                 crpSetErrorMsg(_T("Invalid row index specified."));
                 return -4;
@@ -796,7 +976,7 @@ crpGetPropertyW(
         if(sColumnId.Compare(CRP_META_ROW_COUNT)==0)
         {
             if(pDescReader->m_dwGeneratorVersion==1000)
-                return (int)it->second.m_ContainedFiles.size();
+                return (int)pReportData->m_ContainedFiles.size();
             return (int)pDescReader->m_aFileItems.size();
         }
         else if( sColumnId.Compare(CRP_COL_FILE_ITEM_NAME)==0 ||
@@ -805,13 +985,13 @@ crpGetPropertyW(
             if(pDescReader->m_dwGeneratorVersion==1000)
             {
                 if(sColumnId.Compare(CRP_COL_FILE_ITEM_NAME)==0)
-                    pszPropVal = strconv.t2w(it->second.m_ContainedFiles[nRowIndex]);
+                    pszPropVal = strconv.t2w(pReportData->m_ContainedFiles[nRowIndex]);
                 else
                     pszPropVal = _T("");
             }
             else
             {
-                std::map<CString, CString>::iterator it = pDescReader->m_aFileItems.begin();
+                CArenaStrMap::iterator it = pDescReader->m_aFileItems.begin();
                 int i;
                 for(i=0; i<nRowIndex; i++) it++;
 
@@ -848,7 +1028,7 @@ crpGetPropertyW(
         else if( sColumnId.Compare(CRP_COL_PROPERTY_NAME)==0 ||
             sColumnId.Compare(CRP_COL_PROPERTY_VALUE)==0 )
         {
-            std::map<CString, CString>::iterator it = pDescReader->m_aCustomProps.begin();
+            CArenaStrMap::iterator it = pDescReader->m_aCustomProps.begin();
             int i;
             for(i=0; i<nRowIndex; i++) it++;
 
@@ -989,8 +1169,8 @@ crpGetPropertyW(
             if(nThreadROWID>=0)
             {
                 pDmpReader->StackWalk(pDmpReader->m_DumpData.m_Threads[nThreadROWID].m_dwThreadId);
-                CString sMD5 = pDmpReader->m_DumpData.m_Threads[nThreadROWID].m_sStackTraceMD5;
-                _STPRINTF_S(szBuff, BUFF_SIZE, _T("%s"), sMD5.GetBuffer(0));
+                LPCTSTR sMD5 = pDmpReader->m_DumpData.m_Threads[nThreadROWID].m_sStackTraceMD5;
+                _STPRINTF_S(szBuff, BUFF_SIZE, _T("%s"), sMD5);
             }
             pszPropVal = szBuff;
         }
@@ -1041,7 +1221,7 @@ crpGetPropertyW(
         else if(sColumnId.Compare(CRP_COL_MODULE_SYM_LOAD_STATUS)==0)
         {
             CString sSymLoadStatus;
-            MdmpModule m = pDmpReader->m_DumpData.m_Modules[nRowIndex];
+            MdmpModule& m = pDmpReader->m_DumpData.m_Modules[nRowIndex];
             if(m.m_bImageUnmatched)
                 sSymLoadStatus = _T("No matching binary found.");
             else if(m.m_bPdbUnmatched)
@@ -1121,6 +1301,38 @@ crpGetPropertyW(
         }
 
     }
+    else if(sTableId.Compare(CRP_TBL_PROCESSING_STATS)==0)
+    {
+        if(nRowIndex>=CRP_STAGE_COUNT)
+        {
+            crpSetErrorMsg(_T("Invalid row index specified."));
+            return -4;
+        }
+
+        if(sColumnId.Compare(CRP_META_ROW_COUNT)==0)
+        {
+            return CRP_STAGE_COUNT;
+        }
+        else if(sColumnId.Compare(CRP_COL_STAGE_NAME)==0)
+        {
+            pszPropVal = strconv.t2w(CProcessingStats::GetStageName(nRowIndex));
+        }
+        else if(sColumnId.Compare(CRP_COL_STAGE_TIME_USEC)==0)
+        {
+            _STPRINTF_S(szBuff, BUFF_SIZE, _T("%I64u"), pReportData->m_Stats.GetTimeUsec(nRowIndex));
+            pszPropVal = szBuff;
+        }
+        else if(sColumnId.Compare(CRP_COL_STAGE_CALL_COUNT)==0)
+        {
+            _ULTOT_S(pReportData->m_Stats.GetCallCount(nRowIndex), szBuff, BUFF_SIZE, 10);
+            pszPropVal = szBuff;
+        }
+        else
+        {
+            crpSetErrorMsg(_T("Invalid column ID specified."));
+            return -2;
+        }
+    }
     else if(nDynTable==0)
     {
         int nEntryIndex = nDynTableIndex;
@@ -1263,14 +1475,15 @@ crpExtractFileW(
     int zr;
     unzFile hZip = 0;
 
-    std::map<int, CrpReportData>::iterator it = g_OpenedHandles.find(hReport);
-    if(it==g_OpenedHandles.end())
+    CCrpReportDataRef ReportRef(hReport);
+    CrpReportData* pReportData = ReportRef.Get();
+    if(pReportData==NULL)
     {
         crpSetErrorMsg(_T("Invalid handle specified."));
         return -1;
     }
 
-    hZip = it->second.m_hZip;
+    hZip = pReportData->m_hZip;
 
     zr = unzLocateFile(hZip, strconv.w2a(lpszFileName), 1);
     if(zr!=UNZ_OK)
@@ -1316,6 +1529,196 @@ crpExtractFileA(
     return crpExtractFileW(hReport, pwszFileName, pwszFileSaveAs, bOverwriteExisting);
 }
 
+// Maximum count of threads used by crpExtractAllFilesW()
+#define EXTRACT_MAX_THREADS 8
+
+// Size of the buffer each extraction thread inflates data to
+#define EXTRACT_BUFFER_SIZE (256*1024)
+
+// CrpExtractAllContext
+// Data shared by threads extracting files in crpExtractAllFilesW().
+struct CrpExtractAllContext
+{
+    CrpReportData* m_pReportData; // Report being extracted
+    CString m_sDstDir;            // Destination directory with trailing back slash
+    BOOL m_bOverwriteExisting;    // Overwrite existing files?
+    volatile LONG m_lNextItem;    // Index of the next item to take (pre-incremented)
+    volatile LONG m_lError;       // Nonzero if some item failed; stops other threads
+    int m_nErrorCode;             // Error code of the first failure
+    CString m_sErrorMsg;          // Error message of the first failure
+    CComAutoCriticalSection m_csError; // Protects error info
+};
+
+// Records the first extraction error
+void crpSetExtractError(CrpExtractAllContext* pCtx, int nCode, LPCTSTR szMsg)
+{
+    pCtx->m_csError.Lock();
+    if(InterlockedExchange(&pCtx->m_lError, 1)==0)
+    {
+        pCtx->m_nErrorCode = nCode;
+        pCtx->m_sErrorMsg = szMsg;
+    }
+    pCtx->m_csError.Unlock();
+}
+
+// Extraction worker thread. Takes items one by one from the shared list and
+// inflates them through its own read handle to the ZIP file.
+DWORD WINAPI ExtractAllWorkerThread(LPVOID lpParam)
+{
+    CrpExtractAllContext* pCtx = (CrpExtractAllContext*)lpParam;
+    CrpReportData* pReportData = pCtx->m_pReportData;
+    LONG lCount = (LONG)pReportData->m_ContainedFiles.size();
+    LPBYTE pBuffer = NULL;
+    strconv_t strconv;
+
+    // Minizip handles can't be shared between threads, so open our own one
+    unzFile hZip = crpOpenZip(pReportData->m_sZipFileName);
+    if(hZip==NULL)
+    {
+        crpSetExtractError(pCtx, -4, _T("Error opening ZIP archive."));
+        goto cleanup;
+    }
+
+    pBuffer = new BYTE[EXTRACT_BUFFER_SIZE];
+
+    while(pCtx->m_lError==0)
+    {
+        LONG lItem = InterlockedIncrement(&pCtx->m_lNextItem);
+        if(lItem>=lCount)
+            break;
+
+        LPCTSTR szItemName = pReportData->m_ContainedFiles[lItem];
+
+        // Report ZIPs are flat, so don't let an item name escape the directory
+        if(_tcspbrk(szItemName, _T("\\/:"))!=NULL)
+        {
+            crpSetExtractError(pCtx, -2, _T("ZIP item name contains path components."));
+            break;
+        }
+
+        CString sFileSaveAs = pCtx->m_sDstDir + szItemName;
+
+        if(!pCtx->m_bOverwriteExisting)
+        {
+            // Check if such file already exists
+            DWORD dwFileAttrs = GetFileAttributes(sFileSaveAs);
+            if(dwFileAttrs!=INVALID_FILE_ATTRIBUTES &&
+                dwFileAttrs!=FILE_ATTRIBUTE_DIRECTORY)
+            {
+                crpSetExtractError(pCtx, -3, _T("Such file already exists."));
+                break;
+            }
+        }
+
+        int zr = UnzipFile(hZip, strconv.t2a(szItemName), sFileSaveAs, pBuffer, EXTRACT_BUFFER_SIZE);
+        if(zr!=0)
+        {
+            crpSetExtractError(pCtx, -4, _T("Error extracting the specified zip item."));
+            break;
+        }
+    }
+
+cleanup:
+
+    if(pBuffer!=NULL)
+        delete [] pBuffer;
+
+    if(hZip!=NULL)
+        unzClose(hZip);
+
+    return 0;
+}
+
+CRASHRPTPROBE_API(int)
+crpExtractAllFilesW(
+                CrpHandle hReport,
+                LPCWSTR lpszDirectory,
+                BOOL bOverwriteExisting)
+{
+    crpSetErrorMsg(_T("Unspecified error."));
+
+    strconv_t strconv;
+    CrpExtractAllContext ctx;
+    std::vector<HANDLE> aThreads;
+    SYSTEM_INFO si;
+    LONG lCount = 0;
+    LONG lThreadCount = 0;
+    LONG i;
+
+    CCrpReportDataRef ReportRef(hReport);
+    CrpReportData* pReportData = ReportRef.Get();
+    if(pReportData==NULL)
+    {
+        crpSetErrorMsg(_T("Invalid handle specified."));
+        return -1;
+    }
+
+    if(lpszDirectory==NULL)
+    {
+        crpSetErrorMsg(_T("Invalid argument specified."));
+        return -1;
+    }
+
+    DWORD dwDirAttrs = GetFileAttributesW(lpszDirectory);
+    if(dwDirAttrs==INVALID_FILE_ATTRIBUTES || !(dwDirAttrs&FILE_ATTRIBUTE_DIRECTORY))
+    {
+        crpSetErrorMsg(_T("Invalid directory name for file extraction."));
+        return -1;
+    }
+
+    ctx.m_pReportData = pReportData;
+    ctx.m_sDstDir = strconv.w2t(lpszDirectory);
+    if(ctx.m_sDstDir.Right(1)!=_T("\\"))
+        ctx.m_sDstDir += _T("\\");
+    ctx.m_bOverwriteExisting = bOverwriteExisting;
+    ctx.m_lNextItem = -1;
+    ctx.m_lError = 0;
+    ctx.m_nErrorCode = 0;
+
+    // One thread per CPU, but not more threads than items
+    GetSystemInfo(&si);
+    lCount = (LONG)pReportData->m_ContainedFiles.size();
+    lThreadCount = min((LONG)si.dwNumberOfProcessors, min(lCount, (LONG)EXTRACT_MAX_THREADS));
+
+    for(i=1; i<lThreadCount; i++)
+    {
+        HANDLE hThread = CreateThread(NULL, 0, ExtractAllWorkerThread, &ctx, 0, NULL);
+        if(hThread==NULL)
+            break; // Fewer threads will do the work
+        aThreads.push_back(hThread);
+    }
+
+    // The calling thread works too
+    ExtractAllWorkerThread(&ctx);
+
+    if(!aThreads.empty())
+    {
+        WaitForMultipleObjects((DWORD)aThreads.size(), &aThreads[0], TRUE, INFINITE);
+        size_t j;
+        for(j=0; j<aThreads.size(); j++)
+            CloseHandle(aThreads[j]);
+    }
+
+    if(ctx.m_lError!=0)
+    {
+        crpSetErrorMsg(ctx.m_sErrorMsg.GetBuffer(0));
+        return ctx.m_nErrorCode;
+    }
+
+    crpSetErrorMsg(_T("Success."));
+    return 0;
+}
+
+CRASHRPTPROBE_API(int)
+crpExtractAllFilesA(
+                CrpHandle hReport,
+                LPCSTR lpszDirectory,
+                BOOL bOverwriteExisting)
+{
+    strconv_t strconv;
+    return crpExtractAllFilesW(hReport, strconv.a2w(lpszDirectory), bOverwriteExisting);
+}
+
 CRASHRPTPROBE_API(int)
 crpGetLastErrorMsgW(
                     LPWSTR pszBuffer,
@@ -41,8 +41,12 @@ BOOL CALLBACK SymRegisterCallbackProc64(
                                         ULONG64 UserContext
                                         );
 
-CMiniDumpReader::CMiniDumpReader()
+CMiniDumpReader::CMiniDumpReader(CReportArena* pArena) :
+    m_DumpData(pArena)
 {
+    m_pArena = pArena;
+    m_sFileName = _T("");
+    m_sSymSearchPath = _T("");
     m_bLoaded = FALSE;
     m_bReadSysInfoStream = FALSE;
     m_bReadExceptionStream = FALSE;
@@ -52,16 +56,12 @@ CMiniDumpReader::CMiniDumpReader()
     m_hFileMiniDump = INVALID_HANDLE_VALUE;
     m_hFileMapping = NULL;
     m_pMiniDumpStartPtr = NULL;
-}
-
-CMiniDumpReader::~CMiniDumpReader()
-{
-    Close();
+    m_pStats = NULL;
 }
 
 int CMiniDumpReader::Open(CString sFileName, CString sSymSearchPath)
 {
-    static DWORD dwProcessID = 0;
+    static LONG lProcessID = 0;
 
     if(m_bLoaded)
     {
@@ -69,8 +69,10 @@ int CMiniDumpReader::Open(CString sFileName, CString sSymSearchPath)
         return 0;
     }
 
-    m_sFileName = sFileName;
-    m_sSymSearchPath = sSymSearchPath;
+    m_sFileName = m_pArena->StrDup(sFileName);
+    m_sSymSearchPath = m_pArena->StrDup(sSymSearchPath);
+
+    CStageTimer MapTimer(m_pStats, CRP_STAGE_DUMP_MAP);
 
     m_hFileMiniDump = CreateFile(
         sFileName,
@@ -114,7 +116,12 @@ int CMiniDumpReader::Open(CString sFileName, CString sSymSearchPath)
         return 3;
     }
 
-    m_DumpData.m_hProcess = (HANDLE)(++dwProcessID);
+    // Several reports may be opened concurrently, so generate the pseudo
+    // process handle atomically.
+    m_DumpData.m_hProcess = (HANDLE)(LONG_PTR)InterlockedIncrement(&lProcessID);
+
+    MapTimer.Pause();
+    CStageTimer SymTimer(m_pStats, CRP_STAGE_SYM_LOAD);
 
     DWORD dwOptions = 0;
     //dwOptions |= SYMOPT_DEFERRED_LOADS; // Symbols are not loaded until a reference is made requiring the symbols be loaded.
@@ -141,8 +148,19 @@ int CMiniDumpReader::Open(CString sFileName, CString sSymSearchPath)
     SymRegisterCallbackProc64,
     (ULONG64)this);*/
 
+    // Streams are read in their usual order. Reading the module list loads
+    // modules into the symbol handler, so it is accounted as symbol loading,
+    // and the other streams as mapping.
+    SymTimer.Pause();
+    MapTimer.Resume();
     m_bReadSysInfoStream = !ReadSysInfoStream();
+    MapTimer.Pause();
+
+    SymTimer.Resume();
     m_bReadModuleListStream = !ReadModuleListStream();
+    SymTimer.Stop();
+
+    MapTimer.Resume();
     m_bReadThreadListStream = !ReadThreadListStream();
     m_bReadMemoryListStream = !ReadMemoryListStream();
     m_bReadExceptionStream = !ReadExceptionStream();
@@ -232,9 +250,10 @@ void CMiniDumpReader::Close()
 
     m_pMiniDumpStartPtr = NULL;
 
-    if(m_DumpData.m_hProcess!=NULL)
+    if(m_DumpData.m_hProcess!=NULL && m_DumpData.m_hProcess!=INVALID_HANDLE_VALUE)
     {
         SymCleanup(m_DumpData.m_hProcess);
+        m_DumpData.m_hProcess = NULL;
     }
 }
 
@@ -258,12 +277,11 @@ BOOL CMiniDumpReader::CheckDbgHelpApiVersion()
 }
 
 // Extracts a UNICODE string stored in minidump file by its relative address
-CString CMiniDumpReader::GetMinidumpString(LPVOID start_addr, RVA rva)
+LPCTSTR CMiniDumpReader::GetMinidumpString(LPVOID start_addr, RVA rva)
 {
     MINIDUMP_STRING* pms = (MINIDUMP_STRING*)((LPBYTE)start_addr+rva);
     //CString sModule = CString(pms->Buffer, pms->Length);
-    CString sModule = pms->Buffer;
-    return sModule;
+    return m_pArena->StrDup(pms->Buffer);
 }
 
 int CMiniDumpReader::ReadSysInfoStream()
@@ -342,14 +360,14 @@ int CMiniDumpReader::ReadExceptionStream()
             {
 
             }
-            m_DumpData.m_LoadLog.push_back(sMsg);
+            m_DumpData.m_LoadLog.push_back(m_pArena->StrDup(sMsg));
         }
     }
     else
     {
         CString sMsg;
         sMsg = _T("No exception information found in minidump.");
-        m_DumpData.m_LoadLog.push_back(sMsg);
+        m_DumpData.m_LoadLog.push_back(m_pArena->StrDup(sMsg));
         return 1;
     }
 
@@ -383,16 +401,17 @@ int CMiniDumpReader::ReadModuleListStream()
                 MINIDUMP_MODULE* pModule =
                     (MINIDUMP_MODULE*)((LPBYTE)pModuleStream->Modules+i*sizeof(MINIDUMP_MODULE));
 
-                CString sModuleName = GetMinidumpString(m_pMiniDumpStartPtr, pModule->ModuleNameRva);
+                LPCTSTR sModuleName = GetMinidumpString(m_pMiniDumpStartPtr, pModule->ModuleNameRva);
                 LPCWSTR szModuleName = strconv.t2w(sModuleName);
                 DWORD64 dwBaseAddr = pModule->BaseOfImage;
                 DWORD64 dwImageSize = pModule->SizeOfImage;
 
-                CString sShortModuleName = sModuleName;
-                int pos = -1;
-                pos = sModuleName.ReverseFind('\\');
-                if(pos>=0)
-                    sShortModuleName = sShortModuleName.Mid(pos+1);
+                // Short module name points into the full name - no copy is needed
+                LPCTSTR sShortModuleName = _tcsrchr(sModuleName, '\\');
+                if(sShortModuleName!=NULL)
+                    sShortModuleName++;
+                else
+                    sShortModuleName = sModuleName;
 
                 /*DWORD64 dwLoadResult = */SymLoadModuleExW(
                     m_DumpData.m_hProcess,
@@ -419,6 +438,8 @@ int CMiniDumpReader::ReadModuleListStream()
                     m.m_pVersionInfo = NULL;
                     m.m_sImageName = sModuleName;
                     m.m_sModuleName = sShortModuleName;
+                    m.m_sLoadedImageName = _T("");
+                    m.m_sLoadedPdbName = _T("");
                     m.m_uBaseAddr = dwBaseAddr;
                     m.m_uImageSize = dwImageSize;
                 }
@@ -427,9 +448,9 @@ int CMiniDumpReader::ReadModuleListStream()
                     m.m_uBaseAddr = modinfo.BaseOfImage;
                     m.m_uImageSize = modinfo.ImageSize;
                     m.m_sModuleName = sShortModuleName;
-                    m.m_sImageName = modinfo.ImageName;
-                    m.m_sLoadedImageName = modinfo.LoadedImageName;
-                    m.m_sLoadedPdbName = modinfo.LoadedPdbName;
+                    m.m_sImageName = m_pArena->StrDup(strconv.a2t(modinfo.ImageName));
+                    m.m_sLoadedImageName = m_pArena->StrDup(strconv.a2t(modinfo.LoadedImageName));
+                    m.m_sLoadedPdbName = m_pArena->StrDup(strconv.a2t(modinfo.LoadedPdbName));
                     m.m_pVersionInfo = &pModule->VersionInfo;
                     m.m_bPdbUnmatched = modinfo.PdbUnmatched;
                     BOOL bTimeStampMatched = pModule->TimeDateStamp == modinfo.TimeDateStamp;
@@ -442,9 +463,9 @@ int CMiniDumpReader::ReadModuleListStream()
 
                 CString sMsg;
                 if(m.m_bImageUnmatched)
-                    sMsg.Format(_T("Loaded '*%s'"), (LPCTSTR)sModuleName);
+                    sMsg.Format(_T("Loaded '*%s'"), sModuleName);
                 else
-                    sMsg.Format(_T("Loaded '%s'"), (LPCTSTR)m.m_sLoadedImageName);
+                    sMsg.Format(_T("Loaded '%s'"), m.m_sLoadedImageName);
 
                 if(m.m_bImageUnmatched)
                     sMsg += _T(", No matching binary found.");
@@ -457,7 +478,7 @@ int CMiniDumpReader::ReadModuleListStream()
                     else
                         sMsg += _T(", Symbols loaded.");
                 }
-                m_DumpData.m_LoadLog.push_back(sMsg);
+                m_DumpData.m_LoadLog.push_back(m_pArena->StrDup(sMsg));
             }
         }
     }
@@ -566,7 +587,7 @@ int CMiniDumpReader::ReadThreadListStream()
             {
                 MINIDUMP_THREAD* pThread = (MINIDUMP_THREAD*)(&pThreadList->Threads[i]);
 
-                MdmpThread mt;
+                MdmpThread mt(m_pArena);
                 mt.m_dwThreadId = pThread->ThreadId;
                 mt.m_pThreadContext = (CONTEXT*)(((LPBYTE)m_pMiniDumpStartPtr)+pThread->ThreadContext.Rva);
 
@@ -599,6 +620,9 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
     if(pThreadContext==NULL)
         return 1;
 
+    CStageTimer WalkTimer(m_pStats, CRP_STAGE_STACK_WALK);
+    strconv_t strconv;
+
     // Make modifiable context
     CONTEXT Context;
     memcpy(&Context, pThreadContext, sizeof(CONTEXT));
@@ -705,7 +729,7 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
 
         if(bGetSym)
         {
-            stack_frame.m_sSymbolName = CString(sym_info->Name, sym_info->NameLen);
+            stack_frame.m_sSymbolName = m_pArena->StrDup(CString(sym_info->Name, sym_info->NameLen));
             stack_frame.m_dw64OffsInSymbol = dwDisp64;
         }
 
@@ -720,7 +744,7 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
 
         if(bGetLine)
         {
-            stack_frame.m_sSrcFileName = line.FileName;
+            stack_frame.m_sSrcFileName = m_pArena->StrDup(strconv.a2t(line.FileName));
             stack_frame.m_nSrcLineNumber = line.LineNumber;
         }
 
@@ -734,7 +758,7 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
     {
         MdmpStackFrame& frame = m_DumpData.m_Threads[nThreadIndex].m_StackTrace[i];
 
-        if(frame.m_sSymbolName.IsEmpty())
+        if(frame.m_sSymbolName[0]==0)
             continue;
 
         CString sModuleName;
@@ -787,7 +811,6 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
 
     if(!sStackTrace.IsEmpty())
     {
-        strconv_t strconv;
         LPCSTR szStackTrace = strconv.t2utf8(sStackTrace);
         MD5 md5;
         MD5_CTX md5_ctx;
@@ -796,12 +819,14 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
         md5.MD5Update(&md5_ctx, (unsigned char*)szStackTrace, (unsigned int)strlen(szStackTrace));
         md5.MD5Final(md5_hash, &md5_ctx);
 
+        CString sMD5;
         for(i=0; i<16; i++)
         {
             CString number;
             number.Format(_T("%02x"), md5_hash[i]);
-            m_DumpData.m_Threads[nThreadIndex].m_sStackTraceMD5 += number;
+            sMD5 += number;
         }
+        m_DumpData.m_Threads[nThreadIndex].m_sStackTraceMD5 = m_pArena->StrDup(sMD5);
     }
 
     m_DumpData.m_Threads[nThreadIndex].m_bStackWalk = TRUE;
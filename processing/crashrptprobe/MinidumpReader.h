@@ -15,16 +15,19 @@ be found in the Authors.txt file in the root of the source tree.
 #include "dbghelp.h"
 #include <map>
 #include <vector>
+#include "ReportArena.h"
+#include "ProcessingStats.h"
 
 // Describes a loaded module
+// All strings are stored in the report arena.
 struct MdmpModule
 {
     ULONG64 m_uBaseAddr;   // Base address
     ULONG64 m_uImageSize;  // Size of module
-    CString m_sModuleName; // Module name
-    CString m_sImageName;  // The image name. The name may or may not contain a full path.
-    CString m_sLoadedImageName; // The full path and file name of the file from which symbols were loaded.
-    CString m_sLoadedPdbName;   // The full path and file name of the .pdb file.
+    LPCTSTR m_sModuleName; // Module name
+    LPCTSTR m_sImageName;  // The image name. The name may or may not contain a full path.
+    LPCTSTR m_sLoadedImageName; // The full path and file name of the file from which symbols were loaded.
+    LPCTSTR m_sLoadedPdbName;   // The full path and file name of the .pdb file.
     BOOL m_bImageUnmatched;     // If TRUE than there wasn't matching binary found.
     BOOL m_bPdbUnmatched;       // If TRUE than there wasn't matching PDB file found.
     BOOL m_bNoSymbolInfo;       // If TRUE than no symbols were generated for this module.
@@ -36,34 +39,41 @@ struct MdmpStackFrame
 {
     MdmpStackFrame()
     {
+        m_dwAddrPCOffset = 0;
         m_nModuleRowID = -1;
+        m_sSymbolName = _T("");
         m_dw64OffsInSymbol = 0;
+        m_sSrcFileName = _T("");
         m_nSrcLineNumber = -1;
     }
 
     DWORD64 m_dwAddrPCOffset;
     int m_nModuleRowID;         // ROWID of the record in CPR_MDMP_MODULES table.
-    CString m_sSymbolName;      // Name of symbol
+    LPCTSTR m_sSymbolName;      // Name of symbol
     DWORD64 m_dw64OffsInSymbol; // Offset in symbol
-    CString m_sSrcFileName;     // Name of source file
+    LPCTSTR m_sSrcFileName;     // Name of source file
     int m_nSrcLineNumber;       // Line number in the source file
 };
 
+typedef std::vector<MdmpStackFrame, CArenaAllocator<MdmpStackFrame> > MdmpStackTrace;
+
 // Describes a thread
 struct MdmpThread
 {
-    MdmpThread()
+    MdmpThread(CReportArena* pArena) :
+        m_StackTrace(CArenaAllocator<MdmpStackFrame>(pArena))
     {
         m_dwThreadId = 0;
         m_pThreadContext = NULL;
         m_bStackWalk = FALSE;
+        m_sStackTraceMD5 = _T("");
     }
 
     DWORD m_dwThreadId;        // Thread ID.
     CONTEXT* m_pThreadContext; // Thread context
     BOOL m_bStackWalk;         // Was stack trace retrieved for this thread?
-    CString m_sStackTraceMD5;
-    std::vector<MdmpStackFrame> m_StackTrace; // Stack trace for this thread.
+    LPCTSTR m_sStackTraceMD5;
+    MdmpStackTrace m_StackTrace; // Stack trace for this thread.
 };
 
 // Describes a memory range
@@ -75,16 +85,26 @@ struct MdmpMemRange
 };
 
 // Minidump data
+// Containers take their memory from the report arena, so they are released
+// all at once when the report is closed.
 struct MdmpData
 {
-    MdmpData()
+    MdmpData(CReportArena* pArena) :
+        m_Threads(CArenaAllocator<MdmpThread>(pArena)),
+        m_ThreadIndex(std::less<DWORD>(), CArenaAllocator<std::pair<const DWORD, size_t> >(pArena)),
+        m_Modules(CArenaAllocator<MdmpModule>(pArena)),
+        m_ModuleIndex(std::less<DWORD64>(), CArenaAllocator<std::pair<const DWORD64, size_t> >(pArena)),
+        m_MemRanges(CArenaAllocator<MdmpMemRange>(pArena)),
+        m_LoadLog(CArenaAllocator<LPCTSTR>(pArena))
     {
         m_hProcess = INVALID_HANDLE_VALUE;
         m_uProcessorArchitecture = 0;
+        m_uchNumberOfProcessors = 0;
         m_uchProductType = 0;
         m_ulVerMajor = 0;
         m_ulVerMinor = 0;
         m_ulVerBuild = 0;
+        m_sCSDVer = _T("");
         m_uExceptionCode = 0;
         m_uExceptionAddress = 0;
         m_uExceptionThreadId = 0;
@@ -99,19 +119,21 @@ struct MdmpData
     ULONG  m_ulVerMajor;             // OS major version number
     ULONG  m_ulVerMinor;             // OS minor version number
     ULONG  m_ulVerBuild;             // OS build number
-    CString m_sCSDVer;               // The latest service pack installed
+    LPCTSTR m_sCSDVer;               // The latest service pack installed
 
     ULONG32 m_uExceptionCode;        // Structured exception's code
     ULONG64 m_uExceptionAddress;     // Exception address
     ULONG32 m_uExceptionThreadId;    // Exceptions thread ID
     CONTEXT* m_pExceptionThreadContext; // Thread context
 
-    std::vector<MdmpThread> m_Threads;       // The list of threads.
-    std::map<DWORD, size_t> m_ThreadIndex;   // <thread_id, thread_entry_index> pairs
-    std::vector<MdmpModule> m_Modules;       // The list of loaded modules.
-    std::map<DWORD64, size_t> m_ModuleIndex; // <base_addr, module_entry_index> pairs
-    std::vector<MdmpMemRange> m_MemRanges;   // The list of memory ranges.
-    std::vector<CString> m_LoadLog; // Load log
+    std::vector<MdmpThread, CArenaAllocator<MdmpThread> > m_Threads;  // The list of threads.
+    std::map<DWORD, size_t, std::less<DWORD>,
+        CArenaAllocator<std::pair<const DWORD, size_t> > > m_ThreadIndex;     // <thread_id, thread_entry_index> pairs
+    std::vector<MdmpModule, CArenaAllocator<MdmpModule> > m_Modules;  // The list of loaded modules.
+    std::map<DWORD64, size_t, std::less<DWORD64>,
+        CArenaAllocator<std::pair<const DWORD64, size_t> > > m_ModuleIndex; // <base_addr, module_entry_index> pairs
+    std::vector<MdmpMemRange, CArenaAllocator<MdmpMemRange> > m_MemRanges; // The list of memory ranges.
+    std::vector<LPCTSTR, CArenaAllocator<LPCTSTR> > m_LoadLog; // Load log
 };
 
 // Class for opening minidumps
@@ -120,8 +142,10 @@ class CMiniDumpReader
 public:
 
     /* Construction/destruction */
-    CMiniDumpReader();
-    ~CMiniDumpReader();
+
+    // The reader is created inside the report arena (see CReportArena::Construct()),
+    // its destructor is not called. Call Close() to release system resources.
+    CMiniDumpReader(CReportArena* pArena);
 
     /* Operations */
 
@@ -141,6 +165,7 @@ public:
     int GetThreadRowIdByThreadId(DWORD dwThreadId);
 
     MdmpData m_DumpData; // Minidump data
+    CProcessingStats* m_pStats; // Where to accumulate stage timings (may be NULL)
 
     BOOL m_bLoaded;               // Is minidump loaded?
     BOOL m_bReadSysInfoStream;    // Was system info stream read?
@@ -154,7 +179,8 @@ private:
     /* Internally used member functions */
 
     // Helper function which extracts a UNICODE string from the minidump
-    CString GetMinidumpString(LPVOID pStartAddr, RVA rva);
+    // and copies it to the report arena
+    LPCTSTR GetMinidumpString(LPVOID pStartAddr, RVA rva);
 
     // Reads MINIDUMP_SYSTEM_INFO stream
     int ReadSysInfoStream();
@@ -173,8 +199,9 @@ private:
 
     /* Member variables */
 
-    CString m_sFileName;    // Minidump file name.
-    CString m_sSymSearchPath; // The list of symbol search dirs passed.
+    CReportArena* m_pArena; // Arena where report data is stored.
+    LPCTSTR m_sFileName;    // Minidump file name.
+    LPCTSTR m_sSymSearchPath; // The list of symbol search dirs passed.
     HANDLE m_hFileMiniDump; // Handle to opened .DMP file
     HANDLE m_hFileMapping;  // Handle to memory mapping object
     LPVOID m_pMiniDumpStartPtr; // Pointer to the biginning of memory-mapped minidump
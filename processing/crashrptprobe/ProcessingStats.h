@@ -0,0 +1,149 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ProcessingStats.h
+// Description: Per-stage timing of error report processing.
+
+#pragma once
+#include "stdafx.h"
+
+// Report processing stages. The order defines row order of the ProcessingStats table.
+enum CrpStage
+{
+    CRP_STAGE_MD5 = 0,     // Calculating MD5 hash of the ZIP file
+    CRP_STAGE_UNZIP,       // Extracting files from the ZIP archive
+    CRP_STAGE_XML_PARSE,   // Parsing crash description XML
+    CRP_STAGE_DUMP_MAP,    // Mapping the minidump and reading its streams
+    CRP_STAGE_SYM_LOAD,    // Symbol handler initialization and module loading
+    CRP_STAGE_STACK_WALK,  // Walking thread stacks
+    CRP_STAGE_COUNT
+};
+
+// CProcessingStats
+// Accumulates time spent in each processing stage of a single report.
+// Times are kept in performance counter ticks and converted on request.
+class CProcessingStats
+{
+public:
+
+    CProcessingStats()
+    {
+        int i;
+        for(i=0; i<CRP_STAGE_COUNT; i++)
+        {
+            m_llTicks[i] = 0;
+            m_uCalls[i] = 0;
+        }
+    }
+
+    // Adds time to the stage
+    void AddTicks(int nStage, LONGLONG llTicks)
+    {
+        m_llTicks[nStage] += llTicks;
+        m_uCalls[nStage]++;
+    }
+
+    // Returns total stage time in microseconds
+    ULONGLONG GetTimeUsec(int nStage) const
+    {
+        LARGE_INTEGER Freq;
+        QueryPerformanceFrequency(&Freq);
+        if(Freq.QuadPart==0)
+            return 0;
+        return (ULONGLONG)(m_llTicks[nStage]*1000000/Freq.QuadPart);
+    }
+
+    // Returns how many times the stage was entered
+    UINT GetCallCount(int nStage) const
+    {
+        return m_uCalls[nStage];
+    }
+
+    // Returns stage name as shown in the ProcessingStats table
+    static LPCTSTR GetStageName(int nStage)
+    {
+        static LPCTSTR szNames[CRP_STAGE_COUNT] =
+        {
+            _T("MD5"),
+            _T("Unzip"),
+            _T("XmlParse"),
+            _T("DumpMap"),
+            _T("SymLoad"),
+            _T("StackWalk")
+        };
+        return szNames[nStage];
+    }
+
+private:
+
+    LONGLONG m_llTicks[CRP_STAGE_COUNT]; // Accumulated ticks per stage
+    UINT m_uCalls[CRP_STAGE_COUNT];      // Enter count per stage
+};
+
+// CStageTimer
+// Adds the time elapsed between construction and Stop() (or destruction)
+// to the given stage, except the time between Pause() and Resume(). The
+// stage is entered once however many times the timer is paused.
+class CStageTimer
+{
+public:
+
+    CStageTimer(CProcessingStats* pStats, int nStage)
+    {
+        m_pStats = pStats;
+        m_nStage = nStage;
+        m_llElapsed = 0;
+        m_bPaused = FALSE;
+        QueryPerformanceCounter(&m_Start);
+    }
+
+    ~CStageTimer()
+    {
+        Stop();
+    }
+
+    void Pause()
+    {
+        if(m_pStats==NULL || m_bPaused)
+            return;
+
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        m_llElapsed += Now.QuadPart-m_Start.QuadPart;
+        m_bPaused = TRUE;
+    }
+
+    void Resume()
+    {
+        if(m_pStats==NULL || !m_bPaused)
+            return;
+
+        QueryPerformanceCounter(&m_Start);
+        m_bPaused = FALSE;
+    }
+
+    void Stop()
+    {
+        if(m_pStats==NULL)
+            return;
+
+        Pause();
+        m_pStats->AddTicks(m_nStage, m_llElapsed);
+        m_pStats = NULL;
+    }
+
+private:
+
+    CProcessingStats* m_pStats;
+    int m_nStage;
+    LARGE_INTEGER m_Start;
+    LONGLONG m_llElapsed; // Ticks counted before the last Pause()
+    BOOL m_bPaused;
+};
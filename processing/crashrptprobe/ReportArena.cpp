@@ -0,0 +1,137 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ReportArena.cpp
+// Description: Arena (region) allocator used for storing per-report data.
+
+#include "stdafx.h"
+#include "ReportArena.h"
+
+// Size of a regular arena block. Allocations larger than a quarter of the block
+// get a dedicated block so that the tail of the current block is not wasted.
+#define ARENA_BLOCK_SIZE (64*1024)
+
+// Alignment of every allocation.
+#define ARENA_ALIGNMENT (sizeof(void*)*2)
+
+CReportArena::CReportArena()
+{
+    m_hHeap = NULL;
+    m_pCur = NULL;
+    m_pEnd = NULL;
+    m_cbAllocated = 0;
+    m_uBlockCount = 0;
+}
+
+CReportArena::~CReportArena()
+{
+    Release();
+}
+
+BOOL CReportArena::NewBlock(size_t cbSize)
+{
+    if(m_hHeap==NULL)
+    {
+        // Create a private growable heap. It is not shared with other reports,
+        // so threads processing different reports do not contend for the
+        // process heap lock.
+        m_hHeap = HeapCreate(0, ARENA_BLOCK_SIZE, 0);
+        if(m_hHeap==NULL)
+            return FALSE;
+    }
+
+    LPBYTE pBlock = (LPBYTE)HeapAlloc(m_hHeap, 0, cbSize);
+    if(pBlock==NULL)
+        return FALSE;
+
+    m_uBlockCount++;
+    m_pCur = pBlock;
+    m_pEnd = pBlock + cbSize;
+    return TRUE;
+}
+
+LPVOID CReportArena::Alloc(size_t cbSize)
+{
+    // Round the size up to alignment boundary
+    size_t cbAligned = (cbSize + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if(cbAligned==0)
+        cbAligned = ARENA_ALIGNMENT;
+
+    if(cbAligned>ARENA_BLOCK_SIZE/4)
+    {
+        // Large allocation (a big vector buffer) - give it a dedicated block
+        // and keep the tail of the current block for small allocations.
+        LPBYTE pSavedCur = m_pCur;
+        LPBYTE pSavedEnd = m_pEnd;
+        if(!NewBlock(cbAligned))
+            return NULL;
+        LPVOID p = m_pCur;
+        m_pCur = pSavedCur;
+        m_pEnd = pSavedEnd;
+        m_cbAllocated += cbAligned;
+        return p;
+    }
+
+    if(m_pCur==NULL || (size_t)(m_pEnd-m_pCur)<cbAligned)
+    {
+        if(!NewBlock(ARENA_BLOCK_SIZE))
+            return NULL;
+    }
+
+    LPVOID p = m_pCur;
+    m_pCur += cbAligned;
+    m_cbAllocated += cbAligned;
+    return p;
+}
+
+LPCTSTR CReportArena::StrDup(LPCTSTR pszStr)
+{
+    if(pszStr==NULL)
+        pszStr = _T("");
+
+    return StrDup(pszStr, _tcslen(pszStr));
+}
+
+LPCTSTR CReportArena::StrDup(LPCTSTR pszStr, size_t cchLen)
+{
+    LPTSTR pszCopy = (LPTSTR)Alloc((cchLen+1)*sizeof(TCHAR));
+    if(pszCopy==NULL)
+        return _T("");
+
+    if(cchLen!=0)
+        memcpy(pszCopy, pszStr, cchLen*sizeof(TCHAR));
+    pszCopy[cchLen] = 0;
+    return pszCopy;
+}
+
+void CReportArena::Release()
+{
+    if(m_hHeap!=NULL)
+    {
+        // All blocks are freed with a single call.
+        HeapDestroy(m_hHeap);
+        m_hHeap = NULL;
+    }
+
+    m_pCur = NULL;
+    m_pEnd = NULL;
+    m_cbAllocated = 0;
+    m_uBlockCount = 0;
+}
+
+size_t CReportArena::GetAllocatedSize()
+{
+    return m_cbAllocated;
+}
+
+UINT CReportArena::GetBlockCount()
+{
+    return m_uBlockCount;
+}
@@ -0,0 +1,167 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ReportArena.h
+// Description: Arena (region) allocator used for storing per-report data.
+
+#pragma once
+#include "stdafx.h"
+#include <new>
+
+// CReportArena
+// Owns a private heap and hands out memory from large blocks with a pointer bump.
+// Individual allocations are never freed; the whole arena is released at once
+// when the report is closed (one HeapDestroy() call instead of freeing every
+// string, vector and map node separately).
+class CReportArena
+{
+public:
+
+    // Construction/destruction
+    CReportArena();
+    ~CReportArena();
+
+    // Allocates a memory block aligned to pointer size. Returns NULL on failure.
+    LPVOID Alloc(size_t cbSize);
+
+    // Copies a string into the arena. NULL is copied as an empty string.
+    LPCTSTR StrDup(LPCTSTR pszStr);
+
+    // Copies first cchLen characters of a string into the arena.
+    LPCTSTR StrDup(LPCTSTR pszStr, size_t cchLen);
+
+    // Constructs an object of type T inside the arena. T's constructor receives
+    // pointer to this arena. The object's destructor is never called, so T must
+    // keep all its data inside the arena.
+    template<class T>
+    T* Construct()
+    {
+        LPVOID p = Alloc(sizeof(T));
+        if(p==NULL)
+            return NULL;
+        return new(p) T(this);
+    }
+
+    // Releases all memory allocated from this arena at once.
+    void Release();
+
+    // Returns the number of bytes allocated from the arena so far.
+    size_t GetAllocatedSize();
+
+    // Returns the number of heap blocks owned by the arena.
+    UINT GetBlockCount();
+
+private:
+
+    // Disable copying
+    CReportArena(const CReportArena&);
+    CReportArena& operator=(const CReportArena&);
+
+    // Takes a new block of cbSize bytes from the private heap and makes it current.
+    BOOL NewBlock(size_t cbSize);
+
+    HANDLE m_hHeap;         // Private heap that owns all blocks.
+    LPBYTE m_pCur;          // Current position in the current block.
+    LPBYTE m_pEnd;          // End of the current block.
+    size_t m_cbAllocated;   // Total bytes handed out.
+    UINT   m_uBlockCount;   // Count of blocks taken from the heap.
+};
+
+// CArenaAllocator
+// STL-compatible allocator that takes memory from a CReportArena.
+// deallocate() does nothing, because memory is released with the arena.
+template<class T>
+class CArenaAllocator
+{
+public:
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind
+    {
+        typedef CArenaAllocator<U> other;
+    };
+
+    CArenaAllocator(CReportArena* pArena=NULL)
+    {
+        m_pArena = pArena;
+    }
+
+    template<class U>
+    CArenaAllocator(const CArenaAllocator<U>& other)
+    {
+        m_pArena = other.m_pArena;
+    }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    pointer allocate(size_type n, const void* /*hint*/=0)
+    {
+        // Containers may allocate with default-constructed allocators (for example, the
+        // sentinel node in some STL implementations); use process heap in that case.
+        LPVOID p = m_pArena!=NULL ? m_pArena->Alloc(n*sizeof(T)) : ::operator new(n*sizeof(T));
+        if(p==NULL)
+            throw std::bad_alloc();
+        return (pointer)p;
+    }
+
+    void deallocate(pointer p, size_type /*n*/)
+    {
+        if(m_pArena==NULL)
+            ::operator delete(p);
+        // Otherwise the memory is released together with the arena.
+    }
+
+    size_type max_size() const
+    {
+        return ((size_t)-1)/sizeof(T);
+    }
+
+    void construct(pointer p, const T& val)
+    {
+        new((void*)p) T(val);
+    }
+
+    void destroy(pointer p)
+    {
+        p->~T();
+    }
+
+    CReportArena* m_pArena;
+};
+
+template<class T, class U>
+inline bool operator==(const CArenaAllocator<T>& a, const CArenaAllocator<U>& b)
+{
+    return a.m_pArena==b.m_pArena;
+}
+
+template<class T, class U>
+inline bool operator!=(const CArenaAllocator<T>& a, const CArenaAllocator<U>& b)
+{
+    return a.m_pArena!=b.m_pArena;
+}
+
+// Compares arena strings by value (used as a map key predicate).
+struct CArenaStrLess
+{
+    bool operator()(LPCTSTR a, LPCTSTR b) const
+    {
+        return _tcscmp(a, b)<0;
+    }
+};
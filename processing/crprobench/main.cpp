@@ -0,0 +1,564 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: main.cpp
+// Description: crprobench application. Measures error report processing speed
+// (CrashRptProbe API and crprober) on a directory of error reports, for example
+// the ones generated by processing/scripts/gen_synthetic_reports.py.
+
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "CrashRptProbe.h"
+
+// Character set independent string type
+typedef std::basic_string<TCHAR> tstring;
+
+// The following macros are used for parsing the command line
+#define args_left() (argc-cur_arg)
+#define arg_exists() (cur_arg<argc && argv[cur_arg]!=NULL)
+#define get_arg() ( arg_exists() ? argv[cur_arg]:NULL )
+#define skip_arg() cur_arg++
+#define cmp_arg(val) (arg_exists() && (0==_tcscmp(argv[cur_arg], val)))
+
+// Return codes
+enum ReturnCode
+{
+    SUCCESS     = 0, // OK
+    UNEXPECTED  = 1, // Unexpected error
+    INVALIDARG  = 2, // Invalid argument
+    REGRESSION  = 3  // Some stage exceeded its time threshold
+};
+
+// Measured stages
+enum BenchStage
+{
+    STAGE_OPEN = 0,     // crpOpenErrorReport()
+    STAGE_STACK,        // Stack walk of all threads
+    STAGE_PROPS,        // A batch of crpGetProperty() calls
+    STAGE_EXTRACT,      // crpExtractFile() for every file
+    STAGE_CRPROBER,     // The whole crprober run
+    STAGE_COUNT
+};
+
+LPCTSTR g_szStageNames[STAGE_COUNT] =
+{
+    _T("open"),
+    _T("stack"),
+    _T("props"),
+    _T("extract"),
+    _T("crprober")
+};
+
+// Count of crpGetProperty() calls made in the STAGE_PROPS stage
+#define PROPS_PER_ITERATION 1000
+
+// Monotonic timer
+class CBenchTimer
+{
+public:
+
+    CBenchTimer()
+    {
+        QueryPerformanceFrequency(&m_Freq);
+        Start();
+    }
+
+    void Start()
+    {
+        QueryPerformanceCounter(&m_Start);
+    }
+
+    // Returns milliseconds elapsed since Start()
+    double GetElapsedMsec()
+    {
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        return (double)(Now.QuadPart-m_Start.QuadPart)*1000.0/(double)m_Freq.QuadPart;
+    }
+
+private:
+
+    LARGE_INTEGER m_Freq;
+    LARGE_INTEGER m_Start;
+};
+
+// Options
+struct BenchOptions
+{
+    tstring sInputDir;     // Directory containing report ZIP files
+    tstring sSymPath;      // Symbol search path
+    tstring sCrprober;     // Path to crprober.exe; if empty, the crprober stage is skipped
+    tstring sTempDir;      // Where to extract files
+    int nIterations;       // How many times to process every report
+    double dThreshold[STAGE_COUNT]; // Max allowed median time per stage (msec), or 0
+};
+
+// Per-stage samples
+std::vector<double> g_Samples[STAGE_COUNT];
+
+// Prints usage
+void print_usage()
+{
+    _tprintf(_T("Usage:\n"));
+    _tprintf(_T("crprobench /? Prints this usage help\n"));
+    _tprintf(_T("crprobench /d <report_dir> [arg ...]\n"));
+    _tprintf(_T("  where the argument may be any of the following:\n"));
+    _tprintf(_T("   /d <report_dir>          Required. Directory containing error report ZIP files.\n"));
+    _tprintf(_T("   /sym <sym_search_dirs>   Optional. Symbol search path. By default, an empty local directory is used, ")\
+             _T("so no symbol server is contacted.\n"));
+    _tprintf(_T("   /crprober <exe_path>     Optional. Path to crprober executable; if specified, a full crprober run ")\
+             _T("is timed for every report.\n"));
+    _tprintf(_T("   /n <iterations>          Optional. How many times to process every report (default is 3).\n"));
+    _tprintf(_T("   /max <stage> <msec>      Optional. Fails with exit code 3 if the median time of the stage exceeds ")\
+             _T("the threshold. Stage is one of: open, stack, props, extract, crprober. May be repeated.\n"));
+}
+
+// Returns the row count of the table, or negative value on error
+int get_table_row_count(CrpHandle hReport, LPCTSTR table_id)
+{
+    return crpGetProperty(hReport, table_id, CRP_META_ROW_COUNT, 0, NULL, 0, NULL);
+}
+
+// Prints the last CrashRptProbe error
+void print_last_error(LPCTSTR szFileName)
+{
+    TCHAR szErr[1024];
+    crpGetLastErrorMsg(szErr, 1024);
+    _tprintf(_T("Error '%s' while processing file '%s'\n"), szErr, szFileName);
+}
+
+// Walks the stack of every thread in the minidump
+int bench_stack_walk(CrpHandle hReport)
+{
+    int nThreads = get_table_row_count(hReport, CRP_TBL_MDMP_THREADS);
+    if(nThreads<0)
+        return -1;
+
+    int i;
+    for(i=0; i<nThreads; i++)
+    {
+        TCHAR szStackTableId[128];
+        int res = crpGetProperty(hReport, CRP_TBL_MDMP_THREADS, CRP_COL_THREAD_STACK_TABLEID,
+            i, szStackTableId, 128, NULL);
+        if(res!=0)
+            return -1;
+
+        // Requesting the row count makes the stack to be walked
+        if(get_table_row_count(hReport, szStackTableId)<0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Retrieves a batch of properties from different tables
+int bench_get_props(CrpHandle hReport)
+{
+    LPCTSTR aMiscCols[] =
+    {
+        CRP_COL_CRASH_GUID,
+        CRP_COL_APP_NAME,
+        CRP_COL_APP_VERSION,
+        CRP_COL_EXCEPTION_CODE,
+        CRP_COL_OPERATING_SYSTEM
+    };
+    const int nMiscCols = sizeof(aMiscCols)/sizeof(aMiscCols[0]);
+
+    int nModules = get_table_row_count(hReport, CRP_TBL_MDMP_MODULES);
+    if(nModules<=0)
+        return -1;
+
+    int i;
+    for(i=0; i<PROPS_PER_ITERATION; i++)
+    {
+        TCHAR szBuffer[1024];
+        int res = 0;
+        if(i%2==0)
+            res = crpGetProperty(hReport, CRP_TBL_XMLDESC_MISC, aMiscCols[(i/2)%nMiscCols],
+                0, szBuffer, 1024, NULL);
+        else
+            res = crpGetProperty(hReport, CRP_TBL_MDMP_MODULES, CRP_COL_MODULE_NAME,
+                (i/2)%nModules, szBuffer, 1024, NULL);
+        // Some optional columns may be missing in the report; only unexpected errors count.
+        if(res<0 && i%2!=0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// Extracts every file contained in the report
+int bench_extract(CrpHandle hReport, LPCTSTR szTempDir)
+{
+    int nFiles = get_table_row_count(hReport, CRP_TBL_XMLDESC_FILE_ITEMS);
+    if(nFiles<0)
+        return -1;
+
+    int i;
+    for(i=0; i<nFiles; i++)
+    {
+        TCHAR szFileName[MAX_PATH];
+        int res = crpGetProperty(hReport, CRP_TBL_XMLDESC_FILE_ITEMS, CRP_COL_FILE_ITEM_NAME,
+            i, szFileName, MAX_PATH, NULL);
+        if(res!=0)
+            return -1;
+
+        tstring sSaveAs = tstring(szTempDir) + _T("\\") + szFileName;
+        res = crpExtractFile(hReport, szFileName, sSaveAs.c_str(), TRUE);
+        if(res!=0)
+            return -1;
+        DeleteFile(sSaveAs.c_str());
+    }
+
+    return 0;
+}
+
+// Runs crprober on the report and waits for it to finish
+int bench_crprober(LPCTSTR szCrprober, LPCTSTR szReport, LPCTSTR szSymPath, LPCTSTR szTempDir)
+{
+    tstring sOutFile = tstring(szTempDir) + _T("\\crprober_out.txt");
+    tstring sCmdLine = tstring(_T("\"")) + szCrprober + _T("\" /f \"") + szReport +
+        _T("\" /o \"") + sOutFile + _T("\" /sym \"") + szSymPath + _T("\"");
+
+    std::vector<TCHAR> aCmdLine(sCmdLine.begin(), sCmdLine.end());
+    aCmdLine.push_back(0);
+
+    STARTUPINFO si;
+    memset(&si, 0, sizeof(STARTUPINFO));
+    si.cb = sizeof(STARTUPINFO);
+    PROCESS_INFORMATION pi;
+    memset(&pi, 0, sizeof(PROCESS_INFORMATION));
+
+    if(!CreateProcess(NULL, &aCmdLine[0], NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi))
+        return -1;
+
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD dwExitCode = 1;
+    GetExitCodeProcess(pi.hProcess, &dwExitCode);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    DeleteFile(sOutFile.c_str());
+
+    return dwExitCode==0?0:-1;
+}
+
+// Processes a single report one time and records per-stage times
+int bench_report(BenchOptions& opts, LPCTSTR szReport)
+{
+    int result = UNEXPECTED;
+    CrpHandle hReport = 0;
+    CBenchTimer timer;
+    double dElapsed[STAGE_COUNT];
+    int i;
+    for(i=0; i<STAGE_COUNT; i++)
+        dElapsed[i] = 0;
+
+    // Read MD5 hash from the .md5 file, if exists
+    TCHAR szMD5Buffer[64] = _T("");
+    TCHAR* szMD5Hash = NULL;
+    tstring sMD5FileName = tstring(szReport) + _T(".md5");
+    FILE* f = NULL;
+#if _MSC_VER<1400
+    f = _tfopen(sMD5FileName.c_str(), _T("rt"));
+#else
+    _tfopen_s(&f, sMD5FileName.c_str(), _T("rt"));
+#endif
+    if(f!=NULL)
+    {
+        szMD5Hash = _fgetts(szMD5Buffer, 64, f);
+        fclose(f);
+    }
+
+    timer.Start();
+    if(0!=crpOpenErrorReport(szReport, szMD5Hash, opts.sSymPath.c_str(), 0, &hReport))
+    {
+        print_last_error(szReport);
+        goto cleanup;
+    }
+    dElapsed[STAGE_OPEN] = timer.GetElapsedMsec();
+
+    timer.Start();
+    if(0!=bench_stack_walk(hReport))
+    {
+        print_last_error(szReport);
+        goto cleanup;
+    }
+    dElapsed[STAGE_STACK] = timer.GetElapsedMsec();
+
+    timer.Start();
+    if(0!=bench_get_props(hReport))
+    {
+        print_last_error(szReport);
+        goto cleanup;
+    }
+    dElapsed[STAGE_PROPS] = timer.GetElapsedMsec();
+
+    timer.Start();
+    if(0!=bench_extract(hReport, opts.sTempDir.c_str()))
+    {
+        print_last_error(szReport);
+        goto cleanup;
+    }
+    dElapsed[STAGE_EXTRACT] = timer.GetElapsedMsec();
+
+    crpCloseErrorReport(hReport);
+    hReport = 0;
+
+    if(!opts.sCrprober.empty())
+    {
+        timer.Start();
+        if(0!=bench_crprober(opts.sCrprober.c_str(), szReport, opts.sSymPath.c_str(), opts.sTempDir.c_str()))
+        {
+            _tprintf(_T("Error: crprober failed on file '%s'\n"), szReport);
+            goto cleanup;
+        }
+        dElapsed[STAGE_CRPROBER] = timer.GetElapsedMsec();
+    }
+
+    for(i=0; i<STAGE_COUNT; i++)
+    {
+        if(i==STAGE_CRPROBER && opts.sCrprober.empty())
+            continue;
+        g_Samples[i].push_back(dElapsed[i]);
+    }
+
+    result = SUCCESS;
+
+cleanup:
+
+    if(hReport!=0)
+        crpCloseErrorReport(hReport);
+
+    return result;
+}
+
+// Returns the value at the given percentile (0..100) of sorted samples
+double get_percentile(const std::vector<double>& aSorted, int nPercent)
+{
+    if(aSorted.empty())
+        return 0;
+    size_t nIndex = (aSorted.size()-1)*nPercent/100;
+    return aSorted[nIndex];
+}
+
+// Prints the summary table and checks regression thresholds
+int print_summary(BenchOptions& opts)
+{
+    int result = SUCCESS;
+
+    _tprintf(_T("\n%-10s %8s %10s %10s %10s %10s %10s\n"),
+        _T("stage"), _T("samples"), _T("min,ms"), _T("p50,ms"), _T("p90,ms"), _T("max,ms"), _T("limit,ms"));
+
+    int i;
+    for(i=0; i<STAGE_COUNT; i++)
+    {
+        std::vector<double> aSorted = g_Samples[i];
+        if(aSorted.empty())
+            continue;
+        std::sort(aSorted.begin(), aSorted.end());
+
+        double dMedian = get_percentile(aSorted, 50);
+        _tprintf(_T("%-10s %8d %10.3f %10.3f %10.3f %10.3f "),
+            g_szStageNames[i], (int)aSorted.size(), aSorted.front(), dMedian,
+            get_percentile(aSorted, 90), aSorted.back());
+
+        if(opts.dThreshold[i]>0)
+        {
+            _tprintf(_T("%10.3f"), opts.dThreshold[i]);
+            if(dMedian>opts.dThreshold[i])
+            {
+                _tprintf(_T(" REGRESSION"));
+                result = REGRESSION;
+            }
+        }
+        else
+        {
+            _tprintf(_T("%10s"), _T("-"));
+        }
+        _tprintf(_T("\n"));
+    }
+
+    return result;
+}
+
+// Creates an empty temporary directory and returns its path
+BOOL create_temp_dir(LPCTSTR szName, tstring& sDir)
+{
+    TCHAR szTempPath[MAX_PATH];
+    if(0==GetTempPath(MAX_PATH, szTempPath))
+        return FALSE;
+
+    TCHAR szDir[MAX_PATH];
+    _sntprintf_s(szDir, MAX_PATH, _TRUNCATE, _T("%s%s%lu"), szTempPath, szName, GetCurrentProcessId());
+    if(!CreateDirectory(szDir, NULL) && GetLastError()!=ERROR_ALREADY_EXISTS)
+        return FALSE;
+
+    sDir = szDir;
+    return TRUE;
+}
+
+// Program entry point
+int _tmain(int argc, TCHAR** argv)
+{
+    int result = INVALIDARG; // Return code
+    int cur_arg = 1; // Current cmdline argument being processed
+    BenchOptions opts;
+    std::vector<tstring> aReports;
+    tstring sSymDir;
+    HANDLE hFind = INVALID_HANDLE_VALUE;
+    WIN32_FIND_DATA fd;
+    int i;
+
+    opts.nIterations = 3;
+    for(i=0; i<STAGE_COUNT; i++)
+        opts.dThreshold[i] = 0;
+
+    if(args_left()==0)
+        goto done; // There are no arguments.
+
+    // Parse command line arguments
+    while(arg_exists())
+    {
+        if(cmp_arg(_T("/?")))
+        {
+            result = SUCCESS;
+            print_usage();
+            goto done;
+        }
+        else if(cmp_arg(_T("/d")) || cmp_arg(_T("/sym")) || cmp_arg(_T("/crprober")) || cmp_arg(_T("/n")))
+        {
+            LPCTSTR szName = get_arg();
+            skip_arg();
+            LPCTSTR szValue = get_arg();
+            skip_arg();
+            if(szValue==NULL)
+            {
+                _tprintf(_T("Missing value of %s parameter.\n"), szName);
+                goto done;
+            }
+
+            if(_tcscmp(szName, _T("/d"))==0)
+                opts.sInputDir = szValue;
+            else if(_tcscmp(szName, _T("/sym"))==0)
+                opts.sSymPath = szValue;
+            else if(_tcscmp(szName, _T("/crprober"))==0)
+                opts.sCrprober = szValue;
+            else
+                opts.nIterations = _ttoi(szValue);
+        }
+        else if(cmp_arg(_T("/max")))
+        {
+            skip_arg();
+            LPCTSTR szStage = get_arg();
+            skip_arg();
+            LPCTSTR szLimit = get_arg();
+            skip_arg();
+            if(szStage==NULL || szLimit==NULL)
+            {
+                _tprintf(_T("Missing stage name or threshold in /max parameter.\n"));
+                goto done;
+            }
+
+            int nStage = -1;
+            for(i=0; i<STAGE_COUNT; i++)
+            {
+                if(_tcscmp(szStage, g_szStageNames[i])==0)
+                    nStage = i;
+            }
+            if(nStage<0)
+            {
+                _tprintf(_T("Unknown stage name in /max parameter: %s\n"), szStage);
+                goto done;
+            }
+            opts.dThreshold[nStage] = _tstof(szLimit);
+        }
+        else // unknown arg
+        {
+            _tprintf(_T("Unexpected parameter: %s\n"), get_arg());
+            goto done;
+        }
+    }
+
+    if(opts.sInputDir.empty() || opts.nIterations<=0)
+    {
+        _tprintf(_T("Report directory is missing or iteration count is invalid.\n"));
+        goto done;
+    }
+
+    result = UNEXPECTED;
+
+    if(!create_temp_dir(_T("crprobench"), opts.sTempDir))
+    {
+        _tprintf(_T("Error: couldn't create temporary directory.\n"));
+        goto done;
+    }
+
+    if(opts.sSymPath.empty())
+    {
+        // Use an empty local directory as the symbol search path. This way
+        // dbghelp does not fall back to _NT_SYMBOL_PATH, which may point to
+        // a symbol server, and the benchmark measures the processing code only.
+        if(!create_temp_dir(_T("crprobench_sym"), sSymDir))
+        {
+            _tprintf(_T("Error: couldn't create symbol directory.\n"));
+            goto done;
+        }
+        opts.sSymPath = sSymDir;
+    }
+
+    // Enumerate reports
+    hFind = FindFirstFile((opts.sInputDir + _T("\\*.zip")).c_str(), &fd);
+    if(hFind!=INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            aReports.push_back(opts.sInputDir + _T("\\") + fd.cFileName);
+        }
+        while(FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+
+    if(aReports.empty())
+    {
+        _tprintf(_T("Error: no ZIP files found in '%s'.\n"), opts.sInputDir.c_str());
+        goto done;
+    }
+
+    _tprintf(_T("Processing %d reports, %d iteration(s) each...\n"), (int)aReports.size(), opts.nIterations);
+
+    int nIter;
+    for(nIter=0; nIter<opts.nIterations; nIter++)
+    {
+        size_t j;
+        for(j=0; j<aReports.size(); j++)
+        {
+            if(SUCCESS!=bench_report(opts, aReports[j].c_str()))
+                goto done;
+        }
+    }
+
+    result = print_summary(opts);
+
+done:
+
+    if(!opts.sTempDir.empty())
+        RemoveDirectory(opts.sTempDir.c_str());
+    if(!sSymDir.empty())
+        RemoveDirectory(sSymDir.c_str());
+
+    if(result==INVALIDARG)
+        print_usage();
+
+    return result;
+}
@@ -18,8 +18,11 @@ be found in the Authors.txt file in the root of the source tree.
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <map>
+#include <algorithm>
 #include <assert.h>
 #include "CrashRptProbe.h"
+#include "md5.h"
 
 // Character set independent string type
 typedef std::basic_string<TCHAR> tstring;
@@ -41,12 +44,33 @@ enum ReturnCode
     EXTRACTERR  = 4  // File extraction error
 };
 
+// Results of batch integrity check
+enum MD5Status
+{
+    MD5_NOT_CHECKED = 0, // There is no .md5 file, or the file couldn't be read
+    MD5_MATCH       = 1, // Hash is correct
+    MD5_MISMATCH    = 2  // Hash is wrong
+};
+
 // Function prototypes
 int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
-                   LPTSTR szSymSearchPath, LPTSTR szExtractPath, LPTSTR szTableId, LPTSTR szColumnId, LPTSTR szRowId);
+                   LPTSTR szSymSearchPath, LPTSTR szExtractPath, LPTSTR szTableId, LPTSTR szColumnId, LPTSTR szRowId,
+                   BOOL bMD5Checked=FALSE, BOOL bAppendOutput=FALSE);
+tstring get_md5_file_name(LPCTSTR szInput, LPCTSTR szInputMD5);
+BOOL read_md5_hash(LPCTSTR szMD5FileName, TCHAR* szBuffer, int nBufferSize);
+void check_md5_batch(const std::vector<tstring>& aFiles, LPCTSTR szInputMD5, std::vector<int>& aStatus);
 int get_prop(CrpHandle hReport, LPCTSTR table_id, LPCTSTR column_id, tstring& str, int row_id=0);
 int output_document(CrpHandle hReport, FILE* f);
 int extract_files(CrpHandle hReport, LPCTSTR pszExtractPath);
+int process_batch(LPTSTR szInputPattern, LPTSTR szInputMD5, LPTSTR szOutput,
+                  LPTSTR szSymSearchPath, LPTSTR szExtractPath, LPTSTR szTableId, LPTSTR szColumnId, LPTSTR szRowId);
+void collect_stats(CrpHandle hReport);
+void print_stats_summary();
+
+// Processing stage times collected from all processed reports (/stats parameter)
+BOOL g_bCollectStats = FALSE;
+std::vector<tstring> g_StageNames; // Stage names in table order
+std::map<tstring, std::vector<double> > g_StageTimes; // Stage name -> times, in msec
 
 // We want to use secure version of _stprintf function when possible
 int __STPRINTF_S(TCHAR* buffer, size_t sizeOfBuffer, const TCHAR* format, ... )
@@ -76,7 +100,8 @@ void print_usage()
     _tprintf(_T("crprober /? Prints this usage help\n"));
     _tprintf(_T("crprober <arg> [arg ...]\n"));
     _tprintf(_T("  where the argument may be any of the following:\n"));
-    _tprintf(_T("   /f <input_file>          Required. Absolute or relative path to input ZIP file name.\n"));
+    _tprintf(_T("   /f <input_file>          Required. Absolute or relative path to input ZIP file name. ")\
+             _T("May contain wildcards (for example, reports\\*.zip) to process a batch of files.\n"));
     _tprintf(_T("   /fmd5 <md5_file_or_dir>  Optional. Path to .md5 file containing MD5 hash for the <input_file> ")\
              _T("or directory name where to search for the .md5 file. If this parameter is omitted, the .md5 file is searched "\)
              _T("in the directory where <input_file> is located.\n"));
@@ -88,6 +113,8 @@ void print_usage()
              _T("If this parameter is omitted, files are not extracted.\n"));
     _tprintf(_T("   /get <table_id> <column_id> <row_id> Optional. Specifies the table ID, column ID and row index of the property to retrieve. ")\
              _T("If this parameter specified, the property is written to the output file or to terminal, as defined by /o parameter.\n"));
+    _tprintf(_T("   /stats                   Optional. Prints percentiles of time spent in each processing stage ")\
+             _T("over all processed files, and adds stage times to the output of each file.\n"));
 }
 
 // COutputter
@@ -251,6 +278,11 @@ int _tmain(int argc, TCHAR** argv)
                 goto done;
             }
         }
+        else if(cmp_arg(_T("/stats"))) // print processing stage statistics
+        {
+            skip_arg();
+            g_bCollectStats = TRUE;
+        }
         else // unknown arg
         {
             _tprintf(_T("Unexpected parameter: %s\n"), get_arg());
@@ -259,8 +291,19 @@ int _tmain(int argc, TCHAR** argv)
     }
 
     // Do the processing work
-    result = process_report(szInput, szInputMD5, szOutput, szSymSearchPath,
-        szExtractPath, szTableId, szColumnId, szRowId);
+    if(szInput!=NULL && _tcspbrk(szInput, _T("*?"))!=NULL)
+    {
+        result = process_batch(szInput, szInputMD5, szOutput, szSymSearchPath,
+            szExtractPath, szTableId, szColumnId, szRowId);
+    }
+    else
+    {
+        result = process_report(szInput, szInputMD5, szOutput, szSymSearchPath,
+            szExtractPath, szTableId, szColumnId, szRowId);
+    }
+
+    if(g_bCollectStats && result!=INVALIDARG)
+        print_stats_summary();
 
 done:
 
@@ -273,20 +316,20 @@ done:
 }
 
 
-// Processes a crash report file.
+// Processes a crash report file. If bMD5Checked is set, the hash has been
+// checked by check_md5_batch() already. If bAppendOutput is set, output is
+// appended to the output file instead of overwriting it.
 int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
                    LPTSTR szSymSearchPath, LPTSTR szExtractPath, LPTSTR szTableId,
-                   LPTSTR szColumnId, LPTSTR szRowId)
+                   LPTSTR szColumnId, LPTSTR szRowId, BOOL bMD5Checked, BOOL bAppendOutput)
 {
     int result = UNEXPECTED; // Status
     CrpHandle hReport = 0; // Handle to the error report
     tstring sInDirName;
     tstring sInFileName;
     tstring sOutDirName;
-    tstring sMD5DirName;
     tstring sMD5FileName;
     tstring sExtactDirName;
-    BOOL bInputMD5FromDir = FALSE; // Did user specified file name for .MD5 file or directory name for search?
     BOOL bOutputToDir = FALSE; // Do we save resulting files to directory or save single resulting file?
     DWORD dwFileAttrs = 0;
     TCHAR szMD5Buffer[64]=_T("");
@@ -301,7 +344,7 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
         goto done;
     }
 
-    if(szTableId==NULL && szOutput==NULL && szExtractPath==NULL)
+    if(szTableId==NULL && szOutput==NULL && szExtractPath==NULL && !g_bCollectStats)
     {
         result = INVALIDARG;
         _tprintf(_T("Output file name or directory name is missing.\n"));
@@ -335,32 +378,6 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
         }
     }
 
-    if(szInputMD5!=NULL)
-    {
-        // Determine if user wants us to search for .MD5 files in a directory
-        // or if he specifies the .MD5 file name.
-        dwFileAttrs = GetFileAttributes(szInputMD5);
-        if(dwFileAttrs!=INVALID_FILE_ATTRIBUTES &&
-            (dwFileAttrs&FILE_ATTRIBUTE_DIRECTORY))
-            bInputMD5FromDir = TRUE;
-
-        // Append the last back slash to the MD5 dir name if needed
-        if(bInputMD5FromDir)
-        {
-            sMD5DirName = szInputMD5;
-            size_t pos = sMD5DirName.rfind('\\');
-            if(pos< tstring::npos) // There is no back slash in path
-                sMD5DirName = _T("");
-            else if(pos!=sMD5DirName.length()-1) // Append the back slash to dir name
-                sMD5DirName = sMD5DirName.substr(0, pos+1);
-        }
-    }
-    else
-    {
-        // Assume .md5 files are in the same dir as input file
-        sMD5DirName = sInDirName;
-    }
-
     if(szOutput!=NULL && _tcscmp(szOutput, _T(""))!=0) // If empty, direct output to terminal
     {
         // Determine if user wants us to save resulting file in directory using its respective
@@ -373,34 +390,11 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
 
     //_tprintf(_T("Processing file: %s\n"), sInFileName.c_str());
 
-    // Decide MD5 file name
-    if(szInputMD5==NULL)
-    {
-        // If /md5 cmdline argument is omitted, search for md5 files in the same dir
-        sMD5FileName = szInput;
-        sMD5FileName += _T(".md5");
-    }
-    else
-    {
-        if(bInputMD5FromDir)
-        {
-            // Look for .md5 files in the special directory
-            sMD5FileName = sMD5DirName+sInFileName;
-            sMD5FileName += _T(".md5");
-        }
-        else
-        {
-            // Look for MF5 hash in the specified file
-            sMD5FileName = szInputMD5;
-        }
-    }
-
     // Get MD5 hash from .md5 file
-    _TFOPEN_S(f, sMD5FileName.c_str(), _T("rt"));
-    if(f!=NULL)
+    sMD5FileName = get_md5_file_name(szInput, szInputMD5);
+    if(read_md5_hash(sMD5FileName.c_str(), szMD5Buffer, 64))
     {
-        szMD5Hash = _fgetts(szMD5Buffer, 64, f);
-        fclose(f);
+        szMD5Hash = szMD5Buffer;
         if(szTableId==NULL)
             _tprintf(_T("Found MD5 file %s; MD5=%s\n"), sMD5FileName.c_str(), szMD5Hash);
     }
@@ -409,6 +403,10 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
         _tprintf(_T("Warning: 'MD5 file not detected; integrity check not performed.' while processing file '%s'\n"), sInFileName.c_str());
     }
 
+    // Don't hash the file again if the batch check did it
+    if(bMD5Checked)
+        szMD5Hash = NULL;
+
     // Open the error report file
     int res = crpOpenErrorReport(szInput, szMD5Hash, szSymSearchPath, 0, &hReport);
     if(res!=0)
@@ -440,7 +438,7 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
             }
 
             // Open resulting file
-            _TFOPEN_S(f, sOutFileName.c_str(), _T("wt"));
+            _TFOPEN_S(f, sOutFileName.c_str(), bAppendOutput?_T("at"):_T("wt"));
             if(f==NULL)
             {
                 result = UNEXPECTED;
@@ -512,6 +510,9 @@ int process_report(LPTSTR szInput, LPTSTR szInputMD5, LPTSTR szOutput,
         }
     }
 
+    if(g_bCollectStats)
+        collect_stats(hReport);
+
     // Success.
     result = SUCCESS;
 
@@ -526,6 +527,46 @@ done:
     return result;
 }
 
+// Decides the name of .md5 file containing MD5 hash for the input file
+tstring get_md5_file_name(LPCTSTR szInput, LPCTSTR szInputMD5)
+{
+    // If /fmd5 cmdline argument is omitted, search for md5 files in the same dir
+    if(szInputMD5==NULL)
+        return tstring(szInput) + _T(".md5");
+
+    // Determine if user wants us to search for .MD5 files in a directory
+    // or if he specifies the .MD5 file name.
+    DWORD dwFileAttrs = GetFileAttributes(szInputMD5);
+    if(dwFileAttrs==INVALID_FILE_ATTRIBUTES ||
+        !(dwFileAttrs&FILE_ATTRIBUTE_DIRECTORY))
+        return szInputMD5; // Look for MD5 hash in the specified file
+
+    // Look for .md5 files in the special directory
+    tstring sInFileName = szInput;
+    size_t pos = sInFileName.rfind('\\');
+    if(pos!=tstring::npos)
+        sInFileName = sInFileName.substr(pos+1);
+
+    tstring sMD5DirName = szInputMD5;
+    if(sMD5DirName[sMD5DirName.length()-1]!='\\') // Append the back slash to dir name
+        sMD5DirName += _T("\\");
+
+    return sMD5DirName + sInFileName + _T(".md5");
+}
+
+// Reads MD5 hash from .md5 file; returns FALSE if there is no such file
+BOOL read_md5_hash(LPCTSTR szMD5FileName, TCHAR* szBuffer, int nBufferSize)
+{
+    FILE* f = NULL;
+    _TFOPEN_S(f, szMD5FileName, _T("rt"));
+    if(f==NULL)
+        return FALSE;
+
+    TCHAR* szHash = _fgetts(szBuffer, nBufferSize, f);
+    fclose(f);
+    return szHash!=NULL;
+}
+
 // Helper function thatr etrieves an error report property
 int get_prop(CrpHandle hReport, LPCTSTR table_id, LPCTSTR column_id, tstring& str, int row_id)
 {
@@ -899,6 +940,26 @@ int output_document(CrpHandle hReport, FILE* f)
     }
     doc.EndSection();
 
+    // Stage times differ from run to run, so they are printed only on request
+    // to keep the output of the same report the same
+    if(g_bCollectStats)
+    {
+        doc.BeginSection(_T("Processing Stats"));
+        nItemCount = get_table_row_count(hReport, CRP_TBL_PROCESSING_STATS);
+        for(i=0; i<nItemCount; i++)
+        {
+            tstring sStageName;
+            result = get_prop(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_NAME, sStageName, i);
+            doc.PutTableCell(sStageName.c_str(), 12, false);
+
+            tstring sTimeUsec;
+            result = get_prop(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_TIME_USEC, sTimeUsec, i);
+            sTimeUsec += _T(" usec");
+            doc.PutTableCell(sTimeUsec.c_str(), 16, true);
+        }
+        doc.EndSection();
+    }
+
     doc.EndDocument();
 
     return SUCCESS;
@@ -906,35 +967,270 @@ int output_document(CrpHandle hReport, FILE* f)
 
 int extract_files(CrpHandle hReport, LPCTSTR pszExtractPath)
 {
-    tstring sExtractPath = pszExtractPath;
-    if(sExtractPath.at(sExtractPath.length()-1)!='\\')
-        sExtractPath += _T("\\"); // Add the last slash if needed
+    // Extract all files at once, they are inflated in parallel.
+    int nResult = crpExtractAllFiles(hReport, pszExtractPath, TRUE);
+    if(nResult!=0)
+    {
+        TCHAR szErr[1024];
+        crpGetLastErrorMsg(szErr, 1024);
+        _tprintf(_T("Error extracting files: %s\n"), szErr);
+        return EXTRACTERR; // Error extracting file
+    }
+
+    // Success.
+    return SUCCESS;
+}
+
+// Processes all files matching the pattern. Returns the first error code, if any.
+int process_batch(LPTSTR szInputPattern, LPTSTR szInputMD5, LPTSTR szOutput,
+                  LPTSTR szSymSearchPath, LPTSTR szExtractPath, LPTSTR szTableId,
+                  LPTSTR szColumnId, LPTSTR szRowId)
+{
+    int result = SUCCESS;
+    int nProcessed = 0;
+    WIN32_FIND_DATA fd;
+
+    // Directory part of the pattern, including the last back slash
+    tstring sDirName = szInputPattern;
+    size_t pos = sDirName.rfind('\\');
+    if(pos==tstring::npos)
+        sDirName = _T("");
+    else
+        sDirName = sDirName.substr(0, pos+1);
+
+    HANDLE hFind = FindFirstFile(szInputPattern, &fd);
+    if(hFind==INVALID_HANDLE_VALUE)
+    {
+        _tprintf(_T("No files found matching '%s'\n"), szInputPattern);
+        return UNEXPECTED;
+    }
 
-    // Get count of files to extract.
-    int nFileCount = get_table_row_count(hReport, CRP_TBL_XMLDESC_FILE_ITEMS);
-    if(nFileCount<0)
+    std::vector<tstring> aFiles;
+    do
     {
-        return UNEXPECTED; // Error getting file count.
+        if(fd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        aFiles.push_back(sDirName + fd.cFileName);
     }
+    while(FindNextFile(hFind, &fd));
+
+    FindClose(hFind);
+
+    // If output goes to a single file, all reports are written to it one after another
+    BOOL bAppendOutput = FALSE;
+    if(szOutput!=NULL && _tcscmp(szOutput, _T(""))!=0)
+    {
+        DWORD dwFileAttrs = GetFileAttributes(szOutput);
+        if(dwFileAttrs==INVALID_FILE_ATTRIBUTES || !(dwFileAttrs&FILE_ATTRIBUTE_DIRECTORY))
+        {
+            FILE* f = NULL;
+            _TFOPEN_S(f, szOutput, _T("wt"));
+            if(f==NULL)
+            {
+                _tprintf(_T("Error: couldn't open output file '%s'.\n"), szOutput);
+                return UNEXPECTED;
+            }
+            fclose(f);
+            bAppendOutput = TRUE;
+        }
+    }
+
+    // Check integrity of all files first, several files at once
+    std::vector<int> aMD5Status;
+    check_md5_batch(aFiles, szInputMD5, aMD5Status);
+
+    size_t i;
+    for(i=0; i<aFiles.size(); i++)
+    {
+        int res = UNEXPECTED;
+        if(aMD5Status[i]==MD5_MISMATCH)
+        {
+            // The same message as crpOpenErrorReport() gives
+            tstring sInFileName = aFiles[i].substr(sDirName.length());
+            _tprintf(_T("Error 'File might be corrupted, because MD5 hash is wrong.' while processing file '%s'\n"),
+                sInFileName.c_str());
+        }
+        else
+        {
+            std::vector<TCHAR> aFileName(aFiles[i].begin(), aFiles[i].end());
+            aFileName.push_back(0);
 
+            res = process_report(&aFileName[0], szInputMD5, szOutput, szSymSearchPath,
+                szExtractPath, szTableId, szColumnId, szRowId, aMD5Status[i]==MD5_MATCH, bAppendOutput);
+        }
+        if(res!=SUCCESS && result==SUCCESS)
+            result = res;
+        nProcessed++;
+    }
+
+    if(szTableId==NULL)
+        _tprintf(_T("Processed %d file(s).\n"), nProcessed);
+
+    return result;
+}
+
+// Checks MD5 hashes of files having .md5 files. Files are read in chunks of the
+// same size and hashed by multi-buffer MD5, one file per SIMD lane; a file that
+// ends frees its lane for the next one.
+void check_md5_batch(const std::vector<tstring>& aFiles, LPCTSTR szInputMD5, std::vector<int>& aStatus)
+{
+    const size_t CHUNK_SIZE = 64*1024; // Multiple of MD5 block size
+    MD5MultiBuffer md5;
+    int nLanes = md5.GetLaneCount();
+    std::vector<unsigned char> aBuffer(CHUNK_SIZE*nLanes);
+    std::vector<tstring> aExpected(aFiles.size());
+    FILE* aLaneFile[MD5MultiBuffer::MAX_LANES];
+    size_t aLaneItem[MD5MultiBuffer::MAX_LANES];
+    size_t nNext = 0;
+    int nBusy = 0;
     int i;
-    for(i=0; i<nFileCount; i++)
+
+    aStatus.assign(aFiles.size(), MD5_NOT_CHECKED);
+    for(i=0; i<nLanes; i++)
+        aLaneFile[i] = NULL;
+
+    for(;;)
     {
-        tstring sFileName;
-        int nResult = get_prop(hReport, CRP_TBL_XMLDESC_FILE_ITEMS, CRP_COL_FILE_ITEM_NAME, sFileName, i);
-        if(nResult!=0)
+        // Give idle lanes the next files to check
+        for(i=0; i<nLanes; i++)
         {
-            return UNEXPECTED; // Error getting file name
+            while(aLaneFile[i]==NULL && nNext<aFiles.size())
+            {
+                size_t nItem = nNext++;
+                TCHAR szHash[64] = _T("");
+                if(!read_md5_hash(get_md5_file_name(aFiles[nItem].c_str(), szInputMD5).c_str(), szHash, 64))
+                    continue; // Nothing to check against
+
+                _TFOPEN_S(aLaneFile[i], aFiles[nItem].c_str(), _T("rb"));
+                if(aLaneFile[i]==NULL)
+                    continue; // Leave the error to process_report()
+
+                aExpected[nItem] = szHash;
+                aLaneItem[i] = nItem;
+                md5.Init(i);
+                nBusy++;
+            }
         }
 
-        tstring sFileSaveAs = sExtractPath+sFileName;
-        nResult = crpExtractFile(hReport, sFileName.c_str(), sFileSaveAs.c_str(), TRUE);
-        if(nResult!=0)
+        if(nBusy==0)
+            break; // All files are checked
+
+        // Read the next chunk of every file; a short chunk is the last one
+        const unsigned char* apInput[MD5MultiBuffer::MAX_LANES];
+        BOOL bAnyInput = FALSE;
+        for(i=0; i<nLanes; i++)
         {
-            return EXTRACTERR; // Error extracting file
+            apInput[i] = NULL;
+            if(aLaneFile[i]==NULL)
+                continue;
+
+            unsigned char* pChunk = &aBuffer[i*CHUNK_SIZE];
+            size_t nRead = fread(pChunk, 1, CHUNK_SIZE, aLaneFile[i]);
+            if(nRead==CHUNK_SIZE)
+            {
+                apInput[i] = pChunk;
+                bAnyInput = TRUE;
+                continue;
+            }
+
+            if(!ferror(aLaneFile[i]))
+            {
+                unsigned char digest[16];
+                md5.Final(i, pChunk, nRead, digest);
+
+                TCHAR szHash[33];
+                int j;
+                for(j=0; j<16; j++)
+                    __STPRINTF_S(szHash+j*2, 3, _T("%02x"), digest[j]);
+
+                size_t nItem = aLaneItem[i];
+                aStatus[nItem] = _tcsicmp(szHash, aExpected[nItem].c_str())==0 ? MD5_MATCH : MD5_MISMATCH;
+            }
+
+            fclose(aLaneFile[i]);
+            aLaneFile[i] = NULL;
+            nBusy--;
         }
+
+        if(bAnyInput)
+            md5.Update(apInput, CHUNK_SIZE/MD5MultiBuffer::BLOCK_SIZE);
     }
+}
 
-    // Success.
-    return SUCCESS;
+// Adds processing stage times of the report to the global statistics
+void collect_stats(CrpHandle hReport)
+{
+    // Walk all stacks (if not walked yet) so that the stats cover whole processing
+    int nThreadCount = get_table_row_count(hReport, CRP_TBL_MDMP_THREADS);
+    int i;
+    for(i=0; i<nThreadCount; i++)
+    {
+        tstring sStackTableId;
+        if(get_prop(hReport, CRP_TBL_MDMP_THREADS, CRP_COL_THREAD_STACK_TABLEID, sStackTableId, i)==0)
+            get_table_row_count(hReport, sStackTableId.c_str());
+    }
+
+    int nStageCount = get_table_row_count(hReport, CRP_TBL_PROCESSING_STATS);
+    for(i=0; i<nStageCount; i++)
+    {
+        tstring sStageName;
+        tstring sTimeUsec;
+        if(get_prop(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_NAME, sStageName, i)!=0 ||
+            get_prop(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_TIME_USEC, sTimeUsec, i)!=0)
+            continue;
+
+        if(g_StageTimes.find(sStageName)==g_StageTimes.end())
+            g_StageNames.push_back(sStageName);
+
+        g_StageTimes[sStageName].push_back(_ttoi64(sTimeUsec.c_str())/1000.0);
+    }
+}
+
+// Returns the nearest-rank percentile (0..100) of sorted values
+double get_percentile(const std::vector<double>& aSorted, int nPercent)
+{
+    if(aSorted.empty())
+        return 0;
+    size_t nRank = (aSorted.size()*nPercent+99)/100;
+    if(nRank==0)
+        nRank = 1;
+    return aSorted[nRank-1];
+}
+
+// Prints percentiles of processing stage times over all processed reports
+void print_stats_summary()
+{
+    COutputter doc;
+    doc.Init(stdout);
+    doc.BeginSection(_T("Processing Stats (msec)"));
+
+    doc.PutTableCell(_T("Stage"), 12, false);
+    doc.PutTableCell(_T("Reports"), 8, false);
+    doc.PutTableCell(_T("p50"), 10, false);
+    doc.PutTableCell(_T("p90"), 10, false);
+    doc.PutTableCell(_T("p99"), 10, false);
+    doc.PutTableCell(_T("Max"), 10, true);
+
+    size_t i;
+    for(i=0; i<g_StageNames.size(); i++)
+    {
+        std::vector<double> aTimes = g_StageTimes[g_StageNames[i]];
+        std::sort(aTimes.begin(), aTimes.end());
+
+        TCHAR szBuffer[64];
+        doc.PutTableCell(g_StageNames[i].c_str(), 12, false);
+        __STPRINTF_S(szBuffer, 64, _T("%d"), (int)aTimes.size());
+        doc.PutTableCell(szBuffer, 8, false);
+        __STPRINTF_S(szBuffer, 64, _T("%.3f"), get_percentile(aTimes, 50));
+        doc.PutTableCell(szBuffer, 10, false);
+        __STPRINTF_S(szBuffer, 64, _T("%.3f"), get_percentile(aTimes, 90));
+        doc.PutTableCell(szBuffer, 10, false);
+        __STPRINTF_S(szBuffer, 64, _T("%.3f"), get_percentile(aTimes, 99));
+        doc.PutTableCell(szBuffer, 10, false);
+        __STPRINTF_S(szBuffer, 64, _T("%.3f"), aTimes.empty()?0:aTimes.back());
+        doc.PutTableCell(szBuffer, 10, true);
+    }
+
+    doc.EndSection();
 }
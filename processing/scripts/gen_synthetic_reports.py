@@ -0,0 +1,301 @@
+# This script generates synthetic error report ZIP files for testing and
+# benchmarking CrashRptProbe and crprober. Each report contains crashrpt.xml,
+# a well-formed crashdump.dmp and optional attached log files. A .md5 file is
+# written next to each ZIP, as CrashSender does.
+#
+# The minidump has configurable numbers of threads, modules and memory ranges.
+# Thread stacks are stored in the memory list and filled with return addresses
+# pointing into the fake modules, so stack walking produces several frames even
+# when no binaries or symbols are available.
+#
+# The script uses the standard library only and runs on any OS, e.g.:
+#   python gen_synthetic_reports.py --out-dir reports --count 20 --threads 32 --modules 150
+
+import argparse
+import hashlib
+import os
+import random
+import struct
+import uuid
+import zipfile
+
+# Minidump stream types (see MINIDUMP_STREAM_TYPE in dbghelp.h)
+THREAD_LIST_STREAM = 3
+MODULE_LIST_STREAM = 4
+MEMORY_LIST_STREAM = 5
+EXCEPTION_STREAM = 6
+SYSTEM_INFO_STREAM = 7
+
+MINIDUMP_SIGNATURE = 0x504d444d # 'MDMP'
+MINIDUMP_VERSION = 0xa793
+
+PROCESSOR_ARCHITECTURE_INTEL = 0
+PROCESSOR_ARCHITECTURE_AMD64 = 9
+
+CONTEXT_SIZE = { "x86": 0x2cc, "amd64": 0x4d0 }
+CONTEXT_FLAGS = { "x86": 0x1003f, "amd64": 0x10003f } # CONTEXT_ALL
+
+EXCEPTION_ACCESS_VIOLATION = 0xc0000005
+
+class Blob:
+   """Accumulates minidump data and hands out RVAs."""
+   def __init__(self):
+      self.data = bytearray()
+
+   def align(self, n):
+      while len(self.data) % n:
+         self.data.append(0)
+
+   def add(self, raw, alignment=4):
+      self.align(alignment)
+      rva = len(self.data)
+      self.data += raw
+      return rva
+
+   def add_string(self, s):
+      # MINIDUMP_STRING: length in bytes (without terminator) + UTF-16LE chars + null
+      encoded = s.encode("utf-16-le")
+      return self.add(struct.pack("<I", len(encoded)) + encoded + b"\0\0")
+
+def make_context(arch, pc, sp, fp):
+   ctx = bytearray(CONTEXT_SIZE[arch])
+   if arch == "amd64":
+      struct.pack_into("<I", ctx, 0x30, CONTEXT_FLAGS[arch])
+      struct.pack_into("<Q", ctx, 0x98, sp)  # Rsp
+      struct.pack_into("<Q", ctx, 0xa0, fp)  # Rbp
+      struct.pack_into("<Q", ctx, 0xf8, pc)  # Rip
+   else:
+      struct.pack_into("<I", ctx, 0x00, CONTEXT_FLAGS[arch])
+      struct.pack_into("<I", ctx, 0xb4, fp)  # Ebp
+      struct.pack_into("<I", ctx, 0xb8, pc)  # Eip
+      struct.pack_into("<I", ctx, 0xc4, sp)  # Esp
+   return bytes(ctx)
+
+def make_stack(arch, stack_base, stack_size, frames, rnd):
+   """Returns (stack bytes, sp, fp). Return addresses point into modules."""
+   stack = bytearray(rnd.getrandbits(8) for _ in range(stack_size))
+   ptr = 8 if arch == "amd64" else 4
+   fmt = "<Q" if arch == "amd64" else "<I"
+   sp = stack_base + 64
+   if arch == "amd64":
+      # Without unwind info the x64 walker treats every function as a leaf and
+      # pops the return address at [rsp], so lay the addresses out in a row.
+      off = sp - stack_base
+      for addr in frames:
+         if off + ptr > stack_size:
+            break
+         struct.pack_into(fmt, stack, off, addr)
+         off += ptr
+      return bytes(stack), sp, 0
+   # x86: build an EBP chain, [ebp] = previous ebp, [ebp+4] = return address
+   fp = sp + 32
+   off = fp - stack_base
+   for i, addr in enumerate(frames):
+      next_fp = fp + 32
+      if off + 2 * ptr > stack_size:
+         break
+      struct.pack_into(fmt, stack, off, next_fp if i + 1 < len(frames) else 0)
+      struct.pack_into(fmt, stack, off + ptr, addr)
+      fp = next_fp
+      off = fp - stack_base
+   return bytes(stack), sp, sp + 32
+
+def make_minidump(args, rnd):
+   arch = args.arch
+   blob = Blob()
+   stream_count = 5
+   # Header and stream directory are written at the beginning
+   blob.add(bytes(32 + 12 * stream_count))
+
+   # Modules
+   modules = []
+   base = 0x10000000 if arch == "x86" else 0x7ff600000000
+   for i in range(args.modules):
+      size = rnd.choice([0x10000, 0x40000, 0x100000, 0x400000])
+      if i == 0:
+         name = "C:\\Program Files\\SynthApp\\%s.exe" % args.app_name
+      else:
+         name = "C:\\Windows\\System32\\synth%03d.dll" % i
+      modules.append((base, size, name))
+      base += size + 0x10000
+
+   module_entries = bytearray()
+   for (mbase, msize, name) in modules:
+      name_rva = blob.add_string(name)
+      # VS_FIXEDFILEINFO: signature, struct version, file/product versions, ...
+      vsfi = struct.pack("<13I", 0xfeef04bd, 0x10000, 0x10000, 0x0, 0x10000, 0x0,
+                         0x3f, 0x0, 0x40004, 0x1, 0x0, 0x0, 0x0)
+      module_entries += struct.pack("<QIIII", mbase, msize, 0, 0x5f000000 + rnd.randint(0, 0xffff), name_rva)
+      module_entries += vsfi
+      module_entries += bytes(8 * 4) # CvRecord, MiscRecord, Reserved0, Reserved1
+   module_list_rva = blob.add(struct.pack("<I", len(modules)) + module_entries)
+
+   # Thread stacks and contexts
+   memory_ranges = []
+   threads = []
+   stack_base = 0x00100000 if arch == "x86" else 0x000000c000000000
+   for t in range(args.threads):
+      frames = []
+      for _ in range(args.frames):
+         mbase, msize, _ = rnd.choice(modules)
+         frames.append(mbase + 0x1000 + rnd.randrange(0, msize - 0x1000, 2))
+      stack, sp, fp = make_stack(arch, stack_base, args.stack_size, frames, rnd)
+      pc = frames[0]
+      ctx_rva = blob.add(make_context(arch, pc, sp, fp), 16)
+      stack_rva = blob.add(stack, 16)
+      memory_ranges.append((stack_base, len(stack), stack_rva))
+      threads.append((0x1000 + 4 * t, stack_base, len(stack), stack_rva, CONTEXT_SIZE[arch], ctx_rva))
+      stack_base += 0x100000
+
+   # Extra memory ranges (heap data referenced from the stacks)
+   heap_base = 0x02000000 if arch == "x86" else 0x000001c000000000
+   for _ in range(args.mem_ranges):
+      size = args.mem_range_size
+      data = bytes(rnd.getrandbits(8) for _ in range(size))
+      rva = blob.add(data, 16)
+      memory_ranges.append((heap_base, size, rva))
+      heap_base += size + 0x10000
+
+   thread_entries = bytearray()
+   for (tid, sbase, ssize, srva, csize, crva) in threads:
+      thread_entries += struct.pack("<IIIIQ", tid, 0, 0x20, 0, 0x7ffd0000 + tid)
+      thread_entries += struct.pack("<QII", sbase, ssize, srva)
+      thread_entries += struct.pack("<II", csize, crva)
+   thread_list_rva = blob.add(struct.pack("<I", len(threads)) + thread_entries)
+
+   mem_entries = bytearray()
+   for (start, size, rva) in memory_ranges:
+      mem_entries += struct.pack("<QII", start, size, rva)
+   memory_list_rva = blob.add(struct.pack("<I", len(memory_ranges)) + mem_entries)
+
+   # Exception stream: access violation in the first thread
+   exc_tid, _, _, _, csize, crva = threads[0]
+   mbase, msize, _ = modules[0]
+   exc_addr = mbase + 0x1234
+   exception = struct.pack("<II", exc_tid, 0)
+   exception += struct.pack("<IIQQII", EXCEPTION_ACCESS_VIOLATION, 0, 0, exc_addr, 2, 0)
+   exception += struct.pack("<15Q", *([0, 0xdeadbeef] + [0] * 13))
+   exception += struct.pack("<II", csize, crva)
+   exception_rva = blob.add(exception)
+
+   # System info
+   csd_rva = blob.add_string("Service Pack 1")
+   arch_id = PROCESSOR_ARCHITECTURE_AMD64 if arch == "amd64" else PROCESSOR_ARCHITECTURE_INTEL
+   sysinfo = struct.pack("<HHHBBIIIIIHH", arch_id, 6, 0x3a09, 8, 1, 6, 1, 7601, 2, csd_rva, 0x100, 0)
+   sysinfo += bytes(24) # CPU_INFORMATION
+   sysinfo_rva = blob.add(sysinfo)
+
+   streams = [
+      (THREAD_LIST_STREAM, 4 + len(thread_entries), thread_list_rva),
+      (MODULE_LIST_STREAM, 4 + len(module_entries), module_list_rva),
+      (MEMORY_LIST_STREAM, 4 + len(mem_entries), memory_list_rva),
+      (EXCEPTION_STREAM, len(exception), exception_rva),
+      (SYSTEM_INFO_STREAM, len(sysinfo), sysinfo_rva),
+   ]
+   assert len(streams) == stream_count
+
+   struct.pack_into("<IIIIIIQ", blob.data, 0, MINIDUMP_SIGNATURE, MINIDUMP_VERSION,
+                    stream_count, 32, 0, 0x5f000000, 0)
+   for i, (stype, size, rva) in enumerate(streams):
+      struct.pack_into("<III", blob.data, 32 + 12 * i, stype, size, rva)
+
+   return bytes(blob.data), exc_addr
+
+def xml_escape(s):
+   return (s.replace("&", "&amp;").replace("<", "&lt;").replace(">", "&gt;")
+            .replace("\"", "&quot;").replace("'", "&apos;"))
+
+def make_crash_desc(args, guid, exc_addr, attached_files):
+   lines = []
+   lines.append("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>")
+   lines.append("<CrashRpt version=\"1500\">")
+   def elem(name, value):
+      lines.append("    <%s>%s</%s>" % (name, xml_escape(value), name))
+   elem("CrashGUID", guid)
+   elem("AppName", args.app_name)
+   elem("AppVersion", args.app_version)
+   elem("ImageName", "C:\\Program Files\\SynthApp\\%s.exe" % args.app_name)
+   elem("OperatingSystem", "Windows 7 Ultimate Build 7601 Service Pack 1")
+   elem("OSIs64Bit", "1" if args.arch == "amd64" else "0")
+   elem("GeoLocation", "en-us")
+   elem("SystemTimeUTC", "2013-01-01T00:00:00Z")
+   elem("ExceptionAddress", "0x%x" % exc_addr)
+   elem("ExceptionType", "0")
+   elem("ExceptionCode", str(EXCEPTION_ACCESS_VIOLATION))
+   elem("GUIResourceCount", "42")
+   elem("OpenHandleCount", "128")
+   elem("MemoryUsageKbytes", "65536")
+   lines.append("    <CustomProps>")
+   for i in range(args.props):
+      lines.append("        <Prop name=\"Prop%d\" value=\"%s\" />" % (i, xml_escape("Value %d" % i)))
+   lines.append("    </CustomProps>")
+   lines.append("    <FileList>")
+   lines.append("        <FileItem name=\"crashdump.dmp\" description=\"Crash Minidump\" />")
+   lines.append("        <FileItem name=\"crashrpt.xml\" description=\"Crash Description XML\" />")
+   for name in attached_files:
+      lines.append("        <FileItem name=\"%s\" description=\"Log file\" />" % name)
+   lines.append("    </FileList>")
+   lines.append("</CrashRpt>")
+   return ("\n".join(lines) + "\n").encode("utf-8")
+
+def make_log(size, rnd):
+   # Text logs compress well, like real application logs do
+   out = bytearray()
+   n = 0
+   while len(out) < size:
+      out += ("%08d [INFO] worker %d processed item %d in %d ms\r\n" %
+              (n, rnd.randint(0, 16), rnd.randint(0, 1 << 20), rnd.randint(0, 500))).encode("ascii")
+      n += 1
+   return bytes(out[:size])
+
+def generate_report(args, index):
+   rnd = random.Random(args.seed + index)
+   guid = str(uuid.UUID(int=rnd.getrandbits(128)))
+   dump, exc_addr = make_minidump(args, rnd)
+   attached = ["log%02d.txt" % i for i in range(args.files)]
+   xml = make_crash_desc(args, guid, exc_addr, attached)
+
+   zip_name = os.path.join(args.out_dir, "%s.zip" % guid)
+   with zipfile.ZipFile(zip_name, "w", zipfile.ZIP_DEFLATED) as z:
+      z.writestr("crashdump.dmp", dump)
+      z.writestr("crashrpt.xml", xml)
+      for name in attached:
+         z.writestr(name, make_log(args.file_size, rnd))
+
+   md5 = hashlib.md5()
+   with open(zip_name, "rb") as f:
+      md5.update(f.read())
+   with open(zip_name + ".md5", "w") as f:
+      f.write(md5.hexdigest())
+   return zip_name
+
+def main():
+   parser = argparse.ArgumentParser(description="Generates synthetic CrashRpt error reports.")
+   parser.add_argument("--out-dir", default="synthetic_reports", help="Output directory")
+   parser.add_argument("--count", type=int, default=10, help="Number of reports to generate")
+   parser.add_argument("--arch", choices=["x86", "amd64"], default="amd64", help="Minidump CPU architecture")
+   parser.add_argument("--threads", type=int, default=16, help="Thread count per minidump")
+   parser.add_argument("--frames", type=int, default=24, help="Return addresses per thread stack")
+   parser.add_argument("--stack-size", type=int, default=16384, help="Bytes of stack memory per thread")
+   parser.add_argument("--modules", type=int, default=100, help="Module count per minidump")
+   parser.add_argument("--mem-ranges", type=int, default=32, help="Extra memory ranges per minidump")
+   parser.add_argument("--mem-range-size", type=int, default=4096, help="Bytes per extra memory range")
+   parser.add_argument("--files", type=int, default=4, help="Attached log files per report")
+   parser.add_argument("--file-size", type=int, default=256 * 1024, help="Bytes per attached log file")
+   parser.add_argument("--props", type=int, default=8, help="Custom properties per report")
+   parser.add_argument("--app-name", default="SynthApp", help="Application name")
+   parser.add_argument("--app-version", default="1.0.0", help="Application version")
+   parser.add_argument("--seed", type=int, default=1, help="Random seed (reports are reproducible)")
+   args = parser.parse_args()
+
+   if args.threads < 1 or args.modules < 1:
+      parser.error("at least one thread and one module are required")
+
+   if not os.path.isdir(args.out_dir):
+      os.makedirs(args.out_dir)
+
+   for i in range(args.count):
+      print(generate_report(args, i))
+
+if __name__ == "__main__":
+   main()
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Generates synthetic error reports and runs crprobench on them.
+# On Linux, crprobench.exe and crprober.exe are run with Wine. No symbol server is
+# used: crprobench passes an empty local directory as the symbol search path.
+#
+# crprobench is built when CMake is run with -DCRASHRPT_BUILD_BENCHMARKS=ON.
+#
+# Usage: run_benchmark.sh <bin_dir> [extra crprobench args, e.g. /max open 50 /max stack 200]
+
+BIN_DIR=${1:?"bin directory containing crprobench.exe is required"}
+shift
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+REPORT_DIR=${REPORT_DIR:-synthetic_reports}
+REPORT_COUNT=${REPORT_COUNT:-20}
+
+case "$(uname -s)" in
+  CYGWIN*|MINGW*|MSYS*) RUNNER="" ;;
+  *) RUNNER=${WINE:-wine} ;;
+esac
+
+python3 "$SCRIPT_DIR/gen_synthetic_reports.py" --out-dir "$REPORT_DIR" --count "$REPORT_COUNT" > /dev/null || exit 1
+
+$RUNNER "$BIN_DIR/crprobench.exe" /d "$REPORT_DIR" /crprober "$BIN_DIR/crprober.exe" "$@"
@@ -0,0 +1,382 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: main.cpp
+// Description: codecbench application. Measures throughput of the encoders
+// CrashSender.exe runs on error report data: BASE-64 (e-mail attachments) with
+// each instruction set the CPU supports, compared to base64_encode()/base64_decode(),
+// and MD5 (integrity hashes), single-stream and multi-buffer.
+
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "base64.h"
+#include "md5.h"
+
+// The following macros are used for parsing the command line
+#define args_left() (argc-cur_arg)
+#define arg_exists() (cur_arg<argc && argv[cur_arg]!=NULL)
+#define get_arg() ( arg_exists() ? argv[cur_arg]:NULL )
+#define skip_arg() cur_arg++
+#define cmp_arg(val) (arg_exists() && (0==_tcscmp(argv[cur_arg], val)))
+
+// Return codes
+enum ReturnCode
+{
+    SUCCESS     = 0, // OK
+    UNEXPECTED  = 1, // Unexpected error
+    INVALIDARG  = 2, // Invalid argument
+    MISMATCH    = 3  // Some codec produced wrong output
+};
+
+// Monotonic timer
+class CBenchTimer
+{
+public:
+
+    CBenchTimer()
+    {
+        QueryPerformanceFrequency(&m_Freq);
+        Start();
+    }
+
+    void Start()
+    {
+        QueryPerformanceCounter(&m_Start);
+    }
+
+    // Returns seconds elapsed since Start()
+    double GetElapsedSec()
+    {
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        return (double)(Now.QuadPart-m_Start.QuadPart)/(double)m_Freq.QuadPart;
+    }
+
+private:
+
+    LARGE_INTEGER m_Freq;
+    LARGE_INTEGER m_Start;
+};
+
+// Options
+struct BenchOptions
+{
+    size_t nDataSize;   // Size of data to encode, in bytes
+    int nIterations;    // How many times to run every codec; the fastest run counts
+    int nSplitCount;    // Length of BASE-64 lines
+};
+
+// Prints usage
+void print_usage()
+{
+    _tprintf(_T("Usage:\n"));
+    _tprintf(_T("codecbench /? Prints this usage help\n"));
+    _tprintf(_T("codecbench [arg ...]\n"));
+    _tprintf(_T("  where the argument may be any of the following:\n"));
+    _tprintf(_T("   /size <megabytes>   Optional. Size of random data to encode (default is 32).\n"));
+    _tprintf(_T("   /n <iterations>     Optional. How many times to run every codec (default is 5). ")\
+             _T("The fastest run is reported.\n"));
+    _tprintf(_T("   /split <count>      Optional. BASE-64 line length (default is 76, as in e-mail).\n"));
+}
+
+// Converts bytes processed in the given time to GB/s
+double get_throughput(size_t nBytes, double dSec)
+{
+    return dSec>0 ? (double)nBytes/dSec/1e9 : 0;
+}
+
+// Prints a table row; zero throughput is printed as a dash
+void print_row(LPCTSTR szCodec, double dEncode, double dDecode)
+{
+    _tprintf(_T("%-12s"), szCodec);
+    if(dEncode>0)
+        _tprintf(_T(" %12.3f"), dEncode);
+    else
+        _tprintf(_T(" %12s"), _T("-"));
+    if(dDecode>0)
+        _tprintf(_T(" %12.3f"), dDecode);
+    else
+        _tprintf(_T(" %12s"), _T("-"));
+    _tprintf(_T("\n"));
+}
+
+// Measures base64_encode() and base64_decode(). The latter doesn't skip line
+// breaks, so it is given text without them. Returns encoded text as a reference.
+int bench_base64_current(BenchOptions& opts, const std::vector<unsigned char>& aData, std::string& sReference)
+{
+    CBenchTimer timer;
+    double dEncodeSec = 0;
+    double dDecodeSec = 0;
+    int i;
+
+    for(i=0; i<opts.nIterations; i++)
+    {
+        timer.Start();
+        sReference = base64_encode(&aData[0], (unsigned int)aData.size(), opts.nSplitCount);
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dEncodeSec)
+            dEncodeSec = dSec;
+    }
+
+    std::string sNoSplit = base64_encode(&aData[0], (unsigned int)aData.size(), 0);
+    for(i=0; i<opts.nIterations; i++)
+    {
+        timer.Start();
+        std::string sDecoded = base64_decode(sNoSplit);
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dDecodeSec)
+            dDecodeSec = dSec;
+
+        if(sDecoded.size()!=aData.size() || memcmp(sDecoded.data(), &aData[0], aData.size())!=0)
+        {
+            _tprintf(_T("Error: base64_decode() output differs from the input.\n"));
+            return MISMATCH;
+        }
+    }
+
+    print_row(_T("current"), get_throughput(aData.size(), dEncodeSec), get_throughput(aData.size(), dDecodeSec));
+    return SUCCESS;
+}
+
+// Measures base64_encode_buf() and base64_decode_buf() with the given instruction set
+int bench_base64_buf(BenchOptions& opts, const std::vector<unsigned char>& aData,
+                     const std::string& sReference, base64_simd simd, LPCTSTR szName)
+{
+    if(base64_set_simd(simd)!=simd)
+    {
+        print_row(szName, 0, 0); // Not supported by the CPU
+        return SUCCESS;
+    }
+
+    CBenchTimer timer;
+    double dEncodeSec = 0;
+    double dDecodeSec = 0;
+    std::vector<char> aEncoded(base64_encoded_size(aData.size(), opts.nSplitCount));
+    std::vector<unsigned char> aDecoded(base64_decoded_size(aEncoded.size()));
+    size_t nEncoded = 0;
+    size_t nDecoded = 0;
+    int i;
+
+    for(i=0; i<opts.nIterations; i++)
+    {
+        timer.Start();
+        nEncoded = base64_encode_buf(&aData[0], aData.size(), &aEncoded[0], opts.nSplitCount);
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dEncodeSec)
+            dEncodeSec = dSec;
+    }
+
+    if(nEncoded!=sReference.size() || memcmp(&aEncoded[0], sReference.data(), nEncoded)!=0)
+    {
+        _tprintf(_T("Error: base64_encode_buf() output differs from base64_encode() (%s).\n"), szName);
+        return MISMATCH;
+    }
+
+    for(i=0; i<opts.nIterations; i++)
+    {
+        timer.Start();
+        nDecoded = base64_decode_buf(&aEncoded[0], nEncoded, &aDecoded[0]);
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dDecodeSec)
+            dDecodeSec = dSec;
+    }
+
+    if(nDecoded!=aData.size() || memcmp(&aDecoded[0], &aData[0], nDecoded)!=0)
+    {
+        _tprintf(_T("Error: base64_decode_buf() output differs from the input (%s).\n"), szName);
+        return MISMATCH;
+    }
+
+    print_row(szName, get_throughput(aData.size(), dEncodeSec), get_throughput(aData.size(), dDecodeSec));
+    return SUCCESS;
+}
+
+// Measures MD5 class on the whole data; digest receives the hash
+void bench_md5_single(BenchOptions& opts, const std::vector<unsigned char>& aData, unsigned char digest[16])
+{
+    CBenchTimer timer;
+    double dBestSec = 0;
+    int i;
+
+    for(i=0; i<opts.nIterations; i++)
+    {
+        MD5 md5;
+        MD5_CTX md5_ctx;
+        timer.Start();
+        md5.MD5Init(&md5_ctx);
+        md5.MD5Update(&md5_ctx, (unsigned char*)&aData[0], (unsigned int)aData.size());
+        md5.MD5Final(digest, &md5_ctx);
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dBestSec)
+            dBestSec = dSec;
+    }
+
+    _tprintf(_T("%-12s %12.3f\n"), _T("single"), get_throughput(aData.size(), dBestSec));
+}
+
+// Measures MD5MultiBuffer on the data cut into one message per lane. Throughput
+// is the total of all lanes, as if that many files were checked at once.
+int bench_md5_multi(BenchOptions& opts, const std::vector<unsigned char>& aData, int nLanes, LPCTSTR szName)
+{
+    MD5MultiBuffer md5(nLanes);
+    if(md5.GetLaneCount()!=nLanes)
+    {
+        _tprintf(_T("%-12s %12s\n"), szName, _T("-")); // Not supported by the CPU
+        return SUCCESS;
+    }
+
+    CBenchTimer timer;
+    double dBestSec = 0;
+    size_t nMessageSize = aData.size()/nLanes;
+    size_t nBlocks = nMessageSize/MD5MultiBuffer::BLOCK_SIZE;
+    const unsigned char* apInput[MD5MultiBuffer::MAX_LANES];
+    unsigned char digest[MD5MultiBuffer::MAX_LANES][16];
+    int i;
+    int nLane;
+
+    for(i=0; i<opts.nIterations; i++)
+    {
+        timer.Start();
+        for(nLane=0; nLane<nLanes; nLane++)
+            apInput[nLane] = &aData[nLane*nMessageSize];
+        md5.Update(apInput, nBlocks);
+        for(nLane=0; nLane<nLanes; nLane++)
+        {
+            size_t nDone = nBlocks*MD5MultiBuffer::BLOCK_SIZE;
+            md5.Final(nLane, apInput[nLane]+nDone, nMessageSize-nDone, digest[nLane]);
+        }
+        double dSec = timer.GetElapsedSec();
+        if(i==0 || dSec<dBestSec)
+            dBestSec = dSec;
+    }
+
+    // Compare with MD5 class
+    for(nLane=0; nLane<nLanes; nLane++)
+    {
+        MD5 ref;
+        MD5_CTX ref_ctx;
+        unsigned char ref_digest[16];
+        ref.MD5Init(&ref_ctx);
+        ref.MD5Update(&ref_ctx, (unsigned char*)&aData[nLane*nMessageSize], (unsigned int)nMessageSize);
+        ref.MD5Final(ref_digest, &ref_ctx);
+        if(memcmp(ref_digest, digest[nLane], 16)!=0)
+        {
+            _tprintf(_T("Error: MD5MultiBuffer digest differs from MD5 class (%s).\n"), szName);
+            return MISMATCH;
+        }
+    }
+
+    _tprintf(_T("%-12s %12.3f\n"), szName, get_throughput(nMessageSize*nLanes, dBestSec));
+    return SUCCESS;
+}
+
+// Program entry point
+int _tmain(int argc, TCHAR** argv)
+{
+    int result = INVALIDARG; // Return code
+    int cur_arg = 1; // Current cmdline argument being processed
+    BenchOptions opts;
+    std::vector<unsigned char> aData;
+    std::string sReference;
+    size_t i;
+
+    opts.nDataSize = 32*1024*1024;
+    opts.nIterations = 5;
+    opts.nSplitCount = 76;
+
+    // Parse command line arguments
+    while(arg_exists())
+    {
+        if(cmp_arg(_T("/?")))
+        {
+            result = SUCCESS;
+            print_usage();
+            goto done;
+        }
+        else if(cmp_arg(_T("/size")) || cmp_arg(_T("/n")) || cmp_arg(_T("/split")))
+        {
+            LPCTSTR szName = get_arg();
+            skip_arg();
+            LPCTSTR szValue = get_arg();
+            skip_arg();
+            if(szValue==NULL)
+            {
+                _tprintf(_T("Missing value of %s parameter.\n"), szName);
+                goto done;
+            }
+
+            if(_tcscmp(szName, _T("/size"))==0)
+                opts.nDataSize = (size_t)_ttoi(szValue)*1024*1024;
+            else if(_tcscmp(szName, _T("/n"))==0)
+                opts.nIterations = _ttoi(szValue);
+            else
+                opts.nSplitCount = _ttoi(szValue);
+        }
+        else // unknown arg
+        {
+            _tprintf(_T("Unexpected parameter: %s\n"), get_arg());
+            goto done;
+        }
+    }
+
+    if(opts.nDataSize==0 || opts.nIterations<=0 || opts.nSplitCount<0)
+    {
+        _tprintf(_T("Data size, iteration count or line length is invalid.\n"));
+        goto done;
+    }
+
+    // Random data doesn't let any codec take shortcuts
+    aData.resize(opts.nDataSize);
+    srand(1);
+    for(i=0; i<aData.size(); i++)
+        aData[i] = (unsigned char)(rand()>>4);
+
+    _tprintf(_T("Encoding %d MB, %d iteration(s), line length %d. Throughput is in GB/s of binary data.\n\n"),
+        (int)(opts.nDataSize/(1024*1024)), opts.nIterations, opts.nSplitCount);
+    _tprintf(_T("%-12s %12s %12s\n"), _T("base64"), _T("encode,GB/s"), _T("decode,GB/s"));
+
+    result = bench_base64_current(opts, aData, sReference);
+    if(result!=SUCCESS)
+        goto done;
+
+    result = bench_base64_buf(opts, aData, sReference, base64_simd_scalar, _T("scalar"));
+    if(result!=SUCCESS)
+        goto done;
+    result = bench_base64_buf(opts, aData, sReference, base64_simd_ssse3, _T("ssse3"));
+    if(result!=SUCCESS)
+        goto done;
+    result = bench_base64_buf(opts, aData, sReference, base64_simd_avx2, _T("avx2"));
+    if(result!=SUCCESS)
+        goto done;
+
+    _tprintf(_T("\ncurrent decode is measured on text without line breaks, as base64_decode() stops at them.\n\n"));
+
+    unsigned char digest[16];
+    _tprintf(_T("%-12s %12s\n"), _T("md5"), _T("hash,GB/s"));
+    bench_md5_single(opts, aData, digest);
+    result = bench_md5_multi(opts, aData, 4, _T("x4 (sse2)"));
+    if(result!=SUCCESS)
+        goto done;
+    result = bench_md5_multi(opts, aData, 8, _T("x8 (avx2)"));
+    if(result!=SUCCESS)
+        goto done;
+
+done:
+
+    if(result==INVALIDARG)
+        print_usage();
+
+    return result;
+}
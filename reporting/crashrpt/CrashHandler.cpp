@@ -60,6 +60,15 @@ CCrashHandler::CCrashHandler()
     m_hEvent = NULL;
 	m_hEvent2 = NULL;
     m_pCrashDesc = NULL;
+    m_pPropSlots = NULL;
+    m_lPropSlotsUsed = 0;
+    memset((void*)m_aPropSlotIndex, 0, sizeof(m_aPropSlotIndex));
+    m_pBreadcrumbs = NULL;
+    m_dwBreadcrumbsOffs = 0;
+    memset(&m_ftBreadcrumbsSince, 0, sizeof(FILETIME));
+    memset((void*)m_aBreadcrumbRingTaken, 0, sizeof(m_aBreadcrumbRingTaken));
+    m_dwBreadcrumbTls = TlsAlloc();
+    m_pRingLog = NULL;
 	m_hSenderProcess = NULL;
 	m_pfnCallback2W = NULL;
 	m_pfnCallback2A = NULL;
@@ -75,6 +84,9 @@ CCrashHandler::~CCrashHandler()
 {
     // Clean up
     Destroy();
+
+    if(m_dwBreadcrumbTls!=TLS_OUT_OF_INDEXES)
+        TlsFree(m_dwBreadcrumbTls);
 }
 
 int CCrashHandler::Init(
@@ -508,7 +520,8 @@ int CCrashHandler::SetCrashCallbackA(PFNCRASHCALLBACKA pfnCallback, LPVOID pUser
 }
 
 // Packs config info to shared mem.
-CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pSharedMem, BOOL bTempMem)
+CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pSharedMem, BOOL bTempMem,
+                                                             const std::vector<BYTE>* pPacked)
 {
     m_pTmpSharedMem = pSharedMem;
 
@@ -530,9 +543,10 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 		}
 	}
 
-    // Create memory view.
+    // Create a single view of the whole shared memory; everything is
+    // packed into it with AllocSharedMem().
     m_pTmpCrashDesc =
-        (CRASH_DESCRIPTION*)pSharedMem->CreateView(0, sizeof(CRASH_DESCRIPTION));
+        (CRASH_DESCRIPTION*)pSharedMem->CreateView(0, SHARED_MEM_MAX_SIZE);
     if(m_pTmpCrashDesc==NULL)
     {
         ATLASSERT(0);
@@ -540,6 +554,40 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
         return NULL;
     }
 
+    // Copy what was packed into the previous shared memory, and
+    // update only what differs for the next crash.
+    if(pPacked!=NULL && !pPacked->empty())
+    {
+        memcpy(m_pTmpCrashDesc, &(*pPacked)[0], pPacked->size());
+
+        // Fields set on crash
+        m_pTmpCrashDesc->m_dwInstallFlags = m_dwFlags;
+        m_pTmpCrashDesc->m_bAddVideo = m_bAddVideo;
+        m_pTmpCrashDesc->m_bClientAppCrashed = FALSE;
+        m_pTmpCrashDesc->m_dwThreadId = 0;
+        m_pTmpCrashDesc->m_pExceptionPtrs = NULL;
+        m_pTmpCrashDesc->m_bSendRecentReports = FALSE;
+        m_pTmpCrashDesc->m_nExceptionType = 0;
+        m_pTmpCrashDesc->m_dwExceptionCode = 0;
+        m_pTmpCrashDesc->m_uFPESubcode = 0;
+        m_pTmpCrashDesc->m_dwInvParamExprOffs = 0;
+        m_pTmpCrashDesc->m_dwInvParamFunctionOffs = 0;
+        m_pTmpCrashDesc->m_dwInvParamFileOffs = 0;
+        m_pTmpCrashDesc->m_uInvParamLine = 0;
+
+        // The string of the previous crash GUID is left unused
+        m_pTmpCrashDesc->m_dwCrashGUIDOffs = PackString(m_sCrashGUID);
+
+        // Breadcrumbs of the previous crash are already in its report
+        if(!bTempMem && m_dwBreadcrumbsOffs!=0)
+        {
+            BREADCRUMBS* pBreadcrumbs = (BREADCRUMBS*)((LPBYTE)m_pTmpCrashDesc+m_dwBreadcrumbsOffs);
+            pBreadcrumbs->m_ftSince = m_ftBreadcrumbsSince;
+        }
+
+        return m_pTmpCrashDesc;
+    }
+
     // Pack config information to shared memory
     memset(m_pTmpCrashDesc, 0, sizeof(CRASH_DESCRIPTION));
     memcpy(m_pTmpCrashDesc->m_uchMagic, "CRD", 3);
@@ -561,6 +609,13 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 	m_pTmpCrashDesc->m_nRestartTimeout = m_nRestartTimeout;
 	m_pTmpCrashDesc->m_nMaxReportsPerDay = m_nMaxReportsPerDay;
 
+    // Property slots and breadcrumb rings are in file mappings of their own.
+    if(!bTempMem)
+    {
+        PackPropSlots();
+        PackBreadcrumbs();
+    }
+
     m_pTmpCrashDesc->m_dwAppNameOffs = PackString(m_sAppName);
     m_pTmpCrashDesc->m_dwAppVersionOffs = PackString(m_sAppVersion);
     m_pTmpCrashDesc->m_dwCrashGUIDOffs = PackString(m_sCrashGUID);
@@ -593,8 +648,14 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 	std::map<CString, CString>::iterator pit;
 	for(pit=m_props.begin(); pit!=m_props.end(); pit++)
 	{
-		// Pack this prop into shared mem.
-		PackProperty(pit->first, pit->second);
+		// Short values in slots are up to date, and threads may be changing them.
+		if(!bTempMem && pit->second.GetLength()<CUSTOM_PROP_VALUE_LEN &&
+		   FindPropSlot(pit->first)!=NULL)
+			continue;
+
+		// Pack this prop into shared mem, into a slot if possible.
+		if(bTempMem || !SetPropSlot(pit->first, pit->second))
+			PackProperty(pit->first, pit->second);
 	}
 
 	// Pack reg keys
@@ -607,37 +668,56 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 		PackRegKey(rit->first, rki);
 	}
 
+    // Pack ring log
+    if(!bTempMem && m_RingLogMem.IsInitialized())
+        PackRingLog();
+
     return m_pTmpCrashDesc;
 }
 
+// Allocates a block at the end of shared memory being packed
+LPBYTE CCrashHandler::AllocSharedMem(DWORD dwLength, DWORD& dwOffs)
+{
+    dwOffs = m_pTmpCrashDesc->m_dwTotalSize;
+    if(dwLength>SHARED_MEM_MAX_SIZE-dwOffs)
+    {
+        ATLASSERT(0); // Out of shared memory
+        dwOffs = 0;
+        return NULL;
+    }
+
+    m_pTmpCrashDesc->m_dwTotalSize += dwLength;
+    return (LPBYTE)m_pTmpCrashDesc+dwOffs;
+}
+
 // Packs a string to shared memory
 DWORD CCrashHandler::PackString(CString str)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
     int nStrLen = str.GetLength()*sizeof(TCHAR);
     WORD wLength = (WORD)(sizeof(STRING_DESC)+nStrLen);
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(wLength, dwTotalSize);
+    if(pView==NULL)
+        return 0;
+
     STRING_DESC* pStrDesc = (STRING_DESC*)pView;
     memcpy(pStrDesc->m_uchMagic, "STR", 3);
     pStrDesc->m_wSize = wLength;
     memcpy(pView+sizeof(STRING_DESC), str.GetBuffer(0), nStrLen);
 
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
-
-    m_pTmpSharedMem->DestroyView(pView);
     return dwTotalSize;
 }
 
 // Packs file item to shared memory
 DWORD CCrashHandler::PackFileItem(FileItem& fi)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(FILE_ITEM);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(FILE_ITEM), dwTotalSize);
+    if(pView==NULL)
+        return 0;
     m_pTmpCrashDesc->m_uFileItems++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
     FILE_ITEM* pFileItem = (FILE_ITEM*)pView;
 
     memcpy(pFileItem->m_uchMagic, "FIL", 3);
@@ -648,19 +728,18 @@ DWORD CCrashHandler::PackFileItem(FileItem& fi)
 	pFileItem->m_bAllowDelete = fi.m_bAllowDelete;
     pFileItem->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
 
-    m_pTmpSharedMem->DestroyView(pView);
     return dwTotalSize;
 }
 
 // Packs custom property to shared memory
 DWORD CCrashHandler::PackProperty(CString sName, CString sValue)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(CUSTOM_PROP);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(CUSTOM_PROP), dwTotalSize);
+    if(pView==NULL)
+        return 0;
     m_pTmpCrashDesc->m_uCustomProps++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
     CUSTOM_PROP* pProp = (CUSTOM_PROP*)pView;
 
     memcpy(pProp->m_uchMagic, "CPR", 3);
@@ -668,19 +747,342 @@ DWORD CCrashHandler::PackProperty(CString sName, CString sValue)
     pProp->m_dwValueOffs = PackString(sValue);
     pProp->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
 
-    m_pTmpSharedMem->DestroyView(pView);
     return dwTotalSize;
 }
 
+// Returns FNV-1a hash of property name
+static DWORD HashPropName(LPCTSTR szName)
+{
+    DWORD dwHash = 2166136261;
+    for(; *szName!=0; szName++)
+    {
+        dwHash ^= (DWORD)*szName;
+        dwHash *= 16777619;
+    }
+    return dwHash;
+}
+
+// Makes the sequence of property slot odd, waiting for another writer to finish
+static LONG LockPropSlot(CUSTOM_PROP_SLOT* pSlot)
+{
+    for(;;)
+    {
+        LONG lSequence = pSlot->m_lSequence;
+        if((lSequence&1)==0 &&
+           InterlockedCompareExchange(&pSlot->m_lSequence, lSequence+1, lSequence)==lSequence)
+            return lSequence;
+        Sleep(0);
+    }
+}
+
+// Makes the sequence of property slot even again
+static void UnlockPropSlot(CUSTOM_PROP_SLOT* pSlot, LONG lSequence)
+{
+    InterlockedExchange(&pSlot->m_lSequence, lSequence+2);
+}
+
+// Creates property slots and packs their description to shared memory
+void CCrashHandler::PackPropSlots()
+{
+    // The slots keep the name they got with the first crash GUID, and stay
+    // mapped while shared memory is recreated, since SetPropSlot() doesn't lock
+    if(!m_PropSlotsMem.IsInitialized())
+    {
+        DWORD dwLength = CUSTOM_PROP_SLOT_COUNT*sizeof(CUSTOM_PROP_SLOT);
+        CString sName;
+        sName.Format(_T("%s-props"), (LPCTSTR)m_sCrashGUID);
+        if(!m_PropSlotsMem.Init(sName, FALSE, dwLength))
+            return;
+
+        CUSTOM_PROP_SLOT* pSlots = (CUSTOM_PROP_SLOT*)m_PropSlotsMem.CreateView(0, dwLength);
+        if(pSlots==NULL)
+        {
+            m_PropSlotsMem.Destroy();
+            return;
+        }
+
+        // The file mapping is zero-initialized
+        int i;
+        for(i=0; i<CUSTOM_PROP_SLOT_COUNT; i++)
+        {
+            memcpy(pSlots[i].m_uchMagic, "CPS", 3);
+            pSlots[i].m_wSize = sizeof(CUSTOM_PROP_SLOT);
+        }
+
+        m_pPropSlots = pSlots;
+    }
+
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(PROP_SLOTS), dwTotalSize);
+    if(pView==NULL)
+        return;
+
+    PROP_SLOTS* pPropSlots = (PROP_SLOTS*)pView;
+
+    memcpy(pPropSlots->m_uchMagic, "PSL", 3);
+    pPropSlots->m_dwMappingNameOffs = PackString(m_PropSlotsMem.GetName());
+    pPropSlots->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+}
+
+// Returns the slot of a property
+CUSTOM_PROP_SLOT* CCrashHandler::FindPropSlot(LPCTSTR szName)
+{
+    if(m_pPropSlots==NULL)
+        return NULL;
+
+    DWORD dwIndex = HashPropName(szName);
+    int i;
+    for(i=0; i<PROP_SLOT_INDEX_SIZE; i++, dwIndex++)
+    {
+        dwIndex &= PROP_SLOT_INDEX_SIZE-1;
+        LONG lSlot = m_aPropSlotIndex[dwIndex];
+        if(lSlot==0)
+            break; // Not found
+
+        // Slot names don't change once the slot is taken
+        CUSTOM_PROP_SLOT* pSlot = &m_pPropSlots[lSlot-1];
+        if(_tcscmp(pSlot->m_szName, szName)==0)
+            return pSlot;
+    }
+
+    return NULL;
+}
+
+// Sets property value in its slot
+BOOL CCrashHandler::SetPropSlot(LPCTSTR szName, LPCTSTR szValue)
+{
+    if(m_pPropSlots==NULL || _tcslen(szName)>=CUSTOM_PROP_NAME_LEN)
+        return FALSE;
+
+    // Overwrite the value if the property already has a slot and the value fits;
+    // this doesn't lock anything but the slot and doesn't allocate memory
+    CUSTOM_PROP_SLOT* pSlot = FindPropSlot(szName);
+    if(pSlot!=NULL && _tcslen(szValue)<CUSTOM_PROP_VALUE_LEN)
+    {
+        WritePropSlot(pSlot, NULL, szValue);
+        return TRUE;
+    }
+
+    // Taking a slot and storing a long value append to shared memory
+    CAutoLock lock(&m_csPropSlots);
+
+    BOOL bNewSlot = FALSE;
+    pSlot = FindPropSlot(szName);
+    if(pSlot==NULL)
+    {
+        if(m_lPropSlotsUsed>=CUSTOM_PROP_SLOT_COUNT)
+            return FALSE; // All slots are taken
+
+        pSlot = &m_pPropSlots[m_lPropSlotsUsed];
+        bNewSlot = TRUE;
+    }
+
+    WritePropSlot(pSlot, bNewSlot?szName:NULL, szValue);
+
+    // Short values are taken from the slot by SavePropSlots()
+    m_props[szName] = szValue;
+
+    if(bNewSlot)
+    {
+        // Add the slot to the hash table once its name is written
+        LONG lSlot = InterlockedIncrement(&m_lPropSlotsUsed);
+        DWORD dwIndex = HashPropName(szName);
+        for(;; dwIndex++)
+        {
+            dwIndex &= PROP_SLOT_INDEX_SIZE-1;
+            if(m_aPropSlotIndex[dwIndex]==0)
+                break;
+        }
+        InterlockedExchange(&m_aPropSlotIndex[dwIndex], lSlot);
+    }
+
+    return TRUE;
+}
+
+// Writes property name and value into the slot
+void CCrashHandler::WritePropSlot(CUSTOM_PROP_SLOT* pSlot, LPCTSTR szName, LPCTSTR szValue)
+{
+    // Long values are packed as strings before the slot is locked
+    size_t nValueLen = _tcslen(szValue);
+    DWORD dwValueOffs = 0;
+    if(nValueLen>=CUSTOM_PROP_VALUE_LEN)
+        dwValueOffs = PackString(szValue);
+
+    LONG lSequence = LockPropSlot(pSlot);
+
+    if(szName!=NULL)
+        memcpy(pSlot->m_szName, szName, (_tcslen(szName)+1)*sizeof(TCHAR));
+
+    if(dwValueOffs==0)
+        memcpy(pSlot->m_szValue, szValue, (nValueLen+1)*sizeof(TCHAR));
+    else
+        pSlot->m_szValue[0] = 0;
+    pSlot->m_dwValueOffs = dwValueOffs;
+
+    UnlockPropSlot(pSlot, lSequence);
+}
+
+// Copies current values of slot properties to m_props
+void CCrashHandler::SavePropSlots()
+{
+    if(m_pPropSlots==NULL)
+        return;
+
+    CAutoLock lock(&m_csPropSlots);
+
+    LONG i;
+    for(i=0; i<m_lPropSlotsUsed; i++)
+    {
+        CUSTOM_PROP_SLOT* pSlot = &m_pPropSlots[i];
+        LONG lSequence = LockPropSlot(pSlot);
+
+        // Long values are already there
+        if(pSlot->m_dwValueOffs==0)
+            m_props[pSlot->m_szName] = pSlot->m_szValue;
+
+        UnlockPropSlot(pSlot, lSequence);
+    }
+}
+
+// Packs ring log description to shared memory
+DWORD CCrashHandler::PackRingLog()
+{
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(RING_LOG), dwTotalSize);
+    if(pView==NULL)
+        return 0;
+
+    RING_LOG* pRingLog = (RING_LOG*)pView;
+
+    memcpy(pRingLog->m_uchMagic, "RLG", 3);
+    pRingLog->m_dwMappingNameOffs = PackString(m_RingLogMem.GetName());
+    pRingLog->m_dwDstFileNameOffs = PackString(m_sRingLogDstFile);
+    pRingLog->m_dwDescriptionOffs = PackString(m_sRingLogDesc);
+    pRingLog->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+
+    return dwTotalSize;
+}
+
+// Creates breadcrumb rings and packs their description to shared memory
+void CCrashHandler::PackBreadcrumbs()
+{
+    // The rings keep the name they got with the first crash GUID, and stay
+    // mapped while shared memory is recreated, since AddBreadcrumb() doesn't lock
+    if(!m_BreadcrumbsMem.IsInitialized())
+    {
+        DWORD dwLength = BREADCRUMB_RING_COUNT*sizeof(BREADCRUMB_RING);
+        CString sName;
+        sName.Format(_T("%s-crumbs"), (LPCTSTR)m_sCrashGUID);
+        if(!m_BreadcrumbsMem.Init(sName, FALSE, dwLength))
+            return;
+
+        BREADCRUMB_RING* pRings = (BREADCRUMB_RING*)m_BreadcrumbsMem.CreateView(0, dwLength);
+        if(pRings==NULL)
+        {
+            m_BreadcrumbsMem.Destroy();
+            return;
+        }
+
+        // The file mapping is zero-initialized
+        int i;
+        for(i=0; i<BREADCRUMB_RING_COUNT; i++)
+        {
+            memcpy(pRings[i].m_uchMagic, "BRR", 3);
+            pRings[i].m_wSize = sizeof(BREADCRUMB_RING);
+        }
+
+        m_pBreadcrumbs = pRings;
+    }
+
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(BREADCRUMBS), dwTotalSize);
+    if(pView==NULL)
+        return;
+
+    BREADCRUMBS* pBreadcrumbs = (BREADCRUMBS*)pView;
+
+    memcpy(pBreadcrumbs->m_uchMagic, "BRL", 3);
+    pBreadcrumbs->m_ftSince = m_ftBreadcrumbsSince;
+    pBreadcrumbs->m_dwMappingNameOffs = PackString(m_BreadcrumbsMem.GetName());
+    pBreadcrumbs->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+    m_dwBreadcrumbsOffs = dwTotalSize;
+}
+
+// Returns the ring of the calling thread
+BREADCRUMB_RING* CCrashHandler::GetBreadcrumbRing(BOOL& bShared)
+{
+    BREADCRUMB_RING* pRings = m_pBreadcrumbs;
+    if(pRings==NULL || m_dwBreadcrumbTls==TLS_OUT_OF_INDEXES)
+        return NULL;
+
+    LONG lRing = (LONG)(LONG_PTR)TlsGetValue(m_dwBreadcrumbTls);
+    if(lRing==0)
+    {
+        // Take a free ring; ring 0 is shared by threads coming while all rings are taken
+        for(lRing=1; lRing<BREADCRUMB_RING_COUNT; lRing++)
+        {
+            if(InterlockedCompareExchange(&m_aBreadcrumbRingTaken[lRing], 1, 0)==0)
+                break;
+        }
+        if(lRing>=BREADCRUMB_RING_COUNT)
+            lRing = 0;
+        TlsSetValue(m_dwBreadcrumbTls, (LPVOID)(LONG_PTR)(lRing+1));
+    }
+    else
+        lRing--;
+
+    bShared = lRing==0;
+    return &pRings[lRing];
+}
+
+// Frees the ring of the calling thread
+void CCrashHandler::ReleaseBreadcrumbRing()
+{
+    BREADCRUMB_RING* pRings = m_pBreadcrumbs;
+    if(pRings==NULL || m_dwBreadcrumbTls==TLS_OUT_OF_INDEXES)
+        return;
+
+    LONG lRing = (LONG)(LONG_PTR)TlsGetValue(m_dwBreadcrumbTls);
+    if(lRing==0)
+        return; // The thread has recorded no breadcrumbs
+    lRing--;
+    TlsSetValue(m_dwBreadcrumbTls, NULL);
+
+    // The shared ring is never freed
+    if(lRing==0)
+        return;
+
+    // Drop records of the exiting thread, so that they are not reported
+    // as recorded by the next owner
+    BREADCRUMB_RING* pRing = &pRings[lRing];
+    pRing->m_lHead = 0;
+    int i;
+    for(i=0; i<BREADCRUMB_RING_SIZE; i++)
+        pRing->m_aRecords[i].m_lSequence = 0;
+
+    InterlockedExchange(&m_aBreadcrumbRingTaken[lRing], 0);
+}
+
+// Copies contents of shared memory, so that they can be repacked
+void CCrashHandler::SavePackedInfo(std::vector<BYTE>& aPacked)
+{
+    // Keep out threads adding properties
+    CAutoLock lock(&m_csPropSlots);
+
+    // Property slots are not in shared memory and stay as they are
+    LPBYTE pPacked = (LPBYTE)m_pCrashDesc;
+    aPacked.assign(pPacked, pPacked+m_pCrashDesc->m_dwTotalSize);
+}
+
 // Packs registry key to shared memory
 DWORD CCrashHandler::PackRegKey(CString sKeyName, RegKeyInfo& rki)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(REG_KEY);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwTotalSize = 0;
+    LPBYTE pView = AllocSharedMem(sizeof(REG_KEY), dwTotalSize);
+    if(pView==NULL)
+        return 0;
     m_pTmpCrashDesc->m_uRegKeyEntries++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
     REG_KEY* pKey = (REG_KEY*)pView;
 
     memcpy(pKey->m_uchMagic, "REG", 3);
@@ -689,7 +1091,6 @@ DWORD CCrashHandler::PackRegKey(CString sKeyName, RegKeyInfo& rki)
 	pKey->m_dwDstFileNameOffs = PackString(rki.m_sDstFileName);
     pKey->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
 
-    m_pTmpSharedMem->DestroyView(pView);
     return dwTotalSize;
 }
 
@@ -1107,7 +1508,7 @@ int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc
 
 		// Check if file is already in our list
 		std::map<CString, FileItem>::iterator it = m_files.find(fi.m_sDstFileName);
-		if(it!=m_files.end())
+		if(it!=m_files.end() || (!m_sRingLogDstFile.IsEmpty() && fi.m_sDstFileName==m_sRingLogDstFile))
 		{
 			crSetErrorMsg(_T("A file with such a destination name already exists."));
 			return 1;
@@ -1139,25 +1540,198 @@ int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc
 }
 
 // Adds a custom property to the error report
-int CCrashHandler::AddProperty(CString sPropName, CString sPropValue)
+int CCrashHandler::AddProperty(LPCTSTR szPropName, LPCTSTR szPropValue)
 {
-    crSetErrorMsg(_T("Unspecified error."));
+    // This may be called very often to update a property, so the error
+    // message is left to the caller unless something is wrong.
 
-    if(sPropName.IsEmpty())
+    if(szPropName==NULL || szPropName[0]==0)
     {
         crSetErrorMsg(_T("Invalid property name specified."));
         return 1;
     }
 
-    m_props[sPropName] = sPropValue;
+    if(szPropValue==NULL)
+        szPropValue = _T("");
+
+    // Properties are kept in slots updated in place while there are free slots;
+    // others are appended to shared memory on every call.
+    if(SetPropSlot(szPropName, szPropValue))
+        return 0;
+
+    CAutoLock lock(&m_csPropSlots);
+
+    m_props[szPropName] = szPropValue;
 
-    PackProperty(sPropName, sPropValue);
+    PackProperty(szPropName, szPropValue);
+
+    // OK.
+    return 0;
+}
+
+// Records a breadcrumb
+int CCrashHandler::AddBreadcrumb(LPCTSTR szText)
+{
+    // This is called from frequently executed code, so it doesn't lock
+    // or allocate anything, and doesn't set the error message on success.
+
+    if(szText==NULL)
+    {
+        crSetErrorMsg(_T("Invalid breadcrumb text specified."));
+        return 1;
+    }
+
+    BOOL bShared = FALSE;
+    BREADCRUMB_RING* pRing = GetBreadcrumbRing(bShared);
+    if(pRing==NULL)
+    {
+        crSetErrorMsg(_T("Breadcrumb buffers are not available."));
+        return 1;
+    }
+
+    // Only the owner thread writes to its ring, so it takes the next position
+    // without an interlocked operation; threads sharing ring 0 increment the head
+    // first. When they wrap around the ring faster than a record is written,
+    // the record may be lost.
+    LONG lPos = bShared ? InterlockedIncrement(&pRing->m_lHead)-1 : pRing->m_lHead;
+    BREADCRUMB* pRecord = &pRing->m_aRecords[lPos&(BREADCRUMB_RING_SIZE-1)];
+
+    // Volatile stores are not reordered with other stores
+    pRecord->m_lSequence = 0;
+    pRecord->m_dwThreadId = GetCurrentThreadId();
+    GetSystemTimeAsFileTime(&pRecord->m_ftTime);
+    int i;
+    for(i=0; i<BREADCRUMB_TEXT_LEN-1 && szText[i]!=0; i++)
+        pRecord->m_szText[i] = szText[i];
+    pRecord->m_szText[i] = 0;
+    pRecord->m_lSequence = lPos+1;
+
+    if(!bShared)
+        pRing->m_lHead = lPos+1;
+
+    // OK.
+    return 0;
+}
+
+// Creates the ring log
+int CCrashHandler::AddRingLog(LPCTSTR pszDestFile, LPCTSTR pszDesc, DWORD dwSize)
+{
+    crSetErrorMsg(_T("Unspecified error."));
+
+    if(pszDestFile==NULL || pszDestFile[0]==0 || _tcspbrk(pszDestFile, _T("\\/\r\n\t"))!=NULL)
+    {
+        crSetErrorMsg(_T("Invalid destination file name specified."));
+        return 1;
+    }
+
+    if(dwSize<RING_LOG_MIN_SIZE || dwSize>RING_LOG_MAX_SIZE)
+    {
+        crSetErrorMsg(_T("Invalid ring log size specified."));
+        return 1;
+    }
+
+    // Appends to shared memory
+    CAutoLock lock(&m_csPropSlots);
+
+    if(m_RingLogMem.IsInitialized())
+    {
+        crSetErrorMsg(_T("The ring log has already been added."));
+        return 2;
+    }
+
+    if(m_files.find(pszDestFile)!=m_files.end())
+    {
+        crSetErrorMsg(_T("A file with such a destination name already exists."));
+        return 2;
+    }
+
+    // Round the size up to a power of two
+    DWORD dwDataSize = RING_LOG_MIN_SIZE;
+    while(dwDataSize<dwSize)
+        dwDataSize *= 2;
+
+    // The log keeps the name it got with the first crash GUID
+    CString sName;
+    sName.Format(_T("%s-log"), (LPCTSTR)m_sCrashGUID);
+    if(!m_RingLogMem.Init(sName, FALSE, sizeof(RING_LOG_HEADER)+dwDataSize))
+    {
+        crSetErrorMsg(_T("Couldn't create ring log file mapping."));
+        return 3;
+    }
+
+    RING_LOG_HEADER* pRingLog =
+        (RING_LOG_HEADER*)m_RingLogMem.CreateView(0, sizeof(RING_LOG_HEADER)+dwDataSize);
+    if(pRingLog==NULL)
+    {
+        m_RingLogMem.Destroy();
+        crSetErrorMsg(_T("Couldn't create ring log view."));
+        return 3;
+    }
+
+    // The file mapping is zero-initialized
+    memcpy(pRingLog->m_uchMagic, "RLH", 3);
+    pRingLog->m_wSize = sizeof(RING_LOG_HEADER);
+    pRingLog->m_dwDataSize = dwDataSize;
+
+    m_sRingLogDstFile = pszDestFile;
+    m_sRingLogDesc = pszDesc;
+
+    PackRingLog();
+
+    // Let WriteRingLog() use the log
+    InterlockedExchangePointer((PVOID*)&m_pRingLog, pRingLog);
 
     // OK.
     crSetErrorMsg(_T("Success."));
     return 0;
 }
 
+// Appends data to the ring log
+int CCrashHandler::WriteRingLog(LPCVOID pData, DWORD cbData)
+{
+    // This is called as often as the app logs something, so it doesn't lock
+    // or allocate anything, and doesn't set the error message on success.
+
+    RING_LOG_HEADER* pRingLog = m_pRingLog;
+    if(pRingLog==NULL)
+    {
+        crSetErrorMsg(_T("The ring log has not been added."));
+        return 1;
+    }
+
+    if(pData==NULL && cbData!=0)
+    {
+        crSetErrorMsg(_T("Invalid data specified."));
+        return 1;
+    }
+
+    DWORD dwDataSize = pRingLog->m_dwDataSize;
+    LPBYTE pRingData = (LPBYTE)pRingLog+sizeof(RING_LOG_HEADER);
+
+    // Only the end of data larger than the log would be kept
+    if(cbData>dwDataSize)
+    {
+        pData = (LPBYTE)pData+cbData-dwDataSize;
+        cbData = dwDataSize;
+    }
+
+    if(cbData==0)
+        return 0;
+
+    // Reserve space; writers copy their data at the same time
+    DWORD dwPos = (DWORD)InterlockedExchangeAdd(&pRingLog->m_lHead, (LONG)cbData);
+    if(pRingLog->m_lWrapped==0 && dwPos+cbData>=dwDataSize)
+        pRingLog->m_lWrapped = 1;
+
+    DWORD dwOffs = dwPos&(dwDataSize-1);
+    DWORD dwFirst = cbData<dwDataSize-dwOffs ? cbData : dwDataSize-dwOffs;
+    memcpy(pRingData+dwOffs, pData, dwFirst);
+    memcpy(pRingData, (LPBYTE)pData+dwFirst, cbData-dwFirst);
+
+    // OK.
+    return 0;
+}
+
 // Adds a screen shot to the error report
 int CCrashHandler::AddScreenshot(DWORD dwFlags, int nJpegQuality)
 {
@@ -1671,24 +2245,36 @@ int CCrashHandler::PerCrashInit()
 	m_sErrorReportDirW = strconv.t2w(sErrorReportDirName);
 	m_sErrorReportDirA = strconv.t2a(sErrorReportDirName);
 
-	// Reset shared memory
+	// Reset shared memory. A new one is created for each crash GUID, and what is
+	// packed into the previous one is copied to it. Threads appending properties
+	// to shared memory are kept out until it is packed again.
+	CAutoLock lock(&m_csPropSlots);
+	std::vector<BYTE> aPacked;
 	if(m_SharedMem.IsInitialized())
 	{
+		if(m_pCrashDesc->m_dwTotalSize<=SHARED_MEM_MAX_SIZE/2)
+			SavePackedInfo(aPacked);
+		else
+			SavePropSlots(); // Pack everything again to drop replaced entries
+
+		// Breadcrumbs recorded so far are in the previous report
+		GetSystemTimeAsFileTime(&m_ftBreadcrumbsSince);
+
 		m_SharedMem.Destroy();
 		m_pCrashDesc = NULL;
 	}
 
-    Repack();
+    Repack(aPacked);
 
 	// OK
 	return 0;
 }
 
-void CCrashHandler::Repack()
+void CCrashHandler::Repack(const std::vector<BYTE>& aPacked)
 {
     // Pack configuration info into shared memory.
     // It will be passed to CrashSender.exe later.
-    m_pCrashDesc = PackCrashInfoIntoSharedMem(&m_SharedMem, FALSE);
+    m_pCrashDesc = PackCrashInfoIntoSharedMem(&m_SharedMem, FALSE, &aPacked);
 }
 
 int CCrashHandler::CallBack(int nStage, CR_EXCEPTION_INFO* pExInfo)
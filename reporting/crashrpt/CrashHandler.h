@@ -40,6 +40,10 @@ struct ThreadExceptionHandlers
     void (__cdecl *m_prevSigSEGV)(int);  // Previous illegal storage access handler
 };
 
+// Size of the hash table finding property slots by name; a power of two
+// bigger than CUSTOM_PROP_SLOT_COUNT.
+#define PROP_SLOT_INDEX_SIZE 128
+
 // Sets the last error message (for the caller thread).
 int crSetErrorMsg(PTSTR pszErrorMsg);
 
@@ -145,8 +149,20 @@ public:
     int AddFile(__in_z LPCTSTR lpFile, __in_opt LPCTSTR lpDestFile,
 				__in_opt LPCTSTR lpDesc, DWORD dwFlags);
 
-    // Adds a named text property to the report.
-    int AddProperty(CString sPropName, CString sPropValue);
+    // Adds a named text property to the report, or updates its value.
+    int AddProperty(LPCTSTR szPropName, LPCTSTR szPropValue);
+
+    // Records a breadcrumb into the ring buffer of the calling thread.
+    int AddBreadcrumb(LPCTSTR szText);
+
+    // Frees the ring buffer of the calling thread, which is exiting.
+    void ReleaseBreadcrumbRing();
+
+    // Creates the ring log included into the crash report.
+    int AddRingLog(LPCTSTR pszDestFile, LPCTSTR pszDesc, DWORD dwSize);
+
+    // Appends data to the ring log.
+    int WriteRingLog(LPCVOID pData, DWORD cbData);
 
     // Adds desktop screenshot of crash into error report.
     int AddScreenshot(DWORD dwFlags, int nJpegQuality);
@@ -225,15 +241,39 @@ public:
         EXCEPTION_POINTERS* pExceptionPointers);
 
     // Packs crash description into shared memory.
-    CRASH_DESCRIPTION* PackCrashInfoIntoSharedMem(__in CSharedMem* pSharedMem, BOOL bTempMem);
+    // If pPacked is not empty, it is copied as is (see SavePackedInfo()).
+    CRASH_DESCRIPTION* PackCrashInfoIntoSharedMem(__in CSharedMem* pSharedMem, BOOL bTempMem,
+        const std::vector<BYTE>* pPacked = NULL);
+    // Allocates a block at the end of shared memory; returns NULL if it's full.
+    LPBYTE AllocSharedMem(DWORD dwLength, DWORD& dwOffs);
     // Packs a string.
     DWORD PackString(CString str);
     // Packs a file item.
     DWORD PackFileItem(FileItem& fi);
     // Packs a custom user property.
     DWORD PackProperty(CString sName, CString sValue);
+    // Creates property slots on first call and packs their description.
+    void PackPropSlots();
+    // Returns the slot of a property, or NULL if it has none.
+    CUSTOM_PROP_SLOT* FindPropSlot(LPCTSTR szName);
+    // Sets property value in its slot, taking a free slot if needed.
+    // Returns FALSE if the property can't be kept in a slot.
+    BOOL SetPropSlot(LPCTSTR szName, LPCTSTR szValue);
+    // Writes property name (if not NULL) and value into the slot.
+    void WritePropSlot(CUSTOM_PROP_SLOT* pSlot, LPCTSTR szName, LPCTSTR szValue);
+    // Copies current values of slot properties to m_props.
+    void SavePropSlots();
+    // Creates breadcrumb ring buffers on first call and packs their description.
+    void PackBreadcrumbs();
+    // Returns the ring buffer of the calling thread, taking a free one if needed.
+    // bShared is set to TRUE if the ring is shared with other threads.
+    BREADCRUMB_RING* GetBreadcrumbRing(BOOL& bShared);
+    // Copies contents of shared memory.
+    void SavePackedInfo(std::vector<BYTE>& aPacked);
     // Packs a registry key.
     DWORD PackRegKey(CString sKeyName, RegKeyInfo& rki);
+    // Packs ring log description.
+    DWORD PackRingLog();
 
     // Launches the CrashSender.exe process.
     int LaunchCrashSender(
@@ -250,8 +290,8 @@ public:
 	// Initializes several internal fields before each crash.
 	int PerCrashInit();
 
-    // Pack configuration info into shared memory.
-    void Repack();
+    // Pack configuration info into shared memory, copying aPacked if not empty.
+    void Repack(const std::vector<BYTE>& aPacked);
 
     // Acqure exclusive access to this crash handler.
     void CrashLock(BOOL bLock);
@@ -325,7 +365,22 @@ public:
 	HWND m_hWndVideoParent;        // Parent window for video recording dialog.
     CString m_sCustomSenderIcon;   // Resource name that can be used as custom Error Report dialog icon.
     std::map<CString, FileItem> m_files; // File items to include.
-    std::map<CString, CString> m_props;  // User-defined properties to include.
+    std::map<CString, CString> m_props;  // User-defined properties to include (values of slot properties are updated by SavePropSlots()).
+    CSharedMem m_PropSlotsMem;      // File mapping holding property slots.
+    CUSTOM_PROP_SLOT* m_pPropSlots; // Property slots view, or NULL if there are no slots.
+    volatile LONG m_lPropSlotsUsed; // Count of taken property slots.
+    volatile LONG m_aPropSlotIndex[PROP_SLOT_INDEX_SIZE]; // Hash table of slot numbers plus one, by property name.
+    CCritSec m_csPropSlots;        // Serializes taking property slots and appending to shared memory.
+    CSharedMem m_BreadcrumbsMem;   // File mapping holding breadcrumb rings.
+    BREADCRUMB_RING* m_pBreadcrumbs; // Breadcrumb rings view, or NULL if there are no rings.
+    DWORD m_dwBreadcrumbsOffs;     // Offset of breadcrumb rings description in shared mem.
+    FILETIME m_ftBreadcrumbsSince; // Breadcrumbs recorded earlier are in a previous report.
+    volatile LONG m_aBreadcrumbRingTaken[BREADCRUMB_RING_COUNT]; // Nonzero if the ring belongs to a thread.
+    DWORD m_dwBreadcrumbTls;       // TLS index of the ring number plus one of the calling thread.
+    CSharedMem m_RingLogMem;       // File mapping holding the ring log.
+    RING_LOG_HEADER* m_pRingLog;   // Ring log view, or NULL if there is no ring log.
+    CString m_sRingLogDstFile;     // Ring log file name in crash report.
+    CString m_sRingLogDesc;        // Ring log file description.
     std::map<CString, RegKeyInfo> m_RegKeys; // Registry keys to dump.
     CCritSec m_csCrashLock;        // Critical section used to synchronize thread access to this object.
     HANDLE m_hEvent;               // Event used to synchronize CrashRpt.dll with CrashSender.exe.
@@ -542,7 +542,7 @@ crAddPropertyW(
         return 1; // No handler installed for current process?
     }
 
-    int nResult = pCrashHandler->AddProperty(CString(pszPropNameT), CString(pszPropValueT));
+    int nResult = pCrashHandler->AddProperty(pszPropNameT, pszPropValueT);
     if(nResult!=0)
     {
         crSetErrorMsg(_T("Invalid property name specified."));
@@ -564,6 +564,129 @@ crAddPropertyA(
     return crAddPropertyW(strconv.a2w(pszPropName), strconv.a2w(pszPropValue));
 }
 
+CRASHRPTAPI(int)
+crAddBreadcrumbW(
+                 LPCWSTR pszText
+                 )
+{
+    // Unlike other functions, this one doesn't allocate memory for
+    // string conversion and sets the error message only on fail.
+
+    CCrashHandler *pCrashHandler =
+        CCrashHandler::GetCurrentProcessCrashHandler();
+
+    if(pCrashHandler==NULL)
+    {
+        crSetErrorMsg(_T("Crash handler wasn't previously installed for current process."));
+        return 1; // No handler installed for current process?
+    }
+
+    if(pszText==NULL)
+    {
+        crSetErrorMsg(_T("Invalid breadcrumb text specified."));
+        return 2;
+    }
+
+#ifdef UNICODE
+    LPCTSTR pszTextT = pszText;
+#else
+    // Convert only as much text as is kept
+    CHAR szTextT[BREADCRUMB_TEXT_LEN*2];
+    int nLen = (int)wcsnlen(pszText, BREADCRUMB_TEXT_LEN-1);
+    nLen = WideCharToMultiByte(CP_ACP, 0, pszText, nLen, szTextT, BREADCRUMB_TEXT_LEN*2-1, NULL, NULL);
+    szTextT[nLen] = 0;
+    LPCTSTR pszTextT = szTextT;
+#endif
+
+    if(pCrashHandler->AddBreadcrumb(pszTextT)!=0)
+        return 3; // Error message is set by AddBreadcrumb()
+
+    return 0;
+}
+
+CRASHRPTAPI(int)
+crAddBreadcrumbA(
+                 LPCSTR pszText
+                 )
+{
+    if(pszText==NULL)
+        return crAddBreadcrumbW(NULL);
+
+    // Convert only as much text as is kept
+    CHAR szText[BREADCRUMB_TEXT_LEN];
+    WCHAR szTextW[BREADCRUMB_TEXT_LEN];
+    strncpy_s(szText, BREADCRUMB_TEXT_LEN, pszText, _TRUNCATE);
+    int nLen = MultiByteToWideChar(CP_ACP, 0, szText, -1, szTextW, BREADCRUMB_TEXT_LEN);
+    if(nLen==0)
+        szTextW[0] = 0;
+    return crAddBreadcrumbW(szTextW);
+}
+
+CRASHRPTAPI(int)
+crAddRingLogW(
+              LPCWSTR pszDestFile,
+              LPCWSTR pszDesc,
+              DWORD dwSize
+              )
+{
+    crSetErrorMsg(_T("Unspecified error."));
+
+    strconv_t strconv;
+    LPCTSTR pszDestFileT = strconv.w2t(pszDestFile);
+    LPCTSTR pszDescT = strconv.w2t(pszDesc);
+
+    CCrashHandler *pCrashHandler =
+        CCrashHandler::GetCurrentProcessCrashHandler();
+
+    if(pCrashHandler==NULL)
+    {
+        crSetErrorMsg(_T("Crash handler wasn't previously installed for current process."));
+        return 1; // No handler installed for current process?
+    }
+
+    int nResult = pCrashHandler->AddRingLog(pszDestFileT, pszDescT, dwSize);
+    if(nResult!=0)
+        return 2; // Error message is set by AddRingLog()
+
+    crSetErrorMsg(_T("Success."));
+    return 0;
+}
+
+CRASHRPTAPI(int)
+crAddRingLogA(
+              LPCSTR pszDestFile,
+              LPCSTR pszDesc,
+              DWORD dwSize
+              )
+{
+    // This is just a wrapper for wide-char function version
+    strconv_t strconv;
+    return crAddRingLogW(strconv.a2w(pszDestFile), strconv.a2w(pszDesc), dwSize);
+}
+
+CRASHRPTAPI(int)
+crWriteRingLog(
+               LPCVOID pData,
+               DWORD cbData
+               )
+{
+    // Like crAddBreadcrumbW(), this sets the error message only on fail.
+
+    CCrashHandler *pCrashHandler =
+        CCrashHandler::GetCurrentProcessCrashHandler();
+
+    if(pCrashHandler==NULL)
+    {
+        crSetErrorMsg(_T("Crash handler wasn't previously installed for current process."));
+        return 1; // No handler installed for current process?
+    }
+
+    if(pCrashHandler->WriteRingLog(pData, cbData)!=0)
+        return 2; // Error message is set by WriteRingLog()
+
+    return 0;
+}
+
 CRASHRPTAPI(int)
 crAddRegKeyW(
              LPCWSTR pszRegKey,
@@ -1043,6 +1166,10 @@ BOOL APIENTRY DllMain(HANDLE hModule, DWORD dwReason, LPVOID /*lpReserved*/)
 		{
 			pCrashHandler->UnSetThreadExceptionHandlers();
 		}
+
+		// Let another thread take its breadcrumb ring.
+		if(pCrashHandler!=NULL && pCrashHandler->IsInitialized())
+			pCrashHandler->ReleaseBreadcrumbRing();
 	}
 
     return TRUE;
@@ -63,6 +63,98 @@ struct CUSTOM_PROP
     DWORD m_dwValueOffs; // Property value.
 };
 
+// Property slots are reserved in a file mapping of their own at startup, so that
+// properties are updated in place instead of being appended on every crAddProperty()
+// call. The mapping stays in place while shared memory is recreated for the next crash.
+#define CUSTOM_PROP_SLOT_COUNT 64   // Count of property slots.
+#define CUSTOM_PROP_NAME_LEN   64   // Max length of slot property name, including terminating zero.
+#define CUSTOM_PROP_VALUE_LEN  256  // Max length of inline slot property value, including terminating zero.
+
+// User-defined property updated in place.
+// The slot is guarded by a sequence lock: the writer makes m_lSequence odd, changes
+// the value and makes it even again, and the reader retries until it reads the same
+// even sequence before and after copying the slot.
+struct CUSTOM_PROP_SLOT
+{
+    BYTE m_uchMagic[3];          // Magic sequence "CPS"
+    WORD m_wSize;                // Total bytes occupied by this block.
+    volatile LONG m_lSequence;   // Odd while the value is being written.
+    DWORD m_dwValueOffs;         // Offset in shared memory of a value too long for m_szValue, or 0.
+    TCHAR m_szName[CUSTOM_PROP_NAME_LEN];   // Property name (empty if the slot is free).
+    TCHAR m_szValue[CUSTOM_PROP_VALUE_LEN]; // Property value.
+};
+
+// Property slots description.
+struct PROP_SLOTS
+{
+    BYTE m_uchMagic[3];        // Magic sequence "PSL"
+    WORD m_wSize;              // Total bytes occupied by this block.
+    DWORD m_dwMappingNameOffs; // Name of the file mapping holding CUSTOM_PROP_SLOT_COUNT slots.
+};
+
+// Breadcrumbs are kept in fixed-size ring buffers, one per recording thread, in a file
+// mapping of their own that stays in place while shared memory is recreated for the next crash.
+// A ring is freed when its thread exits.
+#define BREADCRUMB_RING_COUNT 32  // Count of rings; ring 0 is shared by threads that didn't get their own.
+#define BREADCRUMB_RING_SIZE  64  // Count of records in a ring (must be a power of two).
+#define BREADCRUMB_TEXT_LEN   56  // Max length of breadcrumb text, including terminating zero.
+
+// Breadcrumb record.
+// The writer zeroes m_lSequence, fills the record and sets m_lSequence to the
+// ring position plus one; the reader accepts the record only if it reads the
+// expected sequence before and after copying it.
+struct BREADCRUMB
+{
+    volatile LONG m_lSequence;  // Ring position plus one, or 0 while the record is being written.
+    DWORD m_dwThreadId;         // Thread that recorded the breadcrumb.
+    FILETIME m_ftTime;          // UTC time of recording.
+    TCHAR m_szText[BREADCRUMB_TEXT_LEN]; // Breadcrumb text.
+};
+
+// Breadcrumb ring buffer.
+struct BREADCRUMB_RING
+{
+    BYTE m_uchMagic[3];    // Magic sequence "BRR"
+    WORD m_wSize;          // Total bytes occupied by this block.
+    volatile LONG m_lHead; // Count of records ever written to the ring.
+    BREADCRUMB m_aRecords[BREADCRUMB_RING_SIZE]; // Records, indexed by position modulo ring size.
+};
+
+// Breadcrumb rings description.
+struct BREADCRUMBS
+{
+    BYTE m_uchMagic[3];        // Magic sequence "BRL"
+    WORD m_wSize;              // Total bytes occupied by this block.
+    DWORD m_dwMappingNameOffs; // Name of the file mapping holding BREADCRUMB_RING_COUNT rings.
+    FILETIME m_ftSince;        // Records made earlier are in a previous error report.
+};
+
+// Ring log is kept in its own file mapping, so that it may be larger than this shared memory.
+#define RING_LOG_MIN_SIZE 4096              // Min size of ring log data.
+#define RING_LOG_MAX_SIZE (64*1024*1024)    // Max size of ring log data.
+
+// Ring log description.
+struct RING_LOG
+{
+    BYTE m_uchMagic[3];        // Magic sequence "RLG"
+    WORD m_wSize;              // Total bytes occupied by this block.
+    DWORD m_dwMappingNameOffs; // Name of the file mapping holding the log.
+    DWORD m_dwDstFileNameOffs; // Destination file name.
+    DWORD m_dwDescriptionOffs; // File description.
+};
+
+// Header of the ring log file mapping, followed by m_dwDataSize bytes of log data.
+// A writer reserves space by adding the length of its data to m_lHead, and copies
+// data at position P to offset P&(m_dwDataSize-1).
+struct RING_LOG_HEADER
+{
+    BYTE m_uchMagic[3];       // Magic sequence "RLH"
+    WORD m_wSize;             // Size of this header.
+    DWORD m_dwDataSize;       // Size of log data (a power of two).
+    volatile LONG m_lHead;    // Count of bytes ever written, modulo 2^32.
+    volatile LONG m_lWrapped; // Nonzero once the log has wrapped around.
+};
+
 // Crash description.
 struct CRASH_DESCRIPTION
 {
@@ -604,3 +604,17 @@ BOOL Utility::IsFileSearchPattern(CString sFileName)
 	return bSearchPattern;
 }
 
+BOOL Utility::IsTopPriority(const UINT* puPriorities, int nCount, int nIndex)
+{
+    if((int)puPriorities[nIndex]<0)
+        return FALSE; // Disabled
+
+    int i;
+    for(i=0; i<nCount; i++)
+    {
+        if((int)puPriorities[i]>(int)puPriorities[nIndex])
+            return FALSE;
+    }
+
+    return TRUE;
+}
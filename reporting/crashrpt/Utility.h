@@ -107,6 +107,11 @@ namespace Utility
 
 	// Returns file size
 	long GetFileSize(const TCHAR *fileName);
+
+    // Returns TRUE if the item nIndex of the priority array is enabled and no other
+    // item has a higher priority. Priorities are compared as signed numbers, so
+    // a disabled item ((UINT)-1) never ranks above an enabled one.
+    BOOL IsTopPriority(const UINT* puPriorities, int nCount, int nIndex);
 };
 
 #endif	// _UTILITY_H_
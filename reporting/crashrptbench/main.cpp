@@ -0,0 +1,328 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: main.cpp
+// Description: crashrptbench application. Measures the cost of CrashRpt API calls
+// which pack configuration into shared memory: crInstall(), a batch of crAddFile2()
+// and crAddProperty() calls adding new entries, a batch of crAddProperty() calls
+// updating the same property, and batches of crAddBreadcrumb() and crWriteRingLog() calls.
+
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "CrashRpt.h"
+
+// The following macros are used for parsing the command line
+#define args_left() (argc-cur_arg)
+#define arg_exists() (cur_arg<argc && argv[cur_arg]!=NULL)
+#define get_arg() ( arg_exists() ? argv[cur_arg]:NULL )
+#define skip_arg() cur_arg++
+#define cmp_arg(val) (arg_exists() && (0==_tcscmp(argv[cur_arg], val)))
+
+// Return codes
+enum ReturnCode
+{
+    SUCCESS     = 0, // OK
+    UNEXPECTED  = 1, // Unexpected error
+    INVALIDARG  = 2  // Invalid argument
+};
+
+// Measured stages
+enum BenchStage
+{
+    STAGE_INSTALL = 0,  // crInstall()
+    STAGE_ADDFILE,      // crAddFile2() with distinct file names
+    STAGE_ADDPROP,      // crAddProperty() with distinct property names
+    STAGE_UPDATEPROP,   // crAddProperty() with the same property name
+    STAGE_BREADCRUMB,   // crAddBreadcrumb()
+    STAGE_RINGLOG,      // crWriteRingLog()
+    STAGE_UNINSTALL,    // crUninstall()
+    STAGE_COUNT
+};
+
+LPCTSTR g_szStageNames[STAGE_COUNT] =
+{
+    _T("install"),
+    _T("addfile"),
+    _T("addprop"),
+    _T("updateprop"),
+    _T("breadcrumb"),
+    _T("ringlog"),
+    _T("uninstall")
+};
+
+// Monotonic timer
+class CBenchTimer
+{
+public:
+
+    CBenchTimer()
+    {
+        QueryPerformanceFrequency(&m_Freq);
+        Start();
+    }
+
+    void Start()
+    {
+        QueryPerformanceCounter(&m_Start);
+    }
+
+    // Returns milliseconds elapsed since Start()
+    double GetElapsedMsec()
+    {
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        return (double)(Now.QuadPart-m_Start.QuadPart)*1000.0/(double)m_Freq.QuadPart;
+    }
+
+private:
+
+    LARGE_INTEGER m_Freq;
+    LARGE_INTEGER m_Start;
+};
+
+// Per-stage samples
+std::vector<double> g_Samples[STAGE_COUNT];
+
+// Prints usage
+void print_usage()
+{
+    _tprintf(_T("Usage:\n"));
+    _tprintf(_T("crashrptbench /? Prints this usage help\n"));
+    _tprintf(_T("crashrptbench [arg ...]\n"));
+    _tprintf(_T("  where the argument may be any of the following:\n"));
+    _tprintf(_T("   /n <iterations>  Optional. How many times to install and fill the crash handler (default is 10).\n"));
+    _tprintf(_T("   /c <calls>       Optional. Count of calls in each crAddFile2(), crAddProperty(), crAddBreadcrumb() and crWriteRingLog() batch ")\
+             _T("(default is 1000).\n"));
+}
+
+// Prints the last CrashRpt error
+void print_last_error(LPCTSTR szFunction)
+{
+    TCHAR szErr[1024];
+    crGetLastErrorMsg(szErr, 1024);
+    _tprintf(_T("Error '%s' in %s\n"), szErr, szFunction);
+}
+
+// Installs the crash handler, fills it and uninstalls it one time,
+// recording per-stage times
+int bench_iteration(int nCalls)
+{
+    int result = UNEXPECTED;
+    BOOL bInstalled = FALSE;
+    CBenchTimer timer;
+    double dElapsed[STAGE_COUNT];
+    TCHAR szName[64];
+    TCHAR szValue[64];
+    int i;
+
+    // Reports are never sent; files are only registered, they don't have to exist
+    CR_INSTALL_INFO info;
+    memset(&info, 0, sizeof(CR_INSTALL_INFO));
+    info.cb = sizeof(CR_INSTALL_INFO);
+    info.pszAppName = _T("crashrptbench");
+    info.pszAppVersion = _T("1.0.0");
+    info.dwFlags = CR_INST_NO_GUI|CR_INST_DONT_SEND_REPORT;
+
+    timer.Start();
+    if(0!=crInstall(&info))
+    {
+        print_last_error(_T("crInstall()"));
+        goto cleanup;
+    }
+    bInstalled = TRUE;
+    dElapsed[STAGE_INSTALL] = timer.GetElapsedMsec();
+
+    timer.Start();
+    for(i=0; i<nCalls; i++)
+    {
+        _sntprintf_s(szName, 64, _TRUNCATE, _T("C:\\crashrptbench\\file%d.log"), i);
+        if(0!=crAddFile2(szName, NULL, _T("Log file"), CR_AF_MISSING_FILE_OK))
+        {
+            print_last_error(_T("crAddFile2()"));
+            goto cleanup;
+        }
+    }
+    dElapsed[STAGE_ADDFILE] = timer.GetElapsedMsec();
+
+    timer.Start();
+    for(i=0; i<nCalls; i++)
+    {
+        _sntprintf_s(szName, 64, _TRUNCATE, _T("Property%d"), i);
+        if(0!=crAddProperty(szName, _T("Value")))
+        {
+            print_last_error(_T("crAddProperty()"));
+            goto cleanup;
+        }
+    }
+    dElapsed[STAGE_ADDPROP] = timer.GetElapsedMsec();
+
+    timer.Start();
+    for(i=0; i<nCalls; i++)
+    {
+        _sntprintf_s(szValue, 64, _TRUNCATE, _T("%d"), i);
+        if(0!=crAddProperty(_T("CurrentLevel"), szValue))
+        {
+            print_last_error(_T("crAddProperty()"));
+            goto cleanup;
+        }
+    }
+    dElapsed[STAGE_UPDATEPROP] = timer.GetElapsedMsec();
+
+    timer.Start();
+    for(i=0; i<nCalls; i++)
+    {
+        if(0!=crAddBreadcrumb(_T("Entering main loop iteration")))
+        {
+            print_last_error(_T("crAddBreadcrumb()"));
+            goto cleanup;
+        }
+    }
+    dElapsed[STAGE_BREADCRUMB] = timer.GetElapsedMsec();
+
+    if(0!=crAddRingLog(_T("crashrptbench.log"), _T("Log file"), 1024*1024))
+    {
+        print_last_error(_T("crAddRingLog()"));
+        goto cleanup;
+    }
+
+    timer.Start();
+    for(i=0; i<nCalls; i++)
+    {
+        static const char szLine[] = "2013-01-01 00:00:00.000 [main] Entering main loop iteration\n";
+        if(0!=crWriteRingLog(szLine, sizeof(szLine)-1))
+        {
+            print_last_error(_T("crWriteRingLog()"));
+            goto cleanup;
+        }
+    }
+    dElapsed[STAGE_RINGLOG] = timer.GetElapsedMsec();
+
+    timer.Start();
+    bInstalled = FALSE;
+    if(0!=crUninstall())
+    {
+        print_last_error(_T("crUninstall()"));
+        goto cleanup;
+    }
+    dElapsed[STAGE_UNINSTALL] = timer.GetElapsedMsec();
+
+    for(i=0; i<STAGE_COUNT; i++)
+        g_Samples[i].push_back(dElapsed[i]);
+
+    result = SUCCESS;
+
+cleanup:
+
+    if(bInstalled)
+        crUninstall();
+
+    return result;
+}
+
+// Returns the value at the given percentile (0..100) of sorted samples
+double get_percentile(const std::vector<double>& aSorted, int nPercent)
+{
+    if(aSorted.empty())
+        return 0;
+    size_t nIndex = (aSorted.size()-1)*nPercent/100;
+    return aSorted[nIndex];
+}
+
+// Prints the summary table
+void print_summary(int nCalls)
+{
+    _tprintf(_T("\n%-10s %8s %10s %10s %10s %10s %12s\n"),
+        _T("stage"), _T("samples"), _T("min,ms"), _T("p50,ms"), _T("p90,ms"), _T("max,ms"), _T("p50/call,us"));
+
+    int i;
+    for(i=0; i<STAGE_COUNT; i++)
+    {
+        std::vector<double> aSorted = g_Samples[i];
+        if(aSorted.empty())
+            continue;
+        std::sort(aSorted.begin(), aSorted.end());
+
+        double dMedian = get_percentile(aSorted, 50);
+        int nStageCalls = (i==STAGE_INSTALL || i==STAGE_UNINSTALL) ? 1 : nCalls;
+        _tprintf(_T("%-10s %8d %10.3f %10.3f %10.3f %10.3f %12.3f\n"),
+            g_szStageNames[i], (int)aSorted.size(), aSorted.front(), dMedian,
+            get_percentile(aSorted, 90), aSorted.back(), dMedian*1000.0/nStageCalls);
+    }
+}
+
+// Program entry point
+int _tmain(int argc, TCHAR** argv)
+{
+    int result = INVALIDARG; // Return code
+    int cur_arg = 1; // Current cmdline argument being processed
+    int nIterations = 10;
+    int nCalls = 1000;
+    int i;
+
+    // Parse command line arguments
+    while(arg_exists())
+    {
+        if(cmp_arg(_T("/?")))
+        {
+            result = SUCCESS;
+            print_usage();
+            goto done;
+        }
+        else if(cmp_arg(_T("/n")) || cmp_arg(_T("/c")))
+        {
+            LPCTSTR szName = get_arg();
+            skip_arg();
+            LPCTSTR szValue = get_arg();
+            skip_arg();
+            if(szValue==NULL)
+            {
+                _tprintf(_T("Missing value of %s parameter.\n"), szName);
+                goto done;
+            }
+
+            if(_tcscmp(szName, _T("/n"))==0)
+                nIterations = _ttoi(szValue);
+            else
+                nCalls = _ttoi(szValue);
+        }
+        else // unknown arg
+        {
+            _tprintf(_T("Unexpected parameter: %s\n"), get_arg());
+            goto done;
+        }
+    }
+
+    if(nIterations<=0 || nCalls<=0)
+    {
+        _tprintf(_T("Iteration count or call count is invalid.\n"));
+        goto done;
+    }
+
+    _tprintf(_T("%d iterations, %d calls per batch\n"), nIterations, nCalls);
+
+    for(i=0; i<nIterations; i++)
+    {
+        result = bench_iteration(nCalls);
+        if(result!=SUCCESS)
+            goto done;
+    }
+
+    print_summary(nCalls);
+
+done:
+
+    if(result==INVALIDARG)
+        print_usage();
+
+    return result;
+}
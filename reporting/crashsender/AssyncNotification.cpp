@@ -20,6 +20,7 @@ AssyncNotification::AssyncNotification()
     m_hFeedbackEvent = CreateEvent(0, FALSE, FALSE, 0);
 	// Init handle to log file
     m_fileLog = NULL;
+    m_pParent = NULL;
 
     Reset();
 }
@@ -27,6 +28,16 @@ AssyncNotification::AssyncNotification()
 AssyncNotification::~AssyncNotification()
 {
 	CloseLogFile();
+
+    CloseHandle(m_hCompletionEvent);
+    CloseHandle(m_hCancelEvent);
+    CloseHandle(m_hFeedbackEvent);
+}
+
+void AssyncNotification::SetParent(AssyncNotification* pParent, CString sPrefix)
+{
+    m_pParent = pParent;
+    m_sParentPrefix = sPrefix;
 }
 
 void AssyncNotification::CloseLogFile()
@@ -63,6 +74,7 @@ void AssyncNotification::Reset()
 
     m_nCompletionStatus = -1;
     m_nPercentCompleted = 0;
+    m_bConnected = FALSE;
     m_statusLog.clear();
 
     ResetEvent(m_hCancelEvent);
@@ -98,6 +110,10 @@ void AssyncNotification::SetProgress(CString sStatusMsg, int percentCompleted, b
     }
 
     m_cs.Unlock(); // Free lock
+
+    // Log the message in the parent too; the prefix tells which operation it comes from
+    if(m_pParent!=NULL)
+        m_pParent->SetProgress(m_sParentPrefix+sStatusMsg, 0, true);
 }
 
 void AssyncNotification::SetProgress(int percentCompleted, bool bRelative)
@@ -154,6 +170,40 @@ int AssyncNotification::WaitForCompletion()
     return status;
 }
 
+BOOL AssyncNotification::WaitForCompletion(DWORD dwMilliseconds, int& nStatus)
+{
+    // Blocks until assynchronous operation is completed or the time is out
+    if(WaitForSingleObject(m_hCompletionEvent, dwMilliseconds)!=WAIT_OBJECT_0)
+        return FALSE;
+
+    // Get completion status
+    m_cs.Lock(); // Acquire lock
+    nStatus = m_nCompletionStatus;
+    m_cs.Unlock(); // Free lock
+
+    return TRUE;
+}
+
+void AssyncNotification::SetConnected()
+{
+    m_cs.Lock(); // Acquire lock
+
+    m_bConnected = TRUE;
+
+    m_cs.Unlock(); // Free lock
+}
+
+BOOL AssyncNotification::IsConnected()
+{
+    m_cs.Lock(); // Acquire lock
+
+    BOOL bConnected = m_bConnected;
+
+    m_cs.Unlock(); // Free lock
+
+    return bConnected;
+}
+
 void AssyncNotification::Cancel()
 {
     // Cansels the assync operation
@@ -171,6 +221,10 @@ bool AssyncNotification::IsCancelled()
         return true;
     }
 
+    // The whole operation was cancelled
+    if(m_pParent!=NULL)
+        return m_pParent->IsCancelled();
+
     return false;
 }
 
@@ -45,6 +45,17 @@ struct AssyncNotification
     // Blocks until assynchronous operation is completed
     int WaitForCompletion();
 
+    // Waits at most dwMilliseconds for assynchronous operation completion.
+    // Returns TRUE and the completion status if it has completed.
+    BOOL WaitForCompletion(DWORD dwMilliseconds, int& nStatus);
+
+    // Marks that the operation has reached the server, so it is known to be
+    // slow rather than unable to connect
+    void SetConnected();
+
+    // Determines if the operation has reached the server
+    BOOL IsConnected();
+
     // Cancels the assynchronous operation
     void Cancel();
 
@@ -57,6 +68,10 @@ struct AssyncNotification
     // Notifies about feedback is ready to be received
     void FeedbackReady(int code);
 
+    // Forwards progress messages (with a prefix) to another object, and makes
+    // its cancellation cancel this operation too. Used for concurrent sub-operations.
+    void SetParent(AssyncNotification* pParent, CString sPrefix);
+
 private:
 
     CComAutoCriticalSection m_cs; // Protects internal state
@@ -65,7 +80,10 @@ private:
     HANDLE m_hCancelEvent;        // Cancel event
     HANDLE m_hFeedbackEvent;      // Feedback event
     int m_nPercentCompleted;      // Percent completed
+    BOOL m_bConnected;            // Has the operation reached the server?
     std::vector<CString> m_statusLog; // Status log
 	CString m_sLogFile;
     FILE* m_fileLog;
+    AssyncNotification* m_pParent; // Receives progress messages (may be NULL)
+    CString m_sParentPrefix;       // Prefix for forwarded messages
 };
@@ -0,0 +1,173 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "BytePipe.h"
+
+CBytePipe::CBytePipe(DWORD dwCapacity)
+{
+    m_Buffer.resize(dwCapacity!=0?dwCapacity:1);
+    m_dwHead = 0;
+    m_dwSize = 0;
+    m_bClosed = FALSE;
+    m_bAborted = FALSE;
+    m_hCanRead = CreateEvent(NULL, FALSE, FALSE, NULL);
+    m_hCanWrite = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+CBytePipe::~CBytePipe()
+{
+    if(m_hCanRead!=NULL)
+        CloseHandle(m_hCanRead);
+
+    if(m_hCanWrite!=NULL)
+        CloseHandle(m_hCanWrite);
+}
+
+BOOL CBytePipe::Write(const BYTE* pData, DWORD cbData)
+{
+    DWORD dwCapacity = (DWORD)m_Buffer.size();
+
+    while(cbData>0)
+    {
+        m_cs.Lock();
+
+        if(m_bAborted || m_bClosed)
+        {
+            m_cs.Unlock();
+            return FALSE;
+        }
+
+        if(m_dwSize==dwCapacity)
+        {
+            // Full, wait for the reader
+            m_cs.Unlock();
+            WaitForSingleObject(m_hCanWrite, INFINITE);
+            continue;
+        }
+
+        // Copy to the free space after the tail, wrapping around the end of buffer
+        DWORD dwTail = (m_dwHead+m_dwSize)%dwCapacity;
+        DWORD dwFree = dwCapacity-m_dwSize;
+        DWORD dwContig = dwTail>=m_dwHead ? dwCapacity-dwTail : m_dwHead-dwTail;
+        DWORD dwCopy = cbData;
+        if(dwCopy>dwFree)
+            dwCopy = dwFree;
+        if(dwCopy>dwContig)
+            dwCopy = dwContig;
+
+        memcpy(&m_Buffer[dwTail], pData, dwCopy);
+        m_dwSize += dwCopy;
+        pData += dwCopy;
+        cbData -= dwCopy;
+
+        m_cs.Unlock();
+
+        SetEvent(m_hCanRead);
+    }
+
+    return TRUE;
+}
+
+BOOL CBytePipe::Read(BYTE* pBuffer, DWORD cbBuffer, DWORD& cbRead)
+{
+    DWORD dwCapacity = (DWORD)m_Buffer.size();
+
+    cbRead = 0;
+
+    for(;;)
+    {
+        m_cs.Lock();
+
+        if(m_bAborted)
+        {
+            m_cs.Unlock();
+            return FALSE;
+        }
+
+        if(m_dwSize==0)
+        {
+            if(m_bClosed)
+            {
+                // End of data
+                m_cs.Unlock();
+                return TRUE;
+            }
+
+            // Empty, wait for the writer
+            m_cs.Unlock();
+            WaitForSingleObject(m_hCanRead, INFINITE);
+            continue;
+        }
+
+        // Copy data up to the end of buffer; the rest is returned by the next call
+        DWORD dwContig = dwCapacity-m_dwHead;
+        DWORD dwCopy = m_dwSize;
+        if(dwCopy>dwContig)
+            dwCopy = dwContig;
+        if(dwCopy>cbBuffer)
+            dwCopy = cbBuffer;
+
+        memcpy(pBuffer, &m_Buffer[m_dwHead], dwCopy);
+        m_dwHead = (m_dwHead+dwCopy)%dwCapacity;
+        m_dwSize -= dwCopy;
+        cbRead = dwCopy;
+
+        m_cs.Unlock();
+
+        SetEvent(m_hCanWrite);
+        return TRUE;
+    }
+}
+
+void CBytePipe::Close()
+{
+    m_cs.Lock();
+    m_bClosed = TRUE;
+    m_cs.Unlock();
+
+    SetEvent(m_hCanRead);
+}
+
+void CBytePipe::Abort()
+{
+    m_cs.Lock();
+    m_bAborted = TRUE;
+    m_cs.Unlock();
+
+    // Wake up both sides
+    SetEvent(m_hCanRead);
+    SetEvent(m_hCanWrite);
+}
+
+BOOL CBytePipe::IsAborted()
+{
+    m_cs.Lock();
+    BOOL bAborted = m_bAborted;
+    m_cs.Unlock();
+
+    return bAborted;
+}
+
+void CBytePipe::AddTrailingField(LPCTSTR szName, std::string sValue)
+{
+    m_cs.Lock();
+    m_aTrailingFields[szName] = sValue;
+    m_cs.Unlock();
+}
+
+std::map<CString, std::string> CBytePipe::GetTrailingFields()
+{
+    m_cs.Lock();
+    std::map<CString, std::string> aFields = m_aTrailingFields;
+    m_cs.Unlock();
+
+    return aFields;
+}
@@ -0,0 +1,66 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: BytePipe.h
+// Description: Bounded buffer passing a byte stream from one thread to another.
+
+#pragma once
+#include "stdafx.h"
+
+// CBytePipe
+// A ring buffer of fixed capacity with one writer and one reader thread.
+// Write() blocks while the buffer is full and Read() blocks while it is empty,
+// so the faster side is paced by the slower one. Either side may Abort() the
+// transfer, which makes all pending and further calls fail.
+class CBytePipe
+{
+public:
+
+    // Constructor.
+    CBytePipe(DWORD dwCapacity);
+
+    // Destructor.
+    ~CBytePipe();
+
+    // Writes data to the pipe. Returns FALSE if the pipe was aborted.
+    BOOL Write(const BYTE* pData, DWORD cbData);
+
+    // Reads up to cbBuffer bytes. cbRead is zero when the writer has closed
+    // the pipe and all data was read. Returns FALSE if the pipe was aborted.
+    BOOL Read(BYTE* pBuffer, DWORD cbBuffer, DWORD& cbRead);
+
+    // Marks the end of data.
+    void Close();
+
+    // Stops the transfer.
+    void Abort();
+
+    // Returns TRUE if the transfer was stopped.
+    BOOL IsAborted();
+
+    // Adds a name-value pair that becomes known only when the data ends
+    // (for example, a hash of the data). Must be called before Close().
+    void AddTrailingField(LPCTSTR szName, std::string sValue);
+
+    // Returns the trailing fields. Must be called after Read() reported the end of data.
+    std::map<CString, std::string> GetTrailingFields();
+
+private:
+
+    CComAutoCriticalSection m_cs;     // Protects the state below
+    std::vector<BYTE> m_Buffer;       // Ring buffer
+    DWORD m_dwHead;                   // Position of the first unread byte
+    DWORD m_dwSize;                   // Count of unread bytes
+    BOOL m_bClosed;                   // Has the writer finished?
+    BOOL m_bAborted;                  // Was the transfer stopped?
+    HANDLE m_hCanRead;                // Signaled when data arrives or the pipe is closed
+    HANDLE m_hCanWrite;               // Signaled when space is freed
+    std::map<CString, std::string> m_aTrailingFields; // Fields known at the end of data
+};
@@ -17,9 +17,14 @@ be found in the Authors.txt file in the root of the source tree.
 #include "CrashRpt.h"
 #include "CrashInfoReader.h"
 #include "strconv.h"
+#include <algorithm>
 #include "tinyxml.h"
 #include "Utility.h"
 #include "SharedMem.h"
+#include "ReportManifest.h"
+
+// How many times to try reading a property slot the client app keeps writing to.
+#define PROP_SLOT_READ_ATTEMPTS 1000
 
 BOOL ERIFileItem::GetFileInfo(HICON& hIcon, CString& sTypeName, LONGLONG& lSize)
 {
@@ -71,6 +76,7 @@ CErrorReportInfo::CErrorReportInfo()
     m_uTotalSize = 0;
 	m_dwExceptionAddress = 0;
 	m_dwExceptionModuleBase = 0;
+	m_nCrashSignatureCount = 0;
 }
 
 // Destructor.
@@ -155,6 +161,34 @@ ScreenshotInfo& CErrorReportInfo::GetScreenshotInfo()
 	return m_ScreenshotInfo;
 }
 
+ERIRingLog& CErrorReportInfo::GetRingLog()
+{
+	return m_RingLog;
+}
+
+CString CErrorReportInfo::GetCrashSignature()
+{
+	return m_sCrashSignature;
+}
+
+int CErrorReportInfo::GetCrashSignatureCount()
+{
+	return m_nCrashSignatureCount;
+}
+
+void CErrorReportInfo::SetCrashSignature(LPCTSTR szSignature, int nCount)
+{
+	m_sCrashSignature = szSignature;
+	m_nCrashSignatureCount = nCount;
+}
+
+void CErrorReportInfo::RemoveClientItems()
+{
+	m_FileItems.clear();
+	m_RegKeys.clear();
+	m_RingLog = ERIRingLog();
+}
+
 void CErrorReportInfo::SetScreenshotInfo(ScreenshotInfo &si)
 {
 	m_ScreenshotInfo = si;
@@ -318,6 +352,26 @@ void CErrorReportInfo::AddRegKey(LPCTSTR szKeyName, ERIRegKey& rki)
 	m_RegKeys[szKeyName] = rki;
 }
 
+int CErrorReportInfo::GetBreadcrumbCount()
+{
+	return (int)m_aBreadcrumbs.size();
+}
+
+BOOL CErrorReportInfo::GetBreadcrumbByIndex(int nItem, ERIBreadcrumb& bc)
+{
+	if(nItem<0 || nItem>=(int)m_aBreadcrumbs.size())
+		return FALSE; // No such item
+
+	bc = m_aBreadcrumbs[nItem];
+	return TRUE;
+}
+
+// Orders breadcrumbs by time
+static bool IsEarlierBreadcrumb(const ERIBreadcrumb& a, const ERIBreadcrumb& b)
+{
+	return a.m_uTime<b.m_uTime;
+}
+
 // This method calculates the total size of files included into error report
 LONG64 CErrorReportInfo::CalcUncompressedReportSize()
 {
@@ -380,7 +434,17 @@ CCrashInfoReader::CCrashInfoReader()
 	m_bShowAdditionalInfoFields = FALSE;
 	m_bAllowAttachMoreFiles = FALSE;
 	m_bStoreZIPArchives = FALSE;
+	m_dwZipPolicyFlags = 0;
+	m_bStreamingUpload = FALSE;
+	m_bResumableUpload = FALSE;
+	m_bSuppressRepeatedCrashes = FALSE;
+	m_nFullReportsPerSignature = DEFAULT_FULL_REPORTS_PER_SIGNATURE;
+	m_nBriefReportsPerSignature = DEFAULT_BRIEF_REPORTS_PER_SIGNATURE;
+	m_nSignatureWindowDays = DEFAULT_SIGNATURE_WINDOW_DAYS;
 	m_bSendRecentReports = FALSE;
+	m_nMaxConcurrentReports = DEFAULT_CONCURRENT_REPORTS;
+	m_dwMaxUploadRate = 0;
+	m_dwTransportStagger = DEFAULT_TRANSPORT_STAGGER;
 	m_bAppRestart = FALSE;
 	m_uPriorities[CR_HTTP] = 3;
 	m_uPriorities[CR_SMTP] = 2;
@@ -450,6 +514,12 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
 	// Save path to INI file storing settings
     m_sINIFile = m_sUnsentCrashReportsFolder + _T("\\~CrashRpt.ini");
 
+	// Read delivery settings
+    ReadDeliverySettings();
+
+	// Open the journal of delivery attempts
+    m_DeliveryJournal.Open(m_sUnsentCrashReportsFolder + _T("\\~CrashRptQueue.log"));
+
     if(!m_bSendRecentReports) // We should send report immediately
     {
         CollectMiscCrashInfo(eri);
@@ -457,6 +527,8 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
         eri.m_sErrorReportDirName = m_sUnsentCrashReportsFolder + _T("\\") + eri.m_sCrashGUID;
         Utility::CreateFolder(eri.m_sErrorReportDirName);
 
+        m_DeliveryJournal.AddReport(eri.m_sCrashGUID);
+
         m_Reports.push_back(eri);
     }
     else // We should look for pending error reports
@@ -468,6 +540,18 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
         if(hEvent!=NULL)
             SetEvent(hEvent);
 
+        // Reports that have failed recently are not selected for delivery, and
+        // neither is anything while the server seems to be down. The user may
+        // still select them to send right now.
+        __time64_t tNow = _time64(NULL);
+        __time64_t tNextAttempt = 0;
+        BOOL bServerBackingOff = m_DeliveryJournal.IsServerBackingOff(tNow, tNextAttempt);
+        std::set<CString> aLiveReports;
+
+        // Summaries of reports parsed before
+        CReportManifest Manifest;
+        Manifest.Load(m_sUnsentCrashReportsFolder + _T("\\~CrashRptManifest.dat"));
+
         // Look for pending error reports and add them to the list
         CString sSearchPattern = m_sUnsentCrashReportsFolder + _T("\\*");
         CFindFile find;
@@ -481,11 +565,38 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
                 CString sFileName = sErrorReportDirName + _T("\\crashrpt.xml");
                 CErrorReportInfo eri2;
                 eri2.m_sErrorReportDirName = sErrorReportDirName;
-				// Read crash description XML from the directory
-                if(0==ParseCrashDescription(sFileName, TRUE, eri2))
+
+				// The stamp is taken before reading, so that changes made meanwhile are noticed next time
+                ReportStamp stamp;
+                WIN32_FILE_ATTRIBUTE_DATA fad;
+                BOOL bRead = find.GetLastWriteTime(&stamp.m_ftDirWriteTime) &&
+                    GetFileAttributesEx(sFileName, GetFileExInfoStandard, &fad);
+                if(bRead)
                 {
-					// Calculate crash report size
-                    eri2.m_uTotalSize = GetUncompressedReportSize(eri2);
+                    stamp.m_ftXmlWriteTime = fad.ftLastWriteTime;
+                    stamp.m_uXmlSize = ((ULONG64)fad.nFileSizeHigh<<32)|fad.nFileSizeLow;
+                }
+
+				// Take the report from the manifest if the directory hasn't changed
+                if(bRead && !Manifest.GetReport(find.GetFileName(), stamp, eri2))
+                {
+					// Read crash description XML from the directory
+                    bRead = 0==ParseCrashDescription(sFileName, TRUE, eri2);
+                    if(bRead)
+                    {
+						// Calculate crash report size
+                        eri2.m_uTotalSize = GetUncompressedReportSize(eri2);
+                        Manifest.SetReport(find.GetFileName(), stamp, eri2);
+                    }
+                }
+
+                if(bRead)
+                {
+					// Check when the report may be sent
+                    m_DeliveryJournal.AddReport(eri2.m_sCrashGUID);
+                    if(bServerBackingOff || m_DeliveryJournal.IsBackingOff(eri2.m_sCrashGUID, tNow, tNextAttempt))
+                        eri2.m_bSelected = FALSE;
+                    aLiveReports.insert(eri2.m_sCrashGUID);
 					// Add report to the list
                     m_Reports.push_back(eri2);
                 }
@@ -493,6 +604,12 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
 
             bFound = find.FindNextFile();
         }
+
+        // Update the manifest for the next start
+        Manifest.Save();
+
+        // Drop history of reports that are gone
+        m_DeliveryJournal.Compact(aLiveReports);
     }
 
 	// Done
@@ -543,6 +660,11 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
 	m_bShowAdditionalInfoFields = (dwInstallFlags&CR_INST_SHOW_ADDITIONAL_INFO_FIELDS)!=0;
 	m_bAllowAttachMoreFiles = (dwInstallFlags&CR_INST_ALLOW_ATTACH_MORE_FILES)!=0;
     m_bStoreZIPArchives = (dwInstallFlags&CR_INST_STORE_ZIP_ARCHIVES)!=0;
+    m_dwZipPolicyFlags = dwInstallFlags&(CR_INST_ZIP_COMPRESS_MEDIA|CR_INST_ZIP_MINIDUMP_HIGH|
+        CR_INST_ZIP_TEXT_FAST|CR_INST_ZIP_NO_CONTENT_SAMPLING);
+    m_bStreamingUpload = (dwInstallFlags&CR_INST_HTTP_STREAMING_UPLOAD)!=0;
+    m_bResumableUpload = (dwInstallFlags&CR_INST_HTTP_RESUMABLE_UPLOAD)!=0;
+    m_bSuppressRepeatedCrashes = (dwInstallFlags&CR_INST_SUPPRESS_REPEATED_CRASHES)!=0;
     m_bAppRestart = (dwInstallFlags&CR_INST_APP_RESTART)!=0;
     m_bGenerateMinidump = (dwInstallFlags&CR_INST_NO_MINIDUMP)==0;
     m_bQueueEnabled = (dwInstallFlags&CR_INST_SEND_QUEUED_REPORTS)!=0;
@@ -613,6 +735,40 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
 
             m_SharedMem.DestroyView((LPBYTE)pProp);
         }
+        else if(memcmp(pHeader->m_uchMagic, "PSL", 3)==0)
+        {
+            // Custom prop slots entry
+            PROP_SLOTS* pPropSlots = (PROP_SLOTS*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
+
+            CString sMappingName;
+            UnpackString(pPropSlots->m_dwMappingNameOffs, sMappingName);
+            ReadPropSlots(sMappingName, eri.m_Props);
+
+            m_SharedMem.DestroyView((LPBYTE)pPropSlots);
+        }
+        else if(memcmp(pHeader->m_uchMagic, "BRL", 3)==0)
+        {
+            // Breadcrumb rings entry
+            BREADCRUMBS* pBreadcrumbs = (BREADCRUMBS*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
+
+            CString sMappingName;
+            UnpackString(pBreadcrumbs->m_dwMappingNameOffs, sMappingName);
+            ULONG64 uSince = ((ULONG64)pBreadcrumbs->m_ftSince.dwHighDateTime<<32)|pBreadcrumbs->m_ftSince.dwLowDateTime;
+            ReadBreadcrumbs(sMappingName, uSince, eri.m_aBreadcrumbs);
+
+            m_SharedMem.DestroyView((LPBYTE)pBreadcrumbs);
+        }
+        else if(memcmp(pHeader->m_uchMagic, "RLG", 3)==0)
+        {
+            // Ring log entry
+            RING_LOG* pRingLog = (RING_LOG*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
+
+            UnpackString(pRingLog->m_dwMappingNameOffs, eri.m_RingLog.m_sMappingName);
+            UnpackString(pRingLog->m_dwDstFileNameOffs, eri.m_RingLog.m_sDestFile);
+            UnpackString(pRingLog->m_dwDescriptionOffs, eri.m_RingLog.m_sDesc);
+
+            m_SharedMem.DestroyView((LPBYTE)pRingLog);
+        }
         else if(memcmp(pHeader->m_uchMagic, "REG", 3)==0)
         {
             // Reg key entry
@@ -643,6 +799,9 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
         m_SharedMem.DestroyView(pView);
     }
 
+    // Rings are read one by one, so merge them
+    std::stable_sort(eri.m_aBreadcrumbs.begin(), eri.m_aBreadcrumbs.end(), IsEarlierBreadcrumb);
+
     // Success
     return 0;
 }
@@ -667,6 +826,118 @@ int CCrashInfoReader::UnpackString(DWORD dwOffset, CString& str)
     return 0;
 }
 
+void CCrashInfoReader::ReadPropSlots(CString sMappingName, std::map<CString, CString>& aProps)
+{
+    // The slots are in their own file mapping, which the client app keeps
+    // while it is running
+    CSharedMem PropSlotsMem;
+    if(!PropSlotsMem.Init(sMappingName, TRUE, 0))
+        return;
+
+    DWORD dwLength = CUSTOM_PROP_SLOT_COUNT*sizeof(CUSTOM_PROP_SLOT);
+    CUSTOM_PROP_SLOT* pSlots = (CUSTOM_PROP_SLOT*)PropSlotsMem.CreateView(0, dwLength);
+    if(pSlots==NULL)
+        return;
+
+    int i;
+    for(i=0; i<CUSTOM_PROP_SLOT_COUNT; i++)
+    {
+        CString sName;
+        CString sValue;
+        if(ReadPropSlot(&pSlots[i], sName, sValue) && !sName.IsEmpty())
+            aProps[sName] = sValue;
+    }
+
+    PropSlotsMem.DestroyView((LPBYTE)pSlots);
+}
+
+BOOL CCrashInfoReader::ReadPropSlot(CUSTOM_PROP_SLOT* pSlot, CString& sName, CString& sValue)
+{
+    CUSTOM_PROP_SLOT slot;
+    int nAttempt;
+    for(nAttempt=0; nAttempt<PROP_SLOT_READ_ATTEMPTS; nAttempt++)
+    {
+        LONG lSequence = pSlot->m_lSequence;
+        if((lSequence&1)!=0)
+        {
+            Sleep(0); // The value is being written
+            continue;
+        }
+
+        MemoryBarrier();
+        memcpy(&slot, (LPBYTE)pSlot, sizeof(CUSTOM_PROP_SLOT));
+        MemoryBarrier();
+
+        if(pSlot->m_lSequence!=lSequence)
+            continue; // The value has changed while copying
+
+        slot.m_szName[CUSTOM_PROP_NAME_LEN-1] = 0;
+        slot.m_szValue[CUSTOM_PROP_VALUE_LEN-1] = 0;
+        sName = slot.m_szName;
+        if(slot.m_dwValueOffs!=0)
+            return UnpackString(slot.m_dwValueOffs, sValue)==0;
+        sValue = slot.m_szValue;
+        return TRUE;
+    }
+
+    // The writer has been stopped in the middle, for example by the crash
+    return FALSE;
+}
+
+void CCrashInfoReader::ReadBreadcrumbs(CString sMappingName, ULONG64 uSince, std::vector<ERIBreadcrumb>& aBreadcrumbs)
+{
+    // The rings are in their own file mapping, which the client app keeps
+    // while it is running
+    CSharedMem BreadcrumbsMem;
+    if(!BreadcrumbsMem.Init(sMappingName, TRUE, 0))
+        return;
+
+    DWORD dwLength = BREADCRUMB_RING_COUNT*sizeof(BREADCRUMB_RING);
+    BREADCRUMB_RING* pRings = (BREADCRUMB_RING*)BreadcrumbsMem.CreateView(0, dwLength);
+    if(pRings==NULL)
+        return;
+
+    int i;
+    for(i=0; i<BREADCRUMB_RING_COUNT; i++)
+        ReadBreadcrumbRing(&pRings[i], uSince, aBreadcrumbs);
+
+    BreadcrumbsMem.DestroyView((LPBYTE)pRings);
+}
+
+void CCrashInfoReader::ReadBreadcrumbRing(BREADCRUMB_RING* pRing, ULONG64 uSince, std::vector<ERIBreadcrumb>& aBreadcrumbs)
+{
+    // Only the last BREADCRUMB_RING_SIZE positions are still in the ring
+    DWORD dwHead = (DWORD)pRing->m_lHead;
+    DWORD dwFirst = dwHead>BREADCRUMB_RING_SIZE ? dwHead-BREADCRUMB_RING_SIZE : 0;
+
+    DWORD dwPos;
+    for(dwPos=dwFirst; dwPos<dwHead; dwPos++)
+    {
+        BREADCRUMB* pRecord = &pRing->m_aRecords[dwPos&(BREADCRUMB_RING_SIZE-1)];
+
+        // The record may be partially written if the client app has been
+        // stopped while writing it, or overwritten while we copy it
+        BREADCRUMB record;
+        if((DWORD)pRecord->m_lSequence!=dwPos+1)
+            continue;
+        MemoryBarrier();
+        memcpy(&record, (LPBYTE)pRecord, sizeof(BREADCRUMB));
+        MemoryBarrier();
+        if((DWORD)pRecord->m_lSequence!=dwPos+1)
+            continue;
+
+        record.m_szText[BREADCRUMB_TEXT_LEN-1] = 0;
+
+        ERIBreadcrumb bc;
+        bc.m_uTime = ((ULONG64)record.m_ftTime.dwHighDateTime<<32)|record.m_ftTime.dwLowDateTime;
+        if(bc.m_uTime<uSince)
+            continue; // Already in a previous error report
+        bc.m_dwThreadId = record.m_dwThreadId;
+        bc.m_sText = record.m_szText;
+        aBreadcrumbs.push_back(bc);
+    }
+}
+
 CErrorReportInfo* CCrashInfoReader::GetReport(int nIndex)
 {
 	if(nIndex>=0 && nIndex<(int)m_Reports.size())
@@ -686,6 +957,7 @@ void CCrashInfoReader::DeleteReport(int nIndex)
 
 	// Delete report files
 	Utility::RecycleFile(m_Reports[nIndex].m_sErrorReportDirName, TRUE);
+	m_DeliveryJournal.RecordRemoved(m_Reports[nIndex].m_sCrashGUID);
 
 	// Delete from list
 	m_Reports[nIndex].m_DeliveryStatus = DELETED;
@@ -698,6 +970,7 @@ void CCrashInfoReader::DeleteAllReports()
 	{
 		// Delete report files
 		Utility::RecycleFile(m_Reports[i].m_sErrorReportDirName, TRUE);
+		m_DeliveryJournal.RecordRemoved(m_Reports[i].m_sCrashGUID);
 
 		m_Reports[i].m_DeliveryStatus = DELETED;
 	}
@@ -1530,6 +1803,11 @@ void CCrashInfoReader::SetPersistentUserEmail(LPCTSTR szEmail)
 	Utility::SetINIString(m_sINIFile, _T("General"), _T("EmailFrom"), szEmail);
 }
 
+CString CCrashInfoReader::GetINIFile()
+{
+	return m_sINIFile;
+}
+
 static CString GetSystemDateUTC()
 {
     // Get current date
@@ -1558,6 +1836,130 @@ int CCrashInfoReader::GetDailyReportCount()
     return nReports;
 }
 
+void CCrashInfoReader::ReadDeliverySettings()
+{
+    ATLASSERT(!m_sINIFile.IsEmpty());
+
+    // How many queued reports are compressed and uploaded at once
+    m_nMaxConcurrentReports = DEFAULT_CONCURRENT_REPORTS;
+    CString sConcurrent = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("MaxConcurrentReports"));
+    if(!sConcurrent.IsEmpty())
+        m_nMaxConcurrentReports = _ttoi(sConcurrent);
+    if(m_nMaxConcurrentReports<1)
+        m_nMaxConcurrentReports = 1;
+    if(m_nMaxConcurrentReports>MAX_CONCURRENT_REPORTS)
+        m_nMaxConcurrentReports = MAX_CONCURRENT_REPORTS;
+
+    // Total upload rate of all reports, in KB per second (0 means no limit)
+    CString sRate = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("MaxUploadRate"));
+    int nRate = _ttoi(sRate);
+    m_dwMaxUploadRate = nRate>0?(DWORD)nRate*1024:0;
+
+    // Delay before starting the next delivery method while the previous one is running
+    m_dwTransportStagger = DEFAULT_TRANSPORT_STAGGER;
+    CString sStagger = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("TransportStagger"));
+    if(!sStagger.IsEmpty())
+    {
+        int nStagger = _ttoi(sStagger);
+        m_dwTransportStagger = nStagger>0?(DWORD)nStagger:0;
+    }
+
+    // Limits of reports for a repeated crash
+    m_nFullReportsPerSignature = DEFAULT_FULL_REPORTS_PER_SIGNATURE;
+    CString sFull = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("FullReportsPerSignature"));
+    if(!sFull.IsEmpty())
+        m_nFullReportsPerSignature = _ttoi(sFull);
+    if(m_nFullReportsPerSignature<0)
+        m_nFullReportsPerSignature = 0;
+
+    m_nBriefReportsPerSignature = DEFAULT_BRIEF_REPORTS_PER_SIGNATURE;
+    CString sBrief = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("BriefReportsPerSignature"));
+    if(!sBrief.IsEmpty())
+        m_nBriefReportsPerSignature = _ttoi(sBrief);
+    if(m_nBriefReportsPerSignature<0)
+        m_nBriefReportsPerSignature = 0;
+
+    m_nSignatureWindowDays = DEFAULT_SIGNATURE_WINDOW_DAYS;
+    CString sWindow = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("SignatureWindowDays"));
+    if(!sWindow.IsEmpty())
+        m_nSignatureWindowDays = _ttoi(sWindow);
+    if(m_nSignatureWindowDays<1)
+        m_nSignatureWindowDays = 1;
+}
+
+int CCrashInfoReader::CountCrashSignature(LPCTSTR szSignature)
+{
+    ATLASSERT(!m_sINIFile.IsEmpty());
+
+    // Each key of [CrashSignatures] section is a signature, and its value is
+    // "<time of the first occurrence>;<count of occurrences>"
+    __time64_t tNow = _time64(NULL);
+    __time64_t tWindow = (__time64_t)m_nSignatureWindowDays*24*60*60;
+    __time64_t tFirst = tNow;
+    int nCount = 0;
+    int nEntries = 0;
+
+    // Forget signatures which are out of the window
+    std::vector<TCHAR> aKeys(MAX_CRASH_SIGNATURES*64+2);
+    GetPrivateProfileString(_T("CrashSignatures"), NULL, _T(""), &aKeys[0], (DWORD)aKeys.size(), m_sINIFile);
+    LPCTSTR szKey;
+    for(szKey=&aKeys[0]; *szKey!=0; szKey+=_tcslen(szKey)+1)
+    {
+        CString sEntry = Utility::GetINIString(m_sINIFile, _T("CrashSignatures"), szKey);
+        std::vector<CString> aTokens = Utility::ExplodeStr(sEntry, _T(";"));
+        __time64_t tEntry = aTokens.size()==2 ? _ttoi64(aTokens[0]) : 0;
+        if(tEntry<=0 || tEntry>tNow || tNow-tEntry>=tWindow)
+        {
+            Utility::SetINIString(m_sINIFile, _T("CrashSignatures"), szKey, NULL);
+            continue;
+        }
+
+        nEntries++;
+        if(_tcsicmp(szKey, szSignature)==0)
+        {
+            tFirst = tEntry;
+            nCount = _ttoi(aTokens[1]);
+        }
+    }
+
+    // Don't let the section grow without limit; an unknown crash gets a full report
+    if(nCount==0 && nEntries>=MAX_CRASH_SIGNATURES)
+        return 1;
+
+    nCount++;
+    CString sEntry;
+    sEntry.Format(_T("%I64d;%d"), tFirst, nCount);
+    Utility::SetINIString(m_sINIFile, _T("CrashSignatures"), szSignature, sEntry);
+
+    return nCount;
+}
+
+int CCrashInfoReader::GetPreferredTransport()
+{
+    ATLASSERT(!m_sINIFile.IsEmpty());
+
+    CString sTransport = Utility::GetINIString(m_sINIFile, _T("Delivery"), _T("PreferredTransport"));
+    if(sTransport.CompareNoCase(_T("HTTP"))==0)
+        return CR_HTTP;
+    else if(sTransport.CompareNoCase(_T("SMTP"))==0)
+        return CR_SMTP;
+
+    return -1;
+}
+
+void CCrashInfoReader::SetPreferredTransport(int nTransport)
+{
+    ATLASSERT(!m_sINIFile.IsEmpty());
+
+    CString sTransport;
+    if(nTransport==CR_HTTP)
+        sTransport = _T("HTTP");
+    else if(nTransport==CR_SMTP)
+        sTransport = _T("SMTP");
+
+    Utility::SetINIString(m_sINIFile, _T("Delivery"), _T("PreferredTransport"), sTransport);
+}
+
 void CCrashInfoReader::SetDailyReportCount(int nReports)
 {
     ATLASSERT(!m_sINIFile.IsEmpty());
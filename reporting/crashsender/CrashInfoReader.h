@@ -18,6 +18,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include "tinyxml.h"
 #include "SharedMem.h"
 #include "ScreenCap.h"
+#include "DeliveryJournal.h"
 
 // The structure describing a file item contained in crash report.
 struct ERIFileItem
@@ -51,6 +52,28 @@ struct ERIRegKey
 	bool m_bAllowDelete;    // Whether to allow user deleting the file from context menu of Error Report Details dialog.
 };
 
+// Breadcrumb recorded by the client app before the crash.
+struct ERIBreadcrumb
+{
+	ERIBreadcrumb()
+	{
+		m_uTime = 0;
+		m_dwThreadId = 0;
+	}
+
+	ULONG64 m_uTime;      // UTC time of recording, in FILETIME units.
+	DWORD m_dwThreadId;   // Thread that recorded the breadcrumb.
+	CString m_sText;      // Breadcrumb text.
+};
+
+// Ring log of the client app, saved to a file in crash report.
+struct ERIRingLog
+{
+	CString m_sMappingName; // Name of the file mapping holding the log (empty if there is no ring log).
+	CString m_sDestFile;    // Destination file name.
+	CString m_sDesc;        // File description.
+};
+
 // Error report delivery statuses.
 enum DELIVERY_STATUS
 {
@@ -65,6 +88,7 @@ enum DELIVERY_STATUS
 class CErrorReportInfo
 {
 	friend class CCrashInfoReader;
+	friend class CReportManifest;
 
 public:
 
@@ -108,6 +132,12 @@ public:
 	// Adds/replaces a reg key in crash report.
 	void AddRegKey(LPCTSTR szKeyName, ERIRegKey& rki);
 
+	// Returns count of breadcrumbs in error report.
+	int GetBreadcrumbCount();
+
+	// Method that retrieves a breadcrumb by zero-based index (breadcrumbs are ordered by time).
+	BOOL GetBreadcrumbByIndex(int nItem, ERIBreadcrumb& bc);
+
 	// Returns the name of the directory where error report files are located.
 	CString GetErrorReportDirName();
 
@@ -192,6 +222,21 @@ public:
 	// Sets desktop screenshot parameters.
 	void SetScreenshotInfo(ScreenshotInfo &si);
 
+	// Returns the ring log to save on crash.
+	ERIRingLog& GetRingLog();
+
+	// Returns crash signature (empty if not calculated).
+	CString GetCrashSignature();
+
+	// Returns how many times the crash signature has occurred recently.
+	int GetCrashSignatureCount();
+
+	// Sets crash signature and how many times it has occurred recently.
+	void SetCrashSignature(LPCTSTR szSignature, int nCount);
+
+	// Removes files, registry keys and the ring log the client app has added to the report.
+	void RemoveClientItems();
+
 private:
 
 	// Calculates total size of files included into error report.
@@ -221,12 +266,16 @@ private:
 	ULONG64         m_uTotalSize;          // Summary size of this (uncompressed) report.
     BOOL            m_bSelected;           // Is this report selected for delivery or not?
     DELIVERY_STATUS m_DeliveryStatus;      // Error report delivery status.
+    CString         m_sCrashSignature;     // Hash identifying repeats of this crash (may be empty).
+    int             m_nCrashSignatureCount; // Occurrences of the signature within the signature window.
 
     // Kaneva - Bug Fix - Now Using Full SrcPath Instead of DestFileName Only
 	std::map<CString, ERIFileItem>  m_FileItems; // The list of files that are included into this error report.
 
 	std::map<CString, ERIRegKey> m_RegKeys; // The list of registry keys included into this error report.
     std::map<CString, CString> m_Props;   // The list of custom properties included into this error report.
+    std::vector<ERIBreadcrumb> m_aBreadcrumbs; // Breadcrumbs recorded before the crash, ordered by time.
+    ERIRingLog m_RingLog;                 // Ring log to save on crash.
 };
 
 // Remind policy. Defines the way user is notified about recently queued crash reports.
@@ -236,6 +285,24 @@ enum REMIND_POLICY
     NEVER_REMIND    // Never remind.
 };
 
+// Queued reports delivered at once, unless set by MaxConcurrentReports
+// in the [Delivery] section of ~CrashRpt.ini.
+#define DEFAULT_CONCURRENT_REPORTS 4
+#define MAX_CONCURRENT_REPORTS     16
+
+// Delay in milliseconds before the next delivery method starts while the previous
+// one is still running and hasn't reached the server, unless set by TransportStagger
+// in the [Delivery] section of ~CrashRpt.ini (0 means the methods are tried in turn).
+#define DEFAULT_TRANSPORT_STAGGER  0
+
+// Limits of reports for a repeated crash signature, unless set in the [Delivery] section
+// of ~CrashRpt.ini by FullReportsPerSignature, BriefReportsPerSignature (reports without
+// minidump and files) and SignatureWindowDays (how long a signature is remembered).
+#define DEFAULT_FULL_REPORTS_PER_SIGNATURE  1
+#define DEFAULT_BRIEF_REPORTS_PER_SIGNATURE 10
+#define DEFAULT_SIGNATURE_WINDOW_DAYS       7
+#define MAX_CRASH_SIGNATURES                64
+
 // Class responsible for reading the crash info passed by the crashed application.
 class CCrashInfoReader
 {
@@ -264,7 +331,17 @@ public:
 	BOOL		m_bShowAdditionalInfoFields; // Make "Your E-mail" and "Describe what you were doing when the problem occurred" fields of Error Report dialog always visible.
 	BOOL		m_bAllowAttachMoreFiles; // Whether to allow user to attach more files to crash report by clicking "Attach More File(s)" item from context menu of Error Report Details dialog.
     BOOL        m_bStoreZIPArchives;    // Should we store zipped error report files?
+    DWORD       m_dwZipPolicyFlags;     // Per-type ZIP compression overrides (CR_INST_ZIP_* flags).
+    BOOL        m_bStreamingUpload;     // Should we upload ZIP archive over HTTP while compressing it?
+    BOOL        m_bResumableUpload;     // Should we upload ZIP archive over HTTP in resumable chunks?
+    BOOL        m_bSuppressRepeatedCrashes; // Should we send less for a crash which keeps repeating?
+    int         m_nFullReportsPerSignature; // How many full reports are sent for a crash signature.
+    int         m_nBriefReportsPerSignature; // How many XML-only reports are sent after the full ones.
+    int         m_nSignatureWindowDays; // Days after which a crash signature is counted anew.
     BOOL        m_bSendRecentReports;   // Should we send recently queued reports now?
+    int         m_nMaxConcurrentReports; // How many queued reports may be delivered at once.
+    DWORD       m_dwMaxUploadRate;      // Upload rate limit for queued reports, bytes per second (0 if unlimited).
+    DWORD       m_dwTransportStagger;   // Delay before racing the next delivery method, ms (0 if not racing).
     BOOL        m_bAppRestart;          // Should we restart the crashed application?
     CString     m_sRestartCmdLine;      // Command line for crashed app restart.
 	int         m_nRestartTimeout;      // Restart timeout.
@@ -285,6 +362,7 @@ public:
 	int         m_nVideoQuality;        // Video quality.
 	SIZE        m_DesiredFrameSize;     // Desired video frame size.
 	HWND        m_hWndVideoParent;      // Video recording dialog parent.
+    CDeliveryJournal m_DeliveryJournal; // History of delivery attempts of queued reports.
 	BOOL        m_bClientAppCrashed;    // If TRUE, the client app has crashed; otherwise the client app exited successfully.
 	BOOL        m_bQueueEnabled;        // Can reports be sent later or not (queue enabled)?
 	// Below are exception information fields.
@@ -344,6 +422,9 @@ public:
 	// Saves user's E-mail to INI file for later reuse.
 	void SetPersistentUserEmail(LPCTSTR szEmail);
 
+	// Returns path to ~CrashRpt.ini file.
+	CString GetINIFile();
+
 	// Adds the list of files to crash report.
     BOOL AddFilesToCrashReport(int nReport, std::vector<ERIFileItem>);
 
@@ -356,6 +437,19 @@ public:
     // Sets the number of crash reports sent per calendar day.
     void SetDailyReportCount(int nReports);
 
+    // Reads settings of queued report delivery from INI file.
+    void ReadDeliverySettings();
+
+    // Counts one more crash with the signature in INI file; returns how many times
+    // the crash has occurred within the signature window, including this one.
+    int CountCrashSignature(LPCTSTR szSignature);
+
+    // Returns the delivery method (CR_HTTP, CR_SMTP) which delivered the last report, or -1.
+    int GetPreferredTransport();
+
+    // Remembers the delivery method which delivered a report.
+    void SetPreferredTransport(int nTransport);
+
 private:
 
     // Retrieves some crash info from crash description XML.
@@ -376,6 +470,18 @@ private:
     // Unpacks a string.
     int UnpackString(DWORD dwOffset, CString& str);
 
+    // Reads properties from the file mapping holding property slots.
+    void ReadPropSlots(CString sMappingName, std::map<CString, CString>& aProps);
+
+    // Reads a property slot, retrying while the client app is writing to it.
+    BOOL ReadPropSlot(CUSTOM_PROP_SLOT* pSlot, CString& sName, CString& sValue);
+
+    // Reads breadcrumbs recorded since uSince from the file mapping holding breadcrumb rings.
+    void ReadBreadcrumbs(CString sMappingName, ULONG64 uSince, std::vector<ERIBreadcrumb>& aBreadcrumbs);
+
+    // Reads complete records of a breadcrumb ring recorded since uSince.
+    void ReadBreadcrumbRing(BREADCRUMB_RING* pRing, ULONG64 uSince, std::vector<ERIBreadcrumb>& aBreadcrumbs);
+
     // Collects misc info about the crash.
     void CollectMiscCrashInfo(CErrorReportInfo& eri);
 
@@ -0,0 +1,400 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "DeliveryJournal.h"
+#include "strconv.h"
+
+// GUID of the entry counting failures of all reports in a row
+#define SERVER_ENTRY _T("*")
+
+CDeliveryJournal::CDeliveryJournal()
+{
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_nRecords = 0;
+}
+
+CDeliveryJournal::~CDeliveryJournal()
+{
+    Close();
+}
+
+BOOL CDeliveryJournal::Open(LPCTSTR szFileName)
+{
+    Close();
+
+    m_cs.Lock();
+
+    m_sFileName = szFileName;
+
+    // With FILE_APPEND_DATA and no FILE_WRITE_DATA access, every write goes to
+    // the end of file, even if another CrashSender.exe has appended meanwhile
+    m_hFile = CreateFile(szFileName, GENERIC_READ|FILE_APPEND_DATA,
+        FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if(m_hFile==INVALID_HANDLE_VALUE)
+    {
+        m_cs.Unlock();
+        return FALSE;
+    }
+
+    // Read the whole journal
+    std::string sData;
+    char buf[4096];
+    DWORD dwRead = 0;
+    while(ReadFile(m_hFile, buf, sizeof(buf), &dwRead, NULL) && dwRead!=0)
+        sData.append(buf, dwRead);
+
+    // Replay complete lines. A line without the line end was being written
+    // when the process was terminated, it is ignored.
+    size_t nPos = 0;
+    for(;;)
+    {
+        size_t nEnd = sData.find('\n', nPos);
+        if(nEnd==std::string::npos)
+            break;
+        Apply(sData.substr(nPos, nEnd-nPos).c_str());
+        m_nRecords++;
+        nPos = nEnd+1;
+    }
+
+    // Start appending from a new line
+    if(nPos!=sData.size())
+    {
+        DWORD dwWritten = 0;
+        WriteFile(m_hFile, "\n", 1, &dwWritten, NULL);
+    }
+
+    // Compact() runs only when the queue is scanned, and a crash report opens
+    // the journal too. So history of delivered and removed reports is dropped
+    // here as well, which keeps the journal short on every path.
+    std::map<CString, JournalEntry> aEntries;
+    std::map<CString, JournalEntry>::iterator it;
+    for(it=m_aEntries.begin(); it!=m_aEntries.end(); it++)
+    {
+        if(it->first==SERVER_ENTRY || !it->second.m_bDone)
+            aEntries[it->first] = it->second;
+    }
+    if(m_nRecords>(int)aEntries.size()+JOURNAL_COMPACT_SLACK)
+        Rewrite(aEntries);
+
+    m_cs.Unlock();
+    return TRUE;
+}
+
+void CDeliveryJournal::Close()
+{
+    m_cs.Lock();
+
+    if(m_hFile!=INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_aEntries.clear();
+    m_nRecords = 0;
+
+    m_cs.Unlock();
+}
+
+void CDeliveryJournal::AddReport(LPCTSTR szCrashGUID)
+{
+    m_cs.Lock();
+
+    if(m_aEntries.find(szCrashGUID)==m_aEntries.end())
+        Append(szCrashGUID, "queued", JournalEntry());
+
+    m_cs.Unlock();
+}
+
+void CDeliveryJournal::RecordAttempt(LPCTSTR szCrashGUID, LPCTSTR szTransport, BOOL bSuccess)
+{
+    m_cs.Lock();
+
+    JournalEntry entry = m_aEntries[szCrashGUID];
+    entry.m_sLastOutcome.Format(_T("%s:%s"), szTransport, bSuccess?_T("ok"):_T("failed"));
+    Append(szCrashGUID, "attempt", entry);
+
+    m_cs.Unlock();
+}
+
+void CDeliveryJournal::RecordDelivered(LPCTSTR szCrashGUID)
+{
+    m_cs.Lock();
+
+    JournalEntry entry = m_aEntries[szCrashGUID];
+    entry.m_tNextAttempt = 0;
+    Append(szCrashGUID, "delivered", entry);
+
+    // The server works again
+    JournalEntry& server = m_aEntries[SERVER_ENTRY];
+    if(server.m_nAttempts!=0)
+    {
+        JournalEntry reset;
+        reset.m_sLastOutcome = entry.m_sLastOutcome;
+        Append(SERVER_ENTRY, "delivered", reset);
+    }
+
+    m_cs.Unlock();
+}
+
+void CDeliveryJournal::RecordFailed(LPCTSTR szCrashGUID)
+{
+    m_cs.Lock();
+
+    __time64_t tNow = _time64(NULL);
+
+    JournalEntry entry = m_aEntries[szCrashGUID];
+    entry.m_nAttempts++;
+
+    // Spread retries of different reports (and of different users)
+    // over a quarter of the delay, so they don't arrive all at once
+    __time64_t tDelay = GetBackoffDelay(entry.m_nAttempts);
+    DWORD dwHash = 2166136261u;
+    LPCTSTR p;
+    for(p=szCrashGUID; *p!=0; p++)
+        dwHash = (dwHash^(DWORD)*p)*16777619u;
+    dwHash = (dwHash^(DWORD)entry.m_nAttempts)*16777619u;
+    tDelay += (__time64_t)(dwHash%1000)*(tDelay/4)/1000;
+
+    entry.m_tNextAttempt = tNow+tDelay;
+    Append(szCrashGUID, "failed", entry);
+
+    // Count failures in a row. Past the threshold, the server is given
+    // time to recover before any report is sent again.
+    JournalEntry server = m_aEntries[SERVER_ENTRY];
+    server.m_nAttempts++;
+    server.m_sLastOutcome = entry.m_sLastOutcome;
+    if(server.m_nAttempts>=JOURNAL_OUTAGE_THRESHOLD)
+        server.m_tNextAttempt = tNow+GetBackoffDelay(server.m_nAttempts-JOURNAL_OUTAGE_THRESHOLD+1);
+    Append(SERVER_ENTRY, "failed", server);
+
+    m_cs.Unlock();
+}
+
+void CDeliveryJournal::RecordRemoved(LPCTSTR szCrashGUID)
+{
+    m_cs.Lock();
+
+    JournalEntry entry = m_aEntries[szCrashGUID];
+    entry.m_tNextAttempt = 0;
+    Append(szCrashGUID, "removed", entry);
+
+    m_cs.Unlock();
+}
+
+BOOL CDeliveryJournal::IsBackingOff(LPCTSTR szCrashGUID, __time64_t tNow, __time64_t& tNextAttempt)
+{
+    m_cs.Lock();
+
+    tNextAttempt = 0;
+    std::map<CString, JournalEntry>::iterator it = m_aEntries.find(szCrashGUID);
+    if(it!=m_aEntries.end() && !it->second.m_bDone)
+        tNextAttempt = it->second.m_tNextAttempt;
+
+    m_cs.Unlock();
+
+    return tNextAttempt>tNow;
+}
+
+BOOL CDeliveryJournal::IsServerBackingOff(__time64_t tNow, __time64_t& tNextAttempt)
+{
+    m_cs.Lock();
+
+    tNextAttempt = 0;
+    std::map<CString, JournalEntry>::iterator it = m_aEntries.find(SERVER_ENTRY);
+    if(it!=m_aEntries.end() && it->second.m_nAttempts>=JOURNAL_OUTAGE_THRESHOLD)
+        tNextAttempt = it->second.m_tNextAttempt;
+
+    m_cs.Unlock();
+
+    return tNextAttempt>tNow;
+}
+
+int CDeliveryJournal::GetAttemptCount(LPCTSTR szCrashGUID)
+{
+    m_cs.Lock();
+
+    int nAttempts = 0;
+    std::map<CString, JournalEntry>::iterator it = m_aEntries.find(szCrashGUID);
+    if(it!=m_aEntries.end())
+        nAttempts = it->second.m_nAttempts;
+
+    m_cs.Unlock();
+
+    return nAttempts;
+}
+
+int CDeliveryJournal::GetFailuresInRow()
+{
+    m_cs.Lock();
+
+    int nFailures = 0;
+    std::map<CString, JournalEntry>::iterator it = m_aEntries.find(SERVER_ENTRY);
+    if(it!=m_aEntries.end())
+        nFailures = it->second.m_nAttempts;
+
+    m_cs.Unlock();
+
+    return nFailures;
+}
+
+BOOL CDeliveryJournal::Compact(const std::set<CString>& aLiveReports)
+{
+    BOOL bStatus = FALSE;
+    std::map<CString, JournalEntry> aEntries;
+    std::map<CString, JournalEntry>::iterator it;
+
+    m_cs.Lock();
+
+    if(m_hFile==INVALID_HANDLE_VALUE)
+        goto cleanup;
+
+    // Not worth rewriting yet
+    if(m_nRecords<=(int)aLiveReports.size()+JOURNAL_COMPACT_SLACK)
+    {
+        bStatus = TRUE;
+        goto cleanup;
+    }
+
+    // Keep the last state of reports still in the queue, and failure count of the server
+    for(it=m_aEntries.begin(); it!=m_aEntries.end(); it++)
+    {
+        if(it->first==SERVER_ENTRY ||
+           (!it->second.m_bDone && aLiveReports.find(it->first)!=aLiveReports.end()))
+            aEntries[it->first] = it->second;
+    }
+
+    bStatus = Rewrite(aEntries);
+
+cleanup:
+
+    m_cs.Unlock();
+
+    return bStatus;
+}
+
+BOOL CDeliveryJournal::Rewrite(const std::map<CString, JournalEntry>& aEntries)
+{
+    BOOL bStatus = FALSE;
+    CString sTempFile = m_sFileName + _T(".tmp");
+    HANDLE hTempFile = INVALID_HANDLE_VALUE;
+    std::map<CString, JournalEntry>::const_iterator it;
+    __time64_t tNow = _time64(NULL);
+    DWORD dwWritten = 0;
+
+    hTempFile = CreateFile(sTempFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hTempFile==INVALID_HANDLE_VALUE)
+        goto cleanup;
+
+    for(it=aEntries.begin(); it!=aEntries.end(); it++)
+    {
+        std::string sLine = FormatLine(tNow, it->first, it->second.m_nAttempts!=0?"failed":"queued", it->second);
+        if(!WriteFile(hTempFile, sLine.c_str(), (DWORD)sLine.size(), &dwWritten, NULL))
+            goto cleanup;
+    }
+
+    CloseHandle(hTempFile);
+    hTempFile = INVALID_HANDLE_VALUE;
+
+    // Replace the journal. This fails if another process has it open without
+    // FILE_SHARE_DELETE, then the old journal is kept.
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    if(MoveFileEx(sTempFile, m_sFileName, MOVEFILE_REPLACE_EXISTING))
+    {
+        m_aEntries = aEntries;
+        m_nRecords = (int)aEntries.size();
+        bStatus = TRUE;
+    }
+
+    m_hFile = CreateFile(m_sFileName, GENERIC_READ|FILE_APPEND_DATA,
+        FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+
+cleanup:
+
+    if(hTempFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hTempFile);
+
+    if(!bStatus)
+        DeleteFile(sTempFile);
+
+    return bStatus;
+}
+
+__time64_t CDeliveryJournal::GetBackoffDelay(int nAttempts)
+{
+    if(nAttempts<=0)
+        return 0;
+
+    __time64_t tDelay = JOURNAL_MIN_BACKOFF;
+    int i;
+    for(i=1; i<nAttempts && tDelay<JOURNAL_MAX_BACKOFF; i++)
+        tDelay *= 2;
+
+    if(tDelay>JOURNAL_MAX_BACKOFF)
+        tDelay = JOURNAL_MAX_BACKOFF;
+
+    return tDelay;
+}
+
+void CDeliveryJournal::Apply(LPCSTR szLine)
+{
+    strconv_t strconv;
+    __time64_t tTime = 0;
+    char szGUID[64] = "";
+    char szEvent[16] = "";
+    char szOutcome[64] = "";
+    JournalEntry entry;
+
+    int nFields = sscanf_s(szLine, "%I64d %63s %15s %d %I64d %63s", &tTime,
+        szGUID, (unsigned)_countof(szGUID), szEvent, (unsigned)_countof(szEvent),
+        &entry.m_nAttempts, &entry.m_tNextAttempt, szOutcome, (unsigned)_countof(szOutcome));
+    if(nFields<5)
+        return; // Damaged line
+
+    entry.m_bDone = strcmp(szEvent, "delivered")==0 || strcmp(szEvent, "removed")==0;
+    if(nFields==6 && strcmp(szOutcome, "-")!=0)
+        entry.m_sLastOutcome = strconv.a2t(szOutcome);
+
+    m_aEntries[strconv.a2t(szGUID)] = entry;
+}
+
+void CDeliveryJournal::Append(const CString& sCrashGUID, LPCSTR szEvent, JournalEntry entry)
+{
+    // The same rule as when reading the journal
+    entry.m_bDone = strcmp(szEvent, "delivered")==0 || strcmp(szEvent, "removed")==0;
+    m_aEntries[sCrashGUID] = entry;
+
+    if(m_hFile==INVALID_HANDLE_VALUE)
+        return;
+
+    // The line is written with a single call, so lines of concurrent writers don't interleave
+    std::string sLine = FormatLine(_time64(NULL), sCrashGUID, szEvent, entry);
+    DWORD dwWritten = 0;
+    if(WriteFile(m_hFile, sLine.c_str(), (DWORD)sLine.size(), &dwWritten, NULL))
+        m_nRecords++;
+}
+
+std::string CDeliveryJournal::FormatLine(__time64_t tTime, const CString& sCrashGUID, LPCSTR szEvent, const JournalEntry& entry)
+{
+    strconv_t strconv;
+
+    CString sOutcome = entry.m_sLastOutcome.IsEmpty()?_T("-"):entry.m_sLastOutcome;
+
+    char szLine[256];
+    sprintf_s(szLine, sizeof(szLine), "%I64d %s %s %d %I64d %s\n", tTime,
+        strconv.t2a(sCrashGUID), szEvent, entry.m_nAttempts, entry.m_tNextAttempt,
+        strconv.t2a(sOutcome));
+
+    return szLine;
+}
@@ -0,0 +1,129 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: DeliveryJournal.h
+// Description: Append-only journal of error report delivery attempts.
+
+#pragma once
+#include "stdafx.h"
+
+// Delay before the first retry of a failed report, in seconds. The delay
+// doubles with every failed attempt, up to JOURNAL_MAX_BACKOFF.
+#define JOURNAL_MIN_BACKOFF  (5*60)
+#define JOURNAL_MAX_BACKOFF  (24*60*60)
+
+// After this many failures in a row (of any reports), the server is
+// assumed to be down and all reports back off together.
+#define JOURNAL_OUTAGE_THRESHOLD 3
+
+// The journal is rewritten when it has this many more records than reports.
+#define JOURNAL_COMPACT_SLACK 256
+
+// Delivery state of a report as recorded in the journal.
+struct JournalEntry
+{
+    JournalEntry()
+    {
+        m_bDone = FALSE;
+        m_nAttempts = 0;
+        m_tNextAttempt = 0;
+    }
+
+    BOOL m_bDone;             // Was the report delivered or removed?
+    int m_nAttempts;          // Count of failed delivery attempts.
+    __time64_t m_tNextAttempt; // When the report may be sent again (0 if any time).
+    CString m_sLastOutcome;   // Last transport outcome, like "HTTP:failed".
+};
+
+// CDeliveryJournal
+// Keeps the delivery history of queued reports in ~CrashRptQueue.log next to
+// ~CrashRpt.ini. Every change is appended as a single text line:
+//
+//   <time> <crash GUID> <event> <attempts> <next attempt time> <outcome>
+//
+// where event is one of queued, attempt, delivered, failed or removed, and
+// times are seconds since 1970 (UTC). The last line of a report defines its
+// state. The line with GUID "*" tracks failures of all reports in a row,
+// which is how a server outage is detected.
+//
+// Reports are looked up by GUID in O(log n), so checking the whole queue
+// doesn't depend on the journal length. Methods may be called from several
+// threads.
+class CDeliveryJournal
+{
+public:
+
+    // Constructor.
+    CDeliveryJournal();
+
+    // Destructor.
+    ~CDeliveryJournal();
+
+    // Reads the journal and opens it for appending. History of delivered and
+    // removed reports is dropped if the journal has grown too long.
+    BOOL Open(LPCTSTR szFileName);
+
+    // Closes the journal.
+    void Close();
+
+    // Records a report found in the queue, unless the journal knows it already.
+    void AddReport(LPCTSTR szCrashGUID);
+
+    // Records the result of an attempt to send the report with a transport ("HTTP", "SMTP" or "SMAPI").
+    void RecordAttempt(LPCTSTR szCrashGUID, LPCTSTR szTransport, BOOL bSuccess);
+
+    // Records that the report was delivered.
+    void RecordDelivered(LPCTSTR szCrashGUID);
+
+    // Records that all transports have failed and schedules the next attempt.
+    void RecordFailed(LPCTSTR szCrashGUID);
+
+    // Records that the report was deleted.
+    void RecordRemoved(LPCTSTR szCrashGUID);
+
+    // Returns TRUE if the report may not be sent yet; tNextAttempt receives the time when it may.
+    BOOL IsBackingOff(LPCTSTR szCrashGUID, __time64_t tNow, __time64_t& tNextAttempt);
+
+    // Returns TRUE if several reports have failed in a row recently, so the
+    // server should be left alone until tNextAttempt.
+    BOOL IsServerBackingOff(__time64_t tNow, __time64_t& tNextAttempt);
+
+    // Returns the number of failed attempts of the report.
+    int GetAttemptCount(LPCTSTR szCrashGUID);
+
+    // Returns the number of reports that have failed in a row.
+    int GetFailuresInRow();
+
+    // Rewrites the journal to contain reports from the list only, if it has grown too long.
+    BOOL Compact(const std::set<CString>& aLiveReports);
+
+    // Returns delay before attempt nAttempts+1 of a report that failed nAttempts times.
+    static __time64_t GetBackoffDelay(int nAttempts);
+
+private:
+
+    // Applies a journal line to the state.
+    void Apply(LPCSTR szLine);
+
+    // Appends a line to the journal and applies it.
+    void Append(const CString& sCrashGUID, LPCSTR szEvent, JournalEntry entry);
+
+    // Replaces the journal with one line per entry. Must be called with m_cs locked.
+    BOOL Rewrite(const std::map<CString, JournalEntry>& aEntries);
+
+    // Formats a journal line.
+    static std::string FormatLine(__time64_t tTime, const CString& sCrashGUID, LPCSTR szEvent, const JournalEntry& entry);
+
+    CComAutoCriticalSection m_cs;                 // Protects the state below
+    CString m_sFileName;                          // Journal file name
+    HANDLE m_hFile;                               // Journal file opened for appending
+    int m_nRecords;                               // Count of lines in the journal
+    std::map<CString, JournalEntry> m_aEntries;   // Report states by crash GUID
+};
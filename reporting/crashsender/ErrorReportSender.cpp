@@ -20,11 +20,20 @@ be found in the Authors.txt file in the root of the source tree.
 #include "CrashInfoReader.h"
 #include "strconv.h"
 #include "ScreenCap.h"
-#include "base64.h"
 #include <sys/stat.h>
 #include "dbghelp.h"
 #include "VideoRec.h"
 #include "VideoRecDlg.h"
+#include "ParallelZip.h"
+#include "ZipPolicy.h"
+#include "HashedZipOutput.h"
+#include "BytePipe.h"
+
+// Size of the buffer between compression and HTTP upload when streaming.
+#define HTTP_STREAM_BUFFER_SIZE (4*1024*1024)
+
+// How long to wait for each racing delivery method in turn, in milliseconds.
+#define TRANSPORT_POLL_INTERVAL 100
 
 CErrorReportSender* CErrorReportSender::m_pInstance = NULL;
 
@@ -38,8 +47,18 @@ CErrorReportSender::CErrorReportSender() :
 	m_bExport(FALSE),
 	m_MailClientConfirm(NOT_CONFIRMED_YET),
 	m_bSendingNow(FALSE),
-	m_bErrors(FALSE)
+	m_bErrors(FALSE),
+	m_nDeliveryDone(0),
+	m_nDeliveryTotal(0),
+	m_nFailuresInRow(0),
+	m_bOutageLogged(FALSE),
+	m_ReportLevel(REPORT_FULL)
 {
+	// Messages of racing delivery methods go to the common log
+	m_TransportAssync[CR_HTTP].SetParent(&m_Assync, _T("[HTTP] "));
+	m_TransportAssync[CR_SMTP].SetParent(&m_Assync, _T("[SMTP] "));
+	m_bTransportRunning[CR_HTTP] = FALSE;
+	m_bTransportRunning[CR_SMTP] = FALSE;
 }
 
 // Destructor
@@ -124,6 +143,39 @@ BOOL CErrorReportSender::Init(LPCTSTR szFileMappingName)
 
     if(!m_CrashInfo.m_bSendRecentReports)
     {
+        // Check if the crash keeps repeating
+        m_ReportLevel = GetReportLevel();
+        if(m_ReportLevel==REPORT_SKIP)
+        {
+            // Parent process can now terminate
+            UnblockParentProcess();
+
+            // Remove the report folder, it has no files yet
+            CErrorReportInfo* pReport = GetReport();
+            if(pReport!=NULL)
+                Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
+
+            // Clean up temp files
+            m_VideoRec.Destroy();
+
+            // The application is restarted even though no report is collected
+            RestartApp();
+
+            m_sErrorMsg = _T("The crash has been reported too many times recently.");
+            return FALSE;
+        }
+        else if(m_ReportLevel==REPORT_BRIEF)
+        {
+            // The crash has been reported in full already; collect nothing but
+            // crash description, the collecting steps skip disabled items
+            m_CrashInfo.m_bGenerateMinidump = FALSE;
+            m_CrashInfo.m_bAddScreenshot = FALSE;
+            m_VideoRec.Destroy();
+            CErrorReportInfo* pReport = GetReport();
+            if(pReport!=NULL)
+                pReport->RemoveClientItems();
+        }
+
         // Start crash info collection work assynchronously
         DoWorkAssync(COLLECT_CRASH_INFO);
     }
@@ -341,7 +393,10 @@ BOOL CErrorReportSender::DoWork(int Action)
         // Add a message to log
         m_Assync.SetProgress(_T("Start collecting information about the crash..."), 0, false);
 
-        // First take a screenshot of user's desktop (if needed).
+        // Save the ring log first, threads still running in the client app may overwrite it.
+        CollectRingLog();
+
+        // Take a screenshot of user's desktop (if needed).
         TakeDesktopScreenshot();
 
         if(m_Assync.IsCancelled()) // Check if user-cancelled
@@ -408,26 +463,40 @@ BOOL CErrorReportSender::DoWork(int Action)
         RestartApp();
     }
 
+    BOOL bStreamed = FALSE;
+
     if(Action&COMPRESS_REPORT) // We have to compress error report file into ZIP archive
     {
 		// Kaneva - Added
 		auto pReport = GetReport();
 		if (!pReport) return FALSE;
 
+        // Try to upload the archive while compressing it. If that fails,
+        // the archive is written to disk and sent the usual way.
+        if((Action&SEND_REPORT) && IsStreamingUploadPossible())
+        {
+            bStreamed = StreamReportOverHTTP(pReport);
+            if(!bStreamed && !m_Assync.IsCancelled())
+                m_Assync.SetProgress(_T("Streaming upload has failed; falling back to sending ZIP file."), 0, false);
+        }
+
         // Compress error report files
-        BOOL bCompress = CompressReportFiles(pReport);
-        if(!bCompress)
+        if(!bStreamed)
         {
-            // Add a message to log
-            m_Assync.SetProgress(_T("[status_failed]"), 100, false);
-            return FALSE; // Error compressing files
+            BOOL bCompress = CompressReportFiles(pReport);
+            if(!bCompress)
+            {
+                // Add a message to log
+                m_Assync.SetProgress(_T("[status_failed]"), 100, false);
+                return FALSE; // Error compressing files
+            }
         }
     }
 
     if(Action&SEND_REPORT) // We need to send the report over the Internet
     {
-        // Send the error report.
-        if(!SendReport())
+        // Send the error report, unless it has already been streamed.
+        if(!bStreamed && !SendReport())
 			return FALSE;
         else
         {
@@ -853,6 +922,384 @@ cleanup:
     return bStatus;
 }
 
+BOOL CErrorReportSender::CollectRingLog()
+{
+	auto pReport = GetReport();
+	if (!pReport) return FALSE;
+
+    if(pReport->GetRingLog().m_sMappingName.IsEmpty())
+        return TRUE; // The client app has no ring log
+
+    BOOL bStatus = FALSE;
+    CSharedMem RingLogMem;
+    RING_LOG_HEADER* pHeader = NULL;
+    LPBYTE pData = NULL;
+    DWORD dwDataSize = 0;
+    WORD wHeaderSize = 0;
+    std::vector<BYTE> aSnapshot;
+    DWORD dwSkip = 0;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    CString sFileName = pReport->GetErrorReportDirName() + _T("\\") + pReport->GetRingLog().m_sDestFile;
+    CString sErrorMsg;
+    ERIFileItem fi;
+
+    m_Assync.SetProgress(_T("Saving ring log..."), 0, false);
+
+    if(!RingLogMem.Init(pReport->GetRingLog().m_sMappingName, TRUE, 0))
+    {
+        sErrorMsg = _T("Couldn't open ring log file mapping");
+        goto cleanup;
+    }
+
+    pHeader = (RING_LOG_HEADER*)RingLogMem.CreateView(0, sizeof(RING_LOG_HEADER));
+    if(pHeader==NULL || memcmp(pHeader->m_uchMagic, "RLH", 3)!=0)
+    {
+        sErrorMsg = _T("Invalid ring log header");
+        goto cleanup;
+    }
+
+    dwDataSize = pHeader->m_dwDataSize;
+    wHeaderSize = pHeader->m_wSize;
+    RingLogMem.DestroyView((LPBYTE)pHeader);
+    if(dwDataSize<RING_LOG_MIN_SIZE || dwDataSize>RING_LOG_MAX_SIZE ||
+       (dwDataSize&(dwDataSize-1))!=0 || wHeaderSize<sizeof(RING_LOG_HEADER))
+    {
+        sErrorMsg = _T("Invalid ring log header");
+        goto cleanup;
+    }
+
+    pHeader = (RING_LOG_HEADER*)RingLogMem.CreateView(0, wHeaderSize+dwDataSize);
+    if(pHeader==NULL)
+    {
+        sErrorMsg = _T("Couldn't map ring log");
+        goto cleanup;
+    }
+    pData = (LPBYTE)pHeader+wHeaderSize;
+
+    {
+        // Copy the last written bytes
+        DWORD dwHead = (DWORD)pHeader->m_lHead;
+        BOOL bWrapped = pHeader->m_lWrapped!=0 || dwHead>=dwDataSize;
+        DWORD dwLen = bWrapped ? dwDataSize : dwHead;
+        DWORD dwOffs = (dwHead-dwLen)&(dwDataSize-1);
+        DWORD dwFirst = dwLen<dwDataSize-dwOffs ? dwLen : dwDataSize-dwOffs;
+
+        aSnapshot.resize(dwLen);
+        if(dwLen!=0)
+        {
+            memcpy(&aSnapshot[0], pData+dwOffs, dwFirst);
+            memcpy(&aSnapshot[dwFirst], pData, dwLen-dwFirst);
+        }
+        MemoryBarrier();
+
+        // Drop the oldest bytes overwritten while we copied them
+        DWORD dwWritten = (DWORD)pHeader->m_lHead-dwHead;
+        if(dwWritten>dwDataSize)
+            dwSkip = dwLen;
+        else if(dwWritten+dwLen>dwDataSize)
+            dwSkip = dwWritten+dwLen-dwDataSize;
+
+        // Start from a complete line
+        if(bWrapped)
+        {
+            DWORD i;
+            for(i=dwSkip; i<dwLen; i++)
+            {
+                if(aSnapshot[i]=='\n')
+                {
+                    dwSkip = i+1;
+                    break;
+                }
+            }
+        }
+    }
+
+    hFile = CreateFile(sFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    if(dwSkip<aSnapshot.size())
+    {
+        DWORD dwToWrite = (DWORD)aSnapshot.size()-dwSkip;
+        DWORD dwBytesWritten = 0;
+        if(!WriteFile(hFile, &aSnapshot[dwSkip], dwToWrite, &dwBytesWritten, NULL) ||
+           dwBytesWritten!=dwToWrite)
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+    }
+
+    bStatus = TRUE;
+    m_Assync.SetProgress(_T("Finished saving ring log."), 100, false);
+
+cleanup:
+
+    if(hFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+
+    RingLogMem.Destroy();
+
+    if(!bStatus)
+    {
+        CString sMsg;
+        sMsg.Format(_T("CErrorReportSender::CollectRingLog - %s"), (LPCTSTR)sErrorMsg);
+        m_Assync.SetProgress(sMsg, 0, false);
+    }
+
+	// Add the log file to error report
+    fi.m_bMakeCopy = FALSE;
+    fi.m_sDesc = pReport->GetRingLog().m_sDesc;
+    fi.m_sDestFile = pReport->GetRingLog().m_sDestFile;
+    fi.m_sSrcFile = sFileName;
+    fi.m_sErrorStatus = sErrorMsg;
+    pReport->AddFileItem(&fi);
+
+    return bStatus;
+}
+
+// Formats an address in the client process as "module+offset", which doesn't depend on
+// where the module has been loaded. Returns "?" if the address is outside of any module.
+static CString FormatModuleOffset(HANDLE hProcess, const std::vector<HMODULE>& aModules, DWORD64 dwAddr)
+{
+    size_t i;
+    for(i=0; i<aModules.size(); i++)
+    {
+        MODULEINFO mi;
+        if(!GetModuleInformation(hProcess, aModules[i], &mi, sizeof(MODULEINFO)))
+            continue;
+
+        DWORD64 dwBase = (DWORD64)mi.lpBaseOfDll;
+        if(dwAddr<dwBase || dwAddr>=dwBase+mi.SizeOfImage)
+            continue;
+
+        TCHAR szName[MAX_PATH] = _T("");
+        GetModuleBaseName(hProcess, aModules[i], szName, MAX_PATH);
+
+        CString sOffset;
+        sOffset.Format(_T("%s+0x%I64x"), szName, dwAddr-dwBase);
+        sOffset.MakeLower();
+        return sOffset;
+    }
+
+    return _T("?");
+}
+
+BOOL CErrorReportSender::CalcCrashSignature(CString& sSignature)
+{
+    // Count of return addresses included into the signature
+    const int MAX_SIGNATURE_FRAMES = 4;
+    // Count of stack frames walked to find them
+    const int MAX_WALKED_FRAMES = 32;
+
+    typedef DWORD (WINAPI *LPSYMSETOPTIONS)(DWORD SymOptions);
+    typedef BOOL (WINAPI *LPSYMINITIALIZE)(HANDLE hProcess, PCSTR UserSearchPath, BOOL fInvadeProcess);
+    typedef BOOL (WINAPI *LPSYMCLEANUP)(HANDLE hProcess);
+    typedef BOOL (WINAPI *LPSTACKWALK64)(DWORD MachineType, HANDLE hProcess, HANDLE hThread,
+        LPSTACKFRAME64 StackFrame, PVOID ContextRecord, PREAD_PROCESS_MEMORY_ROUTINE64 ReadMemoryRoutine,
+        PFUNCTION_TABLE_ACCESS_ROUTINE64 FunctionTableAccessRoutine, PGET_MODULE_BASE_ROUTINE64 GetModuleBaseRoutine,
+        PTRANSLATE_ADDRESS_ROUTINE64 TranslateAddress);
+
+    BOOL bStatus = FALSE;
+    HANDLE hProcess = NULL;
+    HANDLE hThread = NULL;
+    HMODULE hDbgHelp = NULL;
+    LPSYMCLEANUP pfnSymCleanup = NULL;
+    BOOL bSymInit = FALSE;
+    EXCEPTION_POINTERS ep;
+    EXCEPTION_RECORD er;
+    CONTEXT ctx;
+    STACKFRAME64 sf;
+    DWORD dwMachineType = 0;
+    SIZE_T uBytesRead = 0;
+    std::vector<HMODULE> aModules(256);
+    DWORD cbNeeded = 0;
+    CString sKey;
+    int nFrames = 0;
+    int i;
+    MD5 md5;
+    MD5_CTX md5_ctx;
+    unsigned char md5_hash[16];
+    strconv_t strconv;
+    LPCSTR szKey = NULL;
+
+    sSignature.Empty();
+
+    // Manually generated reports may have no exception context
+    if(m_CrashInfo.m_pExInfo==NULL)
+        return FALSE;
+
+    hProcess = OpenProcess(PROCESS_QUERY_INFORMATION|PROCESS_VM_READ, FALSE, m_CrashInfo.m_dwProcessId);
+    if(hProcess==NULL)
+        goto cleanup;
+
+    // Read exception record and thread context from the client process
+    if(!ReadProcessMemory(hProcess, m_CrashInfo.m_pExInfo, &ep, sizeof(EXCEPTION_POINTERS), &uBytesRead) ||
+       uBytesRead!=sizeof(EXCEPTION_POINTERS) || ep.ExceptionRecord==NULL || ep.ContextRecord==NULL)
+        goto cleanup;
+
+    if(!ReadProcessMemory(hProcess, ep.ExceptionRecord, &er, sizeof(EXCEPTION_RECORD), &uBytesRead) ||
+       uBytesRead!=sizeof(EXCEPTION_RECORD) ||
+       !ReadProcessMemory(hProcess, ep.ContextRecord, &ctx, sizeof(CONTEXT), &uBytesRead) ||
+       uBytesRead!=sizeof(CONTEXT))
+        goto cleanup;
+
+    // Get the list of loaded modules
+    if(!EnumProcessModules(hProcess, &aModules[0], (DWORD)(aModules.size()*sizeof(HMODULE)), &cbNeeded))
+        goto cleanup;
+    if(cbNeeded>aModules.size()*sizeof(HMODULE))
+    {
+        aModules.resize(cbNeeded/sizeof(HMODULE));
+        if(!EnumProcessModules(hProcess, &aModules[0], (DWORD)(aModules.size()*sizeof(HMODULE)), &cbNeeded))
+            goto cleanup;
+    }
+    if(cbNeeded<aModules.size()*sizeof(HMODULE))
+        aModules.resize(cbNeeded/sizeof(HMODULE));
+
+    // The same crash in another version of the app is another crash
+    sKey.Format(_T("%s;%d;0x%x;%s"), (LPCTSTR)GetReport()->GetAppVersion(), m_CrashInfo.m_nExceptionType,
+        m_CrashInfo.m_dwExceptionCode, (LPCTSTR)FormatModuleOffset(hProcess, aModules, (DWORD64)er.ExceptionAddress));
+    bStatus = TRUE;
+
+    // Add the top return addresses. The stack walk is optional: without dbghelp.dll
+    // the signature consists of the faulting address only.
+    hDbgHelp = LoadLibrary(m_CrashInfo.m_sDbgHelpPath);
+    if(hDbgHelp==NULL)
+        hDbgHelp = LoadLibrary(_T("dbghelp.dll"));
+    if(hDbgHelp==NULL)
+        goto cleanup;
+
+    {
+        LPSYMSETOPTIONS pfnSymSetOptions = (LPSYMSETOPTIONS)GetProcAddress(hDbgHelp, "SymSetOptions");
+        LPSYMINITIALIZE pfnSymInitialize = (LPSYMINITIALIZE)GetProcAddress(hDbgHelp, "SymInitialize");
+        LPSTACKWALK64 pfnStackWalk64 = (LPSTACKWALK64)GetProcAddress(hDbgHelp, "StackWalk64");
+        PFUNCTION_TABLE_ACCESS_ROUTINE64 pfnSymFunctionTableAccess64 =
+            (PFUNCTION_TABLE_ACCESS_ROUTINE64)GetProcAddress(hDbgHelp, "SymFunctionTableAccess64");
+        PGET_MODULE_BASE_ROUTINE64 pfnSymGetModuleBase64 =
+            (PGET_MODULE_BASE_ROUTINE64)GetProcAddress(hDbgHelp, "SymGetModuleBase64");
+        pfnSymCleanup = (LPSYMCLEANUP)GetProcAddress(hDbgHelp, "SymCleanup");
+        if(pfnSymSetOptions==NULL || pfnSymInitialize==NULL || pfnStackWalk64==NULL ||
+           pfnSymFunctionTableAccess64==NULL || pfnSymGetModuleBase64==NULL || pfnSymCleanup==NULL)
+            goto cleanup;
+
+        // Only unwind information is needed, don't load symbols
+        pfnSymSetOptions(SYMOPT_DEFERRED_LOADS);
+        bSymInit = pfnSymInitialize(hProcess, NULL, TRUE);
+        if(!bSymInit)
+            goto cleanup;
+
+        hThread = OpenThread(THREAD_GET_CONTEXT|THREAD_QUERY_INFORMATION, FALSE, m_CrashInfo.m_dwThreadId);
+
+        memset(&sf, 0, sizeof(STACKFRAME64));
+#ifdef _WIN64
+        dwMachineType = IMAGE_FILE_MACHINE_AMD64;
+        sf.AddrPC.Offset = ctx.Rip;
+        sf.AddrFrame.Offset = ctx.Rbp;
+        sf.AddrStack.Offset = ctx.Rsp;
+#else
+        dwMachineType = IMAGE_FILE_MACHINE_I386;
+        sf.AddrPC.Offset = ctx.Eip;
+        sf.AddrFrame.Offset = ctx.Ebp;
+        sf.AddrStack.Offset = ctx.Esp;
+#endif
+        sf.AddrPC.Mode = AddrModeFlat;
+        sf.AddrFrame.Mode = AddrModeFlat;
+        sf.AddrStack.Mode = AddrModeFlat;
+
+        for(i=0; i<MAX_WALKED_FRAMES && nFrames<MAX_SIGNATURE_FRAMES; i++)
+        {
+            if(!pfnStackWalk64(dwMachineType, hProcess, hThread, &sf, &ctx, NULL,
+                pfnSymFunctionTableAccess64, pfnSymGetModuleBase64, NULL) || sf.AddrPC.Offset==0)
+                break;
+
+            // Skip the faulting address (already added) and frames of CrashRpt
+            // itself, which are on top when a C++ exception handler is called
+            if(sf.AddrPC.Offset==(DWORD64)er.ExceptionAddress)
+                continue;
+            CString sFrame = FormatModuleOffset(hProcess, aModules, sf.AddrPC.Offset);
+            if(sFrame.Left(8)==_T("crashrpt"))
+                continue;
+
+            sKey += _T(";") + sFrame;
+            nFrames++;
+        }
+    }
+
+cleanup:
+
+    if(bSymInit)
+        pfnSymCleanup(hProcess);
+
+    if(hDbgHelp!=NULL)
+        FreeLibrary(hDbgHelp);
+
+    if(hThread!=NULL)
+        CloseHandle(hThread);
+
+    if(hProcess!=NULL)
+        CloseHandle(hProcess);
+
+    if(!bStatus)
+        return FALSE;
+
+    // The signature is the MD5 hash of the key
+    szKey = strconv.t2utf8(sKey);
+    md5.MD5Init(&md5_ctx);
+    md5.MD5Update(&md5_ctx, (unsigned char*)szKey, (unsigned int)strlen(szKey));
+    md5.MD5Final(md5_hash, &md5_ctx);
+
+    for(i=0; i<16; i++)
+    {
+        CString number;
+        number.Format(_T("%02x"), md5_hash[i]);
+        sSignature += number;
+    }
+
+    return TRUE;
+}
+
+eReportLevel CErrorReportSender::GetReportLevel()
+{
+    // Check our config - should we suppress repeated crashes?
+    if(!m_CrashInfo.m_bSuppressRepeatedCrashes)
+        return REPORT_FULL;
+
+	auto pReport = GetReport();
+	if (!pReport) return REPORT_FULL;
+
+    // Messages go to the log of this report
+    InitLog();
+
+    CString sSignature;
+    if(!CalcCrashSignature(sSignature))
+    {
+        m_Assync.SetProgress(_T("Couldn't calculate crash signature."), 0, false);
+        return REPORT_FULL; // Can't tell whether the crash has repeated
+    }
+
+    int nCount = m_CrashInfo.CountCrashSignature(sSignature);
+    pReport->SetCrashSignature(sSignature, nCount);
+
+    CString sMsg;
+    sMsg.Format(_T("Crash signature %s has occurred %d time(s) recently."), (LPCTSTR)sSignature, nCount);
+    m_Assync.SetProgress(sMsg, 0, false);
+
+    if(nCount<=m_CrashInfo.m_nFullReportsPerSignature)
+        return REPORT_FULL;
+
+    if(nCount<=m_CrashInfo.m_nFullReportsPerSignature+m_CrashInfo.m_nBriefReportsPerSignature)
+    {
+        m_Assync.SetProgress(_T("The crash has repeated; collecting crash description only."), 0, false);
+        return REPORT_BRIEF;
+    }
+
+    m_Assync.SetProgress(_T("The crash has repeated too many times; skipping the report."), 0, false);
+    return REPORT_SKIP;
+}
+
 BOOL CErrorReportSender::SetDumpPrivileges()
 {
 	// This method is used to have the current process be able to call MiniDumpWriteDump
@@ -999,6 +1446,15 @@ BOOL CErrorReportSender::CreateCrashDescriptionXML(CErrorReportInfo& eri)
         AddElemToXML(_T("InvParamLine"), sInvParamLine, root);
     }
 
+    if(!eri.GetCrashSignature().IsEmpty())
+    {
+        AddElemToXML(_T("CrashSignature"), eri.GetCrashSignature(), root);
+
+        CString sSignatureCount;
+        sSignatureCount.Format(_T("%d"), eri.GetCrashSignatureCount());
+        AddElemToXML(_T("CrashSignatureCount"), sSignatureCount, root);
+    }
+
     CString sGuiResources;
     sGuiResources.Format(_T("%d"), eri.GetGuiResourceCount());
     AddElemToXML(_T("GUIResourceCount"), sGuiResources, root);
@@ -1100,6 +1556,38 @@ BOOL CErrorReportSender::CreateCrashDescriptionXML(CErrorReportInfo& eri)
         hCustomProps.ToElement()->LinkEndChild(hProp.ToNode());
     }
 
+    TiXmlHandle hBreadcrumbs = new TiXmlElement("Breadcrumbs");
+    root->LinkEndChild(hBreadcrumbs.ToNode());
+
+    for(i=0; i<eri.GetBreadcrumbCount(); i++)
+    {
+        ERIBreadcrumb bc;
+        eri.GetBreadcrumbByIndex(i, bc);
+
+        ULARGE_INTEGER uTime;
+        uTime.QuadPart = bc.m_uTime;
+        FILETIME ft;
+        ft.dwLowDateTime = uTime.LowPart;
+        ft.dwHighDateTime = uTime.HighPart;
+        SYSTEMTIME st;
+        memset(&st, 0, sizeof(SYSTEMTIME));
+        FileTimeToSystemTime(&ft, &st);
+
+        char szTime[64];
+        sprintf_s(szTime, 64, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+        char szThreadId[32];
+        sprintf_s(szThreadId, 32, "%lu", bc.m_dwThreadId);
+
+        TiXmlHandle hBreadcrumb = new TiXmlElement("Breadcrumb");
+
+        hBreadcrumb.ToElement()->SetAttribute("time", szTime);
+        hBreadcrumb.ToElement()->SetAttribute("thread", szThreadId);
+        hBreadcrumb.ToElement()->SetAttribute("text", strconv.t2utf8(bc.m_sText));
+
+        hBreadcrumbs.ToElement()->LinkEndChild(hBreadcrumb.ToNode());
+    }
+
     TiXmlHandle hFileItems = new TiXmlElement("FileList");
     root->LinkEndChild(hFileItems.ToNode());
 
@@ -1734,7 +2222,8 @@ int CErrorReportSender::DumpRegKey(HKEY hParentKey, CString sSubKey, TiXmlElemen
 int CErrorReportSender::CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 {
     FILE* f = NULL;  // Handle to file
-    BYTE buff[512];  // Read buffer
+    const size_t BUFF_SIZE = 64*1024;
+    std::vector<BYTE> buff(BUFF_SIZE); // Read buffer
     MD5 md5;         // MD5 hash
     MD5_CTX md5_ctx; // MD5 context
     unsigned char md5_hash[16]; // MD5 hash as sequence of bytes
@@ -1764,10 +2253,10 @@ int CErrorReportSender::CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 	// Read file contents and update MD5 hash as each portion is being read
     while(!feof(f))
     {
-        size_t count = fread(buff, 1, 512, f);
+        size_t count = fread(&buff[0], 1, BUFF_SIZE, f);
         if(count>0)
         {
-            md5.MD5Update(&md5_ctx, buff, (unsigned int)count);
+            md5.MD5Update(&md5_ctx, &buff[0], (unsigned int)count);
         }
     }
 
@@ -1793,6 +2282,19 @@ int CErrorReportSender::CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
     return 0;
 }
 
+// This method returns an MD5 hash of the ZIP archive being sent
+int CErrorReportSender::GetZipMD5Hash(CString& sMD5Hash)
+{
+	// Use the hash calculated while the archive was written, if any
+    if(!m_sZipMD5Hash.IsEmpty())
+    {
+        sMD5Hash = m_sZipMD5Hash;
+        return 0;
+    }
+
+    return CalcFileMD5Hash(m_sZipName, sMD5Hash);
+}
+
 // This method restarts the client application
 BOOL CErrorReportSender::RestartApp()
 {
@@ -1867,7 +2369,14 @@ BOOL CErrorReportSender::RestartApp()
 }
 
 // This method compresses the files contained in the report and produces a ZIP archive.
-BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
+BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri, CBytePipe* pPipe)
+{
+    return CompressReportFiles(eri, pPipe, &m_Assync, m_sZipName, m_sZipMD5Hash);
+}
+
+// This method packs report files into a ZIP archive, reporting progress to pAssync
+BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri, CBytePipe* pPipe,
+                                             AssyncNotification* pAssync, CString& sZipName, CString& sZipMD5Hash)
 {
     BOOL bStatus = FALSE;
     strconv_t strconv;
@@ -1875,43 +2384,67 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
     CString sMsg;
     LONG64 lTotalSize = 0;
     LONG64 lTotalCompressed = 0;
-    BYTE buff[1024];
+    std::vector<BYTE> buff(256*1024);
     HANDLE hFile = INVALID_HANDLE_VALUE;
+    CParallelZipWriter ZipWriter;
+    CHashedZipOutput ZipOutput;
+    zlib_filefunc64_def ZipFileFunc;
+    CZipPolicy ZipPolicy(m_CrashInfo.m_dwZipPolicyFlags);
+    std::vector<CString> aZipReasons;
+    ULONGLONG uZipSize = 0;
+    ULONGLONG uZipCompressedSize = 0;
+    DWORD dwZipStartTick = 0;
+    size_t nEntry = 0;
     std::map<CString, ERIFileItem>::iterator it;
     FILE* f = NULL;
     CString sMD5Hash;
 
 	// Add a different log message depending on the current mode.
     if(m_bExport)
-        m_Assync.SetProgress(_T("[exporting_report]"), 0, false);
+        pAssync->SetProgress(_T("[exporting_report]"), 0, false);
     else
-        m_Assync.SetProgress(_T("[compressing_files]"), 0, false);
+        pAssync->SetProgress(_T("[compressing_files]"), 0, false);
 
 	// Calculate the total size of error report files
 	lTotalSize = eri->GetTotalSize();
 
 	// Add a message to log
     sMsg.Format(_T("Total file size for compression is %I64d bytes"), lTotalSize);
-    m_Assync.SetProgress(sMsg, 0, false);
+    pAssync->SetProgress(sMsg, 0, false);
 
 	// Determine what name to use for the output ZIP archive file.
     if(m_bExport)
-        m_sZipName = m_sExportFileName;
+        sZipName = m_sExportFileName;
     else
-        m_sZipName = eri->GetErrorReportDirName() + _T(".zip");
+        sZipName = eri->GetErrorReportDirName() + _T(".zip");
 
 	// Update progress
-    sMsg.Format(_T("Creating ZIP archive file %s"), (LPCTSTR) m_sZipName);
-    m_Assync.SetProgress(sMsg, 1, false);
+    sMsg.Format(_T("Creating ZIP archive file %s"), (LPCTSTR) sZipName);
+    pAssync->SetProgress(sMsg, 1, false);
+
+	// The hash of the previous archive is not valid anymore
+    sZipMD5Hash.Empty();
 
-	// Create ZIP archive
-    hZip = zipOpen((const char*)m_sZipName.GetBuffer(0), APPEND_STATUS_CREATE);
+	// Create ZIP archive. MD5 hash of the archive is calculated while it is being written.
+    if(pPipe!=NULL)
+        ZipOutput.SetPipe(pPipe);
+    ZipOutput.FillFileFunc(&ZipFileFunc);
+    hZip = zipOpen2_64((const char*)sZipName.GetBuffer(0), APPEND_STATUS_CREATE, NULL, &ZipFileFunc);
     if(hZip==NULL)
     {
-        m_Assync.SetProgress(_T("Failed to create ZIP file."), 100, true);
+        pAssync->SetProgress(_T("Failed to create ZIP file."), 100, true);
         goto cleanup;
     }
 
+	// Start compression threads. Files are split into blocks that are deflated
+	// concurrently and written to the archive in order from this thread.
+    if(!ZipWriter.Open(hZip))
+    {
+        pAssync->SetProgress(_T("Failed to start compression threads."), 100, true);
+        goto cleanup;
+    }
+    dwZipStartTick = GetTickCount();
+
 	// Enumerate files contained in the report
 	int i;
 	for(i=0; i<eri->GetFileItemCount(); i++)
@@ -1919,7 +2452,7 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
 		ERIFileItem* pfi = eri->GetFileItemByIndex(i);
 
 		// Check if the operation was cancelled by user
-        if(m_Assync.IsCancelled())
+        if(pAssync->IsCancelled())
             goto cleanup;
 
 		// Define destination file name in ZIP archive
@@ -1931,7 +2464,7 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
 
 		// Update progress
         sMsg.Format(_T("Compressing file %s"), (LPCTSTR) sDstFileName);
-        m_Assync.SetProgress(sMsg, 0, false);
+        pAssync->SetProgress(sMsg, 0, false);
 
 		// Open file for reading
         hFile = CreateFile(sFileName,
@@ -1939,7 +2472,7 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
         if(hFile==INVALID_HANDLE_VALUE)
         {
             sMsg.Format(_T("CErrorReportSender::CompressReportFiles - Couldn't open file %s"), (LPCTSTR)sFileName);
-            m_Assync.SetProgress(sMsg, 0, false);
+            pAssync->SetProgress(sMsg, 0, false);
             continue;
         }
 
@@ -1963,53 +2496,93 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
         info.external_fa = FILE_ATTRIBUTE_NORMAL;
         info.internal_fa = FILE_ATTRIBUTE_NORMAL;
 
+		// Read the first portion of source file, it is also the sample for compression policy
+        DWORD dwBytesRead = 0;
+        if(!ReadFile(hFile, &buff[0], (DWORD)buff.size(), &dwBytesRead, NULL))
+            dwBytesRead = 0;
+
+		// Choose compression level for this file
+        CString sReason;
+        DWORD cbSample = dwBytesRead<ZIP_POLICY_SAMPLE_SIZE?dwBytesRead:ZIP_POLICY_SAMPLE_SIZE;
+        int nLevel = ZipPolicy.ChooseLevel(sDstFileName, &buff[0], cbSample, sReason);
+
 		// Create new file inside of our ZIP archive
-        int n = zipOpenNewFileInZip( hZip, (const char*)strconv.t2a(sDstFileName.GetBuffer(0)), &info,
-            NULL, 0, NULL, 0, strconv.t2a(sDesc), Z_DEFLATED, Z_DEFAULT_COMPRESSION);
-        if(n!=0)
+        ULONGLONG uFileSize = ((ULONGLONG)fi.nFileSizeHigh<<32)|fi.nFileSizeLow;
+        BOOL bEntry = ZipWriter.BeginEntry((const char*)strconv.t2a(sDstFileName.GetBuffer(0)), &info,
+            strconv.t2a(sDesc), nLevel, uFileSize);
+        if(!bEntry)
         {
             sMsg.Format(_T("Couldn't compress file %s"), (LPCTSTR) sDstFileName);
-            m_Assync.SetProgress(sMsg, 0, false);
+            pAssync->SetProgress(sMsg, 0, false);
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
             continue;
         }
 
+		// Entries are written in the order they are begun; the reason is logged once written
+        aZipReasons.push_back(sReason);
+
 		// Read source file contents and write it to ZIP archive
-        for(;;)
+        while(dwBytesRead!=0)
         {
 			// Check if operation was cancelled by user
-            if(m_Assync.IsCancelled())
+            if(pAssync->IsCancelled())
                 goto cleanup;
 
-			// Read a portion of source file
-		    DWORD dwBytesRead=0;
-            BOOL bRead = ReadFile(hFile, buff, 1024, &dwBytesRead, NULL);
-            if(!bRead || dwBytesRead==0)
-                break;
-
-			// Write a portion into destination file
-            int res = zipWriteInFileInZip(hZip, buff, dwBytesRead);
-            if(res!=0)
+			// Pass a portion to compression threads
+            if(!ZipWriter.AddData(&buff[0], dwBytesRead))
             {
-                zipCloseFileInZip(hZip);
                 sMsg.Format(_T("Couldn't write to compressed file %s"), (LPCTSTR) sDstFileName);
-                m_Assync.SetProgress(sMsg, 0, false);
+                pAssync->SetProgress(sMsg, 0, false);
                 break;
             }
 
-			// Update totals
-            lTotalCompressed += dwBytesRead;
-
-			// Update progress
+			// Update progress. Only data already written to the archive is
+			// counted, so the progress doesn't run ahead of the compression.
+            lTotalCompressed = (LONG64)ZipWriter.GetWrittenInputSize();
             float fProgress = 100.0f*lTotalCompressed/lTotalSize;
-            m_Assync.SetProgress((int)fProgress, false);
+            pAssync->SetProgress((int)fProgress, false);
+
+			// Read the next portion of source file
+            if(!ReadFile(hFile, &buff[0], (DWORD)buff.size(), &dwBytesRead, NULL))
+                break;
         }
 
 		// Close file
-        zipCloseFileInZip(hZip);
+        ZipWriter.EndEntry();
         CloseHandle(hFile);
         hFile = INVALID_HANDLE_VALUE;
     }
 
+	// Wait for the remaining blocks to be written
+    if(!ZipWriter.Flush())
+    {
+        pAssync->SetProgress(_T("Couldn't write to ZIP file."), 0, false);
+        goto cleanup;
+    }
+    lTotalCompressed = (LONG64)ZipWriter.GetWrittenInputSize();
+
+	// Log what the compression policy has chosen and what it took
+    for(nEntry=0; nEntry<ZipWriter.GetEntryStats().size(); nEntry++)
+    {
+        const CParallelZipEntryStats& stats = ZipWriter.GetEntryStats()[nEntry];
+        CString sReason = nEntry<aZipReasons.size()?aZipReasons[nEntry]:CString();
+        sMsg.Format(_T("File %s: compression level %d (%s), %I64u bytes compressed to %I64u bytes in %u ms"),
+            (LPCTSTR)CString(stats.m_sFileName.c_str()), stats.m_nLevel, (LPCTSTR)sReason,
+            stats.m_uSize, stats.m_uCompressedSize, stats.m_dwTime);
+        pAssync->SetProgress(sMsg, 0, false);
+
+        uZipSize += stats.m_uSize;
+        uZipCompressedSize += stats.m_uCompressedSize;
+    }
+    sMsg.Format(_T("Compressed %d files: %I64u bytes compressed to %I64u bytes in %u ms"),
+        (int)ZipWriter.GetEntryStats().size(), uZipSize, uZipCompressedSize, GetTickCount()-dwZipStartTick);
+    pAssync->SetProgress(sMsg, 0, false);
+
+    ZipWriter.Close();
+
+    pAssync->SetProgress(100, false);
+
 	// Close ZIP archive
     if(hZip!=NULL)
     {
@@ -2020,32 +2593,56 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
     // Save MD5 hash file
     if(!m_bExport)
     {
-        sMsg.Format(_T("Calculating MD5 hash for file %s"), (LPCTSTR) m_sZipName);
-        m_Assync.SetProgress(sMsg, 0, false);
+        int nCalcMD5 = 0;
+        if(!ZipOutput.GetMD5Hash(sMD5Hash))
+        {
+            if(pPipe!=NULL)
+            {
+				// Streamed data can't be read once again
+                nCalcMD5 = -1;
+            }
+            else
+            {
+				// The archive was rewritten behind the hash, read it once again
+                sMsg.Format(_T("Calculating MD5 hash for file %s"), (LPCTSTR) sZipName);
+                pAssync->SetProgress(sMsg, 0, false);
 
-        int nCalcMD5 = CalcFileMD5Hash(m_sZipName, sMD5Hash);
+                nCalcMD5 = CalcFileMD5Hash(sZipName, sMD5Hash);
+            }
+        }
         if(nCalcMD5!=0)
         {
-            sMsg.Format(_T("Couldn't calculate MD5 hash for file %s"), (LPCTSTR) m_sZipName);
-            m_Assync.SetProgress(sMsg, 0, false);
+            sMsg.Format(_T("Couldn't calculate MD5 hash for file %s"), (LPCTSTR) sZipName);
+            pAssync->SetProgress(sMsg, 0, false);
             goto cleanup;
         }
 
+        if(pPipe!=NULL)
+        {
+			// The hash is sent right after the archive
+            pPipe->AddTrailingField(_T("md5"), strconv.t2utf8(sMD5Hash));
+        }
+        else
+        {
 #if _MSC_VER <1400
-        f = _tfopen(m_sZipName + _T(".md5"), _T("wt"));
+            f = _tfopen(sZipName + _T(".md5"), _T("wt"));
 #else
-        _tfopen_s(&f, m_sZipName + _T(".md5"), _T("wt"));
+            _tfopen_s(&f, sZipName + _T(".md5"), _T("wt"));
 #endif
-        if(f==NULL)
-        {
-            sMsg.Format(_T("Couldn't save MD5 hash for file %s"), (LPCTSTR) m_sZipName);
-            m_Assync.SetProgress(sMsg, 0, false);
-            goto cleanup;
+            if(f==NULL)
+            {
+                sMsg.Format(_T("Couldn't save MD5 hash for file %s"), (LPCTSTR) sZipName);
+                pAssync->SetProgress(sMsg, 0, false);
+                goto cleanup;
+            }
+
+            _ftprintf(f, sMD5Hash);
+            fclose(f);
+            f = NULL;
         }
 
-        _ftprintf(f, sMD5Hash);
-        fclose(f);
-        f = NULL;
+		// Remember the hash for sending
+        sZipMD5Hash = sMD5Hash;
     }
 
 	// Check if totals match
@@ -2056,9 +2653,20 @@ cleanup:
 
 	// Clean up
 
+	// Stop compression threads before closing the archive
+    ZipWriter.Close();
+
+	// Stop the upload before closing the archive, so that the rest isn't sent
+    if(pPipe!=NULL && !bStatus)
+        pPipe->Abort();
+
     if(hZip!=NULL)
         zipClose(hZip, NULL);
 
+	// Let the upload finish
+    if(pPipe!=NULL && bStatus)
+        pPipe->Close();
+
     if(hFile!=INVALID_HANDLE_VALUE)
         CloseHandle(hFile);
 
@@ -2066,20 +2674,20 @@ cleanup:
         fclose(f);
 
     if(bStatus)
-        m_Assync.SetProgress(_T("Finished compressing files...OK"), 100, true);
+        pAssync->SetProgress(_T("Finished compressing files...OK"), 100, true);
     else
-        m_Assync.SetProgress(_T("File compression failed."), 100, true);
+        pAssync->SetProgress(_T("File compression failed."), 100, true);
 
     if(m_bExport)
     {
         if(bStatus)
-            m_Assync.SetProgress(_T("[end_exporting_report_ok]"), 100, false);
+            pAssync->SetProgress(_T("[end_exporting_report_ok]"), 100, false);
         else
-            m_Assync.SetProgress(_T("[end_exporting_report_failed]"), 100, false);
+            pAssync->SetProgress(_T("[end_exporting_report_failed]"), 100, false);
     }
     else
     {
-        m_Assync.SetProgress(_T("[end_compressing_files]"), 100, false);
+        pAssync->SetProgress(_T("[end_compressing_files]"), 100, false);
     }
 
     return bStatus;
@@ -2111,9 +2719,26 @@ BOOL CErrorReportSender::SendReport()
     order.insert(pair1);
 
     std::multimap<int, int>::reverse_iterator rit;
+    std::vector<int> aTransports;
+    for(rit=order.rbegin(); rit!=order.rend(); rit++)
+        aTransports.push_back(rit->second);
+
+    // Start network delivery methods concurrently, so that a blocked one
+    // doesn't hold the others until it times out
+    int nWinner = -1;
+    if(m_CrashInfo.m_dwTransportStagger!=0)
+    {
+        nWinner = RaceTransports(pReport, aTransports);
+        if(nWinner>=0)
+        {
+            status = 0;
+            aTransports.clear();
+        }
+    }
 
 	// Walk through priorities
-    for(rit=order.rbegin(); rit!=order.rend(); rit++)
+    size_t i;
+    for(i=0; i<aTransports.size(); i++)
     {
         m_Assync.SetProgress(_T("[sending_attempt]"), 0);
         m_SendAttempt++;
@@ -2121,15 +2746,15 @@ BOOL CErrorReportSender::SendReport()
 		// Check if operation was cancelled.
         if(m_Assync.IsCancelled()){ break; }
 
-        int id = rit->second;
+        int id = aTransports[i];
 
         BOOL bResult = FALSE;
 
 		// Send the report
         if(id==CR_HTTP)
-            bResult = SendOverHTTP();
+            bResult = SendOverHTTP(&m_Assync);
         else if(id==CR_SMTP)
-            bResult = SendOverSMTP();
+            bResult = SendOverSMTP(&m_Assync);
         else if(id==CR_SMAPI)
             bResult = SendOverSMAPI();
 
@@ -2140,40 +2765,194 @@ BOOL CErrorReportSender::SendReport()
 		// If currently sending through Simple MAPI, do not wait for completion
         if(id==CR_SMAPI && bResult==TRUE)
         {
+            m_CrashInfo.m_DeliveryJournal.RecordAttempt(pReport->GetCrashGUID(), _T("SMAPI"), TRUE);
             status = 0;
             break;
         }
 
 		// else wait for completion
-        if(0==m_Assync.WaitForCompletion())
+        int nResult = m_Assync.WaitForCompletion();
+        m_CrashInfo.m_DeliveryJournal.RecordAttempt(pReport->GetCrashGUID(),
+            id==CR_HTTP?_T("HTTP"):_T("SMTP"), nResult==0);
+        if(0==nResult)
         {
             status = 0;
-
-			// If the report was sent through SMTP
-			if (id == CR_SMTP)
-			{
-				// Remove the ZIP and MD5 files from the attachment list
-				m_EmailMsg.RemoveAttachment(0);
-				m_EmailMsg.RemoveAttachment(0);
-
-				// Remove the recipient so that there will be no copies
-				m_EmailMsg.RemoveRecipient(0);
-			}
-
+            nWinner = id;
 			break;
         }
     }
 
+	// If the report was sent through SMTP
+	if (nWinner == CR_SMTP)
+	{
+		// Remove the ZIP and MD5 files from the attachment list
+		m_EmailMsg.RemoveAttachment(0);
+		m_EmailMsg.RemoveAttachment(0);
+
+		// Remove the recipient so that there will be no copies
+		m_EmailMsg.RemoveRecipient(0);
+	}
+
+    // Report the result before waiting for the delivery methods which lost the race
+    BOOL bResult = FinishDelivery(pReport, status);
+    WaitForCancelledTransports();
+
     // Remove compressed ZIP file and MD5 file
     Utility::RecycleFile(m_sZipName, true);
     Utility::RecycleFile(m_sZipName+_T(".md5"), true);
 
+    return bResult;
+}
+
+// This method starts HTTP and SMTP delivery one after another without waiting for the
+// previous one to fail, and cancels the others as soon as one delivers the report
+int CErrorReportSender::RaceTransports(CErrorReportInfo* pReport, std::vector<int>& aTransports)
+{
+    std::vector<int> aRacers;
+    std::vector<int> aOthers;
+    std::vector<int> aPriorityOrder;
+    BOOL bConnectFailed[CR_SMTP+1] = {FALSE, FALSE}; // Did the method fail without reaching the server?
+    size_t i;
+
+	// Simple MAPI launches the mail client, so it is only tried when the others fail
+    for(i=0; i<aTransports.size(); i++)
+    {
+        if(aTransports[i]==CR_SMAPI)
+            aOthers.push_back(aTransports[i]);
+        else
+            aRacers.push_back(aTransports[i]);
+    }
+    aTransports = aOthers;
+    aPriorityOrder = aRacers;
+
+	// The method which won last time starts first
+    int nPreferred = m_CrashInfo.GetPreferredTransport();
+    for(i=1; i<aRacers.size(); i++)
+    {
+        if(aRacers[i]==nPreferred)
+        {
+            aRacers.erase(aRacers.begin()+i);
+            aRacers.insert(aRacers.begin(), nPreferred);
+            break;
+        }
+    }
+
+    size_t nNext = 0;      // Index of the next method to start
+    int nRunning = 0;      // Count of running methods
+    int nWinner = -1;      // Method which has delivered the report
+    DWORD dwLastStart = 0; // When the last method was started
+
+    while(nWinner<0)
+    {
+		// A running method which has reached the server is only slow (a large
+		// report takes a while to upload), so no other method is started then
+        BOOL bConnected = FALSE;
+        for(i=0; i<nNext; i++)
+        {
+            if(m_bTransportRunning[aRacers[i]] && m_TransportAssync[aRacers[i]].IsConnected())
+                bConnected = TRUE;
+        }
+
+		// Start the next method when the stagger has elapsed, or at once if the others have failed
+        if(nNext<aRacers.size() && !m_Assync.IsCancelled() &&
+           (nRunning==0 || (!bConnected && GetTickCount()-dwLastStart>=m_CrashInfo.m_dwTransportStagger)))
+        {
+            int id = aRacers[nNext++];
+
+            m_Assync.SetProgress(_T("[sending_attempt]"), 0);
+            m_SendAttempt++;
+
+            m_TransportAssync[id].Reset();
+            BOOL bStarted = id==CR_HTTP ?
+                SendOverHTTP(&m_TransportAssync[id]) : SendOverSMTP(&m_TransportAssync[id]);
+            if(bStarted)
+            {
+                m_bTransportRunning[id] = TRUE;
+                nRunning++;
+                dwLastStart = GetTickCount();
+            }
+            continue;
+        }
+
+        if(nRunning==0)
+            break; // All methods have failed
+
+		// Check running methods for completion
+        for(i=0; i<nNext && nWinner<0; i++)
+        {
+            int id = aRacers[i];
+            int nResult = -1;
+            if(!m_bTransportRunning[id] ||
+               !m_TransportAssync[id].WaitForCompletion(TRANSPORT_POLL_INTERVAL, nResult))
+                continue;
+
+            m_bTransportRunning[id] = FALSE;
+            nRunning--;
+            m_CrashInfo.m_DeliveryJournal.RecordAttempt(pReport->GetCrashGUID(),
+                id==CR_HTTP?_T("HTTP"):_T("SMTP"), nResult==0);
+            if(nResult==0)
+                nWinner = id;
+            else if(!m_TransportAssync[id].IsConnected())
+                bConnectFailed[id] = TRUE;
+        }
+    }
+
+    if(nWinner<0)
+        return -1;
+
+	// Start with the winner next time, but put it ahead of methods with higher
+	// priority only if they couldn't reach the server. A method which lost
+	// because it was slower is still tried first.
+    BOOL bPrefer = TRUE;
+    for(i=0; i<aPriorityOrder.size() && aPriorityOrder[i]!=nWinner; i++)
+    {
+        if(!bConnectFailed[aPriorityOrder[i]])
+            bPrefer = FALSE;
+    }
+    if(bPrefer)
+        m_CrashInfo.SetPreferredTransport(nWinner);
+
+	// Cancel the others; they are waited for after the result is reported
+    for(i=0; i<aRacers.size(); i++)
+    {
+        int id = aRacers[i];
+        if(!m_bTransportRunning[id])
+            continue;
+
+        CString sMsg;
+        sMsg.Format(_T("Delivered over %s; cancelling %s."),
+            nWinner==CR_HTTP?_T("HTTP"):_T("SMTP"), id==CR_HTTP?_T("HTTP"):_T("SMTP"));
+        m_Assync.SetProgress(sMsg, 0);
+        m_TransportAssync[id].Cancel();
+    }
+
+    return nWinner;
+}
+
+// This method waits until the delivery methods which lost the race stop
+void CErrorReportSender::WaitForCancelledTransports()
+{
+    int id;
+    for(id=CR_HTTP; id<=CR_SMTP; id++)
+    {
+        if(m_bTransportRunning[id])
+        {
+            m_TransportAssync[id].WaitForCompletion();
+            m_bTransportRunning[id] = FALSE;
+        }
+    }
+}
+
+// This method sets delivery status of the report and notifies the main thread about completion
+BOOL CErrorReportSender::FinishDelivery(CErrorReportInfo* pReport, int status)
+{
 	// Check status
     if(status==0)
     {
 		// Success
         m_Assync.SetProgress(_T("[status_success]"), 0);
         pReport->SetDeliveryStatus(DELIVERED);
+        m_CrashInfo.m_DeliveryJournal.RecordDelivered(pReport->GetCrashGUID());
         // Delete report files
         Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
     }
@@ -2183,11 +2962,15 @@ BOOL CErrorReportSender::SendReport()
         pReport->SetDeliveryStatus(FAILED);
         m_Assync.SetProgress(_T("[status_failed]"), 0);
 
+        // Back off before the next attempt
+        m_CrashInfo.m_DeliveryJournal.RecordFailed(pReport->GetCrashGUID());
+
         // Check if we should store files for later delivery or we should remove them
         if(!m_CrashInfo.m_bQueueEnabled)
         {
             // Delete report files
             Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
+            m_CrashInfo.m_DeliveryJournal.RecordRemoved(pReport->GetCrashGUID());
         }
     }
 
@@ -2198,7 +2981,7 @@ BOOL CErrorReportSender::SendReport()
 }
 
 // This method sends the report over HTTP request
-BOOL CErrorReportSender::SendOverHTTP()
+BOOL CErrorReportSender::SendOverHTTP(AssyncNotification* pAssync)
 {
     strconv_t strconv;
 
@@ -2223,12 +3006,36 @@ BOOL CErrorReportSender::SendOverHTTP()
 	// Create HTTP request
     CHttpRequest request;
     request.m_sUrl = m_CrashInfo.m_sUrl;
+    request.m_bResumable = m_CrashInfo.m_bResumableUpload;
 
 	// Kaneva - Added
 	auto pReport = GetReport();
 	if (!pReport) return FALSE;
 
 	// Fill in the request fields
+    FormatHttpRequestFields(pReport, request);
+
+	// Add an MD5 hash of file attachment
+    CString sMD5Hash;
+    GetZipMD5Hash(sMD5Hash);
+    request.m_aTextFields[_T("md5")] = strconv.t2utf8(sMD5Hash);
+
+	// Set content type
+    CHttpRequestFile f;
+    f.m_sSrcFileName = m_sZipName;
+    f.m_sContentType = _T("application/zip");
+    request.m_aIncludedFiles[_T("crashrpt")] = f;
+
+	// Send HTTP request assynchronously
+    BOOL bSend = m_HttpSender.SendAssync(request, pAssync);
+    return bSend;
+}
+
+// This method fills in text fields of HTTP request
+void CErrorReportSender::FormatHttpRequestFields(CErrorReportInfo* pReport, CHttpRequest& request)
+{
+    strconv_t strconv;
+
 	CString sNum;
 	sNum.Format(_T("%d"), CRASHRPT_VER);
 	request.m_aTextFields[_T("crashrptver")] = strconv.t2utf8(sNum);
@@ -2244,69 +3051,78 @@ BOOL CErrorReportSender::SendOverHTTP()
 	request.m_aTextFields[_T("exceptionmodulebase")] = strconv.t2utf8(sNum);
 	sNum.Format(_T("%I64u"), pReport->GetExceptionAddress());
 	request.m_aTextFields[_T("exceptionaddress")] = strconv.t2utf8(sNum);
+}
 
-	// Add an MD5 hash of file attachment
-    CString sMD5Hash;
-    CalcFileMD5Hash(m_sZipName, sMD5Hash);
-    request.m_aTextFields[_T("md5")] = strconv.t2utf8(sMD5Hash);
-
-	// Set content type
-    CHttpRequestFile f;
-    f.m_sSrcFileName = m_sZipName;
-    f.m_sContentType = _T("application/zip");
-    request.m_aIncludedFiles[_T("crashrpt")] = f;
+// Checks if HTTP is enabled and has the highest priority of delivery methods
+BOOL CErrorReportSender::IsHttpPreferred()
+{
+    if(m_CrashInfo.m_sUrl.IsEmpty())
+        return FALSE;
 
-	// Send HTTP request assynchronously
-    BOOL bSend = m_HttpSender.SendAssync(request, &m_Assync);
-    return bSend;
+	// Compare the same way as SendReport() orders the methods, so that
+	// disabled methods (CR_NEGATIVE_PRIORITY) come last
+    return Utility::IsTopPriority(m_CrashInfo.m_uPriorities, 3, CR_HTTP);
 }
 
-int CErrorReportSender::Base64EncodeAttachment(CString sFileName,
-                                               std::string& sEncodedFileData)
+// Checks if the report may be uploaded over HTTP while it is being compressed
+BOOL CErrorReportSender::IsStreamingUploadPossible()
 {
-    strconv_t strconv;
+    if(!m_CrashInfo.m_bStreamingUpload)
+        return FALSE;
 
-    int uFileSize = 0;
-    BYTE* uchFileData = NULL;
-    struct _stat st;
+	// Resumable upload reads chunks from the archive file again after failures
+    if(m_CrashInfo.m_bResumableUpload)
+        return FALSE;
 
-	// Get file information
-    int nResult = _tstat(sFileName, &st);
-    if(nResult != 0)
-        return 1;  // File not found.
+	// The archive must be on disk when exporting or storing it
+    if(m_bExport || m_CrashInfo.m_bStoreZIPArchives)
+        return FALSE;
 
-    // Allocate buffer of file size
-    uFileSize = (int)st.st_size;
-    uchFileData = new BYTE[uFileSize];
+	// Other methods are tried first, and they need the archive file
+    if(!IsHttpPreferred())
+        return FALSE;
 
-    // Read file data to buffer.
-    FILE* f = NULL;
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("rb"));
-#else
-    /*errno_t err = */_tfopen_s(&f, sFileName, _T("rb"));
-#endif
+    return TRUE;
+}
 
-    if(!f || fread(uchFileData, uFileSize, 1, f)!=1)
-    {
-        m_Assync.SetProgress(_T("CErrorReportSender::Base64EncodeAttachment() - fread FAILED"), 0);
-        delete [] uchFileData;
-        uchFileData = NULL;
-	    fclose(f);
-        return 2; // Coudln't read file data.
-    }
+// This method compresses report files and sends the archive over HTTP as it is being
+// written. The archive goes through a bounded buffer and is never stored on disk.
+BOOL CErrorReportSender::StreamReportOverHTTP(CErrorReportInfo* pReport)
+{
+    m_Assync.SetProgress(_T("[sending_report]"), 0);
+    m_Assync.SetProgress(_T("[sending_attempt]"), 0);
+    m_SendAttempt++;
 
-	// Close file
-    fclose(f);
+    m_Assync.SetProgress(_T("Streaming error report over HTTP..."), 0);
 
-	// BASE-64 ecode data
-    sEncodedFileData = base64_encode(uchFileData, uFileSize);
+	// Create HTTP request. The MD5 hash is not known yet, it is added after the archive.
+    CHttpRequest request;
+    request.m_sUrl = m_CrashInfo.m_sUrl;
+    FormatHttpRequestFields(pReport, request);
 
-	// Clean up
-    delete [] uchFileData;
+    CBytePipe Pipe(HTTP_STREAM_BUFFER_SIZE);
 
-    // OK.
-    return 0;
+    CHttpRequestFile f;
+    f.m_sSrcFileName = pReport->GetErrorReportDirName() + _T(".zip");
+    f.m_sContentType = _T("application/zip");
+    f.m_pStream = &Pipe;
+    request.m_aIncludedFiles[_T("crashrpt")] = f;
+
+	// Start sending; the HTTP thread reads the archive from the pipe
+    if(!m_HttpSender.SendAssync(request, &m_Assync))
+        return FALSE;
+
+	// Compress files into the pipe on this thread
+    BOOL bCompress = CompressReportFiles(pReport, &Pipe);
+
+	// Wait for the server response. The pipe is used by the HTTP thread until then.
+    int nResult = m_Assync.WaitForCompletion();
+    m_CrashInfo.m_DeliveryJournal.RecordAttempt(pReport->GetCrashGUID(), _T("HTTP"), bCompress && nResult==0);
+    if(!bCompress || nResult!=0)
+        return FALSE;
+
+    FinishDelivery(pReport, 0);
+    return TRUE;
 }
 
 // This method formats the E-mail message text
@@ -2351,7 +3167,7 @@ CString CErrorReportSender::FormatEmailText()
 }
 
 // This method sends the report over SMTP
-BOOL CErrorReportSender::SendOverSMTP()
+BOOL CErrorReportSender::SendOverSMTP(AssyncNotification* pAssync)
 {
 	// Kaneva - Added
 	auto pReport = GetReport();
@@ -2399,7 +3215,7 @@ BOOL CErrorReportSender::SendOverSMTP()
 
     // Create and attach MD5 hash file
     CString sErrorRptHash;
-    CalcFileMD5Hash(m_sZipName, sErrorRptHash);
+    GetZipMD5Hash(sErrorRptHash);
     CString sFileTitle = m_sZipName;
     sFileTitle.Replace('/', '\\');
     int pos = sFileTitle.ReverseFind('\\');
@@ -2426,8 +3242,11 @@ BOOL CErrorReportSender::SendOverSMTP()
 	// Set SMTP login and password
 	m_SmtpClient.SetAuthParams(m_CrashInfo.m_sSmtpLogin, m_CrashInfo.m_sSmtpPassword);
 
+    // Reuse MX records resolved while sending other reports
+    m_SmtpClient.SetMxCacheFile(m_CrashInfo.GetINIFile());
+
     // Send mail assynchronously
-    int res = m_SmtpClient.SendEmailAssync(&m_EmailMsg, &m_Assync);
+    int res = m_SmtpClient.SendEmailAssync(&m_EmailMsg, pAssync);
 
     return (res==0);
 }
@@ -2535,7 +3354,7 @@ BOOL CErrorReportSender::SendOverSMAPI()
 
     // Create and attach MD5 hash file
     CString sErrorRptHash;
-    CalcFileMD5Hash(m_sZipName, sErrorRptHash);
+    GetZipMD5Hash(sErrorRptHash);
     sFileTitle += _T(".md5");
     CString sTempDir;
     Utility::getTempDirectory(sTempDir);
@@ -2577,7 +3396,21 @@ BOOL CErrorReportSender::SendRecentReports()
 	m_bSendingNow = TRUE;
 	m_bErrors = FALSE;
 
-	// Send error reports in turn
+	// Keep HTTP connections open between reports, so that each server's
+	// connection and TLS handshake are set up once for the whole batch
+	m_HttpSender.SetSession(&m_HttpSession);
+	m_HttpSession.SetBandwidthLimit(m_CrashInfo.m_dwMaxUploadRate);
+
+	// Failures in a row so far; the batch stops if more reports fail
+	m_nFailuresInRow = m_CrashInfo.m_DeliveryJournal.GetFailuresInRow();
+	m_bOutageLogged = FALSE;
+
+	// Compress and upload several reports at once when HTTP is the method to try first.
+	// Reports that fail over HTTP are left pending and tried with other methods below.
+	if(m_CrashInfo.m_nMaxConcurrentReports>1 && IsHttpPreferred())
+		SendReportsConcurrently(m_CrashInfo.m_nMaxConcurrentReports);
+
+	// Send the rest of error reports in turn
 	BOOL bSend = TRUE;
 	int nReport = -1;
 	while(bSend)
@@ -2591,6 +3424,11 @@ BOOL CErrorReportSender::SendRecentReports()
 		bSend = SendNextReport(nReport);
 	}
 
+	// Log how much connection reuse has saved and close connections
+	m_HttpSender.SetSession(NULL);
+	m_Assync.SetProgress(m_HttpSession.FormatStats(), 0, false);
+	m_HttpSession.Close();
+
 	// Close log
 	m_Assync.CloseLogFile();
 
@@ -2608,6 +3446,50 @@ BOOL CErrorReportSender::SendNextReport(int nReport)
 	if(m_Assync.IsCancelled())
 		return FALSE;	// Return FALSE to prevent sending next report
 
+	if(IsOutageDetected())
+		return FALSE;	// Leave the rest of reports for later
+
+	if(!PickNextReport(nReport))
+	{
+		// Return FALSE to prevent sending next report
+		return FALSE;
+	}
+
+	// Save current report index
+	SetCurReportIndex(nReport);
+
+	// Kaneva - Added
+	auto pReport = GetReport();
+	if (!pReport) return FALSE;
+
+    // Add a message to log
+	CString sMsg;
+	sMsg.Format(_T(">>> Performing actions with error report: '%s'"),
+					(LPCTSTR) pReport->GetErrorReportDirName());
+	m_Assync.SetProgress(sMsg, 0, false);
+
+	// Send report
+    if(!DoWork(COMPRESS_REPORT|SEND_REPORT))
+	{
+		m_bErrors = TRUE;
+		pReport->SetDeliveryStatus(FAILED);
+	}
+	else
+	{
+		pReport->SetDeliveryStatus(DELIVERED);
+	}
+
+	// Notify GUI about current item change
+	if(IsWindow(m_hWndNotify))
+		::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)GetCurReportIndex(), (LPARAM)pReport->GetDeliveryStatus());
+
+	// Return TRUE to indicate next report can be sent
+    return TRUE;
+}
+
+// Finds the report to send next and marks it as being in progress
+BOOL CErrorReportSender::PickNextReport(int& nReport)
+{
 	CErrorReportInfo* eri = NULL;
 	if(nReport != -1)
 	{
@@ -2640,47 +3522,225 @@ BOOL CErrorReportSender::SendNextReport(int nReport)
 	}
 
 	if(eri==NULL)
-	{
-		// Return FALSE to prevent sending next report
-		return FALSE;
-	}
-
-	// Save current report index
-	SetCurReportIndex(nReport);
-
-	// Kaneva - Added
-	auto pReport = GetReport();
-	if (!pReport) return FALSE;
+		return FALSE; // Nothing left to send
 
-	pReport->SetDeliveryStatus(INPROGRESS);
+	eri->SetDeliveryStatus(INPROGRESS);
 
 	// Notify GUI about current item change
 	if(IsWindow(m_hWndNotify))
-		::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)GetCurReportIndex(), (LPARAM)pReport->GetDeliveryStatus());
+		::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)nReport, (LPARAM)eri->GetDeliveryStatus());
+
+	return TRUE;
+}
+
+// Delivers selected pending reports over HTTP, nThreads reports at a time.
+// Each thread compresses a report and uploads it, then takes the next one.
+void CErrorReportSender::SendReportsConcurrently(int nThreads)
+{
+	// Count reports to deliver
+	m_nDeliveryDone = 0;
+	m_nDeliveryTotal = 0;
+	int i;
+	for(i=0; i<m_CrashInfo.GetReportCount(); i++)
+	{
+		CErrorReportInfo* pReport = GetReport(i);
+		if(pReport && pReport->IsSelected() && pReport->GetDeliveryStatus()==PENDING)
+			m_nDeliveryTotal++;
+	}
+
+	// There is no gain in threads for a single report
+	if(m_nDeliveryTotal<2)
+		return;
+
+	if(nThreads>m_nDeliveryTotal)
+		nThreads = m_nDeliveryTotal;
 
-    // Add a message to log
 	CString sMsg;
-	sMsg.Format(_T(">>> Performing actions with error report: '%s'"),
-					(LPCTSTR) pReport->GetErrorReportDirName());
+	sMsg.Format(_T("Delivering %d error reports over HTTP, %d at a time"), m_nDeliveryTotal, nThreads);
 	m_Assync.SetProgress(sMsg, 0, false);
 
-	// Send report
-    if(!DoWork(COMPRESS_REPORT|SEND_REPORT))
+	std::vector<HANDLE> aThreads;
+	for(i=0; i<nThreads; i++)
 	{
-		m_bErrors = TRUE;
-		pReport->SetDeliveryStatus(FAILED);
+		HANDLE hThread = CreateThread(NULL, 0, DeliveryThread, (LPVOID)this, 0, NULL);
+		if(hThread==NULL)
+			break;
+		aThreads.push_back(hThread);
 	}
-	else
+
+	// If no threads could be started, everything is sent the usual way
+	if(aThreads.size()==0)
+		return;
+
+	// WaitForMultipleObjects() can wait for up to MAXIMUM_WAIT_OBJECTS handles,
+	// which is more than MAX_CONCURRENT_REPORTS
+	WaitForMultipleObjects((DWORD)aThreads.size(), &aThreads[0], TRUE, INFINITE);
+
+	for(i=0; i<(int)aThreads.size(); i++)
+		CloseHandle(aThreads[i]);
+}
+
+// Delivery thread proc.
+DWORD WINAPI CErrorReportSender::DeliveryThread(LPVOID lpParam)
+{
+	CErrorReportSender* pSender = (CErrorReportSender*)lpParam;
+
+	// Methods other than HTTP will be tried for failed reports afterwards
+	BOOL bFallback =
+		pSender->m_CrashInfo.m_uPriorities[CR_SMTP]!=CR_NEGATIVE_PRIORITY ||
+		pSender->m_CrashInfo.m_uPriorities[CR_SMAPI]!=CR_NEGATIVE_PRIORITY;
+
+	for(;;)
 	{
-		pReport->SetDeliveryStatus(DELIVERED);
+		if(pSender->m_Assync.IsCancelled() || pSender->IsOutageDetected())
+			break;
+
+		// Take the next report. Ask GUI for a hint, so that reports are started
+		// in the same order as they appear in the list.
+		pSender->m_csDelivery.Lock();
+		int nReport = -1;
+		if(IsWindow(pSender->m_hWndNotify))
+			nReport = (int)::SendMessage(pSender->m_hWndNotify, WM_NEXT_ITEM_HINT, 0, 0);
+		BOOL bPicked = pSender->PickNextReport(nReport);
+		pSender->m_csDelivery.Unlock();
+
+		if(!bPicked)
+			break; // Nothing left to send
+
+		CErrorReportInfo* pReport = pSender->GetReport(nReport);
+
+		CString sMsg;
+		sMsg.Format(_T(">>> Performing actions with error report: '%s'"),
+			(LPCTSTR) pReport->GetErrorReportDirName());
+		pSender->m_Assync.SetProgress(sMsg, 0, false);
+
+		BOOL bDelivered = pSender->DeliverReportOverHTTP(pReport);
+
+		pSender->m_csDelivery.Lock();
+
+		if(bDelivered)
+		{
+			pReport->SetDeliveryStatus(DELIVERED);
+			pSender->m_CrashInfo.m_DeliveryJournal.RecordDelivered(pReport->GetCrashGUID());
+			Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
+
+			int nDailyReportCount = pSender->m_CrashInfo.GetDailyReportCount();
+			pSender->m_CrashInfo.SetDailyReportCount(nDailyReportCount + 1);
+		}
+		else if(bFallback && !pSender->m_Assync.IsCancelled())
+		{
+			// Leave the report for sending in turn with other methods
+			pReport->SetDeliveryStatus(PENDING);
+		}
+		else
+		{
+			pReport->SetDeliveryStatus(FAILED);
+			pSender->m_bErrors = TRUE;
+			pSender->m_CrashInfo.m_DeliveryJournal.RecordFailed(pReport->GetCrashGUID());
+
+			// Check if we should store files for later delivery or we should remove them
+			if(!pSender->m_CrashInfo.m_bQueueEnabled)
+			{
+				Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
+				pSender->m_CrashInfo.m_DeliveryJournal.RecordRemoved(pReport->GetCrashGUID());
+			}
+		}
+
+		// Notify GUI about the item change
+		if(IsWindow(pSender->m_hWndNotify))
+			::PostMessage(pSender->m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)nReport, (LPARAM)pReport->GetDeliveryStatus());
+
+		pSender->m_nDeliveryDone++;
+		pSender->m_Assync.SetProgress(pSender->m_nDeliveryDone*100/pSender->m_nDeliveryTotal, false);
+
+		pSender->m_csDelivery.Unlock();
 	}
 
-	// Notify GUI about current item change
-	if(IsWindow(m_hWndNotify))
-		::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)GetCurReportIndex(), (LPARAM)eri->GetDeliveryStatus());
+	return 0;
+}
 
-	// Return TRUE to indicate next report can be sent
-    return TRUE;
+// Compresses the report and sends it over HTTP. Runs on a delivery thread,
+// so it uses its own archive name, notification object and request sender.
+BOOL CErrorReportSender::DeliverReportOverHTTP(CErrorReportInfo* pReport)
+{
+	strconv_t strconv;
+	BOOL bResult = FALSE;
+
+	// Messages of this report go to the common log, marked with the report GUID
+	AssyncNotification Assync;
+	CString sPrefix;
+	sPrefix.Format(_T("[%s] "), (LPCTSTR)pReport->GetCrashGUID());
+	Assync.SetParent(&m_Assync, sPrefix);
+
+	CString sZipName;
+	CString sZipMD5Hash;
+	if(CompressReportFiles(pReport, NULL, &Assync, sZipName, sZipMD5Hash))
+	{
+		Assync.SetProgress(_T("Sending error report over HTTP..."), 0);
+
+		if(sZipMD5Hash.IsEmpty())
+			CalcFileMD5Hash(sZipName, sZipMD5Hash);
+
+		CHttpRequest request;
+		request.m_sUrl = m_CrashInfo.m_sUrl;
+		request.m_bResumable = m_CrashInfo.m_bResumableUpload;
+		FormatHttpRequestFields(pReport, request);
+		request.m_aTextFields[_T("md5")] = strconv.t2utf8(sZipMD5Hash);
+
+		CHttpRequestFile f;
+		f.m_sSrcFileName = sZipName;
+		f.m_sContentType = _T("application/zip");
+		request.m_aIncludedFiles[_T("crashrpt")] = f;
+
+		// Share connections and the upload rate limit with other threads
+		CHttpRequestSender HttpSender;
+		HttpSender.SetSession(&m_HttpSession);
+		if(HttpSender.SendAssync(request, &Assync))
+			bResult = Assync.WaitForCompletion()==0;
+		m_CrashInfo.m_DeliveryJournal.RecordAttempt(pReport->GetCrashGUID(), _T("HTTP"), bResult);
+
+		Assync.SetProgress(bResult?_T("[status_success]"):_T("[status_failed]"), 0);
+	}
+
+	// Remove compressed ZIP file and MD5 file
+	Utility::RecycleFile(sZipName, true);
+	Utility::RecycleFile(sZipName+_T(".md5"), true);
+
+	return bResult;
+}
+
+// Checks if reports of this batch keep failing, which means the server is down
+BOOL CErrorReportSender::IsOutageDetected()
+{
+	BOOL bOutage = FALSE;
+	__time64_t tNextAttempt = 0;
+	BOOL bBackingOff = m_CrashInfo.m_DeliveryJournal.IsServerBackingOff(_time64(NULL), tNextAttempt);
+	int nFailures = m_CrashInfo.m_DeliveryJournal.GetFailuresInRow();
+
+	m_csDelivery.Lock();
+
+	// The server may have been backing off already when the user chose to send
+	// anyway; count failures from then, or from the last success
+	if(nFailures<m_nFailuresInRow)
+		m_nFailuresInRow = nFailures;
+
+	if(bBackingOff && nFailures>m_nFailuresInRow)
+	{
+		bOutage = TRUE;
+
+		if(!m_bOutageLogged)
+		{
+			CString sMsg;
+			sMsg.Format(_T("%d error reports have failed in a row; leaving the rest for %I64d seconds"),
+				nFailures, tNextAttempt-_time64(NULL));
+			m_Assync.SetProgress(sMsg, 0, false);
+			m_bOutageLogged = TRUE;
+		}
+	}
+
+	m_csDelivery.Unlock();
+
+	return bOutage;
 }
 
 BOOL CErrorReportSender::IsSendingNow()
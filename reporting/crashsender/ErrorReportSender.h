@@ -35,6 +35,14 @@ enum eMailClientConfirm
     NOT_ALLOWED        // User didn't allow mail client launch
 };
 
+// How much of the crash report is collected
+enum eReportLevel
+{
+    REPORT_FULL,  // All files (minidump, screenshot etc.) are collected.
+    REPORT_BRIEF, // Only crash description XML is created.
+    REPORT_SKIP   // No report is created.
+};
+
 // Messages sent to GUI buy the sender
 #define WM_NEXT_ITEM_HINT      (WM_USER+1023)
 #define WM_ITEM_STATUS_CHANGED (WM_USER+1024)
@@ -144,6 +152,9 @@ private:
     // Calculates MD5 hash for a file.
     int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash);
 
+    // Returns MD5 hash of the ZIP archive being sent.
+    int GetZipMD5Hash(CString& sMD5Hash);
+
     // Takes desktop screenshot.
     BOOL TakeDesktopScreenshot();
 
@@ -156,6 +167,16 @@ private:
     // Creates crash dump file.
     BOOL CreateMiniDump();
 
+    // Saves the ring log of the client app to a file.
+    BOOL CollectRingLog();
+
+    // Calculates the signature of the crash from exception code and module-relative
+    // addresses of the faulting instruction and the top return addresses.
+    BOOL CalcCrashSignature(CString& sSignature);
+
+    // Decides how much to collect depending on how often the crash has occurred recently.
+    eReportLevel GetReportLevel();
+
 	// This method is used to have the current process be able to call MiniDumpWriteDump.
 	BOOL SetDumpPrivileges();
 
@@ -182,8 +203,14 @@ private:
 	// Used internally for dumping a registry key.
     int DumpRegKey(HKEY hKeyParent, CString sSubKey, TiXmlElement* elem);
 
-    // Packs error report files to ZIP archive.
-    BOOL CompressReportFiles(CErrorReportInfo* eri);
+    // Packs error report files to ZIP archive. If pPipe is set, the archive
+    // is written to the pipe instead of a file.
+    BOOL CompressReportFiles(CErrorReportInfo* eri, CBytePipe* pPipe=NULL);
+
+    // Packs error report files to ZIP archive, reporting progress to pAssync
+    // and returning the archive name and its MD5 hash.
+    BOOL CompressReportFiles(CErrorReportInfo* eri, CBytePipe* pPipe, AssyncNotification* pAssync,
+        CString& sZipName, CString& sZipMD5Hash);
 
     // Unblocks parent process.
     void UnblockParentProcess();
@@ -191,17 +218,37 @@ private:
     // Sends error report.
     BOOL SendReport();
 
-    // Sends error report over HTTP.
-    BOOL SendOverHTTP();
+    // Sets delivery status of the report and notifies the main thread about completion.
+    BOOL FinishDelivery(CErrorReportInfo* pReport, int status);
+
+    // Starts delivery methods concurrently, each one after a delay, and keeps the first
+    // one which delivers the report. Simple MAPI is left in aTransports as a fallback.
+    // Returns the method which has delivered the report, or -1.
+    int RaceTransports(CErrorReportInfo* pReport, std::vector<int>& aTransports);
+
+    // Waits until delivery methods which lost the race stop.
+    void WaitForCancelledTransports();
 
-    // Encodes attachment file with Base-64 encoding.
-    int Base64EncodeAttachment(CString sFileName, std::string& sEncodedFileData);
+    // Sends error report over HTTP; pAssync is notified about completion.
+    BOOL SendOverHTTP(AssyncNotification* pAssync);
+
+    // Fills in text fields of HTTP request with report properties.
+    void FormatHttpRequestFields(CErrorReportInfo* pReport, CHttpRequest& request);
+
+    // Returns TRUE if HTTP is enabled and is the first delivery method to try.
+    BOOL IsHttpPreferred();
+
+    // Returns TRUE if the report may be uploaded while it is being compressed.
+    BOOL IsStreamingUploadPossible();
+
+    // Compresses report files and uploads the archive over HTTP at the same time.
+    BOOL StreamReportOverHTTP(CErrorReportInfo* pReport);
 
     // Formats Email text.
     CString FormatEmailText();
 
-    // Sends error report over SMTP.
-    BOOL SendOverSMTP();
+    // Sends error report over SMTP; pAssync is notified about completion.
+    BOOL SendOverSMTP(AssyncNotification* pAssync);
 
     // Sends error report over Simple MAPI.
     BOOL SendOverSMAPI();
@@ -212,6 +259,21 @@ private:
 	// Send the next queued report.
 	BOOL SendNextReport(int nReport);
 
+	// Finds the next selected pending report (nReport is a hint) and marks it in progress.
+	BOOL PickNextReport(int& nReport);
+
+	// Delivers queued reports over HTTP using several threads.
+	void SendReportsConcurrently(int nThreads);
+
+	// Delivery thread proc.
+	static DWORD WINAPI DeliveryThread(LPVOID lpParam);
+
+	// Compresses a queued report and sends it over HTTP on the calling thread.
+	BOOL DeliverReportOverHTTP(CErrorReportInfo* pReport);
+
+	// Returns TRUE if reports have kept failing since the batch started.
+	BOOL IsOutageDetected();
+
 	// Internal variables
 	static CErrorReportSender* m_pInstance; // Singleton
 	CCrashInfoReader m_CrashInfo;       // Contains crash information.
@@ -223,11 +285,15 @@ private:
     HANDLE m_hThread;                   // Handle to the worker thread.
     int m_SendAttempt;                  // Number of current sending attempt.
     AssyncNotification m_Assync;        // Used for communication with the main thread.
+    AssyncNotification m_TransportAssync[2]; // Completion of racing HTTP and SMTP delivery.
+    BOOL m_bTransportRunning[2];        // Is HTTP or SMTP delivery still running after the race?
     CEmailMessage m_EmailMsg;           // Email message to send.
     CSmtpClient m_SmtpClient;           // Used to send report over SMTP.
     CHttpRequestSender m_HttpSender;    // Used to send report over HTTP.
+    CHttpSession m_HttpSession;         // HTTP connections shared by queued reports.
     CMailMsg m_MapiSender;              // Used to send report over SMAPI.
     CString m_sZipName;                 // Name of the ZIP archive to send.
+    CString m_sZipMD5Hash;              // MD5 hash of the ZIP archive (calculated while compressing).
     int m_Action;                       // Current assynchronous action.
     BOOL m_bExport;                     // If TRUE than export should be performed.
     CString m_sExportFileName;          // File name for exporting.
@@ -235,6 +301,12 @@ private:
     BOOL m_bSendingNow;                 // TRUE if in progress of sending reports.
 	BOOL m_bErrors;                     // TRUE if there were errors.
 	CString m_sCrashLogFile;            // Log file.
+	CComAutoCriticalSection m_csDelivery; // Protects report states while delivering concurrently.
+	int m_nDeliveryDone;                // Count of reports processed by delivery threads.
+	int m_nDeliveryTotal;               // Count of reports to deliver.
+	int m_nFailuresInRow;               // Reports failed in a row when the batch started.
+	BOOL m_bOutageLogged;               // Was stopping the batch logged?
+	eReportLevel m_ReportLevel;         // How much of the crash report is collected.
 };
 
 
@@ -0,0 +1,221 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "HashedZipOutput.h"
+
+CHashedZipOutput::CHashedZipOutput()
+{
+    fill_fopen64_filefunc(&m_Inner);
+    m_pPipe = NULL;
+    m_md5.MD5Init(&m_md5_ctx);
+    m_uHashed = 0;
+    m_uPos = 0;
+    m_bStale = FALSE;
+}
+
+void CHashedZipOutput::FillFileFunc(zlib_filefunc64_def* pFileFunc)
+{
+    pFileFunc->zopen64_file = Open;
+    pFileFunc->zread_file = Read;
+    pFileFunc->zwrite_file = Write;
+    pFileFunc->ztell64_file = Tell;
+    pFileFunc->zseek64_file = Seek;
+    pFileFunc->zclose_file = Close;
+    pFileFunc->zerror_file = Error;
+    pFileFunc->opaque = this;
+}
+
+void CHashedZipOutput::SetPipe(CBytePipe* pPipe)
+{
+    m_pPipe = pPipe;
+}
+
+BOOL CHashedZipOutput::GetMD5Hash(CString& sMD5Hash)
+{
+    sMD5Hash.Empty();
+
+    if(m_bStale)
+        return FALSE;
+
+    // Hash the held back tail
+    if(m_Window.size()!=0)
+        Hash(&m_Window[0], m_Window.size());
+    m_uHashed += m_Window.size();
+    m_Window.clear();
+
+    unsigned char md5_hash[16];
+    m_md5.MD5Final(md5_hash, &m_md5_ctx);
+
+    int i;
+    for(i=0; i<16; i++)
+    {
+        CString number;
+        number.Format(_T("%02x"), md5_hash[i]);
+        sMD5Hash += number;
+    }
+
+    // The context is finalized, it can't be used again
+    m_bStale = TRUE;
+
+    return TRUE;
+}
+
+void CHashedZipOutput::OnWrite(ZPOS64_T uPos, const BYTE* pData, ULONG cbData)
+{
+    if(m_bStale || cbData==0)
+        return;
+
+    ZPOS64_T uEnd = m_uHashed+m_Window.size();
+
+    if(uPos<m_uHashed || uPos>uEnd)
+    {
+        // A rewrite of bytes that are already hashed, or a gap in the output
+        m_bStale = TRUE;
+        return;
+    }
+
+    // Apply the part that overwrites bytes in the window
+    if(uPos<uEnd)
+    {
+        size_t nOffs = (size_t)(uPos-m_uHashed);
+        size_t nPatch = m_Window.size()-nOffs;
+        if(nPatch>cbData)
+            nPatch = cbData;
+        memcpy(&m_Window[nOffs], pData, nPatch);
+        pData += nPatch;
+        cbData -= (ULONG)nPatch;
+    }
+
+    if(cbData==0)
+        return;
+
+    // Hash what falls out of the window
+    size_t nTotal = m_Window.size()+cbData;
+    if(nTotal>HASHED_ZIP_WINDOW_SIZE)
+    {
+        size_t nExcess = nTotal-HASHED_ZIP_WINDOW_SIZE;
+
+        size_t nFromWindow = nExcess<m_Window.size()?nExcess:m_Window.size();
+        if(nFromWindow!=0)
+        {
+            Hash(&m_Window[0], nFromWindow);
+            m_Window.erase(m_Window.begin(), m_Window.begin()+nFromWindow);
+            m_uHashed += nFromWindow;
+        }
+
+        size_t nFromData = nExcess-nFromWindow;
+        if(nFromData!=0)
+        {
+            Hash(pData, nFromData);
+            pData += nFromData;
+            cbData -= (ULONG)nFromData;
+            m_uHashed += nFromData;
+        }
+    }
+
+    m_Window.insert(m_Window.end(), pData, pData+cbData);
+}
+
+void CHashedZipOutput::Hash(const BYTE* pData, size_t cbData)
+{
+    m_md5.MD5Update(&m_md5_ctx, (unsigned char*)pData, (unsigned int)cbData);
+}
+
+voidpf ZCALLBACK CHashedZipOutput::Open(voidpf opaque, const void* filename, int mode)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+
+    // The pipe doesn't need opening, any non-NULL stream will do
+    if(pThis->m_pPipe!=NULL)
+        return pThis;
+
+    return pThis->m_Inner.zopen64_file(pThis->m_Inner.opaque, filename, mode);
+}
+
+uLong ZCALLBACK CHashedZipOutput::Read(voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+    if(pThis->m_pPipe!=NULL)
+        return 0;
+
+    uLong uRead = pThis->m_Inner.zread_file(pThis->m_Inner.opaque, stream, buf, size);
+    pThis->m_uPos += uRead;
+    return uRead;
+}
+
+uLong ZCALLBACK CHashedZipOutput::Write(voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+    uLong uWritten = 0;
+    if(pThis->m_pPipe!=NULL)
+        uWritten = pThis->m_pPipe->Write((const BYTE*)buf, size)?size:0;
+    else
+        uWritten = pThis->m_Inner.zwrite_file(pThis->m_Inner.opaque, stream, buf, size);
+    pThis->OnWrite(pThis->m_uPos, (const BYTE*)buf, uWritten);
+    pThis->m_uPos += uWritten;
+    return uWritten;
+}
+
+ZPOS64_T ZCALLBACK CHashedZipOutput::Tell(voidpf opaque, voidpf stream)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+    if(pThis->m_pPipe!=NULL)
+        return pThis->m_uPos;
+
+    return pThis->m_Inner.ztell64_file(pThis->m_Inner.opaque, stream);
+}
+
+long ZCALLBACK CHashedZipOutput::Seek(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+
+    if(pThis->m_pPipe!=NULL)
+    {
+        // Data sent to the pipe can't be changed; only seeking to the current position works
+        ZPOS64_T uPos = offset;
+        if(origin==ZLIB_FILEFUNC_SEEK_CUR)
+            uPos = pThis->m_uPos+offset;
+        if(origin==ZLIB_FILEFUNC_SEEK_END || uPos!=pThis->m_uPos)
+            return -1;
+        return 0;
+    }
+
+    long lResult = pThis->m_Inner.zseek64_file(pThis->m_Inner.opaque, stream, offset, origin);
+
+    // Let the wrapped functions resolve the new position
+    ZPOS64_T uPos = pThis->m_Inner.ztell64_file(pThis->m_Inner.opaque, stream);
+    if(uPos!=(ZPOS64_T)-1)
+        pThis->m_uPos = uPos;
+    else
+        pThis->m_bStale = TRUE;
+
+    return lResult;
+}
+
+int ZCALLBACK CHashedZipOutput::Close(voidpf opaque, voidpf stream)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+
+    // The pipe is closed by the owner once the hash is known
+    if(pThis->m_pPipe!=NULL)
+        return 0;
+
+    return pThis->m_Inner.zclose_file(pThis->m_Inner.opaque, stream);
+}
+
+int ZCALLBACK CHashedZipOutput::Error(voidpf opaque, voidpf stream)
+{
+    CHashedZipOutput* pThis = (CHashedZipOutput*)opaque;
+    if(pThis->m_pPipe!=NULL)
+        return pThis->m_pPipe->IsAborted()?1:0;
+
+    return pThis->m_Inner.zerror_file(pThis->m_Inner.opaque, stream);
+}
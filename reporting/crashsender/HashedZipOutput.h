@@ -0,0 +1,74 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: HashedZipOutput.h
+// Description: minizip output filter that calculates MD5 hash of the archive while it is written.
+
+#pragma once
+#include "stdafx.h"
+#include "ioapi.h"
+#include "md5.h"
+#include "BytePipe.h"
+
+// How many trailing bytes of the output are kept unhashed, so that
+// minizip can still rewrite them (for example, a local file header).
+#define HASHED_ZIP_WINDOW_SIZE (64*1024)
+
+// CHashedZipOutput
+// Wraps minizip file functions and feeds written bytes to MD5. The last
+// HASHED_ZIP_WINDOW_SIZE bytes are held back from the hash; rewrites that
+// land inside of this window are applied to it. A rewrite of older bytes
+// makes the hash unusable, GetMD5Hash() then fails and the caller should
+// hash the file the usual way. Entries written with ZIP_FLAG_DATA_DESCRIPTOR
+// are never rewritten.
+//
+// If a pipe is set, the archive is written to the pipe instead of a file.
+// Only sequential output is possible then.
+class CHashedZipOutput
+{
+public:
+
+    // Constructor.
+    CHashedZipOutput();
+
+    // Fills in minizip file functions to pass to zipOpen2_64().
+    void FillFileFunc(zlib_filefunc64_def* pFileFunc);
+
+    // Sends the output to the pipe instead of a file.
+    void SetPipe(CBytePipe* pPipe);
+
+    // Returns MD5 hash of everything written as a hex string. Call after zipClose().
+    BOOL GetMD5Hash(CString& sMD5Hash);
+
+private:
+
+    // Adds written bytes located at position uPos.
+    void OnWrite(ZPOS64_T uPos, const BYTE* pData, ULONG cbData);
+
+    // Passes bytes to MD5.
+    void Hash(const BYTE* pData, size_t cbData);
+
+    static voidpf ZCALLBACK Open(voidpf opaque, const void* filename, int mode);
+    static uLong ZCALLBACK Read(voidpf opaque, voidpf stream, void* buf, uLong size);
+    static uLong ZCALLBACK Write(voidpf opaque, voidpf stream, const void* buf, uLong size);
+    static ZPOS64_T ZCALLBACK Tell(voidpf opaque, voidpf stream);
+    static long ZCALLBACK Seek(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin);
+    static int ZCALLBACK Close(voidpf opaque, voidpf stream);
+    static int ZCALLBACK Error(voidpf opaque, voidpf stream);
+
+    zlib_filefunc64_def m_Inner; // Wrapped file functions
+    CBytePipe* m_pPipe;          // Output pipe (NULL when writing to a file)
+    MD5 m_md5;                   // MD5 calculator
+    MD5_CTX m_md5_ctx;           // MD5 context
+    std::vector<BYTE> m_Window;  // Written bytes not hashed yet
+    ZPOS64_T m_uHashed;          // Count of bytes hashed (start of m_Window)
+    ZPOS64_T m_uPos;             // Current output position
+    BOOL m_bStale;               // Set if already hashed bytes were rewritten
+};
@@ -29,6 +29,16 @@ CHttpRequestSender::CHttpRequestSender()
     m_sTextPartFooterFmt = _T("\r\n");
     m_sFilePartHeaderFmt = _T("--%s\r\nContent-disposition: form-data; name=\"%s\"; filename=\"%s\"\r\nContent-Type: %s\r\nContent-Transfer-Encoding: binary\r\n\r\n");
     m_sFilePartFooterFmt = _T("\r\n");
+
+    m_uPostSize = 0;
+    m_uUploaded = 0;
+    m_bChunked = FALSE;
+    m_pSession = NULL;
+}
+
+void CHttpRequestSender::SetSession(CHttpSession* pSession)
+{
+    m_pSession = pSession;
 }
 
 // Sends HTTP request assyncronously (in a working thread)
@@ -56,9 +66,94 @@ DWORD WINAPI CHttpRequestSender::WorkerThread(VOID* pParam)
     return 0;
 }
 
+// Ignores SSL certificate errors for the request
+static void SetSecurityFlags(HINTERNET hRequest)
+{
+	// This code was copied from http://support.microsoft.com/kb/182888 to address the problem
+	// that MVS doesn't have a valid SSL certificate.
+	DWORD extraSSLDwFlags = 0;
+	DWORD dwBuffLen = sizeof(extraSSLDwFlags);
+	InternetQueryOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
+	(LPVOID)&extraSSLDwFlags, &dwBuffLen);
+	// We have to specifically ignore these 2 errors for MVS
+	extraSSLDwFlags |= SECURITY_FLAG_IGNORE_REVOCATION |  // Ignores certificate revocation problems.
+					   SECURITY_FLAG_IGNORE_WRONG_USAGE | // Ignores incorrect usage problems.
+					   SECURITY_FLAG_IGNORE_CERT_CN_INVALID | // Ignores the ERROR_INTERNET_SEC_CERT_CN_INVALID error message.
+					   SECURITY_FLAG_IGNORE_CERT_DATE_INVALID; // Ignores the ERROR_INTERNET_SEC_CERT_DATE_INVALID error message.
+	InternetSetOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
+						&extraSSLDwFlags, sizeof (extraSSLDwFlags) );
+}
+
+// Reads a custom header of HTTP response
+static BOOL QueryCustomHeader(HINTERNET hRequest, LPCTSTR szName, CString& sValue)
+{
+    TCHAR szBuffer[256];
+    _TCSCPY_S(szBuffer, 256, szName);
+    DWORD dwBuffSize = sizeof(szBuffer);
+    if(!HttpQueryInfo(hRequest, HTTP_QUERY_CUSTOM, szBuffer, &dwBuffSize, NULL))
+        return FALSE;
+
+    sValue = szBuffer;
+    return TRUE;
+}
+
+// Encodes a string for application/x-www-form-urlencoded request body
+static std::string UrlEncode(const std::string& sText)
+{
+    std::string sResult;
+    size_t i;
+    for(i=0; i<sText.length(); i++)
+    {
+        unsigned char c = (unsigned char)sText[i];
+        if((c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') ||
+           c=='-' || c=='_' || c=='.' || c=='~')
+        {
+            sResult += (char)c;
+        }
+        else
+        {
+            char szHex[4];
+#if _MSC_VER<1400
+            sprintf(szHex, "%%%02X", c);
+#else
+            sprintf_s(szHex, 4, "%%%02X", c);
+#endif
+            sResult += szHex;
+        }
+    }
+
+    return sResult;
+}
+
+// Calculates MD5 hash of a memory block as a hex string
+static CString CalcDataMD5Hash(const BYTE* pData, DWORD cbData)
+{
+    MD5 md5;
+    MD5_CTX md5_ctx;
+    unsigned char md5_hash[16];
+
+    md5.MD5Init(&md5_ctx);
+    md5.MD5Update(&md5_ctx, (unsigned char*)pData, cbData);
+    md5.MD5Final(md5_hash, &md5_ctx);
+
+    CString sMD5Hash;
+    int i;
+    for(i=0; i<16; i++)
+    {
+        CString number;
+        number.Format(_T("%02x"), md5_hash[i]);
+        sMD5Hash += number;
+    }
+
+    return sMD5Hash;
+}
+
 // Sends HTTP request and checks response
 BOOL CHttpRequestSender::InternalSend()
 {
+    if(m_Request.m_bResumable)
+        return InternalSendResumable();
+
     BOOL bStatus = FALSE;      // Resulting status
     strconv_t strconv;         // String conversion
     HINTERNET hSession = NULL; // Internet session
@@ -78,22 +173,29 @@ BOOL CHttpRequestSender::InternalSend()
     LONGLONG lPostSize = 0;
     std::map<CString, std::string>::iterator it;
     std::map<CString, CHttpRequestFile>::iterator it2;
-
-    // Calculate size of data to send
-    bRet = CalcRequestSize(lPostSize);
-    if(!bRet)
+    CString sConnServer;       // Server the connection was opened to
+    DWORD dwConnPort = 0;      // Port the connection was opened to
+    BOOL bReused = FALSE;      // Was the connection opened by an earlier request?
+    DWORD dwSendStart = 0;     // Time when sending headers started
+    BYTE pRest[1024];          // Buffer for skipping the rest of response
+    DWORD dwRestSize = 0;
+
+    // The size of streamed attachments is unknown until they end, so such
+    // a request is sent in chunks (RFC 2616, section 3.6.1)
+    m_bChunked = IsStreamingRequest();
+    if(m_bChunked)
     {
-        m_Assync->SetProgress(_T("Error calculating size of data to send!"), 0);
-        goto cleanup;
+        sHeaders += _T("\r\nTransfer-Encoding: chunked");
     }
-
-    // Create Internet session
-    m_Assync->SetProgress(_T("Opening Internet connection."), 0);
-    hSession = InternetOpen(_T("CrashRpt"), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-    if(hSession==NULL)
+    else
     {
-        m_Assync->SetProgress(_T("Error opening Internet session"), 0);
-        goto cleanup;
+        // Calculate size of data to send
+        bRet = CalcRequestSize(lPostSize);
+        if(!bRet)
+        {
+            m_Assync->SetProgress(_T("Error calculating size of data to send!"), 0);
+            goto cleanup;
+        }
     }
 
     // Parse application-provided URL
@@ -102,21 +204,14 @@ BOOL CHttpRequestSender::InternalSend()
     // Connect to HTTP server
     m_Assync->SetProgress(_T("Connecting to server"), 0, true);
 
-    hConnect = InternetConnect(
-        hSession,     // InternetOpen handle
-        szServer,     // Server  name
-        (WORD)dwPort, // Default HTTPS port - 443
-        NULL,         // User name
-        NULL,         //  User password
-        INTERNET_SERVICE_HTTP, // Service
-        0,            // Flags
-        0             // Context
-        );
+    hConnect = OpenConnection(hSession, szServer, dwPort, bReused);
     if(hConnect==NULL)
     {
         m_Assync->SetProgress(_T("Error connecting to server"), 0);
         goto cleanup;
     }
+    sConnServer = szServer;
+    dwConnPort = dwPort;
 
 	// Set large receive timeout to avoid problems in case of
 	// slow upload => slow response from the server.
@@ -131,7 +226,7 @@ BOOL CHttpRequestSender::InternalSend()
     m_Assync->SetProgress(_T("Opening HTTP request..."), 0, true);
 
     // Configure flags for HttpOpenRequest
-    DWORD dwFlags = INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_AUTO_REDIRECT;
+    DWORD dwFlags = INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_AUTO_REDIRECT | INTERNET_FLAG_KEEP_CONNECTION;
     if(dwPort==INTERNET_DEFAULT_HTTPS_PORT)
 	    dwFlags |= INTERNET_FLAG_SECURE; // Use SSL
 
@@ -158,19 +253,8 @@ BOOL CHttpRequestSender::InternalSend()
 			goto cleanup;
 		}
 
-		// This code was copied from http://support.microsoft.com/kb/182888 to address the problem
-		// that MVS doesn't have a valid SSL certificate.
-		DWORD extraSSLDwFlags = 0;
-		DWORD dwBuffLen = sizeof(extraSSLDwFlags);
-		InternetQueryOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
-		(LPVOID)&extraSSLDwFlags, &dwBuffLen);
-		// We have to specifically ignore these 2 errors for MVS
-		extraSSLDwFlags |= SECURITY_FLAG_IGNORE_REVOCATION |  // Ignores certificate revocation problems.
-						   SECURITY_FLAG_IGNORE_WRONG_USAGE | // Ignores incorrect usage problems.
-						   SECURITY_FLAG_IGNORE_CERT_CN_INVALID | // Ignores the ERROR_INTERNET_SEC_CERT_CN_INVALID error message.
-						   SECURITY_FLAG_IGNORE_CERT_DATE_INVALID; // Ignores the ERROR_INTERNET_SEC_CERT_DATE_INVALID error message.
-		InternetSetOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
-							&extraSSLDwFlags, sizeof (extraSSLDwFlags) );
+		// Ignore SSL certificate errors
+		SetSecurityFlags(hRequest);
 
 		// Fill in buffer
 		BufferIn.dwStructSize = sizeof( INTERNET_BUFFERS ); // Must be set or error will occur
@@ -184,17 +268,21 @@ BOOL CHttpRequestSender::InternalSend()
 		BufferIn.dwOffsetLow = 0;
 		BufferIn.dwOffsetHigh = 0;
 
-		m_dwPostSize = (DWORD)lPostSize;
-		m_dwUploaded = 0;
+		m_uPostSize = (ULONGLONG)lPostSize;
+		m_uUploaded = 0;
 
 		// Add a message to log
 		m_Assync->SetProgress(_T("Sending HTTP request..."), 0);
-		// Send request
+		// Send request. This also sets up the connection, unless it is reused.
+		dwSendStart = GetTickCount();
 		if(!HttpSendRequestEx( hRequest, &BufferIn, NULL, 0, 0))
 		{
 			m_Assync->SetProgress(_T("HttpSendRequestEx has failed."), 0);
 			goto cleanup;
 		}
+		m_Assync->SetConnected();
+		if(m_pSession!=NULL)
+			m_pSession->AddRequestTime(bReused && nCount==1, GetTickCount()-dwSendStart);
 
 		// Write text fields
 		for(it=m_Request.m_aTextFields.begin(); it!=m_Request.m_aTextFields.end(); it++)
@@ -210,6 +298,19 @@ BOOL CHttpRequestSender::InternalSend()
 			bRet = WriteAttachmentPart(hRequest, it2->first);
 			if(!bRet)
 				goto cleanup;
+
+			// Write fields that became known when the streamed attachment ended
+			if(it2->second.m_pStream!=NULL)
+			{
+				std::map<CString, std::string> aFields = it2->second.m_pStream->GetTrailingFields();
+				for(it=aFields.begin(); it!=aFields.end(); it++)
+				{
+					m_Request.m_aTextFields[it->first] = it->second;
+					bRet = WriteTextPart(hRequest, it->first);
+					if(!bRet)
+						goto cleanup;
+				}
+			}
 		}
 
 		// Write boundary
@@ -217,6 +318,17 @@ BOOL CHttpRequestSender::InternalSend()
 		if(!bRet)
 			goto cleanup;
 
+		if(m_bChunked)
+		{
+			// Write the last (empty) chunk
+			DWORD dwBytesWritten = 0;
+			if(!InternetWriteFile(hRequest, "0\r\n\r\n", 5, &dwBytesWritten))
+			{
+				m_Assync->SetProgress(_T("Error writing the last chunk."), 0);
+				goto cleanup;
+			}
+		}
+
 		// Add a message to log
 		m_Assync->SetProgress(_T("Ending HTTP request..."), 0);
 
@@ -249,6 +361,10 @@ BOOL CHttpRequestSender::InternalSend()
 		sMsg = _T("Server response body:")  + sMsg;
 		m_Assync->SetProgress(sMsg, 0);
 
+		// Read the rest of response, so that the connection can be reused
+		dwRestSize = dwBuffSize;
+		while(dwRestSize!=0 && InternetReadFile(hRequest, pRest, sizeof(pRest), &dwRestSize) && dwRestSize!=0);
+
 		// If the first byte of HTTP response is a digit, than assume a legacy way
 		// of determining delivery status - the HTTP response starts with a delivery status code
 		if(dwBuffSize>0 && pBuffer[0]>='0' && pBuffer[0]<='9')
@@ -272,6 +388,13 @@ BOOL CHttpRequestSender::InternalSend()
 			// Check if we have a redirect (302 response code)
 			if(bQueryInfo && lHttpStatus==302)
 			{
+				// Streamed data can't be sent again
+				if(m_bChunked)
+				{
+					m_Assync->SetProgress(_T("Redirects are not allowed for streamed requests."), 100, false);
+					goto cleanup;
+				}
+
 				// Check for multiple redirects
 				if(bRedirect)
 				{
@@ -327,6 +450,9 @@ cleanup:
     {
         // Add a message to log
         m_Assync->SetProgress(_T("Error sending HTTP request."), 100, false);
+
+        // Unblock the producers of streamed attachments
+        AbortStreams();
     }
 
     // Clean up
@@ -334,8 +460,7 @@ cleanup:
         InternetCloseHandle(hRequest);
 
     // Clean up internet handle
-    if(hConnect)
-        InternetCloseHandle(hConnect);
+    CloseConnection(hConnect, sConnServer, dwConnPort, !bStatus);
 
     // Clean up internet session
     if(hSession)
@@ -347,6 +472,385 @@ cleanup:
     return bStatus;
 }
 
+// Opens connection to the server, or takes it from the shared session
+HINTERNET CHttpRequestSender::OpenConnection(HINTERNET& hSession, LPCTSTR szServer, DWORD dwPort, BOOL& bReused)
+{
+    bReused = FALSE;
+
+    if(m_pSession!=NULL)
+    {
+        HINTERNET hConnect = m_pSession->GetConnection(szServer, dwPort, bReused);
+        if(hConnect!=NULL)
+        {
+            if(bReused)
+                m_Assync->SetProgress(_T("Reusing open Internet connection."), 0);
+            else
+                m_Assync->SetProgress(_T("Opened Internet connection."), 0);
+        }
+        return hConnect;
+    }
+
+    m_Assync->SetProgress(_T("Opening Internet connection."), 0);
+
+    // Create Internet session
+    if(hSession==NULL)
+    {
+        hSession = InternetOpen(_T("CrashRpt"), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+        if(hSession==NULL)
+        {
+            m_Assync->SetProgress(_T("Error opening Internet session"), 0);
+            return NULL;
+        }
+    }
+
+    return InternetConnect(
+        hSession,     // InternetOpen handle
+        szServer,     // Server  name
+        (WORD)dwPort, // Default HTTPS port - 443
+        NULL,         // User name
+        NULL,         //  User password
+        INTERNET_SERVICE_HTTP, // Service
+        0,            // Flags
+        0             // Context
+        );
+}
+
+// Closes connection, or leaves it open in the shared session for the next request
+void CHttpRequestSender::CloseConnection(HINTERNET hConnect, LPCTSTR szServer, DWORD dwPort, BOOL bFailed)
+{
+    if(hConnect==NULL)
+        return;
+
+    if(m_pSession!=NULL)
+    {
+        // Don't reuse a connection that may be broken
+        if(bFailed)
+            m_pSession->ResetConnection(szServer, dwPort);
+        return;
+    }
+
+    InternetCloseHandle(hConnect);
+}
+
+// Sends the file attachment in chunks, resuming from the server's offset after failures
+BOOL CHttpRequestSender::InternalSendResumable()
+{
+    BOOL bStatus = FALSE;      // Resulting status
+    strconv_t strconv;         // String conversion
+    HINTERNET hSession = NULL; // Internet session
+    HINTERNET hConnect = NULL; // Internet connection
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    TCHAR szProtocol[512];     // Protocol
+    TCHAR szServer[512];       // Server name
+    TCHAR szURI[1024];         // URI
+    DWORD dwPort=0;            // Port
+    DWORD dwFlags = 0;
+    CString sMsg;
+    CString sQuery;
+    CString sHeaders;
+    CString sUploadId;
+    ULONGLONG uOffset = 0;
+    ULONGLONG uFileSize = 0;
+    LARGE_INTEGER lFileSize;
+    DWORD dwStatus = 0;
+    std::string sCreateBody;
+    std::vector<BYTE> Chunk(HTTP_UPLOAD_CHUNK_SIZE);
+    int nRetries = 0;
+    BOOL bNeedOffset = TRUE;
+    std::map<CString, std::string>::iterator it;
+
+    // Only a single file attachment can be sent this way
+    if(m_Request.m_aIncludedFiles.size()!=1)
+    {
+        m_Assync->SetProgress(_T("Resumable upload requires exactly one file attachment."), 0);
+        goto cleanup;
+    }
+
+    hFile = CreateFile(m_Request.m_aIncludedFiles.begin()->second.m_sSrcFileName,
+        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
+    if(hFile==INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &lFileSize))
+    {
+        m_Assync->SetProgress(_T("Error opening attachment file."), 0);
+        goto cleanup;
+    }
+    uFileSize = lFileSize.QuadPart;
+
+    // Format the body of upload_create request
+    for(it=m_Request.m_aTextFields.begin(); it!=m_Request.m_aTextFields.end(); it++)
+    {
+        sCreateBody += UrlEncode(strconv.t2utf8(it->first));
+        sCreateBody += "=";
+        sCreateBody += UrlEncode(it->second);
+        sCreateBody += "&";
+    }
+    sMsg.Format(_T("%I64u"), uFileSize);
+    sCreateBody += "size=";
+    sCreateBody += strconv.t2a(sMsg);
+
+    // Parse application-provided URL
+    ParseURL(m_Request.m_sUrl, szProtocol, 512, szServer, 512, dwPort, szURI, 1024);
+
+    dwFlags = INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_AUTO_REDIRECT | INTERNET_FLAG_KEEP_CONNECTION;
+    if(dwPort==INTERNET_DEFAULT_HTTPS_PORT)
+        dwFlags |= INTERNET_FLAG_SECURE; // Use SSL
+
+    m_uPostSize = uFileSize;
+    m_uUploaded = 0;
+
+    for(;;)
+    {
+        // Check if canceled
+        if(m_Assync->IsCancelled()){ goto cleanup; }
+
+        if(nRetries>HTTP_UPLOAD_MAX_RETRIES)
+        {
+            m_Assync->SetProgress(_T("Too many failed attempts to upload a chunk."), 0);
+            goto cleanup;
+        }
+
+        if(nRetries>0)
+        {
+            // Wait a bit before the next attempt: 1, 2, 4, ... seconds, at most 30 seconds
+            DWORD dwDelay = nRetries<6 ? (1000<<(nRetries-1)) : 30000;
+            sMsg.Format(_T("Retrying in %u ms (attempt %d of %d)."), dwDelay, nRetries, HTTP_UPLOAD_MAX_RETRIES);
+            m_Assync->SetProgress(sMsg, 0);
+            Sleep(dwDelay);
+
+            // Reconnect
+            CloseConnection(hConnect, szServer, dwPort, TRUE);
+            hConnect = NULL;
+        }
+
+        if(hConnect==NULL)
+        {
+            m_Assync->SetProgress(_T("Connecting to server"), 0, true);
+            BOOL bReused = FALSE;
+            hConnect = OpenConnection(hSession, szServer, dwPort, bReused);
+            if(hConnect==NULL)
+            {
+                m_Assync->SetProgress(_T("Error connecting to server"), 0);
+                nRetries++;
+                continue;
+            }
+        }
+
+        if(bNeedOffset)
+        {
+            // Create the upload, or find out how much of it the server already has
+            m_Assync->SetProgress(_T("Negotiating resumable upload..."), 0);
+
+            if(!SendUploadCommand(hConnect, szURI, dwFlags, _T("action=upload_create"),
+                _T("Content-Type: application/x-www-form-urlencoded"),
+                sCreateBody.c_str(), (DWORD)sCreateBody.length(), dwStatus, sUploadId, uOffset))
+            {
+                nRetries++;
+                continue;
+            }
+
+            if(dwStatus!=200 || sUploadId.IsEmpty())
+            {
+                sMsg.Format(_T("Server doesn't accept resumable upload (response code %u)."), dwStatus);
+                m_Assync->SetProgress(sMsg, 0);
+                goto cleanup;
+            }
+
+            if(uOffset>uFileSize)
+            {
+                m_Assync->SetProgress(_T("Server reported invalid upload offset."), 0);
+                goto cleanup;
+            }
+
+            sMsg.Format(_T("Upload ID is %s, continuing from offset %I64u."), (LPCTSTR)sUploadId, uOffset);
+            m_Assync->SetProgress(sMsg, 0);
+            bNeedOffset = FALSE;
+        }
+
+        if(uOffset==uFileSize)
+        {
+            // All data sent, ask the server to check it
+            m_Assync->SetProgress(_T("Finishing upload..."), 0);
+
+            sQuery.Format(_T("action=upload_finish&upload_id=%s"), (LPCTSTR)sUploadId);
+            if(!SendUploadCommand(hConnect, szURI, dwFlags, sQuery, _T(""), NULL, 0,
+                dwStatus, sUploadId, uOffset))
+            {
+                nRetries++;
+                bNeedOffset = TRUE;
+                continue;
+            }
+
+            if(dwStatus!=200)
+            {
+                sMsg.Format(_T("Failed to finish upload (response code %u)."), dwStatus);
+                m_Assync->SetProgress(sMsg, 100, false);
+                goto cleanup;
+            }
+
+            break;
+        }
+
+        // Read the next chunk
+        DWORD dwChunkSize = (DWORD)MIN((ULONGLONG)Chunk.size(), uFileSize-uOffset);
+        LARGE_INTEGER lPos;
+        lPos.QuadPart = uOffset;
+        DWORD dwBytesRead = 0;
+        if(!SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN) ||
+           !ReadFile(hFile, &Chunk[0], dwChunkSize, &dwBytesRead, NULL) ||
+           dwBytesRead!=dwChunkSize)
+        {
+            m_Assync->SetProgress(_T("Error reading data from attachment file."), 0);
+            goto cleanup;
+        }
+
+        // Send it with its checksum
+        sQuery.Format(_T("action=upload_chunk&upload_id=%s&offset=%I64u"), (LPCTSTR)sUploadId, uOffset);
+        sHeaders.Format(_T("Content-Type: application/octet-stream\r\nX-CrashRpt-Chunk-MD5: %s"),
+            (LPCTSTR)CalcDataMD5Hash(&Chunk[0], dwChunkSize));
+
+        ULONGLONG uNewOffset = uOffset;
+        if(!SendUploadCommand(hConnect, szURI, dwFlags, sQuery, sHeaders, &Chunk[0], dwChunkSize,
+            dwStatus, sUploadId, uNewOffset))
+        {
+            // The chunk may have reached the server or not; ask for the offset
+            nRetries++;
+            bNeedOffset = TRUE;
+            continue;
+        }
+
+        if(dwStatus==200 || dwStatus==409)
+        {
+            // Accepted, or the server has a different offset; continue from the server's offset
+            if(uNewOffset>uFileSize)
+            {
+                m_Assync->SetProgress(_T("Server reported invalid upload offset."), 0);
+                goto cleanup;
+            }
+            if(dwStatus==409 || uNewOffset<=uOffset)
+                nRetries++;
+            else
+                nRetries = 0;
+            uOffset = uNewOffset;
+            m_uUploaded = uOffset;
+            UploadProgress(0);
+        }
+        else if(dwStatus==460)
+        {
+            // The chunk was damaged on the way, send it again
+            m_Assync->SetProgress(_T("Server rejected chunk checksum."), 0);
+            nRetries++;
+        }
+        else if(dwStatus==404)
+        {
+            // The server has forgotten the upload
+            m_Assync->SetProgress(_T("Server doesn't know the upload ID, starting a new upload."), 0);
+            sUploadId.Empty();
+            uOffset = 0;
+            nRetries++;
+            bNeedOffset = TRUE;
+        }
+        else
+        {
+            sMsg.Format(_T("Failed to upload a chunk (response code %u)."), dwStatus);
+            m_Assync->SetProgress(sMsg, 100, false);
+            goto cleanup;
+        }
+    }
+
+	// Add a message to log
+    m_Assync->SetProgress(_T("Error report has been sent OK!"), 100, false);
+    bStatus = TRUE;
+
+cleanup:
+
+    if(!bStatus)
+    {
+        // Add a message to log
+        m_Assync->SetProgress(_T("Error sending HTTP request."), 100, false);
+    }
+
+    if(hFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+
+    // Clean up internet connection
+    CloseConnection(hConnect, szServer, dwPort, !bStatus);
+
+    // Clean up internet session
+    if(hSession)
+        InternetCloseHandle(hSession);
+
+    // Notify about completion
+    m_Assync->SetCompleted(bStatus?0:1);
+
+    return bStatus;
+}
+
+// Sends one request of resumable upload. Returns FALSE on network errors, otherwise
+// returns TRUE and the response code, upload ID and offset reported by the server.
+BOOL CHttpRequestSender::SendUploadCommand(HINTERNET hConnect, LPCTSTR szURI, DWORD dwFlags,
+        CString sQuery, CString sHeaders, LPCVOID pBody, DWORD cbBody,
+        DWORD& dwStatus, CString& sUploadId, ULONGLONG& uOffset)
+{
+    BOOL bStatus = FALSE;
+    LPCTSTR szAccept[2]={_T("*/*"), NULL};
+    CString sURI = szURI;
+    CString sValue;
+    BYTE pBuffer[1024];
+    DWORD dwBuffSize = 0;
+    DWORD dwStatusSize = sizeof(dwStatus);
+
+    dwStatus = 0;
+
+    // Append the action to the script URI
+    sURI += (sURI.Find(_T('?'))<0) ? _T("?") : _T("&");
+    sURI += sQuery;
+
+    HINTERNET hRequest = HttpOpenRequest(hConnect, _T("POST"), sURI, NULL, NULL, szAccept, dwFlags, 0);
+    if(hRequest==NULL)
+    {
+        m_Assync->SetProgress(_T("HttpOpenRequest has failed."), 0, true);
+        goto cleanup;
+    }
+
+    // Ignore SSL certificate errors
+    SetSecurityFlags(hRequest);
+
+    // Keep within the upload rate limit shared by concurrent requests
+    if(m_pSession!=NULL)
+        m_pSession->Throttle(cbBody);
+
+    if(!HttpSendRequest(hRequest, sHeaders, sHeaders.GetLength(), (LPVOID)pBody, cbBody))
+    {
+        m_Assync->SetProgress(_T("HttpSendRequest has failed."), 0);
+        goto cleanup;
+    }
+    m_Assync->SetConnected();
+
+    if(!HttpQueryInfo(hRequest, HTTP_QUERY_STATUS_CODE|HTTP_QUERY_FLAG_NUMBER,
+        &dwStatus, &dwStatusSize, 0))
+    {
+        m_Assync->SetProgress(_T("Error reading server response code."), 0);
+        goto cleanup;
+    }
+
+    if(QueryCustomHeader(hRequest, _T("X-CrashRpt-Upload-Id"), sValue))
+        sUploadId = sValue;
+
+    if(QueryCustomHeader(hRequest, _T("X-CrashRpt-Upload-Offset"), sValue))
+        uOffset = _ttoi64(sValue);
+
+    // Read the response body, so that the connection can be reused
+    while(InternetReadFile(hRequest, pBuffer, sizeof(pBuffer), &dwBuffSize) && dwBuffSize!=0);
+
+    bStatus = TRUE;
+
+cleanup:
+
+    if(hRequest)
+        InternetCloseHandle(hRequest);
+
+    return bStatus;
+}
+
 BOOL CHttpRequestSender::WriteTextPart(HINTERNET hRequest, CString sName)
 {
     BOOL bRet = FALSE;
@@ -369,7 +873,7 @@ BOOL CHttpRequestSender::WriteTextPart(HINTERNET hRequest, CString sName)
     }
 
     DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszHeader, (DWORD)strlen(pszHeader), &dwBytesWritten);
+    bRet=WriteRequestData(hRequest, pszHeader, (DWORD)strlen(pszHeader), dwBytesWritten);
     if(!bRet)
     {
         m_Assync->SetProgress(_T("Error uploading text part header."), 0);
@@ -403,7 +907,7 @@ BOOL CHttpRequestSender::WriteTextPart(HINTERNET hRequest, CString sName)
         std::string sBuffer = it->second.substr(pos, dwBytesRead);
 
         DWORD dwBytesWritten = 0;
-        bRet=InternetWriteFile(hRequest, sBuffer.c_str(), dwBytesRead, &dwBytesWritten);
+        bRet=WriteRequestData(hRequest, sBuffer.c_str(), dwBytesRead, dwBytesWritten);
         if(!bRet)
         {
             m_Assync->SetProgress(_T("Error uploading text part data."), 0);
@@ -431,7 +935,7 @@ BOOL CHttpRequestSender::WriteTextPart(HINTERNET hRequest, CString sName)
         return FALSE;
     }
 
-    bRet=InternetWriteFile(hRequest, pszFooter, (DWORD)strlen(pszFooter), &dwBytesWritten);
+    bRet=WriteRequestData(hRequest, pszFooter, (DWORD)strlen(pszFooter), dwBytesWritten);
     if(!bRet)
     {
         m_Assync->SetProgress(_T("Error uploading text part footer."), 0);
@@ -464,7 +968,7 @@ BOOL CHttpRequestSender::WriteAttachmentPart(HINTERNET hRequest, CString sName)
     }
 
     DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszHeader, (DWORD)strlen(pszHeader), &dwBytesWritten);
+    bRet=WriteRequestData(hRequest, pszHeader, (DWORD)strlen(pszHeader), dwBytesWritten);
     if(!bRet)
     {
         m_Assync->SetProgress(_T("Error uploading attachment part header."), 0);
@@ -481,27 +985,42 @@ BOOL CHttpRequestSender::WriteAttachmentPart(HINTERNET hRequest, CString sName)
         return FALSE;
     }
 
-    CString sFileName = it->second.m_sSrcFileName.GetBuffer(0);
-    HANDLE hFile = CreateFile(sFileName,
-        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
-    if(hFile==INVALID_HANDLE_VALUE)
+    CBytePipe* pStream = it->second.m_pStream;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    if(pStream==NULL)
     {
-        m_Assync->SetProgress(_T("Error opening attachment file."), 0);
-        return FALSE;
+        CString sFileName = it->second.m_sSrcFileName.GetBuffer(0);
+        hFile = CreateFile(sFileName,
+            GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
+        if(hFile==INVALID_HANDLE_VALUE)
+        {
+            m_Assync->SetProgress(_T("Error opening attachment file."), 0);
+            return FALSE;
+        }
     }
 
-    BYTE pBuffer[1024];
+    // Streamed data is read in larger pieces to make less chunks
+    BYTE pBuffer[16384];
+    DWORD dwBufSize = pStream!=NULL?sizeof(pBuffer):1024;
     DWORD dwBytesRead = 0;
     for(;;)
     {
         if(m_Assync->IsCancelled())
+        {
+            if(hFile!=INVALID_HANDLE_VALUE)
+                CloseHandle(hFile);
             return FALSE;
+        }
 
-        bRet = ReadFile(hFile, pBuffer, 1024, &dwBytesRead, NULL);
+        if(pStream!=NULL)
+            bRet = pStream->Read(pBuffer, dwBufSize, dwBytesRead);
+        else
+            bRet = ReadFile(hFile, pBuffer, dwBufSize, &dwBytesRead, NULL);
         if(!bRet)
         {
             m_Assync->SetProgress(_T("Error reading data from attachment file."), 0);
-            CloseHandle(hFile);
+            if(hFile!=INVALID_HANDLE_VALUE)
+                CloseHandle(hFile);
             return FALSE;
         }
 
@@ -509,16 +1028,19 @@ BOOL CHttpRequestSender::WriteAttachmentPart(HINTERNET hRequest, CString sName)
             break; // EOF
 
         DWORD dwBytesWritten = 0;
-        bRet=InternetWriteFile(hRequest, pBuffer, dwBytesRead, &dwBytesWritten);
+        bRet=WriteRequestData(hRequest, pBuffer, dwBytesRead, dwBytesWritten);
         if(!bRet)
         {
             m_Assync->SetProgress(_T("Error uploading attachment part data."), 0);
+            if(hFile!=INVALID_HANDLE_VALUE)
+                CloseHandle(hFile);
             return FALSE;
         }
         UploadProgress(dwBytesWritten);
     }
 
-    CloseHandle(hFile);
+    if(hFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
 
     /* Write part footer */
 
@@ -537,7 +1059,7 @@ BOOL CHttpRequestSender::WriteAttachmentPart(HINTERNET hRequest, CString sName)
         return FALSE;
     }
 
-    bRet=InternetWriteFile(hRequest, pszFooter, (DWORD)strlen(pszFooter), &dwBytesWritten);
+    bRet=WriteRequestData(hRequest, pszFooter, (DWORD)strlen(pszFooter), dwBytesWritten);
     if(!bRet)
     {
         m_Assync->SetProgress(_T("Error uploading attachment part footer."), 0);
@@ -563,7 +1085,7 @@ BOOL CHttpRequestSender::WriteTrailingBoundary(HINTERNET hRequest)
         return FALSE;
 
     DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszText, (DWORD)strlen(pszText), &dwBytesWritten);
+    bRet=WriteRequestData(hRequest, pszText, (DWORD)strlen(pszText), dwBytesWritten);
     if(!bRet)
         return FALSE;
 
@@ -573,6 +1095,66 @@ BOOL CHttpRequestSender::WriteTrailingBoundary(HINTERNET hRequest)
 }
 
 
+// Writes a piece of request body, wrapping it into a chunk if needed
+BOOL CHttpRequestSender::WriteRequestData(HINTERNET hRequest, LPCVOID pData, DWORD dwSize, DWORD& dwBytesWritten)
+{
+    dwBytesWritten = 0;
+
+    // Keep within the upload rate limit shared by concurrent requests
+    if(m_pSession!=NULL)
+        m_pSession->Throttle(dwSize);
+
+    if(!m_bChunked)
+        return InternetWriteFile(hRequest, pData, dwSize, &dwBytesWritten);
+
+    // A zero-size chunk would mean the end of body
+    if(dwSize==0)
+        return TRUE;
+
+    char szChunkHeader[32];
+#if _MSC_VER<1400
+    sprintf(szChunkHeader, "%lX\r\n", dwSize);
+#else
+    sprintf_s(szChunkHeader, 32, "%lX\r\n", dwSize);
+#endif
+
+    DWORD dwWritten = 0;
+    if(!InternetWriteFile(hRequest, szChunkHeader, (DWORD)strlen(szChunkHeader), &dwWritten))
+        return FALSE;
+
+    if(!InternetWriteFile(hRequest, pData, dwSize, &dwBytesWritten))
+        return FALSE;
+
+    if(!InternetWriteFile(hRequest, "\r\n", 2, &dwWritten))
+        return FALSE;
+
+    return TRUE;
+}
+
+// Returns TRUE if any attachment is read from a pipe
+BOOL CHttpRequestSender::IsStreamingRequest()
+{
+    std::map<CString, CHttpRequestFile>::iterator it;
+    for(it=m_Request.m_aIncludedFiles.begin(); it!=m_Request.m_aIncludedFiles.end(); it++)
+    {
+        if(it->second.m_pStream!=NULL)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Aborts pipes of streamed attachments
+void CHttpRequestSender::AbortStreams()
+{
+    std::map<CString, CHttpRequestFile>::iterator it;
+    for(it=m_Request.m_aIncludedFiles.begin(); it!=m_Request.m_aIncludedFiles.end(); it++)
+    {
+        if(it->second.m_pStream!=NULL)
+            it->second.m_pStream->Abort();
+    }
+}
+
 BOOL CHttpRequestSender::FormatTextPartHeader(CString sName, CString& sPart)
 {
     std::map<CString, std::string>::iterator it = m_Request.m_aTextFields.find(sName);
@@ -717,9 +1299,13 @@ BOOL CHttpRequestSender::CalcAttachmentPartSize(CString sName, LONGLONG& lSize)
 // This method updates upload progress status
 void CHttpRequestSender::UploadProgress(DWORD dwBytesWritten)
 {
-    m_dwUploaded += dwBytesWritten;
+    m_uUploaded += dwBytesWritten;
+
+    // The total size of a streamed request is unknown
+    if(m_uPostSize==0)
+        return;
 
-    float progress = 100*(float)m_dwUploaded/m_dwPostSize;
+    double progress = 100.0*m_uUploaded/m_uPostSize;
     m_Assync->SetProgress((int)progress, false);
 }
 
@@ -16,25 +16,59 @@ be found in the Authors.txt file in the root of the source tree.
 #pragma once
 #include "stdafx.h"
 #include "AssyncNotification.h"
+#include "BytePipe.h"
+#include "HttpSession.h"
+
+// Size of a chunk sent by one request in resumable upload mode.
+#define HTTP_UPLOAD_CHUNK_SIZE (1024*1024)
+
+// How many times in a row a failed chunk is retried before giving up.
+#define HTTP_UPLOAD_MAX_RETRIES 8
 
 
 struct CHttpRequestFile
 {
+    CHttpRequestFile()
+    {
+        m_pStream = NULL;
+    }
+
     CString m_sSrcFileName;  // Name of the file attachment.
     CString m_sContentType;  // Content type.
+    CBytePipe* m_pStream;    // If set, attachment data is read from this pipe instead of the file.
 };
 
 // HTTP request information
 class CHttpRequest
 {
 public:
+    CHttpRequest()
+    {
+        m_bResumable = FALSE;
+    }
+
     CString m_sUrl;      // Script URL
+    BOOL m_bResumable;   // Upload the file attachment in chunks that can be resent after a failure
     std::map<CString, std::string> m_aTextFields;    // Array of text fields to include into POST data
     std::map<CString, CHttpRequestFile> m_aIncludedFiles; // Array of binary files to include into POST data
 };
 
 // Sends HTTP request
 // See also: RFC 1867 - Form-based File Upload in HTML (http://www.ietf.org/rfc/rfc1867.txt)
+//
+// In resumable mode, the file attachment is sent with a sequence of requests
+// to the same URL, the action is passed in the query string:
+//  - action=upload_create: form-urlencoded text fields and the file size. The server
+//    replies with X-CrashRpt-Upload-Id and X-CrashRpt-Upload-Offset headers. For
+//    an upload it already has (same crashguid, size and md5), it returns the same
+//    ID and the count of bytes received so far.
+//  - action=upload_chunk&upload_id=ID&offset=N: raw bytes of the file starting at N,
+//    with their MD5 hash in X-CrashRpt-Chunk-MD5 header. The server replies with
+//    the new offset, or 409 and its own offset if N doesn't match, or 460 if the
+//    chunk is damaged.
+//  - action=upload_finish&upload_id=ID: the server checks the whole file's MD5 hash.
+// After a network error, the client asks for the offset again and continues from it.
+// See reporting/scripts/crashrpt_upload_server.py for a reference server.
 class CHttpRequestSender
 {
 public:
@@ -44,6 +78,9 @@ public:
     // Sends HTTP request assynchroniously
     BOOL SendAssync(CHttpRequest& Request, AssyncNotification* an);
 
+    // Sets the session to take connections from. If NULL, each request opens its own connection.
+    void SetSession(CHttpSession* pSession);
+
 private:
 
     // Worker thread procedure
@@ -51,6 +88,20 @@ private:
 
     BOOL InternalSend();
 
+    // Opens connection to the server, or takes it from the shared session
+    HINTERNET OpenConnection(HINTERNET& hSession, LPCTSTR szServer, DWORD dwPort, BOOL& bReused);
+
+    // Closes connection, or leaves it open in the shared session unless it has failed
+    void CloseConnection(HINTERNET hConnect, LPCTSTR szServer, DWORD dwPort, BOOL bFailed);
+
+    // Sends the file attachment in resumable mode
+    BOOL InternalSendResumable();
+
+    // Sends one request of resumable upload and reads the response
+    BOOL SendUploadCommand(HINTERNET hConnect, LPCTSTR szURI, DWORD dwFlags,
+        CString sQuery, CString sHeaders, LPCVOID pBody, DWORD cbBody,
+        DWORD& dwStatus, CString& sUploadId, ULONGLONG& uOffset);
+
     // Used to calculate summary size of the request
     BOOL CalcRequestSize(LONGLONG& lSize);
     BOOL FormatTextPartHeader(CString sName, CString& sText);
@@ -63,6 +114,9 @@ private:
     BOOL WriteTextPart(HINTERNET hRequest, CString sName);
     BOOL WriteAttachmentPart(HINTERNET hRequest, CString sName);
     BOOL WriteTrailingBoundary(HINTERNET hRequest);
+    BOOL WriteRequestData(HINTERNET hRequest, LPCVOID pData, DWORD dwSize, DWORD& dwBytesWritten);
+    BOOL IsStreamingRequest();
+    void AbortStreams();
     void UploadProgress(DWORD dwBytesWritten);
 
     // This helper function is used to split URL into several parts
@@ -71,14 +125,16 @@ private:
 
     CHttpRequest m_Request;       // HTTP request being sent
     AssyncNotification* m_Assync; // Used to communicate with the main thread
+    CHttpSession* m_pSession;     // Shared connections (may be NULL)
 
     CString m_sFilePartHeaderFmt;
     CString m_sFilePartFooterFmt;
     CString m_sTextPartHeaderFmt;
     CString m_sTextPartFooterFmt;
     CString m_sBoundary;
-    DWORD m_dwPostSize;
-    DWORD m_dwUploaded;
+    ULONGLONG m_uPostSize;        // Size of request body (0 if unknown)
+    ULONGLONG m_uUploaded;        // Bytes of request body sent so far
+    BOOL m_bChunked;              // Is request body sent with chunked transfer encoding?
 };
 
 
@@ -0,0 +1,186 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "HttpSession.h"
+
+CHttpSession::CHttpSession()
+{
+    m_hSession = NULL;
+    m_nNewRequests = 0;
+    m_nReusedRequests = 0;
+    m_dwNewMsec = 0;
+    m_dwReusedMsec = 0;
+    m_dwBytesPerSec = 0;
+    m_dwLinkFreeTick = 0;
+}
+
+CHttpSession::~CHttpSession()
+{
+    Close();
+}
+
+HINTERNET CHttpSession::GetConnection(LPCTSTR szServer, DWORD dwPort, BOOL& bReused)
+{
+    bReused = FALSE;
+
+    CString sKey;
+    sKey.Format(_T("%s:%u"), szServer, dwPort);
+
+    m_cs.Lock();
+
+    HINTERNET hConnect = NULL;
+
+    std::map<CString, HINTERNET>::iterator it = m_aConnections.find(sKey);
+    if(it!=m_aConnections.end())
+    {
+        hConnect = it->second;
+        bReused = TRUE;
+        goto cleanup;
+    }
+
+    if(m_hSession==NULL)
+    {
+        m_hSession = InternetOpen(_T("CrashRpt"), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+        if(m_hSession==NULL)
+            goto cleanup;
+    }
+
+    hConnect = InternetConnect(m_hSession, szServer, (WORD)dwPort, NULL, NULL,
+        INTERNET_SERVICE_HTTP, 0, 0);
+    if(hConnect!=NULL)
+        m_aConnections[sKey] = hConnect;
+
+cleanup:
+
+    m_cs.Unlock();
+
+    return hConnect;
+}
+
+void CHttpSession::ResetConnection(LPCTSTR szServer, DWORD dwPort)
+{
+    CString sKey;
+    sKey.Format(_T("%s:%u"), szServer, dwPort);
+
+    m_cs.Lock();
+
+    // The handle may still be used by a request on another thread; closing it
+    // would abort that request, so it is only closed by Close()
+    std::map<CString, HINTERNET>::iterator it = m_aConnections.find(sKey);
+    if(it!=m_aConnections.end())
+    {
+        m_aRetired.push_back(it->second);
+        m_aConnections.erase(it);
+    }
+
+    m_cs.Unlock();
+}
+
+void CHttpSession::AddRequestTime(BOOL bReused, DWORD dwMsec)
+{
+    m_cs.Lock();
+
+    if(bReused)
+    {
+        m_nReusedRequests++;
+        m_dwReusedMsec += dwMsec;
+    }
+    else
+    {
+        m_nNewRequests++;
+        m_dwNewMsec += dwMsec;
+    }
+
+    m_cs.Unlock();
+}
+
+CString CHttpSession::FormatStats()
+{
+    CString sStats;
+
+    m_cs.Lock();
+
+    DWORD dwNewAvg = m_nNewRequests!=0 ? m_dwNewMsec/m_nNewRequests : 0;
+    DWORD dwReusedAvg = m_nReusedRequests!=0 ? m_dwReusedMsec/m_nReusedRequests : 0;
+
+    // Had every request opened its own connection, each would take about as long as a new one
+    LONG lSaved = 0;
+    if(m_nNewRequests!=0)
+        lSaved = (LONG)(dwNewAvg*m_nReusedRequests)-(LONG)m_dwReusedMsec;
+
+    sStats.Format(_T("HTTP connections: %d request(s) on new connections (avg %u ms to send headers), ")
+        _T("%d on reused connections (avg %u ms); estimated connection setup time saved %ld ms"),
+        m_nNewRequests, dwNewAvg, m_nReusedRequests, dwReusedAvg, lSaved);
+
+    m_cs.Unlock();
+
+    return sStats;
+}
+
+void CHttpSession::SetBandwidthLimit(DWORD dwBytesPerSec)
+{
+    m_cs.Lock();
+    m_dwBytesPerSec = dwBytesPerSec;
+    m_dwLinkFreeTick = GetTickCount();
+    m_cs.Unlock();
+}
+
+void CHttpSession::Throttle(DWORD dwBytes)
+{
+    m_cs.Lock();
+
+    if(m_dwBytesPerSec==0)
+    {
+        m_cs.Unlock();
+        return;
+    }
+
+    // Data of all threads is queued on a virtual link of the given rate;
+    // the caller waits until its bytes would have left the link
+    DWORD dwNow = GetTickCount();
+    if((LONG)(m_dwLinkFreeTick-dwNow)<0)
+        m_dwLinkFreeTick = dwNow; // The link was idle
+    m_dwLinkFreeTick += (DWORD)((ULONGLONG)dwBytes*1000/m_dwBytesPerSec);
+    LONG lWait = (LONG)(m_dwLinkFreeTick-dwNow);
+
+    m_cs.Unlock();
+
+    if(lWait>0)
+        Sleep(lWait);
+}
+
+void CHttpSession::Close()
+{
+    m_cs.Lock();
+
+    std::map<CString, HINTERNET>::iterator it;
+    for(it=m_aConnections.begin(); it!=m_aConnections.end(); it++)
+        InternetCloseHandle(it->second);
+    m_aConnections.clear();
+
+    size_t i;
+    for(i=0; i<m_aRetired.size(); i++)
+        InternetCloseHandle(m_aRetired[i]);
+    m_aRetired.clear();
+
+    if(m_hSession!=NULL)
+    {
+        InternetCloseHandle(m_hSession);
+        m_hSession = NULL;
+    }
+
+    m_nNewRequests = 0;
+    m_nReusedRequests = 0;
+    m_dwNewMsec = 0;
+    m_dwReusedMsec = 0;
+
+    m_cs.Unlock();
+}
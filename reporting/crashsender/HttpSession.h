@@ -0,0 +1,68 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: HttpSession.h
+// Description: Keeps HTTP connections open between requests.
+
+#pragma once
+#include "stdafx.h"
+
+// CHttpSession
+// Owns a WinINet session and one connection handle per server. Requests sent
+// through the same connection handle reuse the keep-alive socket and TLS session,
+// so a batch of reports pays for connection setup once per server. The object
+// may be used from several threads at once; the upload rate of all of them
+// together may be capped.
+class CHttpSession
+{
+public:
+
+    // Constructor.
+    CHttpSession();
+
+    // Destructor.
+    ~CHttpSession();
+
+    // Returns connection handle for the server, opening the session and connection
+    // if needed. bReused is set if the connection was opened by an earlier request.
+    HINTERNET GetConnection(LPCTSTR szServer, DWORD dwPort, BOOL& bReused);
+
+    // Closes connection to the server after an error, the next request opens a new one.
+    void ResetConnection(LPCTSTR szServer, DWORD dwPort);
+
+    // Records how long it took to send request headers (this includes connection
+    // setup and TLS handshake for a new connection).
+    void AddRequestTime(BOOL bReused, DWORD dwMsec);
+
+    // Returns a summary of request times and the estimated connection setup time saved.
+    CString FormatStats();
+
+    // Limits the total upload rate of requests using this session (0 means no limit).
+    void SetBandwidthLimit(DWORD dwBytesPerSec);
+
+    // Called after sending dwBytes; sleeps as long as needed to keep within the limit.
+    void Throttle(DWORD dwBytes);
+
+    // Closes all handles. No requests may be in progress.
+    void Close();
+
+private:
+
+    CComAutoCriticalSection m_cs;                 // Protects the members below
+    HINTERNET m_hSession;                         // Internet session
+    std::map<CString, HINTERNET> m_aConnections;  // Connections by server:port
+    std::vector<HINTERNET> m_aRetired;            // Failed connections waiting to be closed
+    int m_nNewRequests;                           // Requests sent on new connections
+    int m_nReusedRequests;                        // Requests sent on reused connections
+    DWORD m_dwNewMsec;                            // Total time of the former
+    DWORD m_dwReusedMsec;                         // Total time of the latter
+    DWORD m_dwBytesPerSec;                        // Upload rate limit (0 if unlimited)
+    DWORD m_dwLinkFreeTick;                       // When the data sent so far is allowed to be sent by
+};
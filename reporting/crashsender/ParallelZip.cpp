@@ -0,0 +1,495 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "ParallelZip.h"
+#include "zlib.h"
+
+// An entry of the archive being written.
+struct CParallelZipEntry
+{
+    std::string m_sFileName;   // Name inside of the archive
+    std::string m_sComment;    // File comment
+    zip_fileinfo m_Info;       // Date and attributes
+    int m_nLevel;              // Compression level (0 means stored)
+    int m_nZip64;              // Are sizes written as 64-bit?
+    bool m_bOpened;            // Was the entry opened in the archive?
+    uLong m_uCrc;              // CRC-32 of the data written so far
+    ULONGLONG m_uSize;         // Uncompressed size of the data written so far
+    ULONGLONG m_uCompressedSize; // Compressed size of the data written so far
+    DWORD m_dwStartTick;       // When the entry was begun
+};
+
+CParallelZipWriter::CParallelZipWriter()
+{
+    m_hZip = NULL;
+    m_hQueueSemaphore = NULL;
+    m_hBlockDoneEvent = NULL;
+    m_nMaxPending = 1;
+    m_pEntry = NULL;
+    m_pBlock = NULL;
+    m_uWrittenInput = 0;
+    m_bFailed = FALSE;
+}
+
+CParallelZipWriter::~CParallelZipWriter()
+{
+    Close();
+}
+
+BOOL CParallelZipWriter::Open(zipFile hZip, int nThreadCount)
+{
+    m_hZip = hZip;
+    m_uWrittenInput = 0;
+    m_aStats.clear();
+    m_bFailed = FALSE;
+
+    if(nThreadCount<=0)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        nThreadCount = (int)si.dwNumberOfProcessors;
+    }
+    if(nThreadCount>PZIP_MAX_THREADS)
+        nThreadCount = PZIP_MAX_THREADS;
+
+    // With a single CPU there is no one to share the work with,
+    // so blocks are compressed on the calling thread.
+    if(nThreadCount<=1)
+    {
+        m_nMaxPending = 1;
+        return TRUE;
+    }
+
+    m_hQueueSemaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    m_hBlockDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(m_hQueueSemaphore==NULL || m_hBlockDoneEvent==NULL)
+    {
+        Close();
+        return FALSE;
+    }
+
+    int i;
+    for(i=0; i<nThreadCount; i++)
+    {
+        HANDLE hThread = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+        if(hThread==NULL)
+            break;
+        m_aThreads.push_back(hThread);
+    }
+
+    if(m_aThreads.size()==0)
+    {
+        // Fall back to compressing on the calling thread
+        CloseHandle(m_hQueueSemaphore);
+        m_hQueueSemaphore = NULL;
+        CloseHandle(m_hBlockDoneEvent);
+        m_hBlockDoneEvent = NULL;
+        m_nMaxPending = 1;
+        return TRUE;
+    }
+
+    // Keep every worker busy while the calling thread writes and reads files
+    m_nMaxPending = 2*m_aThreads.size();
+
+    return TRUE;
+}
+
+BOOL CParallelZipWriter::BeginEntry(LPCSTR szFileName, const zip_fileinfo* pInfo, LPCSTR szComment, int nLevel, ULONGLONG uSize)
+{
+    if(m_pEntry!=NULL || m_hZip==NULL)
+        return FALSE;
+
+    m_pEntry = new CParallelZipEntry;
+    m_pEntry->m_sFileName = szFileName;
+    m_pEntry->m_sComment = szComment!=NULL?szComment:"";
+    m_pEntry->m_Info = *pInfo;
+    m_pEntry->m_nLevel = nLevel;
+    m_pEntry->m_nZip64 = uSize>=PZIP_ZIP64_THRESHOLD?1:0;
+    m_pEntry->m_bOpened = false;
+    m_pEntry->m_uCrc = crc32(0L, Z_NULL, 0);
+    m_pEntry->m_uSize = 0;
+    m_pEntry->m_uCompressedSize = 0;
+    m_pEntry->m_dwStartTick = GetTickCount();
+
+    m_Tail.clear();
+
+    return TRUE;
+}
+
+BOOL CParallelZipWriter::AddData(const BYTE* pData, DWORD cbData)
+{
+    if(m_pEntry==NULL)
+        return FALSE;
+
+    while(cbData>0)
+    {
+        if(m_pBlock==NULL)
+        {
+            m_pBlock = new CParallelZipBlock;
+            m_pBlock->m_Input.reserve(PZIP_BLOCK_SIZE);
+        }
+
+        // Copy as much data as fits into the current block
+        DWORD cbFree = (DWORD)(PZIP_BLOCK_SIZE-m_pBlock->m_Input.size());
+        DWORD cbCopy = cbData<cbFree?cbData:cbFree;
+        m_pBlock->m_Input.insert(m_pBlock->m_Input.end(), pData, pData+cbCopy);
+        pData += cbCopy;
+        cbData -= cbCopy;
+
+        if(m_pBlock->m_Input.size()==PZIP_BLOCK_SIZE)
+        {
+            if(!SubmitBlock(false))
+                return FALSE;
+        }
+    }
+
+    // Write out whatever is ready so progress moves on
+    WriteFinishedBlocks(false);
+
+    return !m_bFailed;
+}
+
+BOOL CParallelZipWriter::EndEntry()
+{
+    if(m_pEntry==NULL)
+        return FALSE;
+
+    // The last block is submitted even if it is empty, it finishes the deflate stream
+    // and closes the entry in the archive.
+    if(m_pBlock==NULL)
+        m_pBlock = new CParallelZipBlock;
+
+    BOOL bSubmit = SubmitBlock(true);
+    m_pEntry = NULL;
+    m_Tail.clear();
+
+    WriteFinishedBlocks(false);
+
+    return bSubmit && !m_bFailed;
+}
+
+BOOL CParallelZipWriter::Flush()
+{
+    while(m_Pending.size()!=0)
+        WriteFinishedBlocks(true);
+
+    return !m_bFailed;
+}
+
+void CParallelZipWriter::Close()
+{
+    if(m_aThreads.size()!=0)
+    {
+        // Drop blocks nobody has started yet and tell each worker to exit
+        m_csQueue.Lock();
+        m_Queue.clear();
+        size_t i;
+        for(i=0; i<m_aThreads.size(); i++)
+            m_Queue.push_back(NULL);
+        m_csQueue.Unlock();
+        ReleaseSemaphore(m_hQueueSemaphore, (LONG)m_aThreads.size(), NULL);
+
+        for(i=0; i<m_aThreads.size(); i++)
+        {
+            WaitForSingleObject(m_aThreads[i], INFINITE);
+            CloseHandle(m_aThreads[i]);
+        }
+        m_aThreads.clear();
+        m_Queue.clear();
+    }
+
+    if(m_hQueueSemaphore!=NULL)
+    {
+        CloseHandle(m_hQueueSemaphore);
+        m_hQueueSemaphore = NULL;
+    }
+
+    if(m_hBlockDoneEvent!=NULL)
+    {
+        CloseHandle(m_hBlockDoneEvent);
+        m_hBlockDoneEvent = NULL;
+    }
+
+    // Free blocks that were not written
+    while(m_Pending.size()!=0)
+    {
+        CParallelZipBlock* pBlock = m_Pending.front();
+        m_Pending.pop_front();
+        if(pBlock->m_bLast)
+            delete pBlock->m_pEntry;
+        delete pBlock;
+    }
+
+    if(m_pBlock!=NULL)
+    {
+        delete m_pBlock;
+        m_pBlock = NULL;
+    }
+
+    if(m_pEntry!=NULL)
+    {
+        delete m_pEntry;
+        m_pEntry = NULL;
+    }
+
+    m_Tail.clear();
+    m_hZip = NULL;
+}
+
+ULONGLONG CParallelZipWriter::GetWrittenInputSize()
+{
+    return m_uWrittenInput;
+}
+
+BOOL CParallelZipWriter::IsFailed()
+{
+    return m_bFailed;
+}
+
+const std::vector<CParallelZipEntryStats>& CParallelZipWriter::GetEntryStats()
+{
+    return m_aStats;
+}
+
+BOOL CParallelZipWriter::SubmitBlock(bool bLast)
+{
+    CParallelZipBlock* pBlock = m_pBlock;
+    m_pBlock = NULL;
+
+    pBlock->m_pEntry = m_pEntry;
+    pBlock->m_bLast = bLast;
+    pBlock->m_uCrc = 0;
+    pBlock->m_bFailed = FALSE;
+    pBlock->m_lDone = 0;
+
+    // Stored data needs no dictionary
+    if(m_pEntry->m_nLevel!=0)
+        pBlock->m_Dict.swap(m_Tail);
+
+    // Remember the tail of this block for the next one
+    m_Tail.clear();
+    if(!bLast && m_pEntry->m_nLevel!=0)
+    {
+        size_t nTail = pBlock->m_Input.size()<PZIP_DICT_SIZE?pBlock->m_Input.size():PZIP_DICT_SIZE;
+        m_Tail.assign(pBlock->m_Input.end()-nTail, pBlock->m_Input.end());
+    }
+
+    // Don't let the count of blocks in memory grow without bound
+    while(m_Pending.size()>=m_nMaxPending)
+        WriteFinishedBlocks(true);
+
+    m_Pending.push_back(pBlock);
+
+    if(m_aThreads.size()==0)
+    {
+        CompressBlock(pBlock);
+        pBlock->m_lDone = 1;
+    }
+    else
+    {
+        m_csQueue.Lock();
+        m_Queue.push_back(pBlock);
+        m_csQueue.Unlock();
+        ReleaseSemaphore(m_hQueueSemaphore, 1, NULL);
+    }
+
+    return TRUE;
+}
+
+void CParallelZipWriter::WriteFinishedBlocks(bool bWait)
+{
+    while(m_Pending.size()!=0)
+    {
+        CParallelZipBlock* pBlock = m_Pending.front();
+
+        if(InterlockedCompareExchange(&pBlock->m_lDone, 0, 0)==0)
+        {
+            if(!bWait)
+                break;
+
+            // Wait until some worker finishes a block, then check again
+            WaitForSingleObject(m_hBlockDoneEvent, INFINITE);
+            continue;
+        }
+
+        m_Pending.pop_front();
+        WriteBlock(pBlock);
+
+        // Waiting was needed for the oldest block only
+        bWait = false;
+    }
+}
+
+void CParallelZipWriter::WriteBlock(CParallelZipBlock* pBlock)
+{
+    CParallelZipEntry* pEntry = pBlock->m_pEntry;
+
+    if(pBlock->m_bFailed)
+        m_bFailed = TRUE;
+
+    if(!m_bFailed && !pEntry->m_bOpened)
+    {
+        // Open the entry in raw mode, the data is already compressed. CRC and sizes
+        // go to a data descriptor, so the archive is written strictly sequentially.
+        int nMethod = pEntry->m_nLevel!=0?Z_DEFLATED:0;
+        int nRes = zipOpenNewFileInZip4_64(m_hZip, pEntry->m_sFileName.c_str(), &pEntry->m_Info,
+            NULL, 0, NULL, 0, pEntry->m_sComment.c_str(), nMethod, pEntry->m_nLevel, 1,
+            -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, NULL, 0, 0, ZIP_FLAG_DATA_DESCRIPTOR, pEntry->m_nZip64);
+        if(nRes!=ZIP_OK)
+            m_bFailed = TRUE;
+        else
+            pEntry->m_bOpened = true;
+    }
+
+    if(!m_bFailed && pBlock->m_Output.size()!=0)
+    {
+        int nRes = zipWriteInFileInZip(m_hZip, &pBlock->m_Output[0], (unsigned)pBlock->m_Output.size());
+        if(nRes!=ZIP_OK)
+            m_bFailed = TRUE;
+    }
+
+    if(!m_bFailed)
+    {
+        // Append the CRC of this block to the CRC of the entry
+        ULONGLONG uBlockSize = pBlock->m_Input.size();
+        pEntry->m_uCrc = crc32_combine(pEntry->m_uCrc, pBlock->m_uCrc, (z_off_t)uBlockSize);
+        pEntry->m_uSize += uBlockSize;
+        pEntry->m_uCompressedSize += pBlock->m_Output.size();
+        m_uWrittenInput += uBlockSize;
+
+        if(pBlock->m_bLast)
+        {
+            int nRes = zipCloseFileInZipRaw64(m_hZip, pEntry->m_uSize, pEntry->m_uCrc);
+            if(nRes!=ZIP_OK)
+                m_bFailed = TRUE;
+        }
+    }
+
+    if(pBlock->m_bLast)
+    {
+        CParallelZipEntryStats stats;
+        stats.m_sFileName = pEntry->m_sFileName;
+        stats.m_nLevel = pEntry->m_nLevel;
+        stats.m_uSize = pEntry->m_uSize;
+        stats.m_uCompressedSize = pEntry->m_uCompressedSize;
+        stats.m_dwTime = GetTickCount()-pEntry->m_dwStartTick;
+        stats.m_bFailed = m_bFailed;
+        m_aStats.push_back(stats);
+
+        delete pEntry;
+    }
+    delete pBlock;
+}
+
+void CParallelZipWriter::CompressBlock(CParallelZipBlock* pBlock)
+{
+    std::vector<BYTE>& Input = pBlock->m_Input;
+    std::vector<BYTE>& Output = pBlock->m_Output;
+    uInt cbInput = (uInt)Input.size();
+    Bytef* pInput = cbInput!=0?&Input[0]:Z_NULL;
+
+    pBlock->m_uCrc = crc32(crc32(0L, Z_NULL, 0), pInput, cbInput);
+
+    if(pBlock->m_pEntry->m_nLevel==0)
+    {
+        // Stored
+        Output = Input;
+        return;
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(z_stream));
+
+    // Raw deflate without zlib header, as ZIP requires
+    int nRes = deflateInit2(&zs, pBlock->m_pEntry->m_nLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if(nRes!=Z_OK)
+    {
+        pBlock->m_bFailed = TRUE;
+        return;
+    }
+
+    if(pBlock->m_Dict.size()!=0)
+    {
+        nRes = deflateSetDictionary(&zs, &pBlock->m_Dict[0], (uInt)pBlock->m_Dict.size());
+        if(nRes!=Z_OK)
+        {
+            deflateEnd(&zs);
+            pBlock->m_bFailed = TRUE;
+            return;
+        }
+    }
+
+    // A sync flush leaves the stream on a byte boundary so the next block can follow.
+    int nFlush = pBlock->m_bLast?Z_FINISH:Z_SYNC_FLUSH;
+    size_t cbOutput = 0;
+    Output.resize(deflateBound(&zs, cbInput)+16);
+    zs.next_in = pInput;
+    zs.avail_in = cbInput;
+
+    for(;;)
+    {
+        zs.next_out = &Output[cbOutput];
+        zs.avail_out = (uInt)(Output.size()-cbOutput);
+
+        nRes = deflate(&zs, nFlush);
+        cbOutput = Output.size()-zs.avail_out;
+
+        if(nRes==Z_STREAM_ERROR)
+        {
+            pBlock->m_bFailed = TRUE;
+            break;
+        }
+
+        if(pBlock->m_bLast ? nRes==Z_STREAM_END : (zs.avail_in==0 && zs.avail_out!=0))
+            break;
+
+        // Output buffer is full, grow it and continue
+        Output.resize(Output.size()*2);
+    }
+
+    Output.resize(cbOutput);
+    deflateEnd(&zs);
+
+    // Dictionary is not needed anymore
+    std::vector<BYTE>().swap(pBlock->m_Dict);
+}
+
+DWORD WINAPI CParallelZipWriter::WorkerThread(LPVOID lpParam)
+{
+    CParallelZipWriter* pWriter = (CParallelZipWriter*)lpParam;
+
+    for(;;)
+    {
+        WaitForSingleObject(pWriter->m_hQueueSemaphore, INFINITE);
+
+        pWriter->m_csQueue.Lock();
+        if(pWriter->m_Queue.size()==0)
+        {
+            // The block was taken back by Close()
+            pWriter->m_csQueue.Unlock();
+            continue;
+        }
+        CParallelZipBlock* pBlock = pWriter->m_Queue.front();
+        pWriter->m_Queue.pop_front();
+        pWriter->m_csQueue.Unlock();
+
+        // NULL means exit
+        if(pBlock==NULL)
+            break;
+
+        CompressBlock(pBlock);
+
+        InterlockedExchange(&pBlock->m_lDone, 1);
+        SetEvent(pWriter->m_hBlockDoneEvent);
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ParallelZip.h
+// Description: Writes ZIP archive entries compressed in parallel on a worker pool.
+
+#pragma once
+#include "stdafx.h"
+#include <deque>
+#include "zip.h"
+
+// Size of a block of input data compressed independently by a worker.
+#define PZIP_BLOCK_SIZE   (1024*1024)
+
+// Size of the deflate window; each block is primed with that many
+// trailing bytes of the preceding block of the same entry.
+#define PZIP_DICT_SIZE    (32*1024)
+
+// Entries with source data of this size or more are written with 64-bit sizes.
+// It is below 4 GB, because deflate output of incompressible data is slightly
+// larger than the input.
+#define PZIP_ZIP64_THRESHOLD  ((ULONGLONG)0xF0000000)
+
+// Maximum count of worker threads.
+#define PZIP_MAX_THREADS  8
+
+struct CParallelZipEntry;
+
+// What an entry took once it is written to the archive.
+struct CParallelZipEntryStats
+{
+    std::string m_sFileName;     // Name inside of the archive
+    int m_nLevel;                // Compression level (0 means stored)
+    ULONGLONG m_uSize;           // Uncompressed size
+    ULONGLONG m_uCompressedSize; // Compressed size
+    DWORD m_dwTime;              // Milliseconds from BeginEntry() until the entry was closed
+    BOOL m_bFailed;              // Was the entry not written completely?
+};
+
+// A block of an entry's data passed to a worker.
+struct CParallelZipBlock
+{
+    CParallelZipEntry* m_pEntry; // Entry this block belongs to
+    bool m_bLast;                // Is this the last block of the entry?
+    std::vector<BYTE> m_Input;   // Uncompressed data
+    std::vector<BYTE> m_Dict;    // Preset dictionary (tail of the preceding block)
+    std::vector<BYTE> m_Output;  // Raw deflate (or stored) data
+    uLong m_uCrc;                // CRC-32 of the uncompressed data
+    BOOL m_bFailed;              // Was there a compression error?
+    volatile LONG m_lDone;       // Set to 1 by the worker once the block is ready
+};
+
+// CParallelZipWriter
+// Splits the data of each entry into blocks and deflates them concurrently,
+// the way pigz does: every block is compressed as a separate raw deflate
+// stream primed with the preceding 32 KB and ended with a sync flush, so
+// the concatenation of the blocks is one valid deflate stream. Blocks are
+// written to the archive in order from the calling thread using minizip's
+// raw mode, and the CRC-32 of the entry is combined from per-block CRCs.
+// The produced archive is a regular ZIP file.
+//
+// All methods must be called from the same thread. Progress can be
+// tracked with GetWrittenInputSize() after each AddData() call.
+class CParallelZipWriter
+{
+public:
+
+    // Constructor.
+    CParallelZipWriter();
+
+    // Destructor.
+    ~CParallelZipWriter();
+
+    // Starts worker threads. Pass nThreadCount<=0 to use one thread per CPU.
+    BOOL Open(zipFile hZip, int nThreadCount=0);
+
+    // Starts a new entry. nLevel is a zlib compression level; zero means the data is stored.
+    // uSize is the size of the source data; it decides whether the entry is written as zip64.
+    BOOL BeginEntry(LPCSTR szFileName, const zip_fileinfo* pInfo, LPCSTR szComment, int nLevel, ULONGLONG uSize);
+
+    // Adds entry data.
+    BOOL AddData(const BYTE* pData, DWORD cbData);
+
+    // Finishes the current entry.
+    BOOL EndEntry();
+
+    // Waits until all submitted blocks are written to the archive.
+    BOOL Flush();
+
+    // Stops worker threads. Blocks not yet written are discarded.
+    void Close();
+
+    // Returns count of uncompressed bytes already written to the archive.
+    ULONGLONG GetWrittenInputSize();
+
+    // Returns TRUE if a compression or write error has occurred.
+    BOOL IsFailed();
+
+    // Returns stats of the entries written so far, in archive order.
+    const std::vector<CParallelZipEntryStats>& GetEntryStats();
+
+private:
+
+    // Passes the current block to the workers.
+    BOOL SubmitBlock(bool bLast);
+
+    // Writes finished blocks to the archive in order. If bWait is set, waits for the oldest block.
+    void WriteFinishedBlocks(bool bWait);
+
+    // Writes a block to the archive and frees it.
+    void WriteBlock(CParallelZipBlock* pBlock);
+
+    // Compresses a block.
+    static void CompressBlock(CParallelZipBlock* pBlock);
+
+    // Worker thread procedure.
+    static DWORD WINAPI WorkerThread(LPVOID lpParam);
+
+    zipFile m_hZip;                           // Output archive
+    std::vector<HANDLE> m_aThreads;           // Worker threads
+    CComAutoCriticalSection m_csQueue;        // Protects m_Queue
+    std::deque<CParallelZipBlock*> m_Queue;   // Blocks waiting for a worker (NULL stops a worker)
+    HANDLE m_hQueueSemaphore;                 // Count of items in m_Queue
+    HANDLE m_hBlockDoneEvent;                 // Signaled when a worker finishes a block
+    std::deque<CParallelZipBlock*> m_Pending; // Submitted blocks in archive order
+    size_t m_nMaxPending;                     // Limit on the count of blocks in memory
+    CParallelZipEntry* m_pEntry;              // Entry being added
+    CParallelZipBlock* m_pBlock;              // Block being filled
+    std::vector<BYTE> m_Tail;                 // Tail of the last submitted block of the entry
+    ULONGLONG m_uWrittenInput;                // Uncompressed bytes written so far
+    std::vector<CParallelZipEntryStats> m_aStats; // Stats of written entries
+    BOOL m_bFailed;                           // Error flag
+};
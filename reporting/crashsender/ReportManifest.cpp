@@ -0,0 +1,277 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "ReportManifest.h"
+#include "strconv.h"
+
+// The manifest is a binary file:
+//
+//   "CRMF", version, count of entries, then for each entry:
+//   directory name, stamp, crash GUID, app name, app version, image name,
+//   crash time, total size, count of files, then for each file:
+//   name in ZIP archive, description, optional flag.
+//
+// Strings are stored as a DWORD length followed by UTF-8 bytes.
+
+// Appends raw bytes to the buffer
+static void PutBytes(std::string& sBuffer, const void* pData, size_t cbData)
+{
+    sBuffer.append((const char*)pData, cbData);
+}
+
+// Appends a string to the buffer
+static void PutString(std::string& sBuffer, const CString& str)
+{
+    strconv_t strconv;
+    LPCSTR szUtf8 = strconv.t2utf8(str);
+    DWORD dwLen = (DWORD)strlen(szUtf8);
+    PutBytes(sBuffer, &dwLen, sizeof(DWORD));
+    PutBytes(sBuffer, szUtf8, dwLen);
+}
+
+// Reads raw bytes from the buffer; returns FALSE if it's too short
+static BOOL GetBytes(const std::string& sBuffer, size_t& nPos, void* pData, size_t cbData)
+{
+    if(sBuffer.size()-nPos<cbData)
+        return FALSE;
+    memcpy(pData, sBuffer.data()+nPos, cbData);
+    nPos += cbData;
+    return TRUE;
+}
+
+// Reads a string from the buffer
+static BOOL GetString(const std::string& sBuffer, size_t& nPos, CString& str)
+{
+    strconv_t strconv;
+    DWORD dwLen = 0;
+    if(!GetBytes(sBuffer, nPos, &dwLen, sizeof(DWORD)) || sBuffer.size()-nPos<dwLen)
+        return FALSE;
+    std::string sUtf8 = sBuffer.substr(nPos, dwLen);
+    nPos += dwLen;
+    str = strconv.utf82t(sUtf8.c_str());
+    return TRUE;
+}
+
+CReportManifest::CReportManifest()
+{
+    m_bModified = FALSE;
+}
+
+BOOL CReportManifest::Load(LPCTSTR szFileName)
+{
+    m_sFileName = szFileName;
+    m_aEntries.clear();
+
+    // Save() writes the manifest if there is no valid one
+    m_bModified = TRUE;
+
+    HANDLE hFile = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    // Read the whole file at once
+    std::string sBuffer;
+    LARGE_INTEGER lFileSize;
+    DWORD dwRead = 0;
+    BOOL bRead = FALSE;
+    if(GetFileSizeEx(hFile, &lFileSize) && lFileSize.QuadPart>0 && lFileSize.QuadPart<0x10000000)
+    {
+        sBuffer.resize((size_t)lFileSize.QuadPart);
+        bRead = ReadFile(hFile, &sBuffer[0], (DWORD)sBuffer.size(), &dwRead, NULL) &&
+            dwRead==sBuffer.size();
+    }
+    CloseHandle(hFile);
+    if(!bRead)
+        return FALSE;
+
+    size_t nPos = 0;
+    char szMagic[4];
+    DWORD dwVersion = 0;
+    DWORD dwCount = 0;
+    if(!GetBytes(sBuffer, nPos, szMagic, 4) || memcmp(szMagic, "CRMF", 4)!=0 ||
+       !GetBytes(sBuffer, nPos, &dwVersion, sizeof(DWORD)) || dwVersion!=REPORT_MANIFEST_VERSION ||
+       !GetBytes(sBuffer, nPos, &dwCount, sizeof(DWORD)))
+        return FALSE;
+
+    std::map<CString, Entry> aEntries;
+    DWORD i;
+    for(i=0; i<dwCount; i++)
+    {
+        CString sDirName;
+        Entry entry;
+        DWORD dwFileCount = 0;
+        if(!GetString(sBuffer, nPos, sDirName) ||
+           !GetBytes(sBuffer, nPos, &entry.m_Stamp, sizeof(ReportStamp)) ||
+           !GetString(sBuffer, nPos, entry.m_sCrashGUID) ||
+           !GetString(sBuffer, nPos, entry.m_sAppName) ||
+           !GetString(sBuffer, nPos, entry.m_sAppVersion) ||
+           !GetString(sBuffer, nPos, entry.m_sImageName) ||
+           !GetString(sBuffer, nPos, entry.m_sSystemTimeUTC) ||
+           !GetBytes(sBuffer, nPos, &entry.m_uTotalSize, sizeof(ULONG64)) ||
+           !GetBytes(sBuffer, nPos, &dwFileCount, sizeof(DWORD)))
+            return FALSE;
+
+        DWORD j;
+        for(j=0; j<dwFileCount; j++)
+        {
+            ERIFileItem item;
+            BYTE uOptional = 0;
+            if(!GetString(sBuffer, nPos, item.m_sDestFile) ||
+               !GetString(sBuffer, nPos, item.m_sDesc) ||
+               !GetBytes(sBuffer, nPos, &uOptional, 1))
+                return FALSE;
+            item.m_bAllowDelete = uOptional!=0;
+            entry.m_aFileItems.push_back(item);
+        }
+
+        entry.m_bUsed = FALSE;
+        aEntries[sDirName] = entry;
+    }
+
+    m_aEntries = aEntries;
+    m_bModified = FALSE;
+    return TRUE;
+}
+
+BOOL CReportManifest::GetReport(LPCTSTR szDirName, const ReportStamp& stamp, CErrorReportInfo& eri)
+{
+    std::map<CString, Entry>::iterator it = m_aEntries.find(szDirName);
+    if(it==m_aEntries.end() || !IsSameStamp(it->second.m_Stamp, stamp))
+        return FALSE;
+
+    Entry& entry = it->second;
+    entry.m_bUsed = TRUE;
+
+    eri.m_sCrashGUID = entry.m_sCrashGUID;
+    eri.m_sAppName = entry.m_sAppName;
+    eri.m_sAppVersion = entry.m_sAppVersion;
+    eri.m_sImageName = entry.m_sImageName;
+    eri.m_sSystemTimeUTC = entry.m_sSystemTimeUTC;
+    eri.m_uTotalSize = entry.m_uTotalSize;
+
+    // Files are located in the report directory, the same way ParseCrashDescription() finds them
+    CString sReportDir = eri.m_sErrorReportDirName;
+    if(sReportDir.Right(1)!=_T("\\"))
+        sReportDir += _T("\\");
+
+    size_t i;
+    for(i=0; i<entry.m_aFileItems.size(); i++)
+    {
+        ERIFileItem item = entry.m_aFileItems[i];
+        item.m_sSrcFile = sReportDir + item.m_sDestFile;
+        item.m_bMakeCopy = FALSE;
+        eri.m_FileItems[item.m_sSrcFile] = item;
+    }
+
+    return TRUE;
+}
+
+void CReportManifest::SetReport(LPCTSTR szDirName, const ReportStamp& stamp, CErrorReportInfo& eri)
+{
+    Entry entry;
+    entry.m_Stamp = stamp;
+    entry.m_sCrashGUID = eri.m_sCrashGUID;
+    entry.m_sAppName = eri.m_sAppName;
+    entry.m_sAppVersion = eri.m_sAppVersion;
+    entry.m_sImageName = eri.m_sImageName;
+    entry.m_sSystemTimeUTC = eri.m_sSystemTimeUTC;
+    entry.m_uTotalSize = eri.m_uTotalSize;
+    entry.m_bUsed = TRUE;
+
+    std::map<CString, ERIFileItem>::iterator it;
+    for(it=eri.m_FileItems.begin(); it!=eri.m_FileItems.end(); it++)
+        entry.m_aFileItems.push_back(it->second);
+
+    m_aEntries[szDirName] = entry;
+    m_bModified = TRUE;
+}
+
+BOOL CReportManifest::Save()
+{
+    // Forget reports that are gone
+    std::map<CString, Entry>::iterator it = m_aEntries.begin();
+    while(it!=m_aEntries.end())
+    {
+        if(!it->second.m_bUsed)
+        {
+            m_aEntries.erase(it++);
+            m_bModified = TRUE;
+        }
+        else
+            it++;
+    }
+
+    if(!m_bModified)
+        return TRUE; // Up to date
+
+    std::string sBuffer;
+    DWORD dwVersion = REPORT_MANIFEST_VERSION;
+    DWORD dwCount = (DWORD)m_aEntries.size();
+    PutBytes(sBuffer, "CRMF", 4);
+    PutBytes(sBuffer, &dwVersion, sizeof(DWORD));
+    PutBytes(sBuffer, &dwCount, sizeof(DWORD));
+
+    for(it=m_aEntries.begin(); it!=m_aEntries.end(); it++)
+    {
+        const Entry& entry = it->second;
+        DWORD dwFileCount = (DWORD)entry.m_aFileItems.size();
+
+        PutString(sBuffer, it->first);
+        PutBytes(sBuffer, &entry.m_Stamp, sizeof(ReportStamp));
+        PutString(sBuffer, entry.m_sCrashGUID);
+        PutString(sBuffer, entry.m_sAppName);
+        PutString(sBuffer, entry.m_sAppVersion);
+        PutString(sBuffer, entry.m_sImageName);
+        PutString(sBuffer, entry.m_sSystemTimeUTC);
+        PutBytes(sBuffer, &entry.m_uTotalSize, sizeof(ULONG64));
+        PutBytes(sBuffer, &dwFileCount, sizeof(DWORD));
+
+        size_t i;
+        for(i=0; i<entry.m_aFileItems.size(); i++)
+        {
+            BYTE uOptional = entry.m_aFileItems[i].m_bAllowDelete?1:0;
+            PutString(sBuffer, entry.m_aFileItems[i].m_sDestFile);
+            PutString(sBuffer, entry.m_aFileItems[i].m_sDesc);
+            PutBytes(sBuffer, &uOptional, 1);
+        }
+    }
+
+    // Write a temporary file and replace the manifest with it, so that another
+    // CrashSender.exe never reads a half-written manifest
+    CString sTempFile;
+    sTempFile.Format(_T("%s.%lu.tmp"), (LPCTSTR)m_sFileName, GetCurrentProcessId());
+
+    HANDLE hFile = CreateFile(sTempFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    DWORD dwWritten = 0;
+    BOOL bWrite = WriteFile(hFile, sBuffer.data(), (DWORD)sBuffer.size(), &dwWritten, NULL) &&
+        dwWritten==sBuffer.size();
+    CloseHandle(hFile);
+
+    if(!bWrite || !MoveFileEx(sTempFile, m_sFileName, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(sTempFile);
+        return FALSE;
+    }
+
+    m_bModified = FALSE;
+    return TRUE;
+}
+
+BOOL CReportManifest::IsSameStamp(const ReportStamp& a, const ReportStamp& b)
+{
+    return CompareFileTime(&a.m_ftDirWriteTime, &b.m_ftDirWriteTime)==0 &&
+        CompareFileTime(&a.m_ftXmlWriteTime, &b.m_ftXmlWriteTime)==0 &&
+        a.m_uXmlSize==b.m_uXmlSize;
+}
@@ -0,0 +1,79 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ReportManifest.h
+// Description: Cache of parsed crash descriptions of queued error reports.
+
+#pragma once
+#include "stdafx.h"
+#include "CrashInfoReader.h"
+
+// Bump when the manifest layout changes; manifests of other versions are ignored.
+#define REPORT_MANIFEST_VERSION 1
+
+// Identifies the state of a report directory. The directory time changes when
+// files are added, removed or renamed in it; crash description XML may also be
+// rewritten in place, so its time and size are checked too.
+struct ReportStamp
+{
+    FILETIME m_ftDirWriteTime; // Last write time of the report directory.
+    FILETIME m_ftXmlWriteTime; // Last write time of crashrpt.xml.
+    ULONG64 m_uXmlSize;        // Size of crashrpt.xml.
+};
+
+// CReportManifest
+// Keeps what CCrashInfoReader reads from each queued report (crash description
+// fields, the file list and the total size) in ~CrashRptManifest.dat, so that
+// the queue can be listed without parsing XML and stating every file. An entry
+// is used only if the report directory has the same stamp as when it was saved.
+class CReportManifest
+{
+public:
+
+    // Constructor.
+    CReportManifest();
+
+    // Reads the manifest. A missing or damaged manifest is treated as empty.
+    BOOL Load(LPCTSTR szFileName);
+
+    // Fills in the report from the manifest. Returns FALSE if the report is
+    // not known or its directory has changed since.
+    BOOL GetReport(LPCTSTR szDirName, const ReportStamp& stamp, CErrorReportInfo& eri);
+
+    // Stores a freshly parsed report.
+    void SetReport(LPCTSTR szDirName, const ReportStamp& stamp, CErrorReportInfo& eri);
+
+    // Writes the reports passed to GetReport() or SetReport() since Load(), if
+    // anything has changed. Reports not asked for are dropped.
+    BOOL Save();
+
+private:
+
+    // A cached report.
+    struct Entry
+    {
+        ReportStamp m_Stamp;
+        CString m_sCrashGUID;
+        CString m_sAppName;
+        CString m_sAppVersion;
+        CString m_sImageName;
+        CString m_sSystemTimeUTC;
+        ULONG64 m_uTotalSize;
+        std::vector<ERIFileItem> m_aFileItems; // Source file names are not stored
+        BOOL m_bUsed;                          // Was it asked for since Load()?
+    };
+
+    // Compares stamps.
+    static BOOL IsSameStamp(const ReportStamp& a, const ReportStamp& b);
+
+    CString m_sFileName;                  // Manifest file name
+    std::map<CString, Entry> m_aEntries;  // Cached reports by directory name
+    BOOL m_bModified;                     // Does the file differ from m_aEntries?
+};
@@ -0,0 +1,124 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "ZipPolicy.h"
+#include "CrashRpt.h"
+#include "Utility.h"
+#include <math.h>
+
+CZipPolicy::CZipPolicy(DWORD dwFlags)
+{
+    m_dwFlags = dwFlags;
+}
+
+int CZipPolicy::ChooseLevel(LPCTSTR szFileName, const BYTE* pSample, DWORD cbSample, CString& sReason)
+{
+    eZipFileType Type = GetFileType(szFileName);
+
+    // Already compressed data only costs CPU time to deflate again
+    if(Type==ZIP_FTYPE_MEDIA)
+    {
+        if(m_dwFlags&CR_INST_ZIP_COMPRESS_MEDIA)
+        {
+            sReason = _T("compressed media, forced by flags");
+            return ZIP_LEVEL_FAST;
+        }
+
+        sReason = _T("compressed media");
+        return ZIP_LEVEL_STORE;
+    }
+
+    // Look at the contents; data that looks random won't get smaller
+    if((m_dwFlags&CR_INST_ZIP_NO_CONTENT_SAMPLING)==0 && cbSample!=0)
+    {
+        double dEntropy = CalcEntropy(pSample, cbSample);
+        if(dEntropy>ZIP_POLICY_MAX_ENTROPY)
+        {
+            sReason.Format(_T("entropy %.2f bits/byte"), dEntropy);
+            return ZIP_LEVEL_STORE;
+        }
+    }
+
+    if(Type==ZIP_FTYPE_MINIDUMP)
+    {
+        // Minidumps are large and mostly zeroes and repeated pages; fast level
+        // gets close to the best ratio at a fraction of the time
+        if(m_dwFlags&CR_INST_ZIP_MINIDUMP_HIGH)
+        {
+            sReason = _T("minidump, high level forced by flags");
+            return ZIP_LEVEL_HIGH;
+        }
+
+        sReason = _T("minidump");
+        return ZIP_LEVEL_FAST;
+    }
+
+    if(Type==ZIP_FTYPE_TEXT)
+    {
+        // Text files are small and compress very well
+        if(m_dwFlags&CR_INST_ZIP_TEXT_FAST)
+        {
+            sReason = _T("text, fast level forced by flags");
+            return ZIP_LEVEL_FAST;
+        }
+
+        sReason = _T("text");
+        return ZIP_LEVEL_HIGH;
+    }
+
+    sReason = _T("binary");
+    return ZIP_LEVEL_FAST;
+}
+
+eZipFileType CZipPolicy::GetFileType(LPCTSTR szFileName)
+{
+    CString sExt = Utility::GetFileExtension(szFileName);
+    sExt.MakeLower();
+
+    if(sExt==_T("dmp") || sExt==_T("mdmp"))
+        return ZIP_FTYPE_MINIDUMP;
+
+    if(sExt==_T("xml") || sExt==_T("txt") || sExt==_T("log") || sExt==_T("ini") ||
+       sExt==_T("csv") || sExt==_T("htm") || sExt==_T("html") || sExt==_T("json"))
+        return ZIP_FTYPE_TEXT;
+
+    if(sExt==_T("png") || sExt==_T("jpg") || sExt==_T("jpeg") || sExt==_T("gif") ||
+       sExt==_T("ogg") || sExt==_T("ogv") || sExt==_T("mp4") || sExt==_T("avi") ||
+       sExt==_T("zip") || sExt==_T("7z") || sExt==_T("gz") || sExt==_T("cab") || sExt==_T("rar"))
+        return ZIP_FTYPE_MEDIA;
+
+    return ZIP_FTYPE_OTHER;
+}
+
+double CZipPolicy::CalcEntropy(const BYTE* pData, DWORD cbData)
+{
+    if(cbData==0)
+        return 0;
+
+    DWORD dwCounts[256];
+    memset(dwCounts, 0, sizeof(dwCounts));
+
+    DWORD i;
+    for(i=0; i<cbData; i++)
+        dwCounts[pData[i]]++;
+
+    double dEntropy = 0;
+    for(i=0; i<256; i++)
+    {
+        if(dwCounts[i]==0)
+            continue;
+        double p = (double)dwCounts[i]/cbData;
+        dEntropy -= p*log(p);
+    }
+
+    // Convert from nats to bits
+    return dEntropy/log(2.0);
+}
@@ -0,0 +1,61 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ZipPolicy.h
+// Description: Chooses compression level for each file of the error report ZIP archive.
+
+#pragma once
+#include "stdafx.h"
+
+// Compression levels the policy chooses from.
+#define ZIP_LEVEL_STORE   0  // Store data as is
+#define ZIP_LEVEL_FAST    1  // Fastest deflate
+#define ZIP_LEVEL_HIGH    9  // Best deflate
+
+// How many leading bytes of a file are sampled.
+#define ZIP_POLICY_SAMPLE_SIZE (64*1024)
+
+// Byte entropy (bits per byte) above which data is considered incompressible.
+#define ZIP_POLICY_MAX_ENTROPY 7.8
+
+// File types known to the policy.
+enum eZipFileType
+{
+    ZIP_FTYPE_OTHER    = 0, // Unknown type
+    ZIP_FTYPE_MINIDUMP = 1, // Minidump
+    ZIP_FTYPE_TEXT     = 2, // XML, logs and other text
+    ZIP_FTYPE_MEDIA    = 3  // Already compressed (images, video, archives)
+};
+
+// CZipPolicy
+// Picks store, fast or high level for each entry from the file type and
+// byte entropy of the first bytes of the file. Per-type defaults can be
+// overridden with CR_INST_ZIP_* flags passed to crInstall().
+class CZipPolicy
+{
+public:
+
+    // Constructor. dwFlags is a combination of CR_INST_ZIP_* flags.
+    CZipPolicy(DWORD dwFlags=0);
+
+    // Returns compression level for the file. pSample points to the
+    // first bytes of the file; sReason receives a description of the choice.
+    int ChooseLevel(LPCTSTR szFileName, const BYTE* pSample, DWORD cbSample, CString& sReason);
+
+    // Returns file type determined by file name extension.
+    static eZipFileType GetFileType(LPCTSTR szFileName);
+
+    // Returns byte entropy of data, in bits per byte.
+    static double CalcEntropy(const BYTE* pData, DWORD cbData);
+
+private:
+
+    DWORD m_dwFlags; // CR_INST_ZIP_* flags
+};
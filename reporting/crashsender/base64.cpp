@@ -37,6 +37,7 @@ be found in the Authors.txt file in the root of the source tree.
 
 #include "base64.h"
 #include <iostream>
+#include <string.h>
 
 static const std::string base64_chars =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -102,6 +103,544 @@ std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_
 
 }
 
+// Buffer codecs
+//
+// Full groups of 3 bytes are encoded by a kernel which handles as many of them as
+// it can with SIMD instructions and leaves the rest to the scalar loop. Decoding
+// kernels stop at the first block containing anything but base64 characters
+// (line breaks, padding or garbage), which is then handled one character at a time.
+//
+// SSSE3 and AVX2 kernels follow "Faster Base64 Encoding and Decoding using AVX2
+// Instructions" by W. Mula and D. Lemire.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BASE64_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__)
+#include <cpuid.h>
+#endif
+#if !defined(_MSC_VER) || _MSC_VER>=1700
+#define BASE64_AVX2 // AVX2 intrinsics are available since Visual Studio 2012
+#endif
+#endif
+
+// MSVC lets any function use any instruction set; GCC needs to be told.
+#if defined(__GNUC__)
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BASE64_TARGET(isa)
+#endif
+
+static const char encode_table[] =
+             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+             "abcdefghijklmnopqrstuvwxyz"
+             "0123456789+/";
+
+// Character values for decoding: 0..63, or one of the following
+#define DECODE_INVALID 0xff
+#define DECODE_SPACE   0xfe
+#define DECODE_PAD     0xfd
+
+static const unsigned char decode_table[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xff, 0xff, 0xfe, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+// Encodes up to groups full groups; readable is the count of bytes that may be
+// read at in (at least groups*3). Returns the count of groups encoded.
+typedef size_t (*encode_kernel)(unsigned char const* in, size_t groups, size_t readable, char* out);
+
+// Decodes whole blocks of valid characters. out has room for at least in_len*3/4
+// bytes. Returns the count of bytes written; consumed receives the count of characters read.
+typedef size_t (*decode_kernel)(unsigned char const* in, size_t in_len, unsigned char* out, size_t* consumed);
+
+static size_t encode_scalar(unsigned char const* in, size_t groups, size_t /*readable*/, char* out) {
+  size_t i;
+  for (i = 0; i < groups; i++) {
+    unsigned int v = (in[0] << 16) | (in[1] << 8) | in[2];
+    out[0] = encode_table[v >> 18];
+    out[1] = encode_table[(v >> 12) & 0x3f];
+    out[2] = encode_table[(v >> 6) & 0x3f];
+    out[3] = encode_table[v & 0x3f];
+    in += 3;
+    out += 4;
+  }
+  return groups;
+}
+
+static size_t decode_scalar(unsigned char const* in, size_t in_len, unsigned char* out, size_t* consumed) {
+  unsigned char const* p = in;
+  unsigned char* o = out;
+  while (in_len >= 4) {
+    unsigned int a = decode_table[p[0]], b = decode_table[p[1]], c = decode_table[p[2]], d = decode_table[p[3]];
+    if ((a | b | c | d) & 0xc0)
+      break; // Not a base64 character
+    unsigned int v = (a << 18) | (b << 12) | (c << 6) | d;
+    o[0] = (unsigned char)(v >> 16);
+    o[1] = (unsigned char)(v >> 8);
+    o[2] = (unsigned char)v;
+    p += 4;
+    o += 3;
+    in_len -= 4;
+  }
+  *consumed = p - in;
+  return o - out;
+}
+
+#ifdef BASE64_X86
+
+BASE64_TARGET("ssse3")
+static size_t encode_ssse3(unsigned char const* in, size_t groups, size_t readable, char* out) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  size_t done = 0;
+
+  // 12 bytes are encoded, but 16 are loaded
+  while (groups - done >= 4 && readable >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    v = _mm_shuffle_epi8(v, shuffle);
+
+    // Move each 6-bit field into its own byte
+    __m128i t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t1, t3);
+
+    // Turn values into characters: split them into ranges A-Z, a-z, 0-9, + and /,
+    // then add the offset of the range
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    __m128i chars = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, range), indices);
+    _mm_storeu_si128((__m128i*)out, chars);
+
+    in += 12;
+    readable -= 12;
+    out += 16;
+    done += 4;
+  }
+  return done;
+}
+
+BASE64_TARGET("ssse3")
+static size_t decode_ssse3(unsigned char const* in, size_t in_len, unsigned char* out, size_t* consumed) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_0f = _mm_set1_epi8(0x0f);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  unsigned char const* p = in;
+  unsigned char* o = out;
+
+  // 16 bytes are written, but 12 of them are decoded; 24 characters left
+  // mean there is room for 18 bytes
+  while (in_len >= 24) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_0f);
+    __m128i lo_nibbles = _mm_and_si128(v, mask_0f);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+      break; // Not a base64 character
+
+    __m128i eq_2f = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x2f));
+    __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    __m128i values = _mm_add_epi8(v, roll);
+
+    // Join four 6-bit values into three bytes
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    packed = _mm_shuffle_epi8(packed, pack);
+    _mm_storeu_si128((__m128i*)o, packed);
+
+    p += 16;
+    in_len -= 16;
+    o += 12;
+  }
+  *consumed = p - in;
+  return o - out;
+}
+
+#ifdef BASE64_AVX2
+
+BASE64_TARGET("avx2")
+static size_t encode_avx2(unsigned char const* in, size_t groups, size_t readable, char* out) {
+  const __m256i shuffle = _mm256_broadcastsi128_si256(
+    _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  const __m256i shift_lut = _mm256_broadcastsi128_si256(
+    _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+  size_t done = 0;
+
+  // Each lane gets 12 bytes: 24 bytes are encoded, but 28 are loaded
+  while (groups - done >= 8 && readable >= 28) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)in);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(in + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+
+    __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, range), indices);
+    _mm256_storeu_si256((__m256i*)out, chars);
+
+    in += 24;
+    readable -= 24;
+    out += 32;
+    done += 8;
+  }
+  return done;
+}
+
+BASE64_TARGET("avx2")
+static size_t decode_avx2(unsigned char const* in, size_t in_len, unsigned char* out, size_t* consumed) {
+  const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+  const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+    0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+  const __m256i lut_roll = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+    0, 0, 0, 0, 0, 0, 0, 0));
+  const __m256i mask_0f = _mm256_set1_epi8(0x0f);
+  const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+    14, 13, 12, -1, -1, -1, -1));
+  const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+  unsigned char const* p = in;
+  unsigned char* o = out;
+
+  // 32 bytes are written, but 24 of them are decoded; 48 characters left
+  // mean there is room for 36 bytes
+  while (in_len >= 48) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_0f);
+    __m256i lo_nibbles = _mm256_and_si256(v, mask_0f);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break; // Not a base64 character
+
+    __m256i eq_2f = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x2f));
+    __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    __m256i values = _mm256_add_epi8(v, roll);
+
+    __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    packed = _mm256_shuffle_epi8(packed, pack);
+    packed = _mm256_permutevar8x32_epi32(packed, join); // Close the gap between lanes
+    _mm256_storeu_si256((__m256i*)o, packed);
+
+    p += 32;
+    in_len -= 32;
+    o += 24;
+  }
+  *consumed = p - in;
+  return o - out;
+}
+
+#endif // BASE64_AVX2
+
+// Returns the best instruction set supported by the CPU and the OS
+static base64_simd detect_simd() {
+  int info[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+  __cpuid(info, 1);
+#else
+  unsigned int max_leaf = __get_cpuid_max(0, 0);
+  if (max_leaf >= 1)
+    __cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+  if (max_leaf < 1 || !(info[2] & (1 << 9)))
+    return base64_simd_scalar;
+
+#ifdef BASE64_AVX2
+  // AVX registers must be saved by the OS (OSXSAVE and AVX bits, then XCR0)
+  if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && max_leaf >= 7) {
+    unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+    xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    xcr0 = ((unsigned long long)xcr0_hi << 32) | xcr0_lo;
+#endif
+    int info7[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+    __cpuidex(info7, 7, 0);
+#else
+    __cpuid_count(7, 0, info7[0], info7[1], info7[2], info7[3]);
+#endif
+    if ((xcr0 & 6) == 6 && (info7[1] & (1 << 5)))
+      return base64_simd_avx2;
+  }
+#endif
+
+  return base64_simd_ssse3;
+}
+
+#else
+
+static base64_simd detect_simd() {
+  return base64_simd_scalar;
+}
+
+#endif // BASE64_X86
+
+static encode_kernel simd_encode = NULL;
+static decode_kernel simd_decode = NULL;
+static base64_simd simd_used = base64_simd_scalar;
+
+base64_simd base64_set_simd(base64_simd simd) {
+  base64_simd supported = detect_simd();
+  if (simd > supported)
+    simd = supported;
+
+  encode_kernel enc = encode_scalar;
+  decode_kernel dec = decode_scalar;
+#ifdef BASE64_X86
+  if (simd == base64_simd_ssse3) {
+    enc = encode_ssse3;
+    dec = decode_ssse3;
+  }
+#ifdef BASE64_AVX2
+  if (simd == base64_simd_avx2) {
+    enc = encode_avx2;
+    dec = decode_avx2;
+  }
+#endif
+#endif
+
+  // Threads racing here store the same values
+  simd_used = simd;
+  simd_decode = dec;
+  simd_encode = enc;
+  return simd;
+}
+
+base64_simd base64_get_simd() {
+  if (simd_encode == NULL)
+    base64_set_simd(base64_simd_avx2);
+  return simd_used;
+}
+
+// Encodes full groups, using SIMD for as many as possible
+static void encode_groups(unsigned char const* in, size_t groups, size_t readable, char* out) {
+  if (simd_encode == NULL)
+    base64_get_simd();
+  size_t done = simd_encode(in, groups, readable, out);
+  encode_scalar(in + done * 3, groups - done, 0, out + done * 4);
+}
+
+// Copies encoded characters to out, adding split after every split_count characters
+static char* put_lines(char const* chars, size_t n, char* out, int& count, int split_count, char const* split, size_t split_len) {
+  if (split_count <= 0) {
+    memcpy(out, chars, n);
+    return out + n;
+  }
+
+  while (n > 0) {
+    size_t len = split_count - count;
+    if (len > n)
+      len = n;
+    memcpy(out, chars, len);
+    out += len;
+    chars += len;
+    n -= len;
+    count += (int)len;
+    if (count == split_count) {
+      memcpy(out, split, split_len);
+      out += split_len;
+      count = 0;
+    }
+  }
+  return out;
+}
+
+// Encodes whole groups of in_len bytes, then the padded rest if pad is set.
+// count is the length of the current line. Returns the end of output.
+static char* encode_split(unsigned char const* in, size_t in_len, char* out, int& count, int split_count, char const* split, bool pad) {
+  size_t split_len = split_count > 0 ? strlen(split) : 0;
+  size_t groups = in_len / 3;
+
+  if (split_count <= 0) {
+    // Nothing to insert, encode right into the output
+    encode_groups(in, groups, in_len, out);
+    out += groups * 4;
+  } else {
+    // Encode a chunk into a line-sized buffer, then copy lines out of it
+    const size_t CHUNK_GROUPS = 1024;
+    char chunk[CHUNK_GROUPS * 4];
+    size_t done = 0;
+    while (done < groups) {
+      size_t n = groups - done;
+      if (n > CHUNK_GROUPS)
+        n = CHUNK_GROUPS;
+      encode_groups(in + done * 3, n, in_len - done * 3, chunk);
+      out = put_lines(chunk, n * 4, out, count, split_count, split, split_len);
+      done += n;
+    }
+  }
+
+  size_t rest = in_len - groups * 3;
+  if (pad && rest > 0) {
+    unsigned char const* p = in + groups * 3;
+    unsigned int v = (p[0] << 16) | (rest > 1 ? p[1] << 8 : 0);
+    char chars[3] = {
+      encode_table[v >> 18],
+      encode_table[(v >> 12) & 0x3f],
+      encode_table[(v >> 6) & 0x3f]
+    };
+    out = put_lines(chars, rest + 1, out, count, split_count, split, split_len);
+
+    // Padding is not counted in line length, as by base64_encode()
+    size_t i;
+    for (i = rest; i < 3; i++)
+      *out++ = '=';
+  }
+
+  return out;
+}
+
+size_t base64_encoded_size(size_t in_len, int split_count, const char *split) {
+  size_t chars = in_len / 3 * 4 + (in_len % 3 ? in_len % 3 + 1 : 0);
+  size_t size = (in_len + 2) / 3 * 4;
+  if (split_count > 0)
+    size += chars / split_count * strlen(split);
+  return size;
+}
+
+size_t base64_encode_buf(unsigned char const* bytes_to_encode, size_t in_len, char* out, int split_count, const char *split) {
+  int count = 0;
+  return encode_split(bytes_to_encode, in_len, out, count, split_count, split, true) - out;
+}
+
+size_t base64_decoded_size(size_t in_len) {
+  return (in_len + 3) / 4 * 3;
+}
+
+size_t base64_decode_buf(char const* encoded, size_t in_len, unsigned char* out) {
+  if (simd_decode == NULL)
+    base64_get_simd();
+
+  unsigned char const* p = (unsigned char const*)encoded;
+  unsigned char const* end = p + in_len;
+  unsigned char* o = out;
+  unsigned int v = 0;
+  int n = 0;
+
+  for (;;) {
+    if (n == 0) {
+      // At a group boundary, decode as much as possible at once
+      size_t consumed = 0;
+      o += simd_decode(p, end - p, o, &consumed);
+      p += consumed;
+      o += decode_scalar(p, end - p, o, &consumed);
+      p += consumed;
+    }
+
+    if (p == end)
+      break;
+
+    unsigned char c = decode_table[*p++];
+    if (c < 64) {
+      v = (v << 6) | c;
+      if (++n == 4) {
+        o[0] = (unsigned char)(v >> 16);
+        o[1] = (unsigned char)(v >> 8);
+        o[2] = (unsigned char)v;
+        o += 3;
+        v = 0;
+        n = 0;
+      }
+    }
+    else if (c == DECODE_PAD)
+      break;
+    else if (c != DECODE_SPACE)
+      return (size_t)-1;
+  }
+
+  // A partial group; one character alone doesn't make a byte
+  if (n >= 2)
+    *o++ = (unsigned char)(v >> (n * 6 - 8));
+  if (n == 3)
+    *o++ = (unsigned char)(v >> 2);
+
+  return o - out;
+}
+
+base64_stream_encoder::base64_stream_encoder(int split_count, const char *split)
+  : tail_len(0), count(0), split_count(split_count), split(split) {
+}
+
+void base64_stream_encoder::encode(unsigned char const* bytes_to_encode, size_t in_len, std::string& out) {
+  size_t old_size = out.size();
+  out.resize(old_size + 4 + in_len / 3 * 4 + (split_count > 0 ? (count + in_len / 3 * 4 + 4) / split_count * split.size() : 0));
+  char* p = &out[0] + old_size;
+
+  // Complete the group left from the previous call
+  while (tail_len > 0 && tail_len < 3 && in_len > 0) {
+    tail[tail_len++] = *(bytes_to_encode++);
+    in_len--;
+  }
+  if (tail_len == 3) {
+    p = encode_split(tail, 3, p, count, split_count, split.c_str(), false);
+    tail_len = 0;
+  }
+
+  size_t whole = in_len - in_len % 3;
+  p = encode_split(bytes_to_encode, whole, p, count, split_count, split.c_str(), false);
+  out.resize(p - out.data());
+
+  // Keep the rest for the next call
+  bytes_to_encode += whole;
+  in_len -= whole;
+  while (in_len > 0) {
+    tail[tail_len++] = *(bytes_to_encode++);
+    in_len--;
+  }
+}
+
+void base64_stream_encoder::finish(std::string& out) {
+  if (tail_len == 0)
+    return;
+
+  size_t old_size = out.size();
+  out.resize(old_size + 4 + (split_count > 0 ? (count + 3) / split_count * split.size() : 0));
+  char* p = &out[0] + old_size;
+  p = encode_split(tail, tail_len, p, count, split_count, split.c_str(), true);
+  out.resize(p - out.data());
+
+  tail_len = 0;
+}
+
 std::string base64_decode(std::string const& encoded_string) {
   int in_len = (int)encoded_string.size();
   int i = 0;
@@ -14,3 +14,60 @@ be found in the Authors.txt file in the root of the source tree.
 std::string base64_encode(unsigned char const* , unsigned int len, int split_count = 76, const char *split = "\r\n");
 std::string base64_decode(std::string const& s);
 
+// Codecs working on caller-provided buffers. They use SSSE3 or AVX2 when the
+// CPU supports them, otherwise a scalar loop; the output is the same.
+enum base64_simd
+{
+  base64_simd_scalar = 0,
+  base64_simd_ssse3  = 1,
+  base64_simd_avx2   = 2
+};
+
+// Returns the size of base64_encode_buf() output for in_len bytes.
+size_t base64_encoded_size(size_t in_len, int split_count = 76, const char *split = "\r\n");
+
+// Encodes in_len bytes into out, which must hold base64_encoded_size() characters.
+// Lines are split the same way as by base64_encode(). Returns the count of characters written.
+size_t base64_encode_buf(unsigned char const* bytes_to_encode, size_t in_len, char* out, int split_count = 76, const char *split = "\r\n");
+
+// Returns the max size of base64_decode_buf() output for in_len characters.
+size_t base64_decoded_size(size_t in_len);
+
+// Decodes in_len characters into out, which must hold base64_decoded_size() bytes.
+// Line breaks and spaces are skipped, decoding stops at the first '='.
+// Returns the count of bytes written, or (size_t)-1 if there is an invalid character.
+size_t base64_decode_buf(char const* encoded, size_t in_len, unsigned char* out);
+
+// Returns the instruction set used by the buffer codecs.
+base64_simd base64_get_simd();
+
+// Makes the buffer codecs use the given instruction set, or the best one the
+// CPU supports if it doesn't support this one. Returns the one used.
+// Meant for benchmarks and tests.
+base64_simd base64_set_simd(base64_simd simd);
+
+// Incremental encoder for data that doesn't fit into memory. Output is the same
+// as of base64_encode() called for all the data at once, but it is produced
+// piece by piece, so memory use doesn't depend on the data size.
+class base64_stream_encoder
+{
+public:
+
+  base64_stream_encoder(int split_count = 76, const char *split = "\r\n");
+
+  // Appends encoded data to out. Up to two trailing bytes are kept until
+  // the next call, as they don't make a full group of three.
+  void encode(unsigned char const* bytes_to_encode, size_t in_len, std::string& out);
+
+  // Appends the kept bytes with padding to out.
+  void finish(std::string& out);
+
+private:
+
+  unsigned char tail[3];
+  int tail_len;
+  int count;
+  int split_count;
+  std::string split;
+};
+
@@ -43,6 +43,29 @@ be found in the Authors.txt file in the root of the source tree.
 
 //md5 class include
 #include "md5.h"
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MD5_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__)
+#include <cpuid.h>
+#endif
+#if !defined(_MSC_VER) || _MSC_VER>=1700
+#define MD5_AVX2 // AVX2 intrinsics are available since Visual Studio 2012
+#endif
+#endif
+
+// MSVC lets any function use any instruction set; GCC needs to be told.
+#if defined(__GNUC__)
+#define MD5_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MD5_TARGET(isa)
+#endif
 
 // Constants for MD5Transform routine.
 #define S11 7
@@ -68,42 +91,129 @@ static unsigned char PADDING[64] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-/* F, G, H and I are basic MD5 functions. */
-#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
-#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
+/*
+F, G, H and I are basic MD5 functions. F and G are written so that
+they need one operation less than in RFC 1321.
+*/
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
 #define H(x, y, z) ((x) ^ (y) ^ (z))
 #define I(x, y, z) ((y) ^ ((x) | (~z)))
 
 /* ROTATE_LEFT rotates x left n bits. */
+#if defined(_MSC_VER)
+#define ROTATE_LEFT(x, n) _rotl((x), (n))
+#else
 #define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32-(n))))
-//#define ROTATE_LEFT(x, n) (((x) << (n)) | (( (UINT32) x) >> (32-(n))))
+#endif
 
 /*
-FF, GG, HH, and II transformations for rounds 1, 2, 3, and 4.
-Rotation is separate from addition to prevent recomputation.
+The 64 steps of the MD5 transformation. STEP is called with the function,
+the four state words in the order they are used, message word index,
+rotation and the additive constant; it is defined differently for scalar
+and SIMD code, which share this list.
 */
-#define FF(a, b, c, d, x, s, ac) { \
-    (a) += F ((b), (c), (d)) + (x) + (unsigned long int)(ac); \
-    (a) = ROTATE_LEFT ((a), (s)); \
-    (a) += (b); \
-    }
+#define MD5_STEPS(STEP, F, G, H, I) \
+    STEP(F, a, b, c, d,  0, S11, 0xd76aa478) /* 1 */ \
+    STEP(F, d, a, b, c,  1, S12, 0xe8c7b756) /* 2 */ \
+    STEP(F, c, d, a, b,  2, S13, 0x242070db) /* 3 */ \
+    STEP(F, b, c, d, a,  3, S14, 0xc1bdceee) /* 4 */ \
+    STEP(F, a, b, c, d,  4, S11, 0xf57c0faf) /* 5 */ \
+    STEP(F, d, a, b, c,  5, S12, 0x4787c62a) /* 6 */ \
+    STEP(F, c, d, a, b,  6, S13, 0xa8304613) /* 7 */ \
+    STEP(F, b, c, d, a,  7, S14, 0xfd469501) /* 8 */ \
+    STEP(F, a, b, c, d,  8, S11, 0x698098d8) /* 9 */ \
+    STEP(F, d, a, b, c,  9, S12, 0x8b44f7af) /* 10 */ \
+    STEP(F, c, d, a, b, 10, S13, 0xffff5bb1) /* 11 */ \
+    STEP(F, b, c, d, a, 11, S14, 0x895cd7be) /* 12 */ \
+    STEP(F, a, b, c, d, 12, S11, 0x6b901122) /* 13 */ \
+    STEP(F, d, a, b, c, 13, S12, 0xfd987193) /* 14 */ \
+    STEP(F, c, d, a, b, 14, S13, 0xa679438e) /* 15 */ \
+    STEP(F, b, c, d, a, 15, S14, 0x49b40821) /* 16 */ \
+    STEP(G, a, b, c, d,  1, S21, 0xf61e2562) /* 17 */ \
+    STEP(G, d, a, b, c,  6, S22, 0xc040b340) /* 18 */ \
+    STEP(G, c, d, a, b, 11, S23, 0x265e5a51) /* 19 */ \
+    STEP(G, b, c, d, a,  0, S24, 0xe9b6c7aa) /* 20 */ \
+    STEP(G, a, b, c, d,  5, S21, 0xd62f105d) /* 21 */ \
+    STEP(G, d, a, b, c, 10, S22, 0x02441453) /* 22 */ \
+    STEP(G, c, d, a, b, 15, S23, 0xd8a1e681) /* 23 */ \
+    STEP(G, b, c, d, a,  4, S24, 0xe7d3fbc8) /* 24 */ \
+    STEP(G, a, b, c, d,  9, S21, 0x21e1cde6) /* 25 */ \
+    STEP(G, d, a, b, c, 14, S22, 0xc33707d6) /* 26 */ \
+    STEP(G, c, d, a, b,  3, S23, 0xf4d50d87) /* 27 */ \
+    STEP(G, b, c, d, a,  8, S24, 0x455a14ed) /* 28 */ \
+    STEP(G, a, b, c, d, 13, S21, 0xa9e3e905) /* 29 */ \
+    STEP(G, d, a, b, c,  2, S22, 0xfcefa3f8) /* 30 */ \
+    STEP(G, c, d, a, b,  7, S23, 0x676f02d9) /* 31 */ \
+    STEP(G, b, c, d, a, 12, S24, 0x8d2a4c8a) /* 32 */ \
+    STEP(H, a, b, c, d,  5, S31, 0xfffa3942) /* 33 */ \
+    STEP(H, d, a, b, c,  8, S32, 0x8771f681) /* 34 */ \
+    STEP(H, c, d, a, b, 11, S33, 0x6d9d6122) /* 35 */ \
+    STEP(H, b, c, d, a, 14, S34, 0xfde5380c) /* 36 */ \
+    STEP(H, a, b, c, d,  1, S31, 0xa4beea44) /* 37 */ \
+    STEP(H, d, a, b, c,  4, S32, 0x4bdecfa9) /* 38 */ \
+    STEP(H, c, d, a, b,  7, S33, 0xf6bb4b60) /* 39 */ \
+    STEP(H, b, c, d, a, 10, S34, 0xbebfbc70) /* 40 */ \
+    STEP(H, a, b, c, d, 13, S31, 0x289b7ec6) /* 41 */ \
+    STEP(H, d, a, b, c,  0, S32, 0xeaa127fa) /* 42 */ \
+    STEP(H, c, d, a, b,  3, S33, 0xd4ef3085) /* 43 */ \
+    STEP(H, b, c, d, a,  6, S34, 0x04881d05) /* 44 */ \
+    STEP(H, a, b, c, d,  9, S31, 0xd9d4d039) /* 45 */ \
+    STEP(H, d, a, b, c, 12, S32, 0xe6db99e5) /* 46 */ \
+    STEP(H, c, d, a, b, 15, S33, 0x1fa27cf8) /* 47 */ \
+    STEP(H, b, c, d, a,  2, S34, 0xc4ac5665) /* 48 */ \
+    STEP(I, a, b, c, d,  0, S41, 0xf4292244) /* 49 */ \
+    STEP(I, d, a, b, c,  7, S42, 0x432aff97) /* 50 */ \
+    STEP(I, c, d, a, b, 14, S43, 0xab9423a7) /* 51 */ \
+    STEP(I, b, c, d, a,  5, S44, 0xfc93a039) /* 52 */ \
+    STEP(I, a, b, c, d, 12, S41, 0x655b59c3) /* 53 */ \
+    STEP(I, d, a, b, c,  3, S42, 0x8f0ccc92) /* 54 */ \
+    STEP(I, c, d, a, b, 10, S43, 0xffeff47d) /* 55 */ \
+    STEP(I, b, c, d, a,  1, S44, 0x85845dd1) /* 56 */ \
+    STEP(I, a, b, c, d,  8, S41, 0x6fa87e4f) /* 57 */ \
+    STEP(I, d, a, b, c, 15, S42, 0xfe2ce6e0) /* 58 */ \
+    STEP(I, c, d, a, b,  6, S43, 0xa3014314) /* 59 */ \
+    STEP(I, b, c, d, a, 13, S44, 0x4e0811a1) /* 60 */ \
+    STEP(I, a, b, c, d,  4, S41, 0xf7537e82) /* 61 */ \
+    STEP(I, d, a, b, c, 11, S42, 0xbd3af235) /* 62 */ \
+    STEP(I, c, d, a, b,  2, S43, 0x2ad7d2bb) /* 63 */ \
+    STEP(I, b, c, d, a,  9, S44, 0xeb86d391) /* 64 */
+
+/* Scalar step: a = b + ((a + f(b, c, d) + x[k] + t) <<< s) */
+#define SCALAR_STEP(f, a, b, c, d, k, s, t) \
+    (a) += f((b), (c), (d)) + x[k] + (t); \
+    (a) = ROTATE_LEFT((a), (s)) + (b);
 
-#define GG(a, b, c, d, x, s, ac) { \
-    (a) += G ((b), (c), (d)) + (x) + (unsigned long int)(ac); \
-    (a) = ROTATE_LEFT ((a), (s)); \
-    (a) += (b); \
-    }
-#define HH(a, b, c, d, x, s, ac) { \
-    (a) += H ((b), (c), (d)) + (x) + (unsigned long int)(ac); \
-    (a) = ROTATE_LEFT ((a), (s)); \
-    (a) += (b); \
-    }
-#define II(a, b, c, d, x, s, ac) { \
-    (a) += I ((b), (c), (d)) + (x) + (unsigned long int)(ac); \
-    (a) = ROTATE_LEFT ((a), (s)); \
-    (a) += (b); \
+/*
+MD5 basic transformation. Transforms state based on count blocks.
+Words are 32 bits, whatever the size of unsigned long is.
+*/
+static void MD5Blocks(unsigned int state[4], const unsigned char* block, size_t count)
+{
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3];
+
+    while (count--) {
+        unsigned int aa = a, bb = b, cc = c, dd = d;
+
+        /* Windows runs on little-endian CPUs only, so words are copied as they are. */
+        unsigned int x[16];
+        memcpy(x, block, 64);
+
+        MD5_STEPS(SCALAR_STEP, F, G, H, I)
+
+        a += aa;
+        b += bb;
+        c += cc;
+        d += dd;
+        block += 64;
     }
 
+    state[0] = a;
+    state[1] = b;
+    state[2] = c;
+    state[3] = d;
+}
+
 /* MD5 initialization. Begins an MD5 operation, writing a new context. */
 void MD5::MD5Init (MD5_CTX *context)
 {
@@ -135,15 +245,17 @@ void MD5::MD5Update (MD5_CTX *context, unsigned char *input, unsigned int inputL
     partLen = 64 - index;
 
     /*
-    * Transform as many times as possible.
+    * Transform as many times as possible. Whole blocks are hashed
+    * right from the input, without copying them to the context.
     */
     if (inputLen >= partLen)
     {
-        MD5_memcpy ((POINTER)&context->buffer[index], (POINTER)input, partLen);
-        MD5Transform (context->state, context->buffer);
+        memcpy (&context->buffer[index], input, partLen);
+        MD5Transform (context->state, context->buffer, 1);
 
-        for (i = partLen; i + 63 < inputLen; i += 64)
-            MD5Transform (context->state, &input[i]);
+        i = partLen;
+        MD5Transform (context->state, &input[i], (inputLen - i) / 64);
+        i += (inputLen - i) / 64 * 64;
 
         index = 0;
     }
@@ -151,9 +263,7 @@ void MD5::MD5Update (MD5_CTX *context, unsigned char *input, unsigned int inputL
         i = 0;
 
     /* Buffer remaining input */
-    MD5_memcpy ((POINTER)&context->buffer[index],
-        (POINTER)&input[i],
-        inputLen-i);
+    memcpy (&context->buffer[index], &input[i], inputLen-i);
 }
 
 /*
@@ -184,100 +294,27 @@ void MD5::MD5Final (unsigned char digest[16], MD5_CTX *context)
     /*
     * Zeroize sensitive information.
     */
-    MD5_memset ((POINTER)context, 0, sizeof (*context));
+    memset (context, 0, sizeof (*context));
 }
 
 /*
-* MD5 basic transformation. Transforms state based on block.
+* MD5 basic transformation. Transforms state based on count blocks.
 */
-void MD5::MD5Transform (unsigned long int state[4], unsigned char block[64])
+void MD5::MD5Transform (unsigned long int state[4], const unsigned char* block, size_t count)
 {
-    unsigned long int a = state[0], b = state[1], c = state[2], d = state[3], x[16];
-
-    Decode (x, block, 64);
-
-    /* Round 1 */
-    FF (a, b, c, d, x[ 0], S11, 0xd76aa478); /* 1 */
-    FF (d, a, b, c, x[ 1], S12, 0xe8c7b756); /* 2 */
-    FF (c, d, a, b, x[ 2], S13, 0x242070db); /* 3 */
-    FF (b, c, d, a, x[ 3], S14, 0xc1bdceee); /* 4 */
-    FF (a, b, c, d, x[ 4], S11, 0xf57c0faf); /* 5 */
-    FF (d, a, b, c, x[ 5], S12, 0x4787c62a); /* 6 */
-    FF (c, d, a, b, x[ 6], S13, 0xa8304613); /* 7 */
-    FF (b, c, d, a, x[ 7], S14, 0xfd469501); /* 8 */
-    FF (a, b, c, d, x[ 8], S11, 0x698098d8); /* 9 */
-    FF (d, a, b, c, x[ 9], S12, 0x8b44f7af); /* 10 */
-    FF (c, d, a, b, x[10], S13, 0xffff5bb1); /* 11 */
-    FF (b, c, d, a, x[11], S14, 0x895cd7be); /* 12 */
-    FF (a, b, c, d, x[12], S11, 0x6b901122); /* 13 */
-    FF (d, a, b, c, x[13], S12, 0xfd987193); /* 14 */
-    FF (c, d, a, b, x[14], S13, 0xa679438e); /* 15 */
-    FF (b, c, d, a, x[15], S14, 0x49b40821); /* 16 */
-
-    /* Round 2 */
-    GG (a, b, c, d, x[ 1], S21, 0xf61e2562); /* 17 */
-    GG (d, a, b, c, x[ 6], S22, 0xc040b340); /* 18 */
-    GG (c, d, a, b, x[11], S23, 0x265e5a51); /* 19 */
-    GG (b, c, d, a, x[ 0], S24, 0xe9b6c7aa); /* 20 */
-    GG (a, b, c, d, x[ 5], S21, 0xd62f105d); /* 21 */
-    GG (d, a, b, c, x[10], S22,  0x2441453); /* 22 */
-    GG (c, d, a, b, x[15], S23, 0xd8a1e681); /* 23 */
-    GG (b, c, d, a, x[ 4], S24, 0xe7d3fbc8); /* 24 */
-    GG (a, b, c, d, x[ 9], S21, 0x21e1cde6); /* 25 */
-    GG (d, a, b, c, x[14], S22, 0xc33707d6); /* 26 */
-    GG (c, d, a, b, x[ 3], S23, 0xf4d50d87); /* 27 */
-
-    GG (b, c, d, a, x[ 8], S24, 0x455a14ed); /* 28 */
-    GG (a, b, c, d, x[13], S21, 0xa9e3e905); /* 29 */
-    GG (d, a, b, c, x[ 2], S22, 0xfcefa3f8); /* 30 */
-    GG (c, d, a, b, x[ 7], S23, 0x676f02d9); /* 31 */
-    GG (b, c, d, a, x[12], S24, 0x8d2a4c8a); /* 32 */
-
-    /* Round 3 */
-    HH (a, b, c, d, x[ 5], S31, 0xfffa3942); /* 33 */
-    HH (d, a, b, c, x[ 8], S32, 0x8771f681); /* 34 */
-    HH (c, d, a, b, x[11], S33, 0x6d9d6122); /* 35 */
-    HH (b, c, d, a, x[14], S34, 0xfde5380c); /* 36 */
-    HH (a, b, c, d, x[ 1], S31, 0xa4beea44); /* 37 */
-    HH (d, a, b, c, x[ 4], S32, 0x4bdecfa9); /* 38 */
-    HH (c, d, a, b, x[ 7], S33, 0xf6bb4b60); /* 39 */
-    HH (b, c, d, a, x[10], S34, 0xbebfbc70); /* 40 */
-    HH (a, b, c, d, x[13], S31, 0x289b7ec6); /* 41 */
-    HH (d, a, b, c, x[ 0], S32, 0xeaa127fa); /* 42 */
-    HH (c, d, a, b, x[ 3], S33, 0xd4ef3085); /* 43 */
-    HH (b, c, d, a, x[ 6], S34,  0x4881d05); /* 44 */
-    HH (a, b, c, d, x[ 9], S31, 0xd9d4d039); /* 45 */
-    HH (d, a, b, c, x[12], S32, 0xe6db99e5); /* 46 */
-    HH (c, d, a, b, x[15], S33, 0x1fa27cf8); /* 47 */
-    HH (b, c, d, a, x[ 2], S34, 0xc4ac5665); /* 48 */
-
-    /* Round 4 */
-    II (a, b, c, d, x[ 0], S41, 0xf4292244); /* 49 */
-    II (d, a, b, c, x[ 7], S42, 0x432aff97); /* 50 */
-    II (c, d, a, b, x[14], S43, 0xab9423a7); /* 51 */
-    II (b, c, d, a, x[ 5], S44, 0xfc93a039); /* 52 */
-    II (a, b, c, d, x[12], S41, 0x655b59c3); /* 53 */
-    II (d, a, b, c, x[ 3], S42, 0x8f0ccc92); /* 54 */
-    II (c, d, a, b, x[10], S43, 0xffeff47d); /* 55 */
-    II (b, c, d, a, x[ 1], S44, 0x85845dd1); /* 56 */
-    II (a, b, c, d, x[ 8], S41, 0x6fa87e4f); /* 57 */
-    II (d, a, b, c, x[15], S42, 0xfe2ce6e0); /* 58 */
-    II (c, d, a, b, x[ 6], S43, 0xa3014314); /* 59 */
-    II (b, c, d, a, x[13], S44, 0x4e0811a1); /* 60 */
-    II (a, b, c, d, x[ 4], S41, 0xf7537e82); /* 61 */
-    II (d, a, b, c, x[11], S42, 0xbd3af235); /* 62 */
-    II (c, d, a, b, x[ 2], S43, 0x2ad7d2bb); /* 63 */
-    II (b, c, d, a, x[ 9], S44, 0xeb86d391); /* 64 */
-
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-
-    /*
-    * Zeroize sensitive information.
-    */
-    MD5_memset ((POINTER)x, 0, sizeof (x));
+    if (count == 0)
+        return;
+
+    unsigned int words[4] = {
+        (unsigned int)state[0], (unsigned int)state[1],
+        (unsigned int)state[2], (unsigned int)state[3]
+    };
+    MD5Blocks (words, block, count);
+
+    state[0] = words[0];
+    state[1] = words[1];
+    state[2] = words[2];
+    state[3] = words[3];
 }
 
 /*
@@ -297,39 +334,312 @@ void MD5::Encode (unsigned char *output, unsigned long int *input, unsigned int
 }
 
 /*
-* Decodes input (unsigned char) into output (unsigned long int). Assumes len is
-* a multiple of 4.
+* Multi-buffer MD5
+*
+* Lane i of vector x[k] holds word k of the block of message i, so each
+* SIMD instruction does the same step for all messages. Rotation is
+* emulated with two shifts, as SSE2 and AVX2 have no rotate instruction.
 */
-void MD5::Decode (unsigned long int *output, unsigned char *input, unsigned int len)
+
+/* An all-zero block for idle lanes */
+static const unsigned char ZERO_BLOCK[64] = { 0 };
+
+#ifdef MD5_X86
+
+#define SSE2_F(x, y, z) _mm_xor_si128((z), _mm_and_si128((x), _mm_xor_si128((y), (z))))
+#define SSE2_G(x, y, z) _mm_xor_si128((y), _mm_and_si128((z), _mm_xor_si128((x), (y))))
+#define SSE2_H(x, y, z) _mm_xor_si128(_mm_xor_si128((x), (y)), (z))
+#define SSE2_I(x, y, z) _mm_xor_si128((y), _mm_or_si128((x), _mm_xor_si128((z), ones)))
+
+#define SSE2_STEP(f, a, b, c, d, k, s, t) \
+    (a) = _mm_add_epi32((a), _mm_add_epi32(f((b), (c), (d)), _mm_add_epi32(x[k], _mm_set1_epi32((int)(t))))); \
+    (a) = _mm_add_epi32(_mm_or_si128(_mm_slli_epi32((a), (s)), _mm_srli_epi32((a), 32-(s))), (b));
+
+/* Transposes words w..w+3 of four blocks into x[w]..x[w+3] */
+#define SSE2_TRANSPOSE(p, x, w) { \
+    __m128i r0 = _mm_loadu_si128((const __m128i*)(p[0]) + (w)/4); \
+    __m128i r1 = _mm_loadu_si128((const __m128i*)(p[1]) + (w)/4); \
+    __m128i r2 = _mm_loadu_si128((const __m128i*)(p[2]) + (w)/4); \
+    __m128i r3 = _mm_loadu_si128((const __m128i*)(p[3]) + (w)/4); \
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+    x[(w)+0] = _mm_unpacklo_epi64(t0, t1); \
+    x[(w)+1] = _mm_unpackhi_epi64(t0, t1); \
+    x[(w)+2] = _mm_unpacklo_epi64(t2, t3); \
+    x[(w)+3] = _mm_unpackhi_epi64(t2, t3); }
+
+MD5_TARGET("sse2")
+static void MD5BlocksSSE2(unsigned int state[4][MD5MultiBuffer::MAX_LANES], const unsigned char* apInput[4], size_t count)
 {
-    unsigned int i, j;
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i a = _mm_loadu_si128((const __m128i*)state[0]);
+    __m128i b = _mm_loadu_si128((const __m128i*)state[1]);
+    __m128i c = _mm_loadu_si128((const __m128i*)state[2]);
+    __m128i d = _mm_loadu_si128((const __m128i*)state[3]);
+    const unsigned char* p[4] = { apInput[0], apInput[1], apInput[2], apInput[3] };
+
+    while (count--) {
+        __m128i aa = a, bb = b, cc = c, dd = d;
+        __m128i x[16];
+        SSE2_TRANSPOSE(p, x, 0);
+        SSE2_TRANSPOSE(p, x, 4);
+        SSE2_TRANSPOSE(p, x, 8);
+        SSE2_TRANSPOSE(p, x, 12);
+
+        MD5_STEPS(SSE2_STEP, SSE2_F, SSE2_G, SSE2_H, SSE2_I)
+
+        a = _mm_add_epi32(a, aa);
+        b = _mm_add_epi32(b, bb);
+        c = _mm_add_epi32(c, cc);
+        d = _mm_add_epi32(d, dd);
+
+        int i;
+        for (i = 0; i < 4; i++) {
+            if (p[i] != ZERO_BLOCK)
+                p[i] += 64;
+        }
+    }
 
-    for (i = 0, j = 0; j < len; i++, j += 4)
-        output[i] = ((unsigned long int)input[j]) |
-        (((unsigned long int)input[j+1]) << 8) |
-        (((unsigned long int)input[j+2]) << 16) |
-        (((unsigned long int)input[j+3]) << 24);
+    _mm_storeu_si128((__m128i*)state[0], a);
+    _mm_storeu_si128((__m128i*)state[1], b);
+    _mm_storeu_si128((__m128i*)state[2], c);
+    _mm_storeu_si128((__m128i*)state[3], d);
 }
 
-/*
-* Note: Replace "for loop" with standard memcpy if possible.
-*/
-void MD5::MD5_memcpy (POINTER output, POINTER input, unsigned int len)
+#ifdef MD5_AVX2
+
+#define AVX2_F(x, y, z) _mm256_xor_si256((z), _mm256_and_si256((x), _mm256_xor_si256((y), (z))))
+#define AVX2_G(x, y, z) _mm256_xor_si256((y), _mm256_and_si256((z), _mm256_xor_si256((x), (y))))
+#define AVX2_H(x, y, z) _mm256_xor_si256(_mm256_xor_si256((x), (y)), (z))
+#define AVX2_I(x, y, z) _mm256_xor_si256((y), _mm256_or_si256((x), _mm256_xor_si256((z), ones)))
+
+#define AVX2_STEP(f, a, b, c, d, k, s, t) \
+    (a) = _mm256_add_epi32((a), _mm256_add_epi32(f((b), (c), (d)), _mm256_add_epi32(x[k], _mm256_set1_epi32((int)(t))))); \
+    (a) = _mm256_add_epi32(_mm256_or_si256(_mm256_slli_epi32((a), (s)), _mm256_srli_epi32((a), 32-(s))), (b));
+
+/* Transposes words w..w+7 of eight blocks into x[w]..x[w+7] */
+#define AVX2_TRANSPOSE(p, x, w) { \
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)(p[0]) + (w)/8); \
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(p[1]) + (w)/8); \
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(p[2]) + (w)/8); \
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(p[3]) + (w)/8); \
+    __m256i r4 = _mm256_loadu_si256((const __m256i*)(p[4]) + (w)/8); \
+    __m256i r5 = _mm256_loadu_si256((const __m256i*)(p[5]) + (w)/8); \
+    __m256i r6 = _mm256_loadu_si256((const __m256i*)(p[6]) + (w)/8); \
+    __m256i r7 = _mm256_loadu_si256((const __m256i*)(p[7]) + (w)/8); \
+    __m256i t0 = _mm256_unpacklo_epi32(r0, r1); \
+    __m256i t1 = _mm256_unpackhi_epi32(r0, r1); \
+    __m256i t2 = _mm256_unpacklo_epi32(r2, r3); \
+    __m256i t3 = _mm256_unpackhi_epi32(r2, r3); \
+    __m256i t4 = _mm256_unpacklo_epi32(r4, r5); \
+    __m256i t5 = _mm256_unpackhi_epi32(r4, r5); \
+    __m256i t6 = _mm256_unpacklo_epi32(r6, r7); \
+    __m256i t7 = _mm256_unpackhi_epi32(r6, r7); \
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2); \
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2); \
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3); \
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3); \
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6); \
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6); \
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7); \
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7); \
+    x[(w)+0] = _mm256_permute2x128_si256(u0, u4, 0x20); \
+    x[(w)+1] = _mm256_permute2x128_si256(u1, u5, 0x20); \
+    x[(w)+2] = _mm256_permute2x128_si256(u2, u6, 0x20); \
+    x[(w)+3] = _mm256_permute2x128_si256(u3, u7, 0x20); \
+    x[(w)+4] = _mm256_permute2x128_si256(u0, u4, 0x31); \
+    x[(w)+5] = _mm256_permute2x128_si256(u1, u5, 0x31); \
+    x[(w)+6] = _mm256_permute2x128_si256(u2, u6, 0x31); \
+    x[(w)+7] = _mm256_permute2x128_si256(u3, u7, 0x31); }
+
+MD5_TARGET("avx2")
+static void MD5BlocksAVX2(unsigned int state[4][MD5MultiBuffer::MAX_LANES], const unsigned char* apInput[8], size_t count)
 {
-    unsigned int i;
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i a = _mm256_loadu_si256((const __m256i*)state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i*)state[1]);
+    __m256i c = _mm256_loadu_si256((const __m256i*)state[2]);
+    __m256i d = _mm256_loadu_si256((const __m256i*)state[3]);
+    const unsigned char* p[8];
+    int i;
+    for (i = 0; i < 8; i++)
+        p[i] = apInput[i];
+
+    while (count--) {
+        __m256i aa = a, bb = b, cc = c, dd = d;
+        __m256i x[16];
+        AVX2_TRANSPOSE(p, x, 0);
+        AVX2_TRANSPOSE(p, x, 8);
+
+        MD5_STEPS(AVX2_STEP, AVX2_F, AVX2_G, AVX2_H, AVX2_I)
+
+        a = _mm256_add_epi32(a, aa);
+        b = _mm256_add_epi32(b, bb);
+        c = _mm256_add_epi32(c, cc);
+        d = _mm256_add_epi32(d, dd);
+
+        for (i = 0; i < 8; i++) {
+            if (p[i] != ZERO_BLOCK)
+                p[i] += 64;
+        }
+    }
 
-    for (i = 0; i < len; i++)
-        output[i] = input[i];
+    _mm256_storeu_si256((__m256i*)state[0], a);
+    _mm256_storeu_si256((__m256i*)state[1], b);
+    _mm256_storeu_si256((__m256i*)state[2], c);
+    _mm256_storeu_si256((__m256i*)state[3], d);
 }
 
-/*
-* Note: Replace "for loop" with standard memset if possible.
-*/
-void MD5::MD5_memset (POINTER output,int value,unsigned int len)
+#endif // MD5_AVX2
+
+/* Returns the count of lanes the CPU and the OS support: 8, 4 or 1 */
+static int DetectLaneCount()
+{
+    int info[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+#else
+    unsigned int max_leaf = __get_cpuid_max(0, 0);
+    if (max_leaf >= 1)
+        __cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+    if (max_leaf < 1 || !(info[3] & (1 << 26)))
+        return 1; // No SSE2
+
+#ifdef MD5_AVX2
+    /* AVX registers must be saved by the OS (OSXSAVE and AVX bits, then XCR0) */
+    if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && max_leaf >= 7) {
+        unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+        xcr0 = _xgetbv(0);
+#else
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        xcr0 = ((unsigned long long)xcr0_hi << 32) | xcr0_lo;
+#endif
+        int info7[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+        __cpuidex(info7, 7, 0);
+#else
+        __cpuid_count(7, 0, info7[0], info7[1], info7[2], info7[3]);
+#endif
+        if ((xcr0 & 6) == 6 && (info7[1] & (1 << 5)))
+            return 8;
+    }
+#endif
+
+    return 4;
+}
+
+#else
+
+static int DetectLaneCount()
+{
+    return 1;
+}
+
+#endif // MD5_X86
+
+MD5MultiBuffer::MD5MultiBuffer(int nMaxLanes)
+{
+    m_nLanes = DetectLaneCount();
+    while (m_nLanes > 1 && m_nLanes > nMaxLanes)
+        m_nLanes /= 2;
+    if (m_nLanes == 2)
+        m_nLanes = 1; // There is no 2-lane code
+
+    int i;
+    for (i = 0; i < MAX_LANES; i++)
+        Init(i);
+}
+
+int MD5MultiBuffer::GetLaneCount() const
+{
+    return m_nLanes;
+}
+
+void MD5MultiBuffer::Init(int nLane)
+{
+    m_State[0][nLane] = 0x67452301;
+    m_State[1][nLane] = 0xefcdab89;
+    m_State[2][nLane] = 0x98badcfe;
+    m_State[3][nLane] = 0x10325476;
+    m_Length[nLane] = 0;
+}
+
+void MD5MultiBuffer::Update(const unsigned char* const apInput[], size_t nBlocks)
+{
+    const unsigned char* p[MAX_LANES];
+    int i;
+    for (i = 0; i < m_nLanes; i++) {
+        p[i] = apInput[i] != NULL ? apInput[i] : ZERO_BLOCK;
+        if (apInput[i] != NULL)
+            m_Length[i] += nBlocks * BLOCK_SIZE;
+    }
+
+#ifdef MD5_X86
+    if (m_nLanes > 1) {
+        /* Idle lanes hash zero blocks; keep their state */
+        unsigned int saved[4][MAX_LANES];
+        memcpy(saved, m_State, sizeof(saved));
+
+#ifdef MD5_AVX2
+        if (m_nLanes == 8)
+            MD5BlocksAVX2(m_State, p, nBlocks);
+#endif
+        if (m_nLanes == 4)
+            MD5BlocksSSE2(m_State, p, nBlocks);
+
+        for (i = 0; i < m_nLanes; i++) {
+            if (apInput[i] == NULL) {
+                int j;
+                for (j = 0; j < 4; j++)
+                    m_State[j][i] = saved[j][i];
+            }
+        }
+        return;
+    }
+#endif
+
+    unsigned int state[4] = { m_State[0][0], m_State[1][0], m_State[2][0], m_State[3][0] };
+    if (apInput[0] != NULL)
+        MD5Blocks(state, p[0], nBlocks);
+    m_State[0][0] = state[0];
+    m_State[1][0] = state[1];
+    m_State[2][0] = state[2];
+    m_State[3][0] = state[3];
+}
+
+void MD5MultiBuffer::Final(int nLane, const unsigned char* pInput, size_t nLen, unsigned char digest[16])
 {
-    unsigned int i;
-    for (i = 0; i < len; i++)
-        ((char *)output)[i] = (char)value;
+    unsigned int state[4] = {
+        m_State[0][nLane], m_State[1][nLane], m_State[2][nLane], m_State[3][nLane]
+    };
+    unsigned long long uBits = (m_Length[nLane] + nLen) * 8;
+
+    /* The rest is hashed by scalar code */
+    MD5Blocks(state, pInput, nLen / 64);
+    pInput += nLen / 64 * 64;
+    nLen %= 64;
+
+    /* Pad out to 56 mod 64 and append length */
+    unsigned char block[128];
+    memcpy(block, pInput, nLen);
+    size_t nPadded = nLen < 56 ? 64 : 128;
+    memcpy(block + nLen, PADDING, nPadded - 8 - nLen);
+    int i;
+    for (i = 0; i < 8; i++)
+        block[nPadded - 8 + i] = (unsigned char)(uBits >> (i * 8));
+    MD5Blocks(state, block, nPadded / 64);
+
+    for (i = 0; i < 16; i++)
+        digest[i] = (unsigned char)(state[i / 4] >> ((i % 4) * 8));
+
+    Init(nLane);
 }
 
 /*
@@ -72,11 +72,8 @@ class MD5
 
 	private:
 
-		void MD5Transform (unsigned long int state[4], unsigned char block[64]);
+		void MD5Transform (unsigned long int state[4], const unsigned char* block, size_t count);
 		void Encode (unsigned char*, unsigned long int*, unsigned int);
-		void Decode (unsigned long int*, unsigned char*, unsigned int);
-		void MD5_memcpy (POINTER, POINTER, unsigned int);
-		void MD5_memset (POINTER, int, unsigned int);
 
 	public:
 
@@ -87,6 +84,47 @@ class MD5
 	MD5(){};
 };
 
+/*
+ * Multi-buffer MD5. Hashes several independent messages at once, each
+ * in its own SIMD lane: 8 with AVX2, 4 with SSE2. Messages are fed in
+ * whole blocks of 64 bytes, the same count of blocks to every lane, so
+ * it pays off for a batch of files read in equal chunks.
+ */
+class MD5MultiBuffer
+{
+	public:
+
+		enum { MAX_LANES = 8, BLOCK_SIZE = 64 };
+
+		/* Uses as many lanes as the CPU supports, up to nMaxLanes (1, 4 or 8). */
+		MD5MultiBuffer(int nMaxLanes = MAX_LANES);
+
+		/* Returns the count of lanes. */
+		int GetLaneCount() const;
+
+		/* Starts a new message in the lane. */
+		void Init(int nLane);
+
+		/*
+		 * Hashes nBlocks blocks of each lane. apInput[lane] points to
+		 * nBlocks*BLOCK_SIZE bytes of the lane's message, or is NULL if
+		 * the lane has nothing to add this time.
+		 */
+		void Update(const unsigned char* const apInput[], size_t nBlocks);
+
+		/*
+		 * Hashes the rest of the lane's message (of any length) and
+		 * writes its digest. The lane may be given a new message then.
+		 */
+		void Final(int nLane, const unsigned char* pInput, size_t nLen, unsigned char digest[16]);
+
+	private:
+
+		int m_nLanes;                                  /* Count of lanes in use */
+		unsigned int m_State[4][MAX_LANES];            /* State (ABCD) of each lane, word by word */
+		unsigned long long m_Length[MAX_LANES];        /* Bytes hashed in each lane */
+};
+
 //----------------------------------------------------------------------
 //End of include protection
 #endif
@@ -19,6 +19,9 @@ be found in the Authors.txt file in the root of the source tree.
 #include "strconv.h"
 #include "Base64.h"
 
+// Size of message body chunks (one BDAT command each).
+const size_t BODY_CHUNK_SIZE = 1024*1024;
+
 //----------------------------------------------------------
 // CEmailMessage impl
 //----------------------------------------------------------
@@ -146,6 +149,10 @@ CSmtpClient::CSmtpClient()
 
 	m_scn = NULL;
 	m_msg = NULL;
+
+	m_bPipelining = false;
+	m_bChunking = false;
+	m_nPendingReplies = 0;
 }
 
 CSmtpClient::~CSmtpClient()
@@ -173,6 +180,12 @@ int CSmtpClient::SetAuthParams(LPCTSTR szLogin, LPCTSTR szPassword)
 	return 0;
 }
 
+void CSmtpClient::SetMxCacheFile(LPCTSTR szINIFile)
+{
+	// Save the INI file name
+	m_sMxCacheFile = szINIFile;
+}
+
 int CSmtpClient::SendEmailAssync(CEmailMessage* msg,  AssyncNotification* scn)
 {
 	// This method starts worker thread that will send the E-mail in
@@ -205,61 +218,187 @@ int CSmtpClient::SendEmail(CEmailMessage* msg)
 {
 	m_scn->SetProgress(_T("Start sending email"), 0, false);
 
-    std::map<WORD, CString> host_list;
+	// Find out through which SMTP server(s) each recipient is reached.
+    std::vector<SmtpRoute> aRoutes;
+    int res = GroupRecipientsByServer(msg, aRoutes);
+    if(res!=0)
+    {
+        m_scn->SetProgress(_T("Error querying DNS record."), 100, false);
+        return 1;
+    }
 
-	// Check whether to use proxy server or to resolve SMTP server
-	// address from MX record of domain.
-    if(!m_sServer.IsEmpty())
+    if(aRoutes.empty())
     {
-		// Use proxy server
-        host_list[0] = m_sServer;
+        m_scn->SetProgress(_T("No recipients."), 100, false);
+        return 1;
     }
-    else
+
+	// Send E-mail once per route, to all its recipients.
+    size_t nDelivered = 0;
+    CString sMsg;
+    size_t nRoute;
+    for(nRoute=0; nRoute<aRoutes.size(); nRoute++)
     {
-		// Resolve domain name(s) from DNS record
-		int res = ResolveSmtpServerName(msg->GetRecipientAddress(0), host_list);
+        SmtpRoute& route = aRoutes[nRoute];
+        res = 1;
+
+		// For each SMTP server of the route, try to send E-mail until it succeeds.
+        size_t nHost;
+        size_t nDomain;
+        for(nHost=0; nHost<route.m_aHosts.size(); nHost++)
+        {
+			// Check if operation cancelled by user
+            if(m_scn->IsCancelled())
+                return 2;
+
+			// Send E-mail to current SMTP server
+            res = SendEmailToRecipient(route.m_aHosts[nHost], msg, route.m_aRecipients);
+            if(res==0)
+            {
+				// Succeeded, try this server first next time
+                for(nDomain=0; nDomain<route.m_aDomains.size(); nDomain++)
+                    CacheLastMxHost(route.m_aDomains[nDomain], route.m_aHosts[nHost]);
+                break;
+            }
+
+            if(res==2)
+            {
+				// Failure
+                m_scn->SetProgress(_T("Critical error detected."), 100, false);
+                return 2;
+            }
+        }
+
         if(res!=0)
         {
-            m_scn->SetProgress(_T("Error querying DNS record."), 100, false);
-            return 1;
+			// Name the recipients who haven't got the E-mail
+            CString sRecipients;
+            size_t nRecipient;
+            for(nRecipient=0; nRecipient<route.m_aRecipients.size(); nRecipient++)
+            {
+                if(nRecipient!=0)
+                    sRecipients += _T(", ");
+                sRecipients += route.m_aRecipients[nRecipient];
+            }
+            sMsg.Format(_T("Couldn't send email to %s."), (LPCTSTR)sRecipients);
+            m_scn->SetProgress(sMsg, 0, false);
+
+			// Cached MX records may be stale, resolve them again next time
+            for(nDomain=0; nDomain<route.m_aDomains.size(); nDomain++)
+                CacheMx(route.m_aDomains[nDomain], std::map<WORD, CString>(), 0);
         }
+        else
+            nDelivered++;
     }
 
-	// For each resolved domain name of SMTP server, try to send E-mail to the specified domain.
-    std::map<WORD, CString>::iterator it;
-    for(it=host_list.begin(); it!=host_list.end(); it++)
+    if(nDelivered==0)
     {
-		// Check if operation cancelled by user
-        if(m_scn->IsCancelled())
-            return 2;
+		// Failed to send E-mail to anyone
+        m_scn->SetProgress(_T("Error sending email."), 100, false);
+        return 1;
+    }
 
-		// Send E-mail to current SMTP server
-        int res = SendEmailToRecipient(it->second, msg);
-        if(res==0)
-        {
-			// Succeeded
-            m_scn->SetProgress(_T("Finished OK."), 100, false);
-            return 0;
-        }
-        if(res==2)
+    if(nDelivered<aRoutes.size())
+    {
+		// Some recipients have got the report already. Retrying would send it
+		// to them again, so the delivery is reported as succeeded.
+        sMsg.Format(_T("Email was sent through %d of %d routes."), (int)nDelivered, (int)aRoutes.size());
+        m_scn->SetProgress(sMsg, 100, false);
+        return 0;
+    }
+
+	// Succeeded
+    m_scn->SetProgress(_T("Finished OK."), 100, false);
+    return 0;
+}
+
+int CSmtpClient::GroupRecipientsByServer(CEmailMessage* msg, std::vector<SmtpRoute>& aRoutes)
+{
+    aRoutes.clear();
+
+    int i;
+
+	// Check whether to use proxy server or to resolve SMTP server
+	// address from MX record of domain.
+    if(!m_sServer.IsEmpty())
+    {
+		// Use proxy server for all recipients
+        SmtpRoute route;
+        route.m_aHosts.push_back(m_sServer);
+        for(i=0; i<msg->GetRecipientCount(); i++)
+            route.m_aRecipients.push_back(msg->GetRecipientAddress(i));
+        if(!route.m_aRecipients.empty())
+            aRoutes.push_back(route);
+        return 0;
+    }
+
+	// Resolve domain name(s) from DNS record (or take them from cache), once
+	// per domain. Domains which have the same most preferred MX host (e.g.
+	// hosted by the same provider) share a route.
+    std::map<CString, size_t> aRouteByDomain;
+    std::map<CString, size_t> aRouteByHost;
+    for(i=0; i<msg->GetRecipientCount(); i++)
+    {
+        CString sAddress = msg->GetRecipientAddress(i);
+        CString sDomain = sAddress.Mid(sAddress.Find('@')+1);
+        sDomain.MakeLower();
+
+        std::map<CString, size_t>::iterator it = aRouteByDomain.find(sDomain);
+        if(it==aRouteByDomain.end())
         {
-			// Failure
-            m_scn->SetProgress(_T("Critical error detected."), 100, false);
-            return 2;
+            std::map<WORD, CString> host_list;
+            CString sLastHost;
+            if(!GetCachedMx(sDomain, host_list, sLastHost))
+            {
+                DWORD dwTtl = 0;
+                int res = ResolveSmtpServerName(sAddress, host_list, dwTtl);
+                if(res!=0)
+                    return 1;
+
+                CacheMx(sDomain, host_list, dwTtl);
+            }
+
+            CString sHost = host_list.empty() ? sDomain : host_list.begin()->second;
+            sHost.MakeLower();
+
+            std::map<CString, size_t>::iterator itHost = aRouteByHost.find(sHost);
+            if(itHost==aRouteByHost.end())
+            {
+				// The host which accepted mail last time goes first, the rest by preference
+                SmtpRoute route;
+                std::map<WORD, CString>::iterator itList;
+                for(itList=host_list.begin(); itList!=host_list.end(); itList++)
+                {
+                    if(itList->second.CompareNoCase(sLastHost)==0)
+                        route.m_aHosts.push_back(itList->second);
+                }
+                for(itList=host_list.begin(); itList!=host_list.end(); itList++)
+                {
+                    if(itList->second.CompareNoCase(sLastHost)!=0)
+                        route.m_aHosts.push_back(itList->second);
+                }
+                aRoutes.push_back(route);
+                itHost = aRouteByHost.insert(std::make_pair(sHost, aRoutes.size()-1)).first;
+            }
+
+            aRoutes[itHost->second].m_aDomains.push_back(sDomain);
+            it = aRouteByDomain.insert(std::make_pair(sDomain, itHost->second)).first;
         }
+
+        aRoutes[it->second].m_aRecipients.push_back(sAddress);
     }
 
-	// Failed to send E-mail
-    m_scn->SetProgress(_T("Error sending email."), 100, false);
-    return 1;
+    return 0;
 }
 
 
-int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list)
+int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list, DWORD& dwTtl)
 {
 	// This methods takes an E-mail address and resolve the domain name(s)
 	// associated with this address.
 
+    dwTtl = 0;
+
     DNS_RECORD *apResult = NULL;
 
 	// Convert to CString
@@ -291,6 +430,10 @@ int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CS
 				// Save domain name to our list
                 CString sServerName = CString(apResult->Data.MX.pNameExchange);
                 host_list[apResult->Data.MX.wPreference] = sServerName;
+
+				// The list may be cached until the first record expires
+                if(dwTtl==0 || apResult->dwTtl<dwTtl)
+                    dwTtl = apResult->dwTtl;
             }
 
 			// Next record
@@ -311,10 +454,91 @@ int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CS
 }
 
 
-int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
+BOOL CSmtpClient::GetCachedMx(LPCTSTR szDomain, std::map<WORD, CString>& host_list, CString& sLastHost)
+{
+	// Cache entry looks like "1766150000;10 mx1.company.tld;20 mx2.company.tld",
+	// where the number is the time the entry expires at. The host which accepted
+	// mail last time is stored separately, it outlives the entry.
+
+    host_list.clear();
+    sLastHost.Empty();
+
+    if(m_sMxCacheFile.IsEmpty())
+        return FALSE; // No cache
+
+    CString sLastHostKey = CString(szDomain) + _T(".LastHost");
+    sLastHost = Utility::GetINIString(m_sMxCacheFile, _T("MXCache"), sLastHostKey);
+
+    CString sEntry = Utility::GetINIString(m_sMxCacheFile, _T("MXCache"), szDomain);
+    std::vector<CString> aTokens = Utility::ExplodeStr(sEntry, _T(";"));
+    if(aTokens.size()<2)
+        return FALSE; // Not cached
+
+    __time64_t tExpires = _ttoi64(aTokens[0]);
+    if(tExpires<=_time64(NULL))
+        return FALSE; // Expired
+
+    size_t i;
+    for(i=1; i<aTokens.size(); i++)
+    {
+        int nSpace = aTokens[i].Find(' ');
+        if(nSpace<=0)
+        {
+            host_list.clear();
+            return FALSE; // Damaged entry
+        }
+
+        host_list[(WORD)_ttoi(aTokens[i].Left(nSpace))] = aTokens[i].Mid(nSpace+1);
+    }
+
+	// Add a message to log
+    CString sStatusMsg;
+    sStatusMsg.Format(_T("Using cached MX record of domain %s"), szDomain);
+    m_scn->SetProgress(sStatusMsg, 2);
+
+    return TRUE;
+}
+
+void CSmtpClient::CacheMx(LPCTSTR szDomain, const std::map<WORD, CString>& host_list, DWORD dwTtl)
+{
+    if(m_sMxCacheFile.IsEmpty())
+        return; // No cache
+
+    if(dwTtl==0 || host_list.empty())
+    {
+		// Remove the entry
+        Utility::SetINIString(m_sMxCacheFile, _T("MXCache"), szDomain, NULL);
+        return;
+    }
+
+    CString sEntry;
+    sEntry.Format(_T("%I64d"), _time64(NULL)+dwTtl);
+
+    std::map<WORD, CString>::const_iterator it;
+    for(it=host_list.begin(); it!=host_list.end(); it++)
+    {
+        CString sHost;
+        sHost.Format(_T(";%u %s"), (unsigned)it->first, (LPCTSTR)it->second);
+        sEntry += sHost;
+    }
+
+    Utility::SetINIString(m_sMxCacheFile, _T("MXCache"), szDomain, sEntry);
+}
+
+void CSmtpClient::CacheLastMxHost(LPCTSTR szDomain, LPCTSTR szHost)
+{
+    if(m_sMxCacheFile.IsEmpty())
+        return; // No cache
+
+    CString sLastHostKey = CString(szDomain) + _T(".LastHost");
+    Utility::SetINIString(m_sMxCacheFile, _T("MXCache"), sLastHostKey, szHost);
+}
+
+int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg,
+	const std::vector<CString>& aRecipients)
 {
 	// This method connects to the given SMTP server and tries to send
-	// the E-mail message.
+	// the E-mail message to the given recipients in one session.
 
     int status = 1; // Resulting status.
     strconv_t strconv; // String convertor
@@ -334,8 +558,13 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 	const int RESPONSE_BUFF_SIZE = 4096;
 	char response[RESPONSE_BUFF_SIZE];
 	int res = SOCKET_ERROR;
-    std::string sEncodedFileData;
 	bool bESMTP = false;
+	std::string sReply;
+	std::vector<std::string> aCommands;
+	std::vector<int> aExpectedCodes;
+	LPCSTR lpszData = NULL;
+	BOOL bNoDelay = TRUE;
+	size_t nRecipient = 0;
 
 	// Convert port number to string
     sServiceName.Format(_T("%d"),
@@ -421,6 +650,18 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 	// Add a message to log
     sStatusMsg.Format(_T("Connected OK."));
     m_scn->SetProgress(sStatusMsg, 5);
+    m_scn->SetConnected();
+
+	// Commands are sent as soon as they are ready, they are not held back
+	// until the replies to the previous ones arrive
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&bNoDelay, sizeof(bNoDelay));
+
+	// New session
+    m_bPipelining = false;
+    m_bChunking = false;
+    m_sInput.clear();
+    m_sBody.clear();
+    m_nPendingReplies = 0;
 
 	// Check cancel status
     if(m_scn->IsCancelled()) {status = 2; goto exit;}
@@ -450,12 +691,18 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
     sStatusMsg.Format(_T("Sending EHLO"));
     m_scn->SetProgress(sStatusMsg, 1);
 
-    res=SendMsg(sock, _T("EHLO CrashSender\r\n"), response, RESPONSE_BUFF_SIZE);
+	// The reply lists supported service extensions, for example:
+	// 250-mail.company.tld
+	// 250-PIPELINING
+	// 250 CHUNKING
+    lpszData = "EHLO CrashSender\r\n";
+    res = SendData(sock, lpszData, (int)strlen(lpszData))==0 ? ReadReply(sock, sReply) : -1;
 	// Check return code (expect code 250)
     if(res==250)
     {
-		sStatusMsg = CString(_T("EHLO command not supported"));
 		bESMTP = true;
+		m_bPipelining = HasExtension(sReply, "PIPELINING");
+		m_bChunking = HasExtension(sReply, "CHUNKING");
 	}
 
 	if(!bESMTP)
@@ -540,43 +787,43 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
     sStatusMsg.Format(_T("Sending sender and recipient information"));
     m_scn->SetProgress(sStatusMsg, 1);
 
-	// Send MAIL FROM
+	// MAIL FROM, RCPT TO for each recipient, and DATA unless BDAT is used.
+	// These may be pipelined.
 	sMsg.Format(_T("MAIL FROM:<%s>\r\n"), (LPCTSTR) msg->GetSenderAddress());
-    res=SendMsg(sock, sMsg, response, RESPONSE_BUFF_SIZE);
-	if (res!=250)
+	aCommands.push_back(strconv.t2a(sMsg));
+	aExpectedCodes.push_back(250);
+
+	for(nRecipient=0; nRecipient<aRecipients.size(); nRecipient++)
+	{
+		sMsg.Format(_T("RCPT TO:<%s>\r\n"), (LPCTSTR) aRecipients[nRecipient]);
+		aCommands.push_back(strconv.t2a(sMsg));
+		aExpectedCodes.push_back(250);
+	}
+
+	if(!m_bChunking)
+	{
+		aCommands.push_back("DATA\r\n");
+		aExpectedCodes.push_back(354);
+	}
+
+    if(0!=SendCommands(sock, aCommands, aExpectedCodes))
 	{
         sStatusMsg = _T("Unexpected status code");
         m_scn->SetProgress(sStatusMsg, 0);
         goto exit;
     }
 
-	// Process multiple e-mail recipients.
+    sStatusMsg.Format(_T("Start sending email data"));
+    m_scn->SetProgress(sStatusMsg, 1);
+
+	// "To:" and "Cc:" lines list all recipients of the message,
+	// including those delivered in other sessions.
 	for(i=0; i<msg->GetRecipientCount(); i++)
 	{
 		sMsg.Format(i==0 ? _T("To: <%s>\r\n") : _T("Cc: <%s>\r\n"), (LPCTSTR) msg->GetRecipientAddress(i));
 		sBodyTo += sMsg;
-		sMsg.Format(_T("RCPT TO:<%s>\r\n"), (LPCTSTR) msg->GetRecipientAddress(i));
-		res=SendMsg(sock, sMsg, response, RESPONSE_BUFF_SIZE);
-		if(res!=250)
-		{
-			sStatusMsg = _T("Unexpected status code");
-			m_scn->SetProgress(sStatusMsg, 0);
-			goto exit;
-		}
 	}
 
-    sStatusMsg.Format(_T("Start sending email data"));
-    m_scn->SetProgress(sStatusMsg, 1);
-
-    // Send DATA
-    res=SendMsg(sock, _T("DATA\r\n"), response, RESPONSE_BUFF_SIZE);
-	if (res!=354)
-	{
-        sStatusMsg = _T("Unexpected status code");
-        m_scn->SetProgress(sStatusMsg, 0);
-        goto exit;
-    }
-
     // Get current time
     time_t cur_time;
     time(&cur_time);
@@ -611,8 +858,8 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 	// Send Content-Type
     sMsg += "Content-Type: multipart/mixed; boundary=KkK170891tpbkKk__FV_KKKkkkjjwq\r\n";
     sMsg += "\r\n\r\n";
-    res = SendMsg(sock, sMsg);
-    if(res!=sMsg.GetLength())
+    lpszData = strconv.t2a(sMsg);
+    if(0!=SendBody(sock, lpszData, strlen(lpszData)))
         goto exit;
 
     /* Message text */
@@ -625,8 +872,8 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
     sMsg += "\r\n";
     sMsg += sUTF8Text.c_str();
     sMsg += "\r\n";
-    res = SendMsg(sock, sMsg);
-    if(res!=sMsg.GetLength())
+    lpszData = strconv.t2a(sMsg);
+    if(0!=SendBody(sock, lpszData, strlen(lpszData)))
         goto exit;
 
     sStatusMsg.Format(_T("Sending attachments"));
@@ -647,44 +894,40 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         sMsg += sDisplayName;
         sMsg += "\"\r\n";
         sMsg += "\r\n";
-        res = SendMsg(sock, sMsg);
-        if(res!=sMsg.GetLength())
+        lpszData = strconv.t2a(sMsg);
+        if(0!=SendBody(sock, lpszData, strlen(lpszData)))
             goto exit;
 
-        // Encode data
-        LPBYTE buf = NULL;
-        //int buf_len = 0;
-        int nEncode=Base64EncodeAttachment(sFileName, sEncodedFileData);
+        // Encode and send data
+        int nEncode=SendBase64Attachment(sock, sFileName);
         if(nEncode!=0)
         {
             sStatusMsg.Format(_T("Error BASE64-encoding attachment %s"), (LPCTSTR) sFileName);
             m_scn->SetProgress(sStatusMsg, 1);
             goto exit;
         }
-
-        // Send encoded data
-        sMsg = sEncodedFileData.c_str();
-        res = SendMsg(sock, sMsg);
-        if(res!=sMsg.GetLength())
-            goto exit;
-
-        delete [] buf;
     }
 
     sMsg =  "\r\n--KkK170891tpbkKk__FV_KKKkkkjjwq--";
-    res = SendMsg(sock, sMsg);
-    if(res!=sMsg.GetLength())
+    lpszData = strconv.t2a(sMsg);
+    if(0!=SendBody(sock, lpszData, strlen(lpszData)))
         goto exit;
 
-    // End of message marker
-    res = SendMsg(sock, _T("\r\n.\r\n"), response, RESPONSE_BUFF_SIZE);
-	if (res!=250)
-	{
+    // Send the rest of the message: the last BDAT chunk, or the data
+    // followed by the end of message marker
+    if(0!=FlushBody(sock, true))
         goto exit;
-    }
 
-    // Quit
-    res = SendMsg(sock, _T("QUIT\r\n"), response, RESPONSE_BUFF_SIZE);
+    // Quit. With PIPELINING, QUIT doesn't wait until the message is accepted.
+    if(m_bPipelining)
+    {
+        lpszData = "QUIT\r\n";
+        if(0!=SendData(sock, lpszData, (int)strlen(lpszData)) || 0!=ReadPendingReplies(sock))
+            goto exit;
+        res = ReadReply(sock, sReply);
+    }
+    else
+        res = SendMsg(sock, _T("QUIT\r\n"), response, RESPONSE_BUFF_SIZE);
 	// Expect code 221
 	if(res!=221)
 	{
@@ -789,59 +1032,139 @@ int CSmtpClient::SendMsg(SOCKET sock, LPCTSTR pszMessage, LPSTR pszResponse, UIN
 
 	if(pszMessage!=NULL)
 	{
-		// Determine message length.
-	    int msg_len = (int)_tcslen(pszMessage);
-
 		// Convert message to ASCII
 		LPCSTR lpszMessageA = strconv.t2a((TCHAR*)pszMessage);
 
+		// Determine message length.
+	    int msg_len = (int)strlen(lpszMessageA);
+
 		// Send the message
-		int res = send(sock, lpszMessageA, msg_len, 0);
-		if(res == SOCKET_ERROR)
-		{
-			ATLASSERT(0);
-			CString sMsg;
-			sMsg.Format(_T("Send error: %d"), res);
-			m_scn->SetProgress(sMsg, 0);
-
-			// Print last socket error message
-			CString sLastSocketError;
-			//sLastSocketError.FormatMessage(WSAGetLastError());
-			m_scn->SetProgress(sLastSocketError, 0);
-		}
+		if(0!=SendData(sock, lpszMessageA, msg_len))
+			return SOCKET_ERROR;
 
 		// Check if the caller wants to get response
 		if(pszResponse==NULL)
-			return res; // Return now
+			return msg_len; // Return now
 	}
 
+	// Read response
+	std::string sReply;
+	int nStatusCode = ReadReply(sock, sReply);
+	if(pszResponse!=NULL && uResponseSize>0)
+	{
+		size_t nLen = min(sReply.size(), (size_t)uResponseSize-1);
+		memcpy(pszResponse, sReply.data(), nLen);
+		pszResponse[nLen] = 0;
+	}
+
+	return nStatusCode;
+}
+
+int CSmtpClient::ReadReply(SOCKET sock, std::string& sReply)
+{
+	// Reply consists of lines like "250-PIPELINING", the last line has
+	// a space after the code: "250 OK".
+
+    sReply.clear();
+
 	for(;;)
 	{
-		// Read response
-		memset(pszResponse, 0, uResponseSize);
-		int br = recv(sock, pszResponse, uResponseSize, 0);
-		// Check result
-		if(br==SOCKET_ERROR)
+		size_t nEnd = m_sInput.find('\n');
+		if(nEnd==std::string::npos)
 		{
-			m_scn->SetProgress(_T("Receive error"), 0);
-			return br; // Failed
+			// Check if cancelled
+			if(m_scn->IsCancelled())
+				return -1;
+
+			// Need more data
+			char buf[4096];
+			int br = recv(sock, buf, sizeof(buf), 0);
+			if(br==SOCKET_ERROR || br==0)
+			{
+				m_scn->SetProgress(_T("Receive error"), 0);
+				return -1; // Failed
+			}
+
+			m_sInput.append(buf, br);
+			continue;
 		}
 
-		// Add a message to log
-		CString sStatusMsg = CString(pszResponse);
-		m_scn->SetProgress(sStatusMsg, 0);
+		std::string sLine = m_sInput.substr(0, nEnd+1);
+		m_sInput.erase(0, nEnd+1);
+		sReply += sLine;
 
-		// Determine status returned
-		int nStatusCode = GetMessageCode(pszResponse);
-		if(nStatusCode==-1)
-			continue; // Intermediate result
-		else if(nStatusCode==-2)
+		// Check message format is valid
+		if(sLine.size()<4 || !isdigit((unsigned char)sLine[0]) ||
+		   !isdigit((unsigned char)sLine[1]) || !isdigit((unsigned char)sLine[2]))
 			return -1; // Invalid response format
-		else
-			return nStatusCode; // Ready
+
+		if(sLine[3]=='-')
+			continue; // Intermediate result
+
+		// Add a message to log
+		m_scn->SetProgress(CString(sReply.c_str()), 0);
+
+		// Extract the number
+		return atoi(sLine.c_str());
 	}
 }
 
+int CSmtpClient::SendCommands(SOCKET sock, const std::vector<std::string>& aCommands,
+	const std::vector<int>& aExpectedCodes)
+{
+    std::string sReply;
+    size_t i;
+
+    if(m_bPipelining)
+    {
+		// Send all commands at once
+        std::string sCommands;
+        for(i=0; i<aCommands.size(); i++)
+            sCommands += aCommands[i];
+        if(0!=SendData(sock, sCommands.data(), (int)sCommands.size()))
+            return 1;
+    }
+
+    for(i=0; i<aCommands.size(); i++)
+    {
+        if(!m_bPipelining)
+        {
+            if(0!=SendData(sock, aCommands[i].data(), (int)aCommands[i].size()))
+                return 1;
+        }
+
+		// Replies come in the order of commands
+        int res = ReadReply(sock, sReply);
+        if(res<0 || res/100!=aExpectedCodes[i]/100)
+            return 1;
+    }
+
+    return 0;
+}
+
+bool CSmtpClient::HasExtension(const std::string& sEhloReply, LPCSTR szKeyword)
+{
+	// Each line after the first one is "250-KEYWORD params" or "250 KEYWORD params"
+    size_t nKeywordLen = strlen(szKeyword);
+    size_t nPos = 0;
+    while(nPos<sEhloReply.size())
+    {
+        size_t nEnd = sEhloReply.find('\n', nPos);
+        if(nEnd==std::string::npos)
+            nEnd = sEhloReply.size();
+
+        std::string sLine = sEhloReply.substr(nPos, nEnd-nPos);
+        if(sLine.size()>=4+nKeywordLen &&
+           _strnicmp(sLine.c_str()+4, szKeyword, nKeywordLen)==0 &&
+           (sLine.size()==4+nKeywordLen || isspace((unsigned char)sLine[4+nKeywordLen])))
+            return true;
+
+        nPos = nEnd+1;
+    }
+
+    return false;
+}
+
 int CSmtpClient::CheckAttachmentOK(CString sFileName)
 {
 	// This method checks if the given file presents.
@@ -856,53 +1179,149 @@ int CSmtpClient::CheckAttachmentOK(CString sFileName)
     return 0;
 }
 
-int CSmtpClient::Base64EncodeAttachment(CString sFileName,
-                                        std::string& sEncodedFileData)
+int CSmtpClient::SendData(SOCKET sock, const char* pData, int nLen)
 {
-	// This method encodes the file into BASE-64 encoding.
-	// It is suitable for small files only, because it reads
-	// entire file contents into memory.
+	// send() may take only a part of data, so repeat until all is sent
+    while(nLen>0)
+    {
+        int res = send(sock, pData, nLen, 0);
+        if(res==SOCKET_ERROR || res==0)
+        {
+            CString sMsg;
+            sMsg.Format(_T("Send error: %d"), WSAGetLastError());
+            m_scn->SetProgress(sMsg, 0);
+            return 1;
+        }
+
+        pData += res;
+        nLen -= res;
+    }
+
+    return 0;
+}
+
+int CSmtpClient::SendBody(SOCKET sock, const char* pData, size_t nLen)
+{
+    m_sBody.append(pData, nLen);
+
+	// Send full chunks
+    while(m_sBody.size()>=BODY_CHUNK_SIZE)
+    {
+        if(0!=FlushBody(sock, false))
+            return 1;
+    }
+
+    return 0;
+}
 
+int CSmtpClient::FlushBody(SOCKET sock, bool bLast)
+{
     strconv_t strconv;
-    int uFileSize = 0;
-    BYTE* uchFileData = NULL;
 
-	// Check if file exists.
-	long lFileSize = Utility::GetFileSize(sFileName);
-    if(lFileSize<0)
-        return 1;  // File not found.
+	// Check if cancelled
+    if(m_scn->IsCancelled())
+        return 1;
+
+    if(m_bChunking)
+    {
+		// The chunk is preceded by BDAT command with its size, and it is sent
+		// together with the data. The body may not be a multiple of the chunk size,
+		// so everything buffered is sent.
+        CString sCommand;
+        sCommand.Format(_T("BDAT %u%s\r\n"), (unsigned)m_sBody.size(), bLast?_T(" LAST"):_T(""));
+        m_sBody.insert(0, strconv.t2a(sCommand));
+        m_nPendingReplies++;
+    }
+    else if(bLast)
+    {
+		// End of message marker
+        m_sBody += "\r\n.\r\n";
+        m_nPendingReplies++;
+    }
+
+    if(0!=SendData(sock, m_sBody.data(), (int)m_sBody.size()))
+        return 1;
 
-    // Allocate buffer of file size
-    uFileSize = (int)lFileSize;
-    uchFileData = new BYTE[uFileSize];
+    m_sBody.clear();
+
+	// Without PIPELINING, each BDAT command is confirmed before the next one
+    if(!m_bPipelining)
+        return ReadPendingReplies(sock);
+
+    return 0;
+}
+
+int CSmtpClient::ReadPendingReplies(SOCKET sock)
+{
+    std::string sReply;
+
+    while(m_nPendingReplies>0)
+    {
+        m_nPendingReplies--;
+
+		// Expect code 250
+        int res = ReadReply(sock, sReply);
+        if(res!=250)
+            return 1;
+    }
+
+    return 0;
+}
+
+int CSmtpClient::SendBase64Attachment(SOCKET sock, CString sFileName)
+{
+	// This method encodes the file into BASE-64 encoding while sending it.
+	// The file is read in blocks of whole lines (57 bytes make a 76 character line).
+
+    const size_t BLOCK_SIZE = 57*4096;
+    std::vector<BYTE> buf(BLOCK_SIZE);
+    std::string sEncoded;
+    base64_stream_encoder encoder;
+    int nStatus = 2;
 
-    // Read file data to buffer.
     FILE* f = NULL;
 #if _MSC_VER<1400
     f = _tfopen(sFileName, _T("rb"));
 #else
     _tfopen_s(&f, sFileName, _T("rb"));
 #endif
+    if(f==NULL)
+        return 1; // Couldn't open file.
 
-	// Read file data to buffer
-    if(!f || fread(uchFileData, uFileSize, 1, f)!=1)
+    for(;;)
     {
-        delete [] uchFileData;
-        uchFileData = NULL;
-        return 2; // Coudln't read file data.
-    }
+		// Check if cancelled
+        if(m_scn->IsCancelled())
+            goto cleanup;
 
-	// Close file
-    fclose(f);
+        size_t nRead = fread(&buf[0], 1, BLOCK_SIZE, f);
+        if(nRead==0)
+        {
+            if(ferror(f))
+                goto cleanup; // Couldn't read file data.
+            break;
+        }
 
-	// Encode file data.
-    sEncodedFileData = base64_encode(uchFileData, uFileSize);
+		// Reuse the same string for every block
+        sEncoded.clear();
+        encoder.encode(&buf[0], nRead, sEncoded);
+        if(0!=SendBody(sock, sEncoded.data(), sEncoded.size()))
+            goto cleanup;
+    }
 
-	// Release buffer
-    delete [] uchFileData;
+	// Send the padded end of data
+    sEncoded.clear();
+    encoder.finish(sEncoded);
+    if(0!=SendBody(sock, sEncoded.data(), sEncoded.size()))
+        goto cleanup;
 
     // OK.
-    return 0;
+    nStatus = 0;
+
+cleanup:
+
+    fclose(f);
+    return nStatus;
 }
 
 
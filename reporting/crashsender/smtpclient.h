@@ -83,11 +83,26 @@ private:
     std::vector<CString> m_aAttachments; // The list of file attachments
 };
 
+// Struct: SmtpRoute
+// Brief: SMTP servers and the recipients delivered through them.
+struct SmtpRoute
+{
+	std::vector<CString> m_aHosts;      // Server names, in the order to try.
+	std::vector<CString> m_aDomains;    // Recipient domains (none if proxy server is used).
+	std::vector<CString> m_aRecipients; // Recipient addresses.
+};
+
 // Class: CSmtpClient
 // Brief: Simple SMTP client.
 // Details: Sends an E-mail message to one or several recipients.
 //   Supports messages with attachment files. Can send mail in
 //   assynchronous mode. Supports SMTP authentication.
+//   Recipients whose domains share an SMTP server get the message in one
+//   session. If the server supports PIPELINING (RFC 2920), envelope commands
+//   are sent without waiting for each reply; if it supports CHUNKING (RFC 3030),
+//   the message is sent with BDAT in large chunks.
+//   Resolved MX records may be cached in an INI file for their TTL, along with
+//   the MX host which accepted mail last time (it is tried first).
 class CSmtpClient
 {
 public:
@@ -106,6 +121,10 @@ public:
 	// If these not set, authentication not used.
 	int SetAuthParams(LPCTSTR szLogin, LPCTSTR szPassword);
 
+	// Sets INI file where resolved MX records are cached ([MXCache] section).
+	// If not set, DNS is queried for every message.
+	void SetMxCacheFile(LPCTSTR szINIFile);
+
 	// Sends E-mail message in synchronous mode.
 	// Returns zero on success, otherwise non-zero.
     int SendEmail(CEmailMessage* msg);
@@ -119,12 +138,29 @@ protected:
 
     // Resolves the domain name(s) of SMTP server by given E-mail address.
 	// To resolve the name, MX record of DNS is used.
+	// dwTtl receives the time (in seconds) the result may be cached for.
 	// Returns zero on success, otherwise non-zero.
-    int ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list);
+    int ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list, DWORD& dwTtl);
+
+	// Reads cached MX records of the domain and the host which accepted mail last time.
+	// Returns TRUE if the records haven't expired yet.
+    BOOL GetCachedMx(LPCTSTR szDomain, std::map<WORD, CString>& host_list, CString& sLastHost);
+
+	// Caches MX records of the domain for dwTtl seconds; zero TTL removes them.
+    void CacheMx(LPCTSTR szDomain, const std::map<WORD, CString>& host_list, DWORD dwTtl);
 
-	// Sends E-mail message to the specified SMTP server.
+	// Remembers the host which accepted mail for the domain.
+    void CacheLastMxHost(LPCTSTR szDomain, LPCTSTR szHost);
+
+	// Groups recipients by SMTP server: recipients whose domains have the same
+	// most preferred MX host are delivered in one session.
+	// Returns zero on success, otherwise non-zero.
+    int GroupRecipientsByServer(CEmailMessage* msg, std::vector<SmtpRoute>& aRoutes);
+
+	// Sends E-mail message to the given recipients over the specified SMTP server.
 	// Returns zero on success, otherwise non-zero.
-    int SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg);
+    int SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg,
+		const std::vector<CString>& aRecipients);
 
 	// Validates E-mail address syntax.
 	// Returns zero on success, otherwise non-zero.
@@ -135,6 +171,21 @@ protected:
     int SendMsg(SOCKET sock, LPCTSTR pszMessage,
 		LPSTR pszResponse=0, UINT uResponseSize=0);
 
+	// Reads one (possibly multi-line) reply. Bytes received past its end
+	// belong to the replies to the next pipelined commands and are kept.
+	// Returns the reply code, or -1 on error.
+    int ReadReply(SOCKET sock, std::string& sReply);
+
+	// Sends the commands and checks that each gets a reply of the expected class
+	// (2xx, 3xx). With PIPELINING, all commands are sent at once and replies
+	// are read afterwards; otherwise each command waits for its reply.
+	// Returns zero on success, otherwise non-zero.
+    int SendCommands(SOCKET sock, const std::vector<std::string>& aCommands,
+		const std::vector<int>& aExpectedCodes);
+
+	// Checks if EHLO reply lists the given service extension.
+    static bool HasExtension(const std::string& sEhloReply, LPCSTR szKeyword);
+
 	// Extracts the first number from reponse message.
     int GetMessageCode(LPSTR msg);
 
@@ -142,10 +193,29 @@ protected:
 	// Returns zero on success, otherwise non-zero.
     int CheckAttachmentOK(CString sFileName);
 
-	// Encodes the given file into BASE-64 encoding and returns the file contents as a string.
+	// Sends raw data, retrying partial sends.
+	// Returns zero on success, otherwise non-zero.
+    int SendData(SOCKET sock, const char* pData, int nLen);
+
+	// Adds data to the message body. The body is sent in chunks of
+	// BODY_CHUNK_SIZE, as BDAT commands if the server supports CHUNKING.
+	// Returns zero on success, otherwise non-zero.
+    int SendBody(SOCKET sock, const char* pData, size_t nLen);
+
+	// Sends the buffered part of the message body. With BDAT, the replies are
+	// read later, unless the server doesn't support PIPELINING.
+	// bLast ends the message (BDAT LAST or the DATA end marker).
 	// Returns zero on success, otherwise non-zero.
-    int Base64EncodeAttachment(CString sFileName,
-        std::string& sEncodedFileData);
+    int FlushBody(SOCKET sock, bool bLast);
+
+	// Reads replies to BDAT commands or to the end of message marker.
+	// Returns zero if all of them are positive, otherwise non-zero.
+    int ReadPendingReplies(SOCKET sock);
+
+	// Reads the file block by block and sends it in BASE-64 encoding,
+	// so that memory use doesn't depend on the file size.
+	// Returns zero on success, otherwise non-zero.
+    int SendBase64Attachment(SOCKET sock, CString sFileName);
 
 	// Converts a string from UTF-16 (UNICODE) to UTF-8 encoding.
     std::string UTF16toUTF8(LPCWSTR utf16);
@@ -156,11 +226,20 @@ protected:
 	/* Variables used internally */
 
     CString m_sServer;       // SMTP server.
+    CString m_sMxCacheFile;  // INI file with cached MX records.
     int m_nPort;             // Port.
 	CString m_sLogin;        // Login name (used for SMTP authentication).
 	CString m_sPassword;     // Password (used for SMTP authentication).
 	CEmailMessage* m_msg;    // Pointer to E-mail message being sent.
     AssyncNotification* m_scn; // Synchronization object.
+
+	/* State of the current SMTP session */
+
+	bool m_bPipelining;      // Does server support PIPELINING?
+	bool m_bChunking;        // Does server support CHUNKING (BDAT)?
+	std::string m_sInput;    // Received bytes not parsed yet.
+	std::string m_sBody;     // Message body not sent yet.
+	int m_nPendingReplies;   // Count of BDAT replies not read yet.
 };
 
 
@@ -0,0 +1,205 @@
+# This script is a reference server for resumable error report uploads
+# (CR_INST_HTTP_RESUMABLE_UPLOAD). It implements the protocol described in
+# reporting/crashsender/HttpRequestSender.h:
+#
+#   POST <url>?action=upload_create
+#        Body: form-urlencoded text fields (crashguid, md5, appname, ...) and size.
+#        Reply headers: X-CrashRpt-Upload-Id, X-CrashRpt-Upload-Offset.
+#   POST <url>?action=upload_chunk&upload_id=ID&offset=N
+#        Body: raw file bytes starting at N. Header X-CrashRpt-Chunk-MD5.
+#        Reply: 200 and the new offset, 409 and the current offset if N is wrong,
+#        460 if the chunk checksum doesn't match, 404 for an unknown upload ID.
+#   POST <url>?action=upload_finish&upload_id=ID
+#        Reply: 200 if the whole file has the expected size and MD5 hash.
+#
+# Uploads in progress are kept in <root>/uploads, so an upload can be resumed
+# after the server restarts. Finished reports are saved as <root>/<crashguid>.zip.
+#
+# To test resuming on a reliable network, --drop-rate makes the server drop
+# connections in the middle of chunk requests, either before or after the chunk
+# is stored.
+#
+# The script uses the standard library only, e.g.:
+#   python crashrpt_upload_server.py --root reports --port 8080 --drop-rate 0.2
+# and pszUrl = "http://localhost:8080/crashrpt" in CR_INSTALL_INFO.
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import re
+import threading
+import urllib.parse
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+class UploadStore:
+   """Keeps uploads in progress on disk."""
+   def __init__(self, root):
+      self.root = root
+      self.upload_dir = os.path.join(root, "uploads")
+      os.makedirs(self.upload_dir, exist_ok=True)
+      self.lock = threading.Lock()
+
+   def meta_path(self, upload_id):
+      return os.path.join(self.upload_dir, upload_id + ".json")
+
+   def data_path(self, upload_id):
+      return os.path.join(self.upload_dir, upload_id + ".part")
+
+   def load(self, upload_id):
+      if not re.match(r"^[0-9a-f]{32}$", upload_id or ""):
+         return None
+      try:
+         with open(self.meta_path(upload_id)) as f:
+            return json.load(f)
+      except (OSError, ValueError):
+         return None
+
+   def offset(self, upload_id):
+      try:
+         return os.path.getsize(self.data_path(upload_id))
+      except OSError:
+         return 0
+
+   def create(self, fields, size):
+      """Returns ID of a new upload, or of the upload of the same report in progress."""
+      with self.lock:
+         for name in os.listdir(self.upload_dir):
+            if not name.endswith(".json"):
+               continue
+            upload_id = name[:-5]
+            meta = self.load(upload_id)
+            if meta and meta["crashguid"] == fields["crashguid"] and \
+               meta["md5"] == fields["md5"] and meta["size"] == size:
+               return upload_id, self.offset(upload_id)
+
+         upload_id = uuid.uuid4().hex
+         open(self.data_path(upload_id), "wb").close()
+         with open(self.meta_path(upload_id), "w") as f:
+            json.dump({ "crashguid": fields["crashguid"], "md5": fields["md5"],
+                        "size": size, "fields": fields }, f)
+         return upload_id, 0
+
+   def append(self, upload_id, offset, data):
+      """Appends a chunk. Returns (status, offset)."""
+      with self.lock:
+         meta = self.load(upload_id)
+         if meta is None:
+            return 404, 0
+         current = self.offset(upload_id)
+         if offset != current or offset + len(data) > meta["size"]:
+            return 409, current
+         with open(self.data_path(upload_id), "ab") as f:
+            f.write(data)
+         return 200, current + len(data)
+
+   def finish(self, upload_id):
+      """Checks the file and moves it to the report directory. Returns (status, message)."""
+      with self.lock:
+         meta = self.load(upload_id)
+         if meta is None:
+            return 404, "Unknown upload ID."
+         data_path = self.data_path(upload_id)
+         if self.offset(upload_id) != meta["size"]:
+            return 409, "Upload is incomplete."
+         md5 = hashlib.md5()
+         with open(data_path, "rb") as f:
+            for block in iter(lambda: f.read(1024*1024), b""):
+               md5.update(block)
+         if md5.hexdigest() != meta["md5"].lower():
+            # The data can't be fixed by resending chunks, start over
+            os.remove(data_path)
+            os.remove(self.meta_path(upload_id))
+            return 451, "MD5 hash is invalid."
+         os.replace(data_path, os.path.join(self.root, meta["crashguid"] + ".zip"))
+         os.remove(self.meta_path(upload_id))
+         return 200, "Success."
+
+class UploadHandler(BaseHTTPRequestHandler):
+   protocol_version = "HTTP/1.1"
+
+   def reply(self, status, message, headers={}):
+      body = ("%d %s" % (status, message)).encode("ascii")
+      self.send_response(status, message)
+      for name, value in headers.items():
+         self.send_header(name, str(value))
+      self.send_header("Content-Type", "text/plain")
+      self.send_header("Content-Length", str(len(body)))
+      self.end_headers()
+      self.wfile.write(body)
+
+   def drop(self):
+      self.close_connection = True
+      self.connection.close()
+
+   def do_POST(self):
+      store = self.server.store
+      query = urllib.parse.parse_qs(urllib.parse.urlparse(self.path).query)
+      action = query.get("action", [""])[0]
+      upload_id = query.get("upload_id", [""])[0]
+      length = int(self.headers.get("Content-Length", "0"))
+
+      if action == "upload_chunk":
+         drop = random.random() < self.server.drop_rate
+         if drop and random.random() < 0.5:
+            # Lose the chunk on the way
+            self.rfile.read(length // 2)
+            self.log_message("dropped connection before storing chunk")
+            return self.drop()
+         data = self.rfile.read(length)
+         try:
+            offset = int(query.get("offset", ["-1"])[0])
+         except ValueError:
+            return self.reply(450, "Invalid offset.")
+         chunk_md5 = self.headers.get("X-CrashRpt-Chunk-MD5", "").lower()
+         if hashlib.md5(data).hexdigest() != chunk_md5:
+            return self.reply(460, "Chunk checksum mismatch.")
+         status, offset = store.append(upload_id, offset, data)
+         if drop:
+            # Lose the reply; the client has to ask for the offset
+            self.log_message("dropped connection after storing chunk")
+            return self.drop()
+         return self.reply(status, "Chunk stored." if status == 200 else "Chunk rejected.",
+                           { "X-CrashRpt-Upload-Offset": offset })
+
+      body = self.rfile.read(length)
+
+      if action == "upload_create":
+         fields = { k: v[0] for k, v in urllib.parse.parse_qs(body.decode("utf-8")).items() }
+         if len(fields.get("md5", "")) != 32:
+            return self.reply(450, "MD5 hash is missing.")
+         if len(fields.get("crashguid", "")) != 36 or not re.match(r"^[0-9A-Fa-f-]+$", fields["crashguid"]):
+            return self.reply(450, "Crash GUID is missing.")
+         try:
+            size = int(fields.get("size", ""))
+         except ValueError:
+            return self.reply(450, "File size is missing.")
+         upload_id, offset = store.create(fields, size)
+         return self.reply(200, "Upload created.",
+                           { "X-CrashRpt-Upload-Id": upload_id, "X-CrashRpt-Upload-Offset": offset })
+
+      if action == "upload_finish":
+         status, message = store.finish(upload_id)
+         return self.reply(status, message)
+
+      return self.reply(450, "Unknown action.")
+
+def main():
+   parser = argparse.ArgumentParser(description="Reference server for resumable error report uploads.")
+   parser.add_argument("--root", default="crash_reports", help="directory to save error reports to")
+   parser.add_argument("--host", default="localhost")
+   parser.add_argument("--port", type=int, default=8080)
+   parser.add_argument("--drop-rate", type=float, default=0.0,
+                       help="probability of dropping the connection during a chunk request")
+   args = parser.parse_args()
+
+   server = ThreadingHTTPServer((args.host, args.port), UploadHandler)
+   server.store = UploadStore(args.root)
+   server.drop_rate = args.drop_rate
+   print("Listening on http://%s:%d/, saving reports to %s" % (args.host, args.port, os.path.abspath(args.root)))
+   server.serve_forever()
+
+if __name__ == "__main__":
+   main()
@@ -36,6 +36,10 @@ class CrashRptAPITests : public CTestSuite
         REGISTER_TEST(Test_crAddScreenshot2)
         REGISTER_TEST(Test_crAddPropertyA)
         REGISTER_TEST(Test_crAddPropertyW)
+        REGISTER_TEST(Test_crAddBreadcrumbA)
+        REGISTER_TEST(Test_crAddBreadcrumbW)
+        REGISTER_TEST(Test_crAddRingLogA)
+        REGISTER_TEST(Test_crAddRingLogW)
         REGISTER_TEST(Test_crAddRegKeyA)
         REGISTER_TEST(Test_crAddRegKeyW)
 		REGISTER_TEST(Test_crAddVideo)
@@ -46,6 +50,8 @@ class CrashRptAPITests : public CTestSuite
 		REGISTER_TEST(Test_crSetCrashCallbackW_stage)
 		REGISTER_TEST(Test_crSetCrashCallbackW_cancel)
         REGISTER_TEST(Test_crGenerateErrorReport)
+        REGISTER_TEST(Test_crGenerateErrorReport_repeated)
+        REGISTER_TEST(Test_crGenerateErrorReport_concurrent_props)
         REGISTER_TEST(Test_crEmulateCrash)
         REGISTER_TEST(Test_crGetLastErrorMsgA)
         REGISTER_TEST(Test_crGetLastErrorMsgW)
@@ -84,6 +90,10 @@ class CrashRptAPITests : public CTestSuite
     void Test_crAddScreenshot2();
     void Test_crAddPropertyA();
     void Test_crAddPropertyW();
+    void Test_crAddBreadcrumbA();
+    void Test_crAddBreadcrumbW();
+    void Test_crAddRingLogA();
+    void Test_crAddRingLogW();
     void Test_crAddRegKeyA();
     void Test_crAddRegKeyW();
 	void Test_crAddVideo();
@@ -94,6 +104,8 @@ class CrashRptAPITests : public CTestSuite
 	void Test_crSetCrashCallbackW_stage();
 	void Test_crSetCrashCallbackW_cancel();
     void Test_crGenerateErrorReport();
+    void Test_crGenerateErrorReport_repeated();
+    void Test_crGenerateErrorReport_concurrent_props();
     void Test_crEmulateCrash();
     void Test_crGetLastErrorMsgA();
     void Test_crGetLastErrorMsgW();
@@ -109,6 +121,7 @@ class CrashRptAPITests : public CTestSuite
     static DWORD WINAPI ThreadProc1(LPVOID /*lpParam*/);
     static DWORD WINAPI ThreadProc2(LPVOID /*lpParam*/);
     static DWORD WINAPI ThreadProc3(LPVOID /*lpParam*/);
+    static DWORD WINAPI ThreadProc4(LPVOID lpParam);
 
 	static int CALLBACK CrashCallbackA(CR_CRASH_CALLBACK_INFOA* pInfo);
 	static int CALLBACK CrashCallbackW(CR_CRASH_CALLBACK_INFOW* pInfo);
@@ -535,11 +548,201 @@ void CrashRptAPITests::Test_crAddPropertyW()
     int nResult3 = crAddPropertyW(L"VideoAdapter", L"nVidia GeForce GTS 250");
     TEST_ASSERT(nResult3==0);
 
+    // Updating the property many times should succeed
+    int i;
+    for(i=0; i<100000; i++)
+    {
+        CStringW sValue;
+        sValue.Format(L"%d", i);
+        int nResult4 = crAddPropertyW(L"CurrentLevel", sValue);
+        TEST_ASSERT(nResult4==0);
+    }
+
+    // Long value should succeed
+    {
+        CStringW sLongValue(L'x', 1000);
+        int nResult5 = crAddPropertyW(L"CurrentLevel", sLongValue);
+        TEST_ASSERT(nResult5==0);
+    }
+
+    // More properties than there are property slots should succeed
+    for(i=0; i<100; i++)
+    {
+        CStringW sName;
+        sName.Format(L"Prop%d", i);
+        int nResult6 = crAddPropertyW(sName, L"Value");
+        TEST_ASSERT(nResult6==0);
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+
+}
+
+void CrashRptAPITests::Test_crAddBreadcrumbA()
+{
+    // Should fail, because crInstall() should be called first
+    int nResult = crAddBreadcrumbA("Loading level");
+    TEST_ASSERT(nResult!=0);
+
+    // Install crash handler
+    CR_INSTALL_INFOA infoA;
+    memset(&infoA, 0, sizeof(CR_INSTALL_INFOA));
+    infoA.cb = sizeof(CR_INSTALL_INFOA);
+    infoA.pszAppVersion = "1.0.0"; // Specify app version, otherwise it will fail.
+
+    int nInstallResult = crInstallA(&infoA);
+    TEST_ASSERT(nInstallResult==0);
+
+    // Should fail, because text is NULL
+    int nResult2 = crAddBreadcrumbA(NULL);
+    TEST_ASSERT(nResult2!=0);
+
+    // Should succeed
+    int nResult3 = crAddBreadcrumbA("Loading level");
+    TEST_ASSERT(nResult3==0);
+
+    // Long text should succeed (it is truncated)
+    {
+        CStringA sLongText('x', 1000);
+        int nResult4 = crAddBreadcrumbA(sLongText);
+        TEST_ASSERT(nResult4==0);
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+}
+
+void CrashRptAPITests::Test_crAddBreadcrumbW()
+{
+    // Should fail, because crInstall() should be called first
+    int nResult = crAddBreadcrumbW(L"Loading level");
+    TEST_ASSERT(nResult!=0);
+
+    // Install crash handler
+    CR_INSTALL_INFOW infoW;
+    memset(&infoW, 0, sizeof(CR_INSTALL_INFOW));
+    infoW.cb = sizeof(CR_INSTALL_INFOW);
+    infoW.pszAppVersion = L"1.0.0"; // Specify app version, otherwise it will fail.
+
+    int nInstallResult = crInstallW(&infoW);
+    TEST_ASSERT(nInstallResult==0);
+
+    // Should fail, because text is NULL
+    int nResult2 = crAddBreadcrumbW(NULL);
+    TEST_ASSERT(nResult2!=0);
+
+    // Recording many more breadcrumbs than a ring holds should succeed
+    int i;
+    for(i=0; i<1000; i++)
+    {
+        CStringW sText;
+        sText.Format(L"Step %d", i);
+        int nResult3 = crAddBreadcrumbW(sText);
+        TEST_ASSERT(nResult3==0);
+    }
+
+    // Empty text should succeed
+    int nResult4 = crAddBreadcrumbW(L"");
+    TEST_ASSERT(nResult4==0);
+
     __TEST_CLEANUP__;
 
     // Uninstall
     crUninstall();
+}
+
+void CrashRptAPITests::Test_crAddRingLogA()
+{
+    // Should fail, because crInstall() should be called first
+    int nResult = crAddRingLogA("app.log", "Application Log", 65536);
+    TEST_ASSERT(nResult!=0);
+
+    // Install crash handler
+    CR_INSTALL_INFOA infoA;
+    memset(&infoA, 0, sizeof(CR_INSTALL_INFOA));
+    infoA.cb = sizeof(CR_INSTALL_INFOA);
+    infoA.pszAppVersion = "1.0.0"; // Specify app version, otherwise it will fail.
+
+    int nInstallResult = crInstallA(&infoA);
+    TEST_ASSERT(nInstallResult==0);
+
+    // Should fail, because destination file name is invalid
+    int nResult2 = crAddRingLogA("logs\\app.log", "Application Log", 65536);
+    TEST_ASSERT(nResult2!=0);
+
+    // Should fail, because size is too small
+    int nResult3 = crAddRingLogA("app.log", "Application Log", 100);
+    TEST_ASSERT(nResult3!=0);
+
+    // Should succeed
+    int nResult4 = crAddRingLogA("app.log", "Application Log", 65536);
+    TEST_ASSERT(nResult4==0);
+
+    // Should fail, because there may be only one ring log
+    int nResult5 = crAddRingLogA("app2.log", "Application Log", 65536);
+    TEST_ASSERT(nResult5!=0);
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+}
+
+void CrashRptAPITests::Test_crAddRingLogW()
+{
+    const char szLine[] = "Entering main loop iteration\n";
+
+    // Should fail, because crInstall() should be called first
+    int nResult = crWriteRingLog(szLine, sizeof(szLine)-1);
+    TEST_ASSERT(nResult!=0);
+
+    // Install crash handler
+    CR_INSTALL_INFOW infoW;
+    memset(&infoW, 0, sizeof(CR_INSTALL_INFOW));
+    infoW.cb = sizeof(CR_INSTALL_INFOW);
+    infoW.pszAppVersion = L"1.0.0"; // Specify app version, otherwise it will fail.
+
+    int nInstallResult = crInstallW(&infoW);
+    TEST_ASSERT(nInstallResult==0);
+
+    // Should fail, because the ring log is not created yet
+    int nResult2 = crWriteRingLog(szLine, sizeof(szLine)-1);
+    TEST_ASSERT(nResult2!=0);
+
+    // Should succeed
+    int nResult3 = crAddRingLogW(L"app.log", L"Application Log", 4096);
+    TEST_ASSERT(nResult3==0);
 
+    // Writing more data than the log holds should succeed
+    int i;
+    for(i=0; i<1000; i++)
+    {
+        int nResult4 = crWriteRingLog(szLine, sizeof(szLine)-1);
+        TEST_ASSERT(nResult4==0);
+    }
+
+    // Data larger than the log should succeed
+    {
+        std::vector<char> aData(10000, 'x');
+        int nResult5 = crWriteRingLog(&aData[0], (DWORD)aData.size());
+        TEST_ASSERT(nResult5==0);
+    }
+
+    // Adding a file with the same name as the log should fail
+    CString sFileName = Utility::GetModulePath(NULL)+_T("\\dummy.log");
+    strconv_t strconv;
+    int nResult6 = crAddFile2W(strconv.t2w(sFileName), L"app.log", L"Dummy Log File", 0);
+    TEST_ASSERT(nResult6!=0);
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
 }
 
 void CrashRptAPITests::Test_crAddScreenshot()
@@ -1181,6 +1384,159 @@ void CrashRptAPITests::Test_crGenerateErrorReport()
     Utility::RecycleFile(sTmpFolder, TRUE);
 }
 
+void CrashRptAPITests::Test_crGenerateErrorReport_repeated()
+{
+    CString sAppDataFolder;
+    CString sTmpFolder;
+    int nReports = 0;
+    int nMinidumps = 0;
+    int i;
+
+    // Create a temporary folder
+    Utility::GetSpecialFolder(CSIDL_APPDATA, sAppDataFolder);
+    sTmpFolder = sAppDataFolder+_T("\\CrashRpt");
+    BOOL bCreate = Utility::CreateFolder(sTmpFolder);
+    TEST_ASSERT(bCreate);
+
+    // Install crash handler which suppresses repeated crashes
+    CR_INSTALL_INFO info;
+    memset(&info, 0, sizeof(CR_INSTALL_INFO));
+    info.cb = sizeof(CR_INSTALL_INFO);
+    info.pszAppVersion = _T("1.0.0"); // Specify app version, otherwise it will fail.
+    info.dwFlags = CR_INST_NO_GUI|CR_INST_DONT_SEND_REPORT|CR_INST_SUPPRESS_REPEATED_CRASHES;
+    info.pszErrorReportSaveDir = sTmpFolder;
+    int nInstResult = crInstall(&info);
+    TEST_ASSERT(nInstResult==0);
+
+    // Generate the same report twice - the second one should have no minidump
+    for(i=0; i<2; i++)
+    {
+        CR_EXCEPTION_INFO exc;
+        memset(&exc, 0, sizeof(CR_EXCEPTION_INFO));
+        exc.cb = sizeof(CR_EXCEPTION_INFO);
+        int nResult = crGenerateErrorReport(&exc);
+        TEST_ASSERT(nResult==0);
+    }
+
+    // The minidump is written before crGenerateErrorReport() returns
+    {
+        WIN32_FIND_DATA fd;
+        HANDLE hFind = FindFirstFile(sTmpFolder+_T("\\*"), &fd);
+        TEST_ASSERT(hFind!=INVALID_HANDLE_VALUE);
+        do
+        {
+            if((fd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)==0 ||
+               _tcscmp(fd.cFileName, _T("."))==0 || _tcscmp(fd.cFileName, _T(".."))==0 ||
+               _tcscmp(fd.cFileName, _T("Logs"))==0)
+                continue;
+
+            nReports++;
+            CString sMinidump = sTmpFolder+_T("\\")+fd.cFileName+_T("\\crashdump.dmp");
+            if(GetFileAttributes(sMinidump)!=INVALID_FILE_ATTRIBUTES)
+                nMinidumps++;
+        }
+        while(FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+    TEST_ASSERT(nReports==2);
+    TEST_ASSERT(nMinidumps==1);
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+
+    // Delete tmp folder
+    Utility::RecycleFile(sTmpFolder, TRUE);
+}
+
+// This test updates properties in a worker thread while error reports are
+// generated, so that shared memory is recreated under the worker's feet.
+
+DWORD WINAPI CrashRptAPITests::ThreadProc4(LPVOID lpParam)
+{
+    volatile LONG* plStop = (volatile LONG*)lpParam;
+    DWORD dwFailures = 0;
+    int i;
+    for(i=0; *plStop==0; i++)
+    {
+        // Short value updated in its slot in place
+        CString sValue;
+        sValue.Format(_T("%d"), i);
+        if(crAddProperty(_T("CurrentLevel"), sValue)!=0)
+            dwFailures++;
+
+        // Long value appended to shared memory
+        CString sLongValue(_T('x'), 300+i%100);
+        if(crAddProperty(_T("LongValue"), sLongValue)!=0)
+            dwFailures++;
+    }
+
+    return dwFailures;
+}
+
+void CrashRptAPITests::Test_crGenerateErrorReport_concurrent_props()
+{
+    CString sAppDataFolder;
+    CString sTmpFolder;
+    volatile LONG lStop = 0;
+    HANDLE hThread = NULL;
+    DWORD dwFailures = 0;
+    int i;
+
+    // Create a temporary folder
+    Utility::GetSpecialFolder(CSIDL_APPDATA, sAppDataFolder);
+    sTmpFolder = sAppDataFolder+_T("\\CrashRpt");
+    BOOL bCreate = Utility::CreateFolder(sTmpFolder);
+    TEST_ASSERT(bCreate);
+
+    // Install crash handler
+    CR_INSTALL_INFO info;
+    memset(&info, 0, sizeof(CR_INSTALL_INFO));
+    info.cb = sizeof(CR_INSTALL_INFO);
+    info.pszAppVersion = _T("1.0.0"); // Specify app version, otherwise it will fail.
+    info.dwFlags = CR_INST_NO_GUI|CR_INST_DONT_SEND_REPORT;
+    info.pszErrorReportSaveDir = sTmpFolder;
+    int nInstResult = crInstall(&info);
+    TEST_ASSERT(nInstResult==0);
+
+    // Run a worker thread updating properties
+    hThread = CreateThread(NULL, 0, ThreadProc4, (LPVOID)&lStop, 0, NULL);
+    TEST_ASSERT(hThread!=NULL);
+
+    // Each report recreates shared memory - should succeed
+    for(i=0; i<5; i++)
+    {
+        CR_EXCEPTION_INFO exc;
+        memset(&exc, 0, sizeof(CR_EXCEPTION_INFO));
+        exc.cb = sizeof(CR_EXCEPTION_INFO);
+        int nResult = crGenerateErrorReport(&exc);
+        TEST_ASSERT(nResult==0);
+    }
+
+    // Stop the worker thread - its updates should have succeeded
+    InterlockedExchange(&lStop, 1);
+    WaitForSingleObject(hThread, INFINITE);
+    GetExitCodeThread(hThread, &dwFailures);
+    TEST_ASSERT(dwFailures==0);
+
+    __TEST_CLEANUP__;
+
+    // Stop the worker thread if a check has failed
+    if(hThread!=NULL)
+    {
+        InterlockedExchange(&lStop, 1);
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+    }
+
+    // Uninstall
+    crUninstall();
+
+    // Delete tmp folder
+    Utility::RecycleFile(sTmpFolder, TRUE);
+}
+
 #ifndef CRASHRPT_LIB
 // Test that API function names are undecorated
 void CrashRptAPITests::Test_undecorated_func_names()
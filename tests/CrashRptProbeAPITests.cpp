@@ -24,6 +24,7 @@ class CrashRptProbeAPITests : public CTestSuite
         REGISTER_TEST(Test_crpCloseErrorReport)
         REGISTER_TEST(Test_crpExtractFileW)
         REGISTER_TEST(Test_crpExtractFileA)
+        REGISTER_TEST(Test_crpExtractAllFiles)
         REGISTER_TEST(Test_crpGetLastErrorW)
         REGISTER_TEST(Test_crpGetLastErrorA)
         REGISTER_TEST(Test_crpGetPropertyW)
@@ -44,6 +45,7 @@ public:
     void Test_crpCloseErrorReport();
     void Test_crpExtractFileW();
     void Test_crpExtractFileA();
+    void Test_crpExtractAllFiles();
     void Test_crpGetLastErrorW();
     void Test_crpGetLastErrorA();
     void Test_crpGetPropertyW();
@@ -187,13 +189,54 @@ void CrashRptProbeAPITests::Test_crpOpenErrorReportA()
 
 void CrashRptProbeAPITests::Test_crpCloseErrorReport()
 {
+    strconv_t strconv;
     CrpHandle hReport = 3;
+    CrpHandle hReport1 = 0;
+    CrpHandle hReport2 = 0;
+    CrpHandle hReport3 = 0;
+    const int BUFF_SIZE = 1024;
+    WCHAR szBuffer[BUFF_SIZE] = L"";
 
     // Close invalid report - should fail
     int nCloseResult = crpCloseErrorReport(hReport);
     TEST_ASSERT(nCloseResult!=0);
 
+    // Open the same report twice - should succeed
+    LPCWSTR szReportName = strconv.t2w(m_sErrorReportNameW);
+    int nOpenResult = crpOpenErrorReportW(szReportName, NULL, NULL, 0, &hReport1);
+    TEST_ASSERT(nOpenResult==0 && hReport1!=0);
+    int nOpenResult2 = crpOpenErrorReportW(szReportName, NULL, NULL, 0, &hReport2);
+    TEST_ASSERT(nOpenResult2==0 && hReport2!=0 && hReport2!=hReport1);
+
+    // Load minidump data of the first report, then close it - should succeed
+    int nModuleCount = crpGetPropertyW(hReport1, CRP_TBL_MDMP_MODULES, CRP_META_ROW_COUNT, 0, NULL, 0, NULL);
+    TEST_ASSERT(nModuleCount>0);
+    int nCloseResult2 = crpCloseErrorReport(hReport1);
+    TEST_ASSERT(nCloseResult2==0);
+
+    // Closing it again should fail
+    int nCloseResult3 = crpCloseErrorReport(hReport1);
+    TEST_ASSERT(nCloseResult3!=0);
+    hReport1 = 0;
+
+    // Open another report - handle should not collide with the second report
+    int nOpenResult3 = crpOpenErrorReportW(szReportName, NULL, NULL, 0, &hReport3);
+    TEST_ASSERT(nOpenResult3==0 && hReport3!=0 && hReport3!=hReport2);
+
+    // The second report must still be readable
+    int nResult = crpGetPropertyW(hReport2, CRP_TBL_XMLDESC_MISC, CRP_COL_APP_NAME, 0, szBuffer, BUFF_SIZE, NULL);
+    TEST_ASSERT(nResult==0 && wcslen(szBuffer)!=0);
+    int nModuleCount2 = crpGetPropertyW(hReport2, CRP_TBL_MDMP_MODULES, CRP_META_ROW_COUNT, 0, NULL, 0, NULL);
+    TEST_ASSERT(nModuleCount2==nModuleCount);
+
     __TEST_CLEANUP__;
+
+    if(hReport1!=0)
+        crpCloseErrorReport(hReport1);
+    if(hReport2!=0)
+        crpCloseErrorReport(hReport2);
+    if(hReport3!=0)
+        crpCloseErrorReport(hReport3);
 }
 
 void CrashRptProbeAPITests::Test_crpExtractFileW()
@@ -282,6 +325,55 @@ void CrashRptProbeAPITests::Test_crpExtractFileW()
     crpCloseErrorReport(hReport);
 }
 
+void CrashRptProbeAPITests::Test_crpExtractAllFiles()
+{
+    CrpHandle hReport = 0;
+    const int BUFF_SIZE = 1024;
+    TCHAR szBuffer[BUFF_SIZE] = _T("");
+    CString sDstDir = m_sTmpFolderW + _T("\\ExtractAll");
+
+    // Open report - should succeed
+    int nOpenResult = crpOpenErrorReport(m_sErrorReportNameW, NULL, NULL, 0, &hReport);
+    TEST_ASSERT(nOpenResult==0 && hReport!=0);
+
+    // Extract to not existing directory - should fail
+    int nExtract = crpExtractAllFiles(hReport, sDstDir, FALSE);
+    TEST_ASSERT(nExtract!=0);
+
+    BOOL bCreate = Utility::CreateFolder(sDstDir);
+    TEST_ASSERT(bCreate);
+
+    // Extract all files - should succeed
+    int nExtract2 = crpExtractAllFiles(hReport, sDstDir, FALSE);
+    TEST_ASSERT(nExtract2==0);
+
+    // Check that every file listed in the report exists
+    int nRowCount = crpGetProperty(hReport, CRP_TBL_XMLDESC_FILE_ITEMS, CRP_META_ROW_COUNT, 0, NULL, 0, NULL);
+    TEST_ASSERT(nRowCount>0);
+
+    int i;
+    for(i=0; i<nRowCount; i++)
+    {
+        int nResult = crpGetProperty(hReport, CRP_TBL_XMLDESC_FILE_ITEMS, CRP_COL_FILE_ITEM_NAME, i, szBuffer, BUFF_SIZE, NULL);
+        TEST_ASSERT(nResult==0);
+
+        DWORD dwAttrs = GetFileAttributes(sDstDir + _T("\\") + szBuffer);
+        TEST_ASSERT(dwAttrs!=INVALID_FILE_ATTRIBUTES);
+    }
+
+    // Extract the second time - should fail, because files already exist
+    int nExtract3 = crpExtractAllFiles(hReport, sDstDir, FALSE);
+    TEST_ASSERT(nExtract3!=0);
+
+    // Extract the second time and overwrite existing - should succeed
+    int nExtract4 = crpExtractAllFiles(hReport, sDstDir, TRUE);
+    TEST_ASSERT(nExtract4==0);
+
+    __TEST_CLEANUP__;
+
+    crpCloseErrorReport(hReport);
+}
+
 void CrashRptProbeAPITests::Test_crpExtractFileA()
 {
     strconv_t strconv;
@@ -505,6 +597,25 @@ void CrashRptProbeAPITests::Test_crpGetProperty()
         0, szBuffer, BUFF_SIZE, &uCount);
     TEST_ASSERT(nResult7>0 && uCount==0);
 
+    // Get row count in CRP_TBL_PROCESSING_STATS table - should return >0 (one row per stage)
+    int nResult8 = crpGetProperty(hReport, CRP_TBL_PROCESSING_STATS, CRP_META_ROW_COUNT,
+        0, szBuffer, BUFF_SIZE, &uCount);
+    TEST_ASSERT(nResult8>0 && uCount==0);
+
+    // Get stage name and time of the first stage - should succeed
+    int nResult9 = crpGetProperty(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_NAME,
+        0, szBuffer, BUFF_SIZE, &uCount);
+    TEST_ASSERT(nResult9==0 && uCount>0);
+
+    int nResult10 = crpGetProperty(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_TIME_USEC,
+        0, szBuffer, BUFF_SIZE, &uCount);
+    TEST_ASSERT(nResult10==0 && uCount>0);
+
+    // Get stage with invalid row index - should fail
+    int nResult11 = crpGetProperty(hReport, CRP_TBL_PROCESSING_STATS, CRP_COL_STAGE_NAME,
+        nResult8, szBuffer, BUFF_SIZE, &uCount);
+    TEST_ASSERT(nResult11!=0);
+
     __TEST_CLEANUP__;
 
     crpCloseErrorReport(hReport);
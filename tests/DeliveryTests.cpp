@@ -17,9 +17,11 @@ class DeliveryTests : public CTestSuite
 {
     BEGIN_TEST_MAP(DeliveryTests, "Error report delivery tests")
         //REGISTER_TEST(Test_HttpDelivery)
+        //REGISTER_TEST(Test_HttpResumableDelivery)
         //REGISTER_TEST(Test_SmtpDelivery)
         //REGISTER_TEST(Test_SmtpDelivery_proxy);
         //REGISTER_TEST(Test_SMAPI_Delivery)
+        REGISTER_TEST(Test_HttpTopPriority)
     END_TEST_MAP()
 
 public:
@@ -28,9 +30,11 @@ public:
     void TearDown();
 
     void Test_HttpDelivery();
+    void Test_HttpResumableDelivery();
     void Test_SmtpDelivery();
     void Test_SmtpDelivery_proxy();
     void Test_SMAPI_Delivery();
+    void Test_HttpTopPriority();
 };
 
 REGISTER_TEST_SUITE( DeliveryTests );
@@ -93,6 +97,58 @@ void DeliveryTests::Test_HttpDelivery()
     Utility::RecycleFile(sTmpFolder, TRUE);
 }
 
+// Needs reporting/scripts/crashrpt_upload_server.py running on port 8080;
+// start it with --drop-rate to check that the upload resumes.
+void DeliveryTests::Test_HttpResumableDelivery()
+{
+    CString sAppDataFolder;
+    CString sExeFolder;
+    CString sTmpFolder;
+
+    // Create a temporary folder
+    Utility::GetSpecialFolder(CSIDL_APPDATA, sAppDataFolder);
+    sTmpFolder = sAppDataFolder+_T("\\CrashRpt");
+    BOOL bCreate = Utility::CreateFolder(sTmpFolder);
+    TEST_ASSERT(bCreate);
+
+    // Install crash handler for the main thread
+
+    CR_INSTALL_INFO info;
+    memset(&info, 0, sizeof(CR_INSTALL_INFO));
+    info.cb = sizeof(CR_INSTALL_INFO);
+    info.pszAppVersion = _T("1.0.0"); // Specify app version, otherwise it will fail.
+    info.dwFlags = CR_INST_NO_GUI|CR_INST_HTTP_RESUMABLE_UPLOAD;
+    info.pszUrl = _T("http://localhost:8080/crashrpt"); // Use resumable upload server for delivery
+    info.uPriorities[CR_HTTP] = 0;
+    info.uPriorities[CR_SMTP] = CR_NEGATIVE_PRIORITY;
+    info.uPriorities[CR_SMAPI] = CR_NEGATIVE_PRIORITY;
+    info.pszErrorReportSaveDir = sTmpFolder;
+    int nInstResult = crInstall(&info);
+    TEST_ASSERT(nInstResult==0);
+
+    // Generate and send error report
+    CR_EXCEPTION_INFO exc;
+    memset(&exc, 0, sizeof(CR_EXCEPTION_INFO));
+    exc.cb = sizeof(CR_EXCEPTION_INFO);
+    int nResult2 = crGenerateErrorReport(&exc);
+    TEST_ASSERT(nResult2==0);
+
+    // Wait until CrashSender exits and check exit code
+    WaitForSingleObject(exc.hSenderProcess, INFINITE);
+
+    DWORD dwExitCode = 1;
+    GetExitCodeProcess(exc.hSenderProcess, &dwExitCode);
+    TEST_ASSERT(dwExitCode==0); // Exit code should be zero
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+
+    // Delete tmp folder
+    Utility::RecycleFile(sTmpFolder, TRUE);
+}
+
 void DeliveryTests::Test_SmtpDelivery()
 {
     CString sAppDataFolder;
@@ -253,3 +309,39 @@ void DeliveryTests::Test_SMAPI_Delivery()
     // Delete tmp folder
     Utility::RecycleFile(sTmpFolder, TRUE);
 }
+
+// Checks how HTTP ranks against other delivery methods; concurrent and streaming
+// HTTP delivery is used only when HTTP is the first method to try
+void DeliveryTests::Test_HttpTopPriority()
+{
+    // HTTP only: disabled methods must not rank above HTTP
+    UINT uHttpOnly[3];
+    uHttpOnly[CR_HTTP] = 0;
+    uHttpOnly[CR_SMTP] = CR_NEGATIVE_PRIORITY;
+    uHttpOnly[CR_SMAPI] = CR_NEGATIVE_PRIORITY;
+    TEST_ASSERT(Utility::IsTopPriority(uHttpOnly, 3, CR_HTTP));
+    TEST_ASSERT(!Utility::IsTopPriority(uHttpOnly, 3, CR_SMTP));
+
+    // Default priorities: HTTP first
+    UINT uDefault[3];
+    uDefault[CR_HTTP] = 3;
+    uDefault[CR_SMTP] = 2;
+    uDefault[CR_SMAPI] = 1;
+    TEST_ASSERT(Utility::IsTopPriority(uDefault, 3, CR_HTTP));
+
+    // SMTP first
+    UINT uSmtpFirst[3];
+    uSmtpFirst[CR_HTTP] = 1;
+    uSmtpFirst[CR_SMTP] = 2;
+    uSmtpFirst[CR_SMAPI] = CR_NEGATIVE_PRIORITY;
+    TEST_ASSERT(!Utility::IsTopPriority(uSmtpFirst, 3, CR_HTTP));
+
+    // HTTP disabled
+    UINT uNoHttp[3];
+    uNoHttp[CR_HTTP] = CR_NEGATIVE_PRIORITY;
+    uNoHttp[CR_SMTP] = CR_NEGATIVE_PRIORITY;
+    uNoHttp[CR_SMAPI] = CR_NEGATIVE_PRIORITY;
+    TEST_ASSERT(!Utility::IsTopPriority(uNoHttp, 3, CR_HTTP));
+
+    __TEST_CLEANUP__;
+}
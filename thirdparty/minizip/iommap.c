@@ -0,0 +1,263 @@
+/* iommap.c -- Memory-mapped read-only IO functions for uncompress .zip
+     part of the MiniZip project - ( http://www.winimage.com/zLibDll/minizip.html )
+
+     For more info read MiniZip_info.txt
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+#include "iommap.h"
+
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    const unsigned char* base;  /* start of the mapping (NULL for an empty file) */
+    ZPOS64_T size;              /* file size */
+    ZPOS64_T pos;               /* current position */
+    int error;
+#if defined(_WIN32) || defined(WIN32)
+    HANDLE hFile;
+    HANDLE hMapping;
+#endif
+} MMAP_FILE;
+
+static voidpf ZCALLBACK mmap_open64_file_func OF((voidpf opaque, const void* filename, int mode));
+static uLong  ZCALLBACK mmap_read_file_func OF((voidpf opaque, voidpf stream, void* buf, uLong size));
+static uLong  ZCALLBACK mmap_write_file_func OF((voidpf opaque, voidpf stream, const void* buf, uLong size));
+static ZPOS64_T ZCALLBACK mmap_tell64_file_func OF((voidpf opaque, voidpf stream));
+static long   ZCALLBACK mmap_seek64_file_func OF((voidpf opaque, voidpf stream, ZPOS64_T offset, int origin));
+static int    ZCALLBACK mmap_close_file_func OF((voidpf opaque, voidpf stream));
+static int    ZCALLBACK mmap_error_file_func OF((voidpf opaque, voidpf stream));
+
+#if defined(_WIN32) || defined(WIN32)
+
+static voidpf ZCALLBACK mmap_open64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    MMAP_FILE* mf = NULL;
+    LARGE_INTEGER size;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+    const unsigned char* base = NULL;
+
+    if (filename == NULL || (mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+        return NULL;
+
+    hFile = CreateFileW((LPCWSTR)filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(hFile, &size))
+        goto fail;
+
+    /* The whole file must fit into the address space */
+    if ((ZPOS64_T)size.QuadPart != (ZPOS64_T)(SIZE_T)size.QuadPart)
+        goto fail;
+
+    if (size.QuadPart != 0)
+    {
+        /* Zero-length files can't be mapped; they are served as empty streams */
+        hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping == NULL)
+            goto fail;
+
+        base = (const unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (base == NULL)
+            goto fail;
+    }
+
+    mf = (MMAP_FILE*)malloc(sizeof(MMAP_FILE));
+    if (mf == NULL)
+        goto fail;
+
+    mf->base = base;
+    mf->size = (ZPOS64_T)size.QuadPart;
+    mf->pos = 0;
+    mf->error = 0;
+    mf->hFile = hFile;
+    mf->hMapping = hMapping;
+    return mf;
+
+fail:
+    if (base != NULL)
+        UnmapViewOfFile(base);
+    if (hMapping != NULL)
+        CloseHandle(hMapping);
+    CloseHandle(hFile);
+    return NULL;
+}
+
+static int ZCALLBACK mmap_close_file_func (voidpf opaque, voidpf stream)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    if (mf == NULL)
+        return -1;
+
+    if (mf->base != NULL)
+        UnmapViewOfFile(mf->base);
+    if (mf->hMapping != NULL)
+        CloseHandle(mf->hMapping);
+    CloseHandle(mf->hFile);
+    free(mf);
+    return 0;
+}
+
+#else
+
+static voidpf ZCALLBACK mmap_open64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    MMAP_FILE* mf = NULL;
+    struct stat st;
+    void* base = NULL;
+    int fd;
+
+    if (filename == NULL || (mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+        return NULL;
+
+    fd = open((const char*)filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || (ZPOS64_T)st.st_size != (ZPOS64_T)(size_t)st.st_size)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size != 0)
+    {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+
+    mf = (MMAP_FILE*)malloc(sizeof(MMAP_FILE));
+    if (mf == NULL)
+    {
+        if (base != NULL)
+            munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+
+    mf->base = (const unsigned char*)base;
+    mf->size = (ZPOS64_T)st.st_size;
+    mf->pos = 0;
+    mf->error = 0;
+    return mf;
+}
+
+static int ZCALLBACK mmap_close_file_func (voidpf opaque, voidpf stream)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    if (mf == NULL)
+        return -1;
+
+    if (mf->base != NULL)
+        munmap((void*)mf->base, (size_t)mf->size);
+    free(mf);
+    return 0;
+}
+
+#endif
+
+static uLong ZCALLBACK mmap_read_file_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    ZPOS64_T avail;
+
+    if (mf == NULL)
+        return 0;
+
+    avail = mf->pos < mf->size ? mf->size - mf->pos : 0;
+    if ((ZPOS64_T)size > avail)
+        size = (uLong)avail;
+
+    if (size != 0)
+    {
+        memcpy(buf, mf->base + mf->pos, size);
+        mf->pos += size;
+    }
+    return size;
+}
+
+static uLong ZCALLBACK mmap_write_file_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    if (mf != NULL)
+        mf->error = 1; /* read-only */
+    return 0;
+}
+
+static ZPOS64_T ZCALLBACK mmap_tell64_file_func (voidpf opaque, voidpf stream)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    if (mf == NULL)
+        return (ZPOS64_T)-1;
+    return mf->pos;
+}
+
+static long ZCALLBACK mmap_seek64_file_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    ZPOS64_T new_pos;
+
+    if (mf == NULL)
+        return -1;
+
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        new_pos = mf->pos + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        new_pos = mf->size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        new_pos = offset;
+        break;
+    default: return -1;
+    }
+
+    /* Like fseek, positioning past the end is allowed; reads there return 0 bytes */
+    mf->pos = new_pos;
+    return 0;
+}
+
+static int ZCALLBACK mmap_error_file_func (voidpf opaque, voidpf stream)
+{
+    MMAP_FILE* mf = (MMAP_FILE*)stream;
+    if (mf == NULL)
+        return -1;
+    return mf->error;
+}
+
+void fill_mmap_filefunc64 (zlib_filefunc64_def* pzlib_filefunc_def)
+{
+    pzlib_filefunc_def->zopen64_file = mmap_open64_file_func;
+    pzlib_filefunc_def->zread_file = mmap_read_file_func;
+    pzlib_filefunc_def->zwrite_file = mmap_write_file_func;
+    pzlib_filefunc_def->ztell64_file = mmap_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = mmap_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = mmap_close_file_func;
+    pzlib_filefunc_def->zerror_file = mmap_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+}
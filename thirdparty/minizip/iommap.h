@@ -0,0 +1,30 @@
+/* iommap.h -- Memory-mapped read-only IO functions for uncompress .zip
+     part of the MiniZip project - ( http://www.winimage.com/zLibDll/minizip.html )
+
+     Reads are served directly from a read-only mapping of the whole archive,
+     so there are no read system calls and seeks are free. Only read mode
+     is supported; opening for writing fails.
+
+     On Windows the file name passed to the open function is a wide-character
+     string (as with fill_win32_filefunc64W), on other systems it is a char string.
+
+     For more info read MiniZip_info.txt
+
+*/
+
+#ifndef _ZLIBIOMMAP_H
+#define _ZLIBIOMMAP_H
+
+#include "ioapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void fill_mmap_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
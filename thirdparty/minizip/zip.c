@@ -105,6 +105,7 @@ const char zip_copyright[] =" zip 1.01 Copyright 1998-2004 Gilles Vollant - http
 #define ENDHEADERMAGIC      (0x06054b50)
 #define ZIP64ENDHEADERMAGIC      (0x6064b50)
 #define ZIP64ENDLOCHEADERMAGIC   (0x7064b50)
+#define DATADESCRIPTORMAGIC      (0x08074b50)
 
 #define FLAG_LOCALHEADER_OFFSET (0x06)
 #define CRC_LOCALHEADER_OFFSET  (0x0e)
@@ -1698,7 +1699,33 @@ extern int ZEXPORT zipCloseFileInZipRaw64 (zipFile file, ZPOS64_T uncompressed_s
 
     free(zi->ci.central_header);
 
-    if (err==ZIP_OK)
+    if ((err==ZIP_OK) && (zi->ci.flag & ZIP_FLAG_DATA_DESCRIPTOR))
+    {
+        // The values follow the data in a data descriptor, so the file is written
+        // sequentially and the local header is never rewritten.
+        err = zip64local_putValue(&zi->z_filefunc,zi->filestream,(uLong)DATADESCRIPTORMAGIC,4);
+
+        if (err==ZIP_OK)
+            err = zip64local_putValue(&zi->z_filefunc,zi->filestream,crc32,4);
+
+        if (zi->ci.zip64)
+        {
+          if (err==ZIP_OK)
+              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,compressed_size,8);
+
+          if (err==ZIP_OK)
+              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,uncompressed_size,8);
+        }
+        else
+        {
+          if (err==ZIP_OK)
+              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,compressed_size,4);
+
+          if (err==ZIP_OK)
+              err = zip64local_putValue(&zi->z_filefunc,zi->filestream,uncompressed_size,4);
+        }
+    }
+    else if (err==ZIP_OK)
     {
         // Update the LocalFileHeader with the new values.
 
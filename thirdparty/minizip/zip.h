@@ -301,8 +301,13 @@ extern int ZEXPORT zipOpenNewFileInZip4_64 OF((zipFile file,
   Same than zipOpenNewFileInZip4, except
     versionMadeBy : value for Version made by field
     flag : value for flag field (compression level info will be added)
+           if ZIP_FLAG_DATA_DESCRIPTOR is set, crc and sizes are written in a data
+           descriptor after the file data, and the local header is not rewritten
+           when the file is closed, so the zipfile is written strictly sequentially
  */
 
+#define ZIP_FLAG_DATA_DESCRIPTOR 0x08
+
 
 extern int ZEXPORT zipWriteInFileInZip OF((zipFile file,
                        const void* buf,